@@ -40,7 +40,7 @@ endif
 # This can be overridden by parent GNUmakefiles if desired
 #
 remove_to = $(if $(filter $(1),$(2)),$(call remove_to,$(1),$(wordlist 2,$(words $(2)),$(2))),$(2))
-ALL_LIBRARIES ?= sxe-dirwatch sxe-ring-buffer sxe-httpd sxe-http sxe-sync-ev sxe-pool-tcp sxe-jitson sxe-dict sxe-cdb sxe-hash \
+ALL_LIBRARIES ?= sxe-ring-buffer sxe-httpd sxe-dirwatch sxe-http sxe-sync-ev sxe-pool-tcp sxe-jitson sxe-dict sxe-cdb sxe-hash \
                  lookup3 md5 murmurhash3 sha1 sxe-spawn sxe sxe-pool sxe-thread sxe-mmap sxe-buffer sxe-list sxe-socket \
                  ev sxe-cstr sxe-util sxe-log sxe-test mock port $(TAP)
 LIB_DEPENDENCIES = $(call remove_to,$(LIBRARIES),$(ALL_LIBRARIES))
@@ -21,6 +21,7 @@
 
 #include <stdint.h> /* defines uint32_t etc */
 
+#include "sxe-hash.h"
 #include "sxe-spinlock.h"
 
 #define SXE_CDB_KERNEL_PAGE_BYTES (4096)
@@ -179,6 +180,7 @@ struct SXE_CDB_INSTANCE {
     uint32_t        counts_used                        ; /*   used  total in generic    double linked *counts* list */
     uint32_t        counts_hi[SXE_CDB_COUNTS_LISTS_MAX]; /* highest count in particular double linked *counts* list */
     uint32_t        counts_lo[SXE_CDB_COUNTS_LISTS_MAX]; /* lowest  count in particular double linked *counts* list */
+    SXE_HASH_FILTER * filter                           ; /* filter consulted before looking in the sheets, or NULL */
     uint16_t        sheets_index[SXE_CDB_SHEETS_MAX]   ;
 } __attribute__((packed));
 
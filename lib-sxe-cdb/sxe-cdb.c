@@ -81,20 +81,26 @@ sxe_cdb_copy_tls_to_hkv(SXE_CDB_INSTANCE * cdb_instance, uint32_t hkv_pos)
     return;
 } /* sxe_cdb_copy_tls_to_hkv() */
 
+static void
+sxe_cdb_hash_key(const uint8_t * key, uint32_t key_len, SXE_CDB_HASH * hash)
+{
+    MurmurHash3_xnn_128(key, key_len, 12345 /* todo: handle seed better :-) */, &hash->u64[0]);
+    if (hash->u16[1] == hash->u16[2]) { /* guarantee that hash->u16[1] and hash->u16[2] are unique ... (in the worst possible way?) */
+        hash->u16[1]  = hash->u16[3];
+        if (hash->u16[1] == hash->u16[2]) {
+            hash->u16[1]  = hash->u16[4]; /* COVERAGE EXCLUSION: todo: calculate some murmurhash3 collisions to coverage this line! */
+        }
+        if (hash->u16[1] == hash->u16[2]) {
+            hash->u16[1]  = hash->u16[2] + 1; /* COVERAGE EXCLUSION: todo: calculate some murmurhash3 collisions to coverage this line! */
+        }
+    }
+} /* sxe_cdb_hash_key() */
+
 void
 sxe_cdb_prepare(const uint8_t * key, uint32_t key_len)
 {
     if (key) {
-        MurmurHash3_xnn_128(key, key_len, 12345 /* todo: handle seed better :-) */, &sxe_cdb_hash.u64[0]);
-        if (sxe_cdb_hash.u16[1] == sxe_cdb_hash.u16[2]) { /* guarantee that sxe_cdb_hash.u16[1] and sxe_cdb_hash.u16[2] are unique ... (in the worst possible way?) */
-            sxe_cdb_hash.u16[1]  = sxe_cdb_hash.u16[3];
-            if (sxe_cdb_hash.u16[1] == sxe_cdb_hash.u16[2]) {
-                sxe_cdb_hash.u16[1]  = sxe_cdb_hash.u16[4]; /* COVERAGE EXCLUSION: todo: calculate some murmurhash3 collisions to coverage this line! */
-            }
-            if (sxe_cdb_hash.u16[1] == sxe_cdb_hash.u16[2]) {
-                sxe_cdb_hash.u16[1]  = sxe_cdb_hash.u16[2] + 1; /* COVERAGE EXCLUSION: todo: calculate some murmurhash3 collisions to coverage this line! */
-            }
-        }
+        sxe_cdb_hash_key(key, key_len, &sxe_cdb_hash);
     }
     sxe_cdb_key     = key    ;
     sxe_cdb_key_len = key_len;
@@ -197,6 +203,7 @@ sxe_cdb_instance_new(
     SXEL7("SXE_CDB_COUNT_BYTES      : %zu", SXE_CDB_COUNT_BYTES      );
 
     sxe_cdb_instance_new_init(cdb_instance, keys_at_start, kvdata_maximum);
+    cdb_instance->filter = NULL; /* see sxe_cdb_instance_new_filter() */
 
     SXER6("return %p=cdb_instance", cdb_instance);
     return cdb_instance;
@@ -216,6 +223,7 @@ sxe_cdb_instance_destroy(SXE_CDB_INSTANCE * cdb_instance)
 {
     SXEL6("%s(cdb_instance=?){}", __FUNCTION__);
     sxe_cdb_instance_destroy_mmaps(cdb_instance);
+    if (cdb_instance->filter) { sxe_hash_filter_delete(cdb_instance->filter); }
     sxe_free(cdb_instance);
 } /* sxe_cdb_instance_destroy() */
 
@@ -226,8 +234,68 @@ sxe_cdb_instance_reboot(SXE_CDB_INSTANCE * cdb_instance)
 
     sxe_cdb_instance_destroy_mmaps(cdb_instance                                                           ); /* goodbye mmaps */
     sxe_cdb_instance_new_init     (cdb_instance, cdb_instance->keys_at_start, cdb_instance->kvdata_maximum); /*   hello mmaps */
+    if (cdb_instance->filter) { sxe_hash_filter_clear(cdb_instance->filter); }                               /* goodbye keys  */
 } /* sxe_cdb_instance_reboot() */
 
+/**
+ * Attach a filter to an instance, so that looking up most keys that were never put reads one cache line instead of two rows
+ *
+ * @param cdb_instance Instance to attach the filter to; it takes ownership of the filter, and deletes any filter it had
+ * @param filter       Filter that already holds every key in the instance, e.g. new for an empty instance or a copy (see
+ *                     sxe_hash_filter_copy()) of one saved along with the instance's memory, or NULL to remove the filter
+ *
+ * @note To build a filter for the keys already in an instance, use sxe_cdb_instance_new_filter()
+ */
+void
+sxe_cdb_instance_set_filter(SXE_CDB_INSTANCE * cdb_instance, SXE_HASH_FILTER * filter)
+{
+    SXEL6("%s(cdb_instance=?, filter=%p){}", __FUNCTION__, filter);
+    if (cdb_instance->filter) { sxe_hash_filter_delete(cdb_instance->filter); }
+    cdb_instance->filter = filter;
+} /* sxe_cdb_instance_set_filter() */
+
+SXE_HASH_FILTER * /* NULL or the instance's filter; e.g. to read its counters or save it (see sxe_hash_filter_get_size()) */
+sxe_cdb_instance_get_filter(SXE_CDB_INSTANCE * cdb_instance)
+{
+    return cdb_instance->filter;
+} /* sxe_cdb_instance_get_filter() */
+
+/**
+ * Build a filter for the keys in an instance and attach it; the filter is then kept up to date as keys are put
+ *
+ * @param cdb_instance Instance
+ * @param keys         Number of keys the filter is sized for; more can be put, at the cost of a higher false positive rate
+ * @param bits_per_key Bits of filter per key; 10 gives about 1% false positives
+ */
+void
+sxe_cdb_instance_new_filter(SXE_CDB_INSTANCE * cdb_instance, uint64_t keys, unsigned bits_per_key)
+{
+    SXE_HASH_FILTER  * filter = sxe_hash_filter_new(keys, bits_per_key);
+    SXE_CDB_HKV_PART   hkv_part;
+    SXE_CDB_HASH       hash;
+    uint32_t           sheet;
+    uint32_t           row;
+    uint32_t           cell;
+    uint32_t           hkv_pos;
+
+    SXEE6("(cdb_instance=?, keys=%lu, bits_per_key=%u)", keys, bits_per_key);
+
+    for (sheet = 0; sheet < cdb_instance->sheets_size; sheet ++) {
+        for (row = 0; row < SXE_CDB_ROWS_PER_SHEET; row ++) {
+            for (cell = 0; cell < SXE_CDB_KEYS_PER_ROW; cell ++) {
+                if ((hkv_pos = cdb_instance->sheets[sheet].row[row].hkv_pos.u32[cell])) {
+                    sxe_cdb_hkv_unpack((SXE_CDB_HKV *) &cdb_instance->kvdata[hkv_pos], &hkv_part);
+                    sxe_cdb_hash_key(hkv_part.key, hkv_part.key_len, &hash);
+                    sxe_hash_filter_add(filter, hash.u64[1]);
+                }
+            }
+        }
+    }
+
+    sxe_cdb_instance_set_filter(cdb_instance, filter);
+    SXER6("return // %lu keys in filter", filter->keys);
+} /* sxe_cdb_instance_new_filter() */
+
 #if SXE_DEBUG
 void
 sxe_cdb_instance_debug_validate(SXE_CDB_INSTANCE * cdb_instance, const char * debug)
@@ -391,6 +459,10 @@ SXE_CDB_ADD_RETRY_ROW_SCAN:;
             SXEA1(MAP_FAILED != cdb_instance->kvdata, "ERROR: FATAL: expected mremap() not to fail // %s(){}", __FUNCTION__);
     }
 
+    if (cdb_instance->filter) {
+        sxe_hash_filter_add(cdb_instance->filter, sxe_cdb_hash.u64[1]); /* u64[0] picks sheet & rows; u64[1] is independent */
+    }
+
     cdb_instance->sheets[sheet].row[row].hash_lo.u16[cell] = sxe_cdb_hash.u16[1];
     cdb_instance->sheets[sheet].row[row].hash_hi.u16[cell] = sxe_cdb_hash.u16[0];
     cdb_instance->sheets[sheet].row[row].hkv_pos.u32[cell] = k;
@@ -490,6 +562,10 @@ sxe_cdb_instance_get_hkv_raw( /* NOTE: hkv only usable in-between sxe_cdb_*() ca
 {
     SXE_CDB_HKV * tls_hkv = NULL; /* result */
 
+    if (cdb_instance->filter && !sxe_hash_filter_may_contain(cdb_instance->filter, sxe_cdb_hash.u64[1])) {
+        goto SXE_EARLY_OUT; /* key was never put */
+    }
+
     uint16_t sheet = cdb_instance->sheets_index[sxe_cdb_hash.u16[0] % SXE_CDB_SHEETS_MAX];
     SXEA6(sheet < cdb_instance->sheets_size, "ERROR: INTERNAL: %u=sheet < %u=cdb_instance->sheets_size", sheet, cdb_instance->sheets_size);
 
@@ -507,6 +583,10 @@ sxe_cdb_instance_get_hkv_raw( /* NOTE: hkv only usable in-between sxe_cdb_*() ca
         SXE_CDB_GET_HKV_IN_CELL_IN(row_2);
     }
 
+    if (cdb_instance->filter) {
+        sxe_hash_filter_miss(cdb_instance->filter);
+    }
+
 SXE_EARLY_OUT:;
     SXEL6("%s(cdb_instance=?){} // return %p (%s); sxe_cdb_tls_hkv_part.val_len=%u", __FUNCTION__, tls_hkv, tls_hkv ? "key exists" : "key doesn't exist", sxe_cdb_tls_hkv_part.val_len);
     return tls_hkv;
@@ -517,6 +597,12 @@ sxe_cdb_instance_get_uid(SXE_CDB_INSTANCE * cdb_instance)
 {
     SXE_CDB_UID uid;
 
+    uid.as_u64.u = SXE_CDB_UID_NONE;
+
+    if (cdb_instance->filter && !sxe_hash_filter_may_contain(cdb_instance->filter, sxe_cdb_hash.u64[1])) {
+        goto SXE_EARLY_OUT; /* key was never put */
+    }
+
     uid.as_u64.u = 0;
 
     uid.as_part.sheets_index_index = sxe_cdb_hash.u16[0] % SXE_CDB_SHEETS_MAX;
@@ -539,11 +625,100 @@ sxe_cdb_instance_get_uid(SXE_CDB_INSTANCE * cdb_instance)
 
     uid.as_u64.u = SXE_CDB_UID_NONE;
 
+    if (cdb_instance->filter) {
+        sxe_hash_filter_miss(cdb_instance->filter);
+    }
+
 SXE_EARLY_OUT:;
     SXEL6("%s(cdb_instance=?){} // return %010lx=ii[%04x]%03x-%01x=%s // sxe_cdb_tls_hkv_part.val_len=%u", __FUNCTION__, uid.as_u64.u, uid.as_part.sheets_index_index, uid.as_part.row, uid.as_part.cell, SXE_CDB_UID_NONE == uid.as_u64.u ? "key doesn't exist" : "key exists", sxe_cdb_tls_hkv_part.val_len);
     return uid.as_u64.u;
 } /* sxe_cdb_instance_get_uid() */
 
+#define SXE_CDB_BATCH 16 /* keys hashed and prefetched ahead of resolving them */
+
+static inline bool /* false if the instance's filter rejects the key; not counted, since the lookup that follows counts it */
+sxe_cdb_instance_filter_passes(SXE_CDB_INSTANCE * cdb_instance, const SXE_CDB_HASH * hash)
+{
+    return NULL == cdb_instance->filter || sxe_hash_filter_check(cdb_instance->filter, hash->u64[1]);
+} /* sxe_cdb_instance_filter_passes() */
+
+static inline void
+sxe_cdb_instance_prefetch_rows(SXE_CDB_INSTANCE * cdb_instance, const SXE_CDB_HASH * hash)
+{
+    uint16_t      sheet = cdb_instance->sheets_index[hash->u16[0] % SXE_CDB_SHEETS_MAX];
+    SXE_CDB_ROW * row_1 = &cdb_instance->sheets[sheet].row[hash->u16[1] & (SXE_CDB_ROWS_PER_SHEET - 1)];
+    SXE_CDB_ROW * row_2 = &cdb_instance->sheets[sheet].row[hash->u16[2] & (SXE_CDB_ROWS_PER_SHEET - 1)];
+
+    __builtin_prefetch(&row_1->hash_lo); /* a row spans two cache lines; hashes in the 1st, hkv positions in the 2nd */
+    __builtin_prefetch(&row_1->hkv_pos);
+    __builtin_prefetch(&row_2->hash_lo);
+    __builtin_prefetch(&row_2->hkv_pos);
+} /* sxe_cdb_instance_prefetch_rows() */
+
+static inline void
+sxe_cdb_instance_prefetch_hkv(SXE_CDB_INSTANCE * cdb_instance, const SXE_CDB_HASH * hash)
+{
+    uint16_t      sheet = cdb_instance->sheets_index[hash->u16[0] % SXE_CDB_SHEETS_MAX];
+    SXE_CDB_ROW * row   = &cdb_instance->sheets[sheet].row[hash->u16[1] & (SXE_CDB_ROWS_PER_SHEET - 1)];
+    uint32_t      cell;
+
+    for (cell = 0; cell < SXE_CDB_KEYS_PER_ROW; cell ++) { /* only the 1st row; most keys live there */
+        if ((hash->u16[1] == row->hash_lo.u16[cell]) && (hash->u16[0] == row->hash_hi.u16[cell]) && row->hkv_pos.u32[cell]) {
+            __builtin_prefetch(&cdb_instance->kvdata[row->hkv_pos.u32[cell]]);
+            break;
+        }
+    }
+} /* sxe_cdb_instance_prefetch_hkv() */
+
+/**
+ * Look up the uids of a batch of keys
+ *
+ * @param cdb_instance Instance to look in
+ * @param keys         Array of count pointers to keys
+ * @param key_lens     Array of count key lengths
+ * @param count        Number of keys
+ * @param uids         Array of count uids to fill in; SXE_CDB_UID_NONE for keys that don't exist
+ *
+ * @note Keys are hashed and their rows and key value data prefetched SXE_CDB_BATCH at a time before any key is resolved, so
+ *       the cache misses of a batch overlap instead of being taken one after the other. On return, sxe_cdb_hash and
+ *       sxe_cdb_tls_hkv_part are as if sxe_cdb_prepare() and sxe_cdb_instance_get_uid() had been called on the last key.
+ *       Nothing is prefetched for keys the instance's filter rejects.
+ */
+void
+sxe_cdb_instance_get_uids(SXE_CDB_INSTANCE * cdb_instance, const uint8_t * const * keys, const uint32_t * key_lens, uint32_t count, uint64_t * uids)
+{
+    SXE_CDB_HASH hashes[SXE_CDB_BATCH];
+    bool         passes[SXE_CDB_BATCH];
+    uint32_t     done;
+    uint32_t     todo;
+    uint32_t     i;
+
+    SXEE6("(cdb_instance=?, keys=?, key_lens=?, count=%u, uids=?)", count);
+
+    for (done = 0; done < count; done += todo) {
+        todo = count - done < SXE_CDB_BATCH ? count - done : SXE_CDB_BATCH;
+
+        for (i = 0; i < todo; i++) {
+            sxe_cdb_hash_key(keys[done + i], key_lens[done + i], &hashes[i]);
+            passes[i] = sxe_cdb_instance_filter_passes(cdb_instance, &hashes[i]);
+            if (passes[i]) { sxe_cdb_instance_prefetch_rows(cdb_instance, &hashes[i]); }
+        }
+
+        for (i = 0; i < todo; i++) {
+            if (passes[i]) { sxe_cdb_instance_prefetch_hkv(cdb_instance, &hashes[i]); }
+        }
+
+        for (i = 0; i < todo; i++) {
+            sxe_cdb_hash      = hashes[i];
+            sxe_cdb_key       = keys[done + i];
+            sxe_cdb_key_len   = key_lens[done + i];
+            uids[done + i]    = sxe_cdb_instance_get_uid(cdb_instance);
+        }
+    }
+
+    SXER6("return");
+} /* sxe_cdb_instance_get_uids() */
+
 SXE_CDB_HKV * /* NULL or tls SXE_CDB_HKV raw; not copy */
 sxe_cdb_instance_get_uid_hkv_raw(SXE_CDB_INSTANCE * cdb_instance, SXE_CDB_UID uid)
 {
@@ -970,14 +1145,14 @@ sxe_cdb_ensemble_new(
         cdb_ensemble = sxe_malloc(sizeof(* cdb_ensemble));
         SXEA1(cdb_ensemble, "ERROR: INTERNAL: sxe_malloc() failed for %zu bytes // %s(){}", sizeof(* cdb_ensemble), __FUNCTION__);
         cdb_ensemble->cdb_instances      = sxe_malloc(cdb_count * sizeof(cdb_ensemble->cdb_instances));
-        cdb_ensemble->cdb_instance_locks = sxe_malloc(cdb_count * sizeof(cdb_ensemble->cdb_instance_locks));
+        cdb_ensemble->cdb_instance_locks = sxe_malloc(cdb_count * sizeof(* cdb_ensemble->cdb_instance_locks));
         SXEA1(cdb_ensemble->cdb_instances,       "ERROR: INTERNAL: sxe_malloc() failed for %zu bytes // %s(){}",
               cdb_count * sizeof(cdb_ensemble->cdb_instances), __FUNCTION__);
         SXEA1(cdb_ensemble->cdb_instance_locks , "ERROR: INTERNAL: sxe_malloc() failed for %zu bytes // %s(){}",
-              cdb_count * sizeof(cdb_ensemble->cdb_instance_locks), __FUNCTION__);
+              cdb_count * sizeof(* cdb_ensemble->cdb_instance_locks), __FUNCTION__);
         SXEL6("cdb_ensemble                     = sxe_malloc(%zu)", sizeof(* cdb_ensemble));
         SXEL6("cdb_ensemble->cdb_instances      = sxe_malloc(%u * %zu)", cdb_count, sizeof(cdb_ensemble->cdb_instances));
-        SXEL6("cdb_ensemble->cdb_instance_locks = sxe_malloc(%u * %zu)", cdb_count, sizeof(cdb_ensemble->cdb_instance_locks));
+        SXEL6("cdb_ensemble->cdb_instance_locks = sxe_malloc(%u * %zu)", cdb_count, sizeof(* cdb_ensemble->cdb_instance_locks));
 
         SXEL6("creating array of cdb pointers, each with its own lock:");
         uint32_t i;
@@ -1062,6 +1237,65 @@ sxe_cdb_ensemble_reboot(SXE_CDB_ENSEMBLE * cdb_ensemble)
     SXER6("return");
 } /* sxe_cdb_ensemble_reboot() */
 
+/**
+ * Build a filter for the keys in each instance of an ensemble; see sxe_cdb_instance_new_filter()
+ *
+ * @param cdb_ensemble Ensemble
+ * @param keys         Number of keys the filters are sized for, all together; each instance's filter is sized for its share
+ * @param bits_per_key Bits of filter per key; 10 gives about 1% false positives
+ */
+void
+sxe_cdb_ensemble_new_filters(SXE_CDB_ENSEMBLE * cdb_ensemble, uint64_t keys, unsigned bits_per_key)
+{
+    uint32_t instance;
+    SXEE6("(cdb_ensemble=?, keys=%lu, bits_per_key=%u)", keys, bits_per_key);
+
+    for (instance = 0; instance < cdb_ensemble->cdb_count; instance++) {
+        SXE_CDB_ENSEMBLE_INSTANCE_LOCK_BEFORE(cdb_ensemble, sxe_cdb_instance_new_filter);
+        sxe_cdb_instance_new_filter(cdb_ensemble->cdb_instances[instance], keys / cdb_ensemble->cdb_count, bits_per_key);
+        SXE_CDB_ENSEMBLE_INSTANCE_UNLOCK(cdb_ensemble);
+    }
+
+    SXER6("return");
+} /* sxe_cdb_ensemble_new_filters() */
+
+SXE_HASH_FILTER * /* NULL or the filter of one instance of an ensemble; e.g. to save it */
+sxe_cdb_ensemble_get_filter(SXE_CDB_ENSEMBLE * cdb_ensemble, uint32_t instance)
+{
+    SXEA1(instance < cdb_ensemble->cdb_count, "ERROR: INTERNAL: %u=instance < %u=cdb_ensemble->cdb_count", instance, cdb_ensemble->cdb_count);
+    return sxe_cdb_instance_get_filter(cdb_ensemble->cdb_instances[instance]);
+} /* sxe_cdb_ensemble_get_filter() */
+
+void /* attach a filter to one instance of an ensemble; see sxe_cdb_instance_set_filter() */
+sxe_cdb_ensemble_set_filter(SXE_CDB_ENSEMBLE * cdb_ensemble, uint32_t instance, SXE_HASH_FILTER * filter)
+{
+    SXEA1(instance < cdb_ensemble->cdb_count, "ERROR: INTERNAL: %u=instance < %u=cdb_ensemble->cdb_count", instance, cdb_ensemble->cdb_count);
+    SXE_CDB_ENSEMBLE_INSTANCE_LOCK_BEFORE(cdb_ensemble, sxe_cdb_instance_set_filter);
+    sxe_cdb_instance_set_filter(cdb_ensemble->cdb_instances[instance], filter);
+    SXE_CDB_ENSEMBLE_INSTANCE_UNLOCK(cdb_ensemble);
+} /* sxe_cdb_ensemble_set_filter() */
+
+/**
+ * Get the measured false positive rate of the filters of an ensemble, all together; see sxe_hash_filter_get_false_positive_rate()
+ */
+double
+sxe_cdb_ensemble_get_filter_false_positive_rate(SXE_CDB_ENSEMBLE * cdb_ensemble)
+{
+    SXE_HASH_FILTER * filter;
+    uint64_t          rejected        = 0;
+    uint64_t          false_positives = 0;
+    uint32_t          instance;
+
+    for (instance = 0; instance < cdb_ensemble->cdb_count; instance++) {
+        if ((filter = cdb_ensemble->cdb_instances[instance]->filter)) {
+            rejected        += filter->rejected;
+            false_positives += filter->false_positives;
+        }
+    }
+
+    return rejected + false_positives == 0 ? 0.0 : (double)false_positives / (rejected + false_positives);
+} /* sxe_cdb_ensemble_get_filter_false_positive_rate() */
+
 /**
  * USE WITH CAUTION: Caller responsible for unlock!
  *
@@ -1135,6 +1369,52 @@ sxe_cdb_ensemble_get_uid(SXE_CDB_ENSEMBLE * cdb_ensemble)
     return uid.as_u64.u;
 } /* sxe_cdb_ensemble_get_uid() */
 
+/**
+ * Look up the uids of a batch of keys in an ensemble; see sxe_cdb_instance_get_uids()
+ *
+ * @note Rows are prefetched without taking the instance locks; at worst a concurrent mremap() makes a prefetch useless. The
+ *       key value data is only prefetched for unlocked ensembles, because finding it means reading the rows. Each key is then
+ *       resolved by sxe_cdb_ensemble_get_uid(), under its instance's lock. In unlocked ensembles, nothing is prefetched for keys
+ *       the filter of their instance rejects. In locked ensembles, the filters are only read under the instance locks, since
+ *       sxe_cdb_ensemble_set_filter() may free them, so the rows of every key are prefetched.
+ */
+void
+sxe_cdb_ensemble_get_uids(SXE_CDB_ENSEMBLE * cdb_ensemble, const uint8_t * const * keys, const uint32_t * key_lens, uint32_t count, uint64_t * uids)
+{
+    SXE_CDB_HASH       hashes[SXE_CDB_BATCH];
+    bool               passes[SXE_CDB_BATCH];
+    SXE_CDB_INSTANCE * cdb_instance;
+    uint32_t           done;
+    uint32_t           todo;
+    uint32_t           i;
+
+    SXEE6("(cdb_ensemble=?, keys=?, key_lens=?, count=%u, uids=?)", count);
+
+    for (done = 0; done < count; done += todo) {
+        todo = count - done < SXE_CDB_BATCH ? count - done : SXE_CDB_BATCH;
+
+        for (i = 0; i < todo; i++) {
+            sxe_cdb_hash_key(keys[done + i], key_lens[done + i], &hashes[i]);
+            cdb_instance = cdb_ensemble->cdb_instances[hashes[i].u16[3] % cdb_ensemble->cdb_count];
+            passes[i]    = cdb_ensemble->cdb_is_locked || sxe_cdb_instance_filter_passes(cdb_instance, &hashes[i]);
+            if (passes[i]) { sxe_cdb_instance_prefetch_rows(cdb_instance, &hashes[i]); }
+        }
+
+        for (i = 0; !cdb_ensemble->cdb_is_locked && i < todo; i++) {
+            if (passes[i]) { sxe_cdb_instance_prefetch_hkv(cdb_ensemble->cdb_instances[hashes[i].u16[3] % cdb_ensemble->cdb_count], &hashes[i]); }
+        }
+
+        for (i = 0; i < todo; i++) {
+            sxe_cdb_hash      = hashes[i];
+            sxe_cdb_key       = keys[done + i];
+            sxe_cdb_key_len   = key_lens[done + i];
+            uids[done + i]    = sxe_cdb_ensemble_get_uid(cdb_ensemble);
+        }
+    }
+
+    SXER6("return");
+} /* sxe_cdb_ensemble_get_uids() */
+
 SXE_CDB_HKV * /* NULL or tls SXE_CDB_HKV raw; not copy */
 sxe_cdb_ensemble_get_uid_hkv_raw_locked(SXE_CDB_ENSEMBLE * cdb_ensemble, SXE_CDB_UID uid)
 {
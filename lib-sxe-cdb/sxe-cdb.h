@@ -22,6 +22,8 @@
 #ifndef __SXE_CDB_H__
 #define __SXE_CDB_H__
 
+#include "sxe-hash.h" /* for SXE_HASH_FILTER */
+
 /**
  * - What is sxe-cdb? sxe-cdb tries to have similar advantages
  *   to cdb "constant database" but with less disadvantages.
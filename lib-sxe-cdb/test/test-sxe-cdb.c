@@ -129,6 +129,32 @@ test_runaway_variant(
     sxe_cdb_instance_destroy(ci);
 } /* test_runaway_variant() */
 
+#define TEST_BATCH 64
+
+/* Look up the uids of the keys first .. first + count - 1 (count <= TEST_BATCH) in either an instance or an ensemble
+ */
+static void
+test_get_uids(SXE_CDB_INSTANCE * cdb_instance, SXE_CDB_ENSEMBLE * cdb_ensemble, uint32_t first, uint32_t count, uint64_t * uids)
+{
+    uint32_t        key_values[TEST_BATCH];
+    const uint8_t * key_ptrs  [TEST_BATCH];
+    uint32_t        key_lens  [TEST_BATCH];
+    uint32_t        i;
+
+    for (i = 0; i < count; i++) {
+        key_values[i] = first + i;
+        key_ptrs  [i] = (const uint8_t *) &key_values[i];
+        key_lens  [i] = sizeof(key_values[i]);
+    }
+
+    if (cdb_instance) {
+        sxe_cdb_instance_get_uids(cdb_instance, key_ptrs, key_lens, count, uids);
+    }
+    else {
+        sxe_cdb_ensemble_get_uids(cdb_ensemble, key_ptrs, key_lens, count, uids);
+    }
+} /* test_get_uids() */
+
 int
 main(void)
 {
@@ -140,7 +166,7 @@ main(void)
     uint8_t  header_len_5_key[KEY_HEADER_LEN_5_KEY_LEN_MAX]; /* 65535 bytes */
     uint8_t  header_len_8_key[KEY_HEADER_LEN_5_KEY_LEN_MAX + 1 /* 2^24 too big :-) */];
 
-    plan_tests(224);
+    plan_tests(235);
     uint64_t start_allocations = sxe_allocations;
     sxe_alloc_diagnostics      = true;
 
@@ -211,6 +237,54 @@ main(void)
            sxe_cdb_instance_destroy(cdb_instance);
     }
 
+    /* tests for filters in front of instances */
+
+    {
+        SXE_CDB_ENSEMBLE * cdb_ensemble = sxe_cdb_ensemble_new(0 /* grow from minimum size */, 0 /* grow to maximum allowed size */, 4 /* number of cdb instances */, 1 /* locked */);
+        uint64_t           uids[TEST_BATCH];
+        uint32_t           found;
+        uint32_t           first;
+
+        for (i = 0; i < 1000; i++) {
+            sxe_cdb_prepare((const uint8_t *) &i, sizeof(i));
+            SXEA1(sxe_cdb_ensemble_put_val(cdb_ensemble, (const uint8_t *) &i, sizeof(i)) != SXE_CDB_UID_NONE, "ERROR: INTERNAL: sxe_cdb_ensemble_put_val() unexpectedly failing");
+        }
+
+        ok(sxe_cdb_ensemble_get_filter(cdb_ensemble, 0) == NULL, "filter: instances have no filter by default");
+        sxe_cdb_ensemble_new_filters(cdb_ensemble, 2000, 10);
+        is(sxe_cdb_ensemble_get_filter(cdb_ensemble, 0)->keys + sxe_cdb_ensemble_get_filter(cdb_ensemble, 1)->keys
+         + sxe_cdb_ensemble_get_filter(cdb_ensemble, 2)->keys + sxe_cdb_ensemble_get_filter(cdb_ensemble, 3)->keys, 1000, "filter: filters were built from the keys in the instances");
+
+        for (i = 1000; i < 2000; i++) {
+            sxe_cdb_prepare((const uint8_t *) &i, sizeof(i));
+            SXEA1(sxe_cdb_ensemble_put_val(cdb_ensemble, (const uint8_t *) &i, sizeof(i)) != SXE_CDB_UID_NONE, "ERROR: INTERNAL: sxe_cdb_ensemble_put_val() unexpectedly failing");
+        }
+
+        for (found = 0, i = 0; i < 4000; i++) {
+            sxe_cdb_prepare((const uint8_t *) &i, sizeof(i));
+            found += sxe_cdb_ensemble_get_uid(cdb_ensemble) != SXE_CDB_UID_NONE;
+        }
+
+        is(found, 2000, "filter: every key put before or after the filters were built is found");
+        ok(sxe_cdb_ensemble_get_filter_false_positive_rate(cdb_ensemble) < 0.03, "filter: at most 3%% of misses passed the filters (%.2f%%)", 100.0 * sxe_cdb_ensemble_get_filter_false_positive_rate(cdb_ensemble));
+
+        for (found = 0, first = 0; first < 4000; first += TEST_BATCH) {
+            test_get_uids(NULL, cdb_ensemble, first, TEST_BATCH, uids);
+
+            for (i = 0; i < TEST_BATCH; i++) {
+                found += uids[i] != SXE_CDB_UID_NONE;
+            }
+        }
+
+        is(found, 2000, "filter: every key is found in batches");
+
+        sxe_cdb_ensemble_set_filter(cdb_ensemble, 0, NULL);
+        ok(sxe_cdb_ensemble_get_filter(cdb_ensemble, 0) == NULL, "filter: the filter of an instance was removed");
+        sxe_cdb_ensemble_reboot(cdb_ensemble);
+        is(sxe_cdb_ensemble_get_filter(cdb_ensemble, 1)->keys, 0, "filter: rebooting an ensemble clears its filters");
+        sxe_cdb_ensemble_destroy(cdb_ensemble);
+    }
+
     /* tests for ensemble swap & reboot */
 
     {
@@ -336,6 +410,32 @@ main(void)
         elapsed_time = sxe_time_to_double_seconds(sxe_time_get() - start_time);
         SXEL5("test: instance: get-uid %u keys in %6.2f seconds or %8u keys per second // keylen_misses %lu; memcmp_misses %lu", keys, elapsed_time, (unsigned)(((uint64_t)keys << 32) / (sxe_time_get() - start_time)), cdb_instance->keylen_misses, cdb_instance->memcmp_misses);
 
+        start_time = sxe_time_get();
+        for (i = 0; i < keys; i += TEST_BATCH) {
+            uint32_t count = keys - i < TEST_BATCH ? keys - i : TEST_BATCH;
+            uint64_t batch_uids[TEST_BATCH];
+            uint32_t j;
+
+            test_get_uids(cdb_instance, NULL, i, count, batch_uids);
+            for (j = 0; j < count; j++) {
+                SXEA1(uids[i + j].as_u64.u == batch_uids[j], "ERROR: INTERNAL: unexpected batch uid at i=%u", i + j);
+            }
+        }
+        elapsed_time = sxe_time_to_double_seconds(sxe_time_get() - start_time);
+        SXEL5("test: instance: get-uids %u keys in %6.2f seconds or %8u keys per second // batches of %u", keys, elapsed_time, (unsigned)(((uint64_t)keys << 32) / (sxe_time_get() - start_time)), TEST_BATCH);
+
+        {
+            uint64_t batch_uids[TEST_BATCH];
+
+            test_get_uids(cdb_instance, NULL, keys - TEST_BATCH / 2, TEST_BATCH, batch_uids);
+            is(batch_uids[TEST_BATCH / 2 - 1], uids[keys - 1].as_u64.u, "instance: get-uids: last existing key found in a batch straddling the end of the keys");
+            is(batch_uids[TEST_BATCH / 2    ], SXE_CDB_UID_NONE       , "instance: get-uids: first missing key not found in a batch straddling the end of the keys");
+            SXE_CDB_HASH batch_hash = sxe_cdb_hash;
+            uint32_t     last_key   = keys + TEST_BATCH / 2 - 1;
+            sxe_cdb_prepare((const uint8_t *) &last_key, sizeof(last_key));
+            ok(0 == memcmp(&batch_hash, &sxe_cdb_hash, sizeof(batch_hash)), "instance: get-uids: tls hash left as if the last key had been prepared");
+        }
+
         start_time = sxe_time_get();
         for (i = 0; i < keys; i++) {
             uid.as_u64.u = uids[i].as_u64.u;
@@ -478,6 +578,28 @@ main(void)
         elapsed_time = sxe_time_to_double_seconds(sxe_time_get() - start_time);
         SXEL5("test: ensemble: get-uid %u keys in %6.2f seconds or %8u keys per second", keys, elapsed_time, (unsigned)(((uint64_t)keys << 32) / (sxe_time_get() - start_time)));
 
+        start_time = sxe_time_get();
+        for (i = 0; i < keys; i += TEST_BATCH) {
+            uint32_t count = keys - i < TEST_BATCH ? keys - i : TEST_BATCH;
+            uint64_t batch_uids[TEST_BATCH];
+            uint32_t j;
+
+            test_get_uids(NULL, cdb_ensemble, i, count, batch_uids);
+            for (j = 0; j < count; j++) {
+                SXEA1(uids[i + j].as_u64.u == batch_uids[j], "ERROR: INTERNAL: unexpected batch uid at i=%u", i + j);
+            }
+        }
+        elapsed_time = sxe_time_to_double_seconds(sxe_time_get() - start_time);
+        SXEL5("test: ensemble: get-uids %u keys in %6.2f seconds or %8u keys per second // batches of %u", keys, elapsed_time, (unsigned)(((uint64_t)keys << 32) / (sxe_time_get() - start_time)), TEST_BATCH);
+
+        {
+            uint64_t batch_uids[TEST_BATCH];
+
+            test_get_uids(NULL, cdb_ensemble, keys - TEST_BATCH / 2, TEST_BATCH, batch_uids);
+            ok(batch_uids[TEST_BATCH / 2 - 1] == uids[keys - 1].as_u64.u && batch_uids[TEST_BATCH / 2] == SXE_CDB_UID_NONE,
+               "ensemble: get-uids: batch straddling the end of the keys finds the last existing key and not the first missing one");
+        }
+
         start_time = sxe_time_get();
         for (i = 0; i < keys; i++) {
             uid.as_u64.u = uids[i].as_u64.u;
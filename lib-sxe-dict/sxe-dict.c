@@ -1,10 +1,22 @@
+#include <limits.h>
 #include <xmmintrin.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "sxe-alloc.h"
 #include "sxe-dict.h"
+#include "sxe-log.h"
 
 #define hash_func       meiyan
 
+#define SXE_DICT_MIGRATE_BUCKETS 8       // Buckets migrated per add or find while an incremental dictionary is resizing
+#define SXE_DICT_MIGRATE_GROUPS  1       // Groups of slots migrated per add or find while an inline dictionary is resizing
+#define SXE_DICT_GROUP_SIZE      16      // Inline dictionaries match the control bytes of this many slots at a time
+#define SXE_DICT_EMPTY           0x80    // Control byte of an empty slot; used slots have the top 7 bits of their hash
+#define SXE_DICT_TAG(hash)       ((uint8_t)((hash) >> 25))
+
 struct sxe_dict_node {
     struct sxe_dict_node *next;
     char                 *key;
@@ -12,6 +24,20 @@ struct sxe_dict_node {
     const void           *value;
 };
 
+/* Inline dictionaries keep their entries in slots of an open addressing table rather than in malloced nodes, so a lookup reads the
+ * control bytes of a group of slots and then, usually, a single slot. Keys of up to SXE_DICT_INLINE_KEY_MAX bytes are kept in the
+ * slot; longer ones are appended to the dictionary's arena.
+ */
+struct sxe_dict_slot {
+    const void *value;
+    uint32_t    hash;
+    uint32_t    len;
+    union {
+        char    key[SXE_DICT_INLINE_KEY_MAX];    // Key, if it's short enough
+        size_t  offset;                          // Otherwise, offset of the key in the arena
+    };
+};
+
 static inline uint32_t
 meiyan(const char *key, size_t count)
 {
@@ -56,32 +82,175 @@ sxe_dict_node_delete(struct sxe_dict_node *node)
     sxe_free(node);
 }
 
+/* Round a number of slots up to a power of 2 number of groups
+ */
+static unsigned
+sxe_dict_inline_size(unsigned size)
+{
+    unsigned rounded = SXE_DICT_GROUP_SIZE;
+
+    while (rounded < size)
+        rounded *= 2;
+
+    return rounded;
+}
+
+static void
+sxe_dict_inline_alloc(struct sxe_dict *dic, unsigned size)
+{
+    dic->controls = sxe_malloc(size + (size_t)size * sizeof(struct sxe_dict_slot));
+    memset(dic->controls, SXE_DICT_EMPTY, size);
+    dic->slots = (struct sxe_dict_slot *)(dic->controls + size);    // size is a multiple of the group size, so slots are aligned
+    dic->size  = size;
+}
+
+/**
+ * Create a dictionary
+ *
+ * @param initial_size The initial number of buckets (slots, if inline), or 0 to allocate them on the first add
+ * @param options      0 or a combination of:
+ *                     SXE_DICT_OPTION_INCREMENTAL: Spread resizes over the adds and finds that follow them, migrating
+ *                     SXE_DICT_MIGRATE_BUCKETS buckets per call rather than rehashing every node at once
+ *                     SXE_DICT_OPTION_INLINE: Keep entries in an open addressing table of slots, matching the control bytes
+ *                     of 16 slots at a time, with short keys in the slots and long keys in an arena, so there is no malloc
+ *                     per entry; the size is rounded up to a power of 2 of at least 16, the load defaults to 87 and must be
+ *                     less than 100, and resizes are incremental
+ *
+ * @note In an inline dictionary, the value pointers returned by sxe_dict_add() are only valid until the next add or find
+ */
 struct sxe_dict *
-sxe_dict_new(int initial_size)
+sxe_dict_new_plus(int initial_size, unsigned options)
 {
-    struct sxe_dict* dic = sxe_malloc(sizeof(struct sxe_dict));
+    struct sxe_dict* dic = sxe_calloc(1, sizeof(struct sxe_dict));
+
+    dic->options = options & SXE_DICT_OPTION_INLINE ? options | SXE_DICT_OPTION_INCREMENTAL : options;
+    dic->load    = 100;    // As many entries as there are buckets
+    dic->growth  = 2;      // Double when load exceeded
+
+    if (options & SXE_DICT_OPTION_INLINE) {
+        dic->load = 87;    // Leave at least one slot in 8 empty, so that lookups of missing keys stop quickly
+
+        if (initial_size)
+            sxe_dict_inline_alloc(dic, sxe_dict_inline_size(initial_size));
 
-    dic->size   = initial_size;
-    dic->count  = 0;
-    dic->table  = initial_size ? sxe_calloc(sizeof(struct sxe_dict_node*), initial_size) : NULL;
-    dic->load   = 100;    // As many entries as there are buckets
-    dic->growth = 2;      // Double when load exceeded
+        return dic;
+    }
+
+    dic->size  = initial_size;
+    dic->table = initial_size ? sxe_calloc(sizeof(struct sxe_dict_node*), initial_size) : NULL;
     return dic;
 }
 
+struct sxe_dict *
+sxe_dict_new(int initial_size)
+{
+    return sxe_dict_new_plus(initial_size, 0);
+}
+
 void
 sxe_dict_delete(struct sxe_dict *dic)
 {
-    for (unsigned i = 0; i < dic->size; i++) {
+    for (unsigned i = 0; dic->table && i < dic->size; i++) {
         if (dic->table[i])
             sxe_dict_node_delete(dic->table[i]);
     }
 
+    for (unsigned i = dic->migrated; dic->old_table && i < dic->old_size; i++) {
+        if (dic->old_table[i])
+            sxe_dict_node_delete(dic->old_table[i]);
+    }
+
     sxe_free(dic->table);
+    sxe_free(dic->old_table);
+    sxe_free(dic->controls);
+    sxe_free(dic->old_controls);
+    sxe_free(dic->arena);
     dic->table = 0;
     sxe_free(dic);
 }
 
+/* Match a byte against the control bytes of a group of slots
+ *
+ * @return A bit mask with bit i set if the control of slot i of the group is the byte
+ */
+static inline unsigned
+sxe_dict_group_match(const uint8_t *controls, uint8_t byte)
+{
+#ifdef __SSE2__
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)controls), _mm_set1_epi8((char)byte)));
+#else
+    unsigned mask = 0;
+
+    for (unsigned i = 0; i < SXE_DICT_GROUP_SIZE; i++)
+        mask |= (unsigned)(controls[i] == byte) << i;
+
+    return mask;
+#endif
+}
+
+static inline const char *
+sxe_dict_slot_key(const struct sxe_dict *dic, const struct sxe_dict_slot *slot)
+{
+    return slot->len <= SXE_DICT_INLINE_KEY_MAX ? slot->key : dic->arena + slot->offset;
+}
+
+// Non-const version of sxe_dict_slot_key for sxe_dict_forEach, whose iterator function takes a non-const key
+static inline char *
+sxe_dict_slot_key_mutable(struct sxe_dict *dic, struct sxe_dict_slot *slot)
+{
+    return slot->len <= SXE_DICT_INLINE_KEY_MAX ? slot->key : dic->arena + slot->offset;
+}
+
+/* Look for a key in a table of slots, probing its groups triangularly (which visits every group, since there's a power of 2 of
+ * them). Groups before skip have been migrated, so they are passed over without stopping at their empty slots.
+ */
+static struct sxe_dict_slot *
+sxe_dict_inline_look(const struct sxe_dict *dic, const uint8_t *controls, struct sxe_dict_slot *slots, unsigned size,
+                     unsigned skip, const void *key, size_t keyn, uint32_t hash)
+{
+    unsigned mask  = size / SXE_DICT_GROUP_SIZE - 1;
+    unsigned group = hash & mask;
+
+    for (unsigned probe = 0; probe <= mask; group = (group + ++probe) & mask) {
+        if (group < skip)
+            continue;
+
+        const uint8_t *group_controls = controls + (size_t)group * SXE_DICT_GROUP_SIZE;
+        unsigned       match          = sxe_dict_group_match(group_controls, SXE_DICT_TAG(hash));
+
+        for (; match; match &= match - 1) {
+            struct sxe_dict_slot *slot = &slots[(size_t)group * SXE_DICT_GROUP_SIZE + __builtin_ctz(match)];
+
+            if (slot->hash == hash && slot->len == keyn && !memcmp(sxe_dict_slot_key(dic, slot), key, keyn))
+                return slot;
+        }
+
+        if (sxe_dict_group_match(group_controls, SXE_DICT_EMPTY))
+            return NULL;
+    }
+
+    return NULL;
+}
+
+/* Claim the first empty slot in the probe sequence of a hash. The load factor guarantees that there is one.
+ */
+static struct sxe_dict_slot *
+sxe_dict_inline_claim(uint8_t *controls, struct sxe_dict_slot *slots, unsigned size, uint32_t hash)
+{
+    unsigned mask  = size / SXE_DICT_GROUP_SIZE - 1;
+    unsigned group = hash & mask;
+    unsigned empty;
+    unsigned slot;
+
+    for (unsigned probe = 0; !(empty = sxe_dict_group_match(controls + (size_t)group * SXE_DICT_GROUP_SIZE, SXE_DICT_EMPTY));
+         group = (group + ++probe) & mask) {
+    }
+
+    slot           = group * SXE_DICT_GROUP_SIZE + __builtin_ctz(empty);
+    controls[slot] = SXE_DICT_TAG(hash);
+    return &slots[slot];
+}
+
 static void
 sxe_dict_reinsert_when_resizing(struct sxe_dict *dic, struct sxe_dict_node *k2)
 {
@@ -97,16 +266,33 @@ sxe_dict_reinsert_when_resizing(struct sxe_dict *dic, struct sxe_dict_node *k2)
     dic->table[n] = k2;
 }
 
-void
-sxe_dict_resize(struct sxe_dict *dic, int newsize)
+/* Migrate up to a number of buckets (groups of slots, if inline) from the old table to the new one, freeing the old table when
+ * they have all been migrated
+ */
+static void
+sxe_dict_migrate(struct sxe_dict *dic, unsigned buckets)
 {
-    int o = dic->size;
-    struct sxe_dict_node **old = dic->table;
-    dic->table = sxe_calloc(sizeof(struct sxe_dict_node*), newsize);
-    dic->size = newsize;
+    if (dic->options & SXE_DICT_OPTION_INLINE) {
+        for (; buckets > 0 && dic->migrated < dic->old_size / SXE_DICT_GROUP_SIZE; buckets--, dic->migrated++) {
+            for (unsigned i = dic->migrated * SXE_DICT_GROUP_SIZE; i < (dic->migrated + 1) * SXE_DICT_GROUP_SIZE; i++) {
+                if (dic->old_controls[i] != SXE_DICT_EMPTY)
+                    *sxe_dict_inline_claim(dic->controls, dic->slots, dic->size, dic->old_slots[i].hash) = dic->old_slots[i];
+            }
+        }
+
+        if (dic->migrated == dic->old_size / SXE_DICT_GROUP_SIZE) {
+            sxe_free(dic->old_controls);
+            dic->old_controls = NULL;
+            dic->old_slots    = NULL;
+            dic->old_size     = 0;
+            dic->migrated     = 0;
+        }
 
-    for (int i = 0; i < o; i++) {
-        struct sxe_dict_node *k = old[i];
+        return;
+    }
+
+    for (; buckets > 0 && dic->migrated < dic->old_size; buckets--, dic->migrated++) {
+        struct sxe_dict_node *k = dic->old_table[dic->migrated];
         while (k) {
             struct sxe_dict_node *next = k->next;
             k->next = 0;
@@ -115,7 +301,100 @@ sxe_dict_resize(struct sxe_dict *dic, int newsize)
         }
     }
 
-    sxe_free(old);
+    if (dic->migrated == dic->old_size) {
+        sxe_free(dic->old_table);
+        dic->old_table = NULL;
+        dic->old_size  = 0;
+        dic->migrated  = 0;
+    }
+}
+
+/* Allocate a new table and make the current one the old table, to be migrated by sxe_dict_migrate()
+ */
+static void
+sxe_dict_grow(struct sxe_dict *dic, unsigned newsize)
+{
+    if (dic->old_size)    // Finish any migration still in progress
+        sxe_dict_migrate(dic, UINT_MAX);
+
+    dic->old_size = dic->size;
+    dic->migrated = 0;
+
+    if (dic->options & SXE_DICT_OPTION_INLINE) {
+        if ((uint64_t)newsize * dic->load <= (uint64_t)(dic->count + 1) * 100)    // Keep room for another entry under the load
+            newsize = (uint64_t)(dic->count + 1) * 100 / dic->load + 1;
+
+        dic->old_controls = dic->controls;
+        dic->old_slots    = dic->slots;
+        sxe_dict_inline_alloc(dic, sxe_dict_inline_size(newsize));
+    }
+    else {
+        dic->old_table = dic->table;
+        dic->table     = sxe_calloc(sizeof(struct sxe_dict_node*), newsize);
+        dic->size      = newsize;
+    }
+
+    if (dic->old_size == 0)    // There was no table to migrate
+        sxe_dict_migrate(dic, 0);
+}
+
+/**
+ * Resize a dictionary, migrating every entry at once
+ *
+ * @param newsize The new number of buckets (slots, if inline, rounded up to a power of 2 and to enough slots to stay under the
+ *                load with room for another entry)
+ */
+void
+sxe_dict_resize(struct sxe_dict *dic, int newsize)
+{
+    sxe_dict_grow(dic, newsize);
+    sxe_dict_migrate(dic, UINT_MAX);
+}
+
+static const void **
+sxe_dict_inline_add(struct sxe_dict *dic, const void *key, size_t keyn)
+{
+    struct sxe_dict_slot *slot;
+    uint32_t              hash = hash_func((const char *)key, keyn);
+
+    SXEA1(dic->load > 0 && dic->load < 100, "An inline dictionary's load must leave empty slots, but it is %u%%", dic->load);
+
+    if (dic->controls == NULL)    // If this is a completely empty dictionary
+        sxe_dict_inline_alloc(dic, SXE_DICT_GROUP_SIZE);
+
+    if (dic->old_size)
+        sxe_dict_migrate(dic, SXE_DICT_MIGRATE_GROUPS);
+
+    if ((slot = sxe_dict_inline_look(dic, dic->controls, dic->slots, dic->size, 0, key, keyn, hash))
+     || (dic->old_size
+      && (slot = sxe_dict_inline_look(dic, dic->old_controls, dic->old_slots, dic->old_size, dic->migrated, key, keyn, hash))))
+        return &slot->value;
+
+    if ((uint64_t)(dic->count + 1) * 100 > (uint64_t)dic->size * dic->load) {
+        sxe_dict_grow(dic, dic->size * dic->growth);
+        sxe_dict_migrate(dic, SXE_DICT_MIGRATE_GROUPS);
+    }
+
+    slot        = sxe_dict_inline_claim(dic->controls, dic->slots, dic->size, hash);
+    slot->value = NULL;
+    slot->hash  = hash;
+    slot->len   = keyn;
+
+    if (keyn <= SXE_DICT_INLINE_KEY_MAX)
+        memcpy(slot->key, key, keyn);
+    else {
+        if (dic->arena_used + keyn > dic->arena_size) {
+            dic->arena_size = (dic->arena_used + keyn) * 2;
+            dic->arena      = sxe_realloc(dic->arena, dic->arena_size);
+        }
+
+        memcpy(dic->arena + dic->arena_used, key, keyn);
+        slot->offset     = dic->arena_used;
+        dic->arena_used += keyn;
+    }
+
+    dic->count++;
+    return &slot->value;
 }
 
 /**
@@ -128,6 +407,7 @@ sxe_dict_resize(struct sxe_dict *dic, int newsize)
  * @return A pointer to a value. If there is a collision, the value it points to should be something other than NULL.
  *
  * @note The caller is expected to save a non-NULL value in the value pointed at by the return value.
+ * @note An inline dictionary returns the value of the key if it's already in the dictionary.
  */
 const void **
 sxe_dict_add(struct sxe_dict *dic, const void *key, size_t keyn)
@@ -136,18 +416,28 @@ sxe_dict_add(struct sxe_dict *dic, const void *key, size_t keyn)
 
     keyn = keyn ?: strlen(key);
 
+    if (dic->options & SXE_DICT_OPTION_INLINE)
+        return sxe_dict_inline_add(dic, key, keyn);
+
     if (dic->table == NULL) {    // If this is a completely empty dictionary
         dic->table    = sxe_calloc(sizeof(struct sxe_dict_node*), 1);
         dic->size     = 1;
     }
 
+    if (dic->old_size)
+        sxe_dict_migrate(dic, SXE_DICT_MIGRATE_BUCKETS);
+
     unsigned hash   = hash_func((const char *)key, keyn);
     unsigned bucket = hash % dic->size;
 
     if (dic->table[bucket] != NULL) {
         unsigned load = dic->count * 100 / dic->size;
 
-        if (load >= dic->load)
+        if (load >= dic->load && dic->options & SXE_DICT_OPTION_INCREMENTAL) {
+            sxe_dict_grow(dic, dic->size * dic->growth);
+            sxe_dict_migrate(dic, SXE_DICT_MIGRATE_BUCKETS);
+        }
+        else if (load >= dic->load)
             sxe_dict_resize(dic, dic->size * dic->growth);
 
         bucket = hash % dic->size;
@@ -173,22 +463,45 @@ sxe_dict_add(struct sxe_dict *dic, const void *key, size_t keyn)
 const void *
 sxe_dict_find(struct sxe_dict *dic, const void *key, size_t keyn)
 {
+    keyn = keyn ?: strlen(key);
+
+    if (dic->options & SXE_DICT_OPTION_INLINE) {
+        struct sxe_dict_slot *slot;
+        uint32_t              hash;
+
+        if (dic->controls == NULL)    // If the dictionary is empty and its initial_size was 0, the key is not found.
+            return NULL;
+
+        if (dic->old_size)
+            sxe_dict_migrate(dic, SXE_DICT_MIGRATE_GROUPS);
+
+        hash = hash_func((const char *)key, keyn);
+
+        if ((slot = sxe_dict_inline_look(dic, dic->controls, dic->slots, dic->size, 0, key, keyn, hash))
+         || (dic->old_size
+          && (slot = sxe_dict_inline_look(dic, dic->old_controls, dic->old_slots, dic->old_size, dic->migrated, key, keyn, hash))))
+            return slot->value;
+
+        return NULL;
+    }
+
     if (dic->table == NULL)    // If the dictionary is empty and its initial_size was 0, the key is not found.
         return NULL;
 
-    unsigned n = hash_func((const char *)key, keyn) % dic->size;
+    if (dic->old_size)
+        sxe_dict_migrate(dic, SXE_DICT_MIGRATE_BUCKETS);
+
+    unsigned hash = hash_func((const char *)key, keyn);
+    unsigned n    = hash % dic->size;
     #if defined(__MINGW32__) || defined(__MINGW64__)
-    __builtin_prefetch(gc->table[n]);
+    __builtin_prefetch(dic->table[n]);
     #endif
 
     #if defined(_WIN32) || defined(_WIN64)
-    _mm_prefetch((char*)gc->table[n], _MM_HINT_T0);
+    _mm_prefetch((char*)dic->table[n], _MM_HINT_T0);
     #endif
     struct sxe_dict_node *k = dic->table[n];
 
-    if (!k)
-        return NULL;
-
     while (k) {
         if (k->len == keyn && !memcmp(k->key, key, keyn))
             return k->value;
@@ -196,12 +509,35 @@ sxe_dict_find(struct sxe_dict *dic, const void *key, size_t keyn)
         k = k->next;
     }
 
+    if (dic->old_size && (n = hash % dic->old_size) >= dic->migrated) {    // Not yet migrated from the old table
+        for (k = dic->old_table[n]; k; k = k->next) {
+            if (k->len == keyn && !memcmp(k->key, key, keyn))
+                return k->value;
+        }
+    }
+
     return NULL;
 }
 
 void
 sxe_dict_forEach(struct sxe_dict *dic, sxe_dict_iter f, void *user)
 {
+    if (dic->options & SXE_DICT_OPTION_INLINE) {
+        for (unsigned i = 0; dic->controls && i < dic->size; i++) {
+            if (dic->controls[i] != SXE_DICT_EMPTY
+             && !f(sxe_dict_slot_key_mutable(dic, &dic->slots[i]), dic->slots[i].len, &dic->slots[i].value, user))
+                return;
+        }
+
+        for (unsigned i = dic->migrated * SXE_DICT_GROUP_SIZE; i < dic->old_size; i++) {    // Slots not yet migrated
+            if (dic->old_controls[i] != SXE_DICT_EMPTY
+             && !f(sxe_dict_slot_key_mutable(dic, &dic->old_slots[i]), dic->old_slots[i].len, &dic->old_slots[i].value, user))
+                return;
+        }
+
+        return;
+    }
+
     for (unsigned i = 0; i < dic->size; i++) {
         if (dic->table[i] != 0) {
             struct sxe_dict_node *k = dic->table[i];
@@ -214,5 +550,12 @@ sxe_dict_forEach(struct sxe_dict *dic, sxe_dict_iter f, void *user)
             }
         }
     }
+
+    for (unsigned i = dic->migrated; i < dic->old_size; i++) {    // Buckets not yet migrated
+        for (struct sxe_dict_node *k = dic->old_table[i]; k; k = k->next) {
+            if (!f(k->key, k->len, &k->value, user))
+                return;
+        }
+    }
 }
 #undef hash_func
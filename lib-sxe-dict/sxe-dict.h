@@ -2,18 +2,36 @@
 #define SXE_DICT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#define SXE_DICT_OPTION_INCREMENTAL 0x1    // When resizing, migrate a few buckets per add or find rather than all at once
+#define SXE_DICT_OPTION_INLINE      0x2    // Keep entries in an open addressing table of slots; implies incremental resizing
+
+#define SXE_DICT_INLINE_KEY_MAX 16         // Inline dictionaries keep keys of up to this many bytes in their slots
+
 typedef bool (*sxe_dict_iter)(void *key, size_t key_size, const void **value, void *user);
 
 struct sxe_dict_node;
+struct sxe_dict_slot;
 
 struct sxe_dict {
-    struct sxe_dict_node **table;    // Pointer to the bucket list or NULL if the dictionary is empty
-    unsigned               size;     // Number of buckets
-    unsigned               count;    // Number of entries
-    unsigned               load;     // Maximum load factor (count/size) as a percentage. 100 -> count == size
-    unsigned               growth;   // Growth factor when load exceeded. 2 is for doubling
+    struct sxe_dict_node **table;           // Pointer to the bucket list or NULL if the dictionary is empty (or inline)
+    unsigned               size;            // Number of buckets (slots, if inline)
+    unsigned               count;           // Number of entries
+    unsigned               load;            // Maximum load factor (count/size) as a percentage. 100 -> count == size
+    unsigned               growth;          // Growth factor when load exceeded. 2 is for doubling
+    unsigned               options;         // SXE_DICT_OPTION_* flags
+    struct sxe_dict_node **old_table;       // Incremental: Bucket list being migrated to table, or NULL
+    unsigned               old_size;        // Incremental: Number of buckets (slots, if inline) being migrated, or 0 if none
+    unsigned               migrated;        // Incremental: Number of buckets (groups of slots, if inline) migrated so far
+    uint8_t               *controls;        // Inline: Control byte of each slot, followed by the slots, or NULL if empty
+    struct sxe_dict_slot  *slots;           // Inline: Slots, each with a hash, a value and a key or its offset in the arena
+    uint8_t               *old_controls;    // Inline: Controls of the slots being migrated, or NULL
+    struct sxe_dict_slot  *old_slots;       // Inline: Slots being migrated, or NULL
+    char                  *arena;           // Inline: Keys longer than SXE_DICT_INLINE_KEY_MAX bytes, or NULL
+    size_t                 arena_used;      // Inline: Number of bytes of the arena used
+    size_t                 arena_size;      // Inline: Number of bytes allocated for the arena
 };
 
 #include "sxe-dict-proto.h"
@@ -1,17 +1,62 @@
 #include <inttypes.h>
+#include <stdio.h>
 #include <tap.h>
 
 #include "sxe-alloc.h"
 #include "sxe-dict.h"
 
+#define TEST_KEYS 10000
+
+static bool
+test_count(void *key, size_t key_size, const void **value, void *user)
+{
+    (*(unsigned *)user)++;
+    return true;
+}
+
+/* Add TEST_KEYS keys, every third one too long to be kept inline, checking whether any resize was spread over later adds
+ */
+static void
+test_grow(struct sxe_dict *dic, const char *name)
+{
+    const void **value_ptr;
+    char         key[64];
+    unsigned     found     = 0;
+    unsigned     iterated  = 0;
+    bool         migrating = false;
+    unsigned     i;
+
+    for (i = 0; i < TEST_KEYS; i++) {
+        snprintf(key, sizeof(key), i % 3 ? "%u" : "a key longer than sixteen bytes %u", i);
+        value_ptr  = sxe_dict_add(dic, key, 0);
+        *value_ptr = (const void *)(uintptr_t)(i + 1);
+        migrating  = migrating || dic->old_size != 0;
+    }
+
+    ok(migrating, "%s: Resizes were spread over the following adds", name);
+
+    for (i = 0; i < TEST_KEYS; i++) {
+        snprintf(key, sizeof(key), i % 3 ? "%u" : "a key longer than sixteen bytes %u", i);
+        found += sxe_dict_find(dic, key, 0) == (const void *)(uintptr_t)(i + 1);
+    }
+
+    is(found, TEST_KEYS,                                 "%s: All keys were found with their values", name);
+    is(dic->count, TEST_KEYS,                            "%s: All keys were counted", name);
+    sxe_dict_forEach(dic, test_count, &iterated);
+    is(iterated, TEST_KEYS,                              "%s: All keys were iterated over", name);
+    ok(sxe_dict_find(dic, "missing", 0) == NULL,         "%s: A missing key is not found", name);
+}
+
 int
 main(void) {
     struct sxe_dict *dic;
     const void      **value_ptr;
     const void       *value;
     uint64_t          start_allocations;
+    size_t            arena_used;
+    unsigned          i;
 
-    plan_tests(13);
+    plan_tests(33);
     start_allocations     = sxe_allocations;
     sxe_alloc_diagnostics = true;
 
@@ -44,6 +89,30 @@ main(void) {
 
     sxe_dict_delete(dic);
 
+    dic = sxe_dict_new_plus(0, SXE_DICT_OPTION_INCREMENTAL);
+    test_grow(dic, "incremental");
+    sxe_dict_delete(dic);
+
+    dic = sxe_dict_new_plus(0, SXE_DICT_OPTION_INLINE);
+    is(dic->controls, NULL,                                               "Empty inline dictionary has no slots");
+    ok(sxe_dict_find(dic, "ABC", 3) == NULL,                              "Empty inline dictionary finds nothing");
+    test_grow(dic, "inline");
+    ok(dic->size >= TEST_KEYS * 100 / 87 && !(dic->size & (dic->size - 1)), "Inline dictionary size %u is a power of 2 under the load", dic->size);
+    is(*sxe_dict_add(dic, "1", 1), 2,                                     "Adding a key that is already in an inline dictionary returns its value");
+    is(dic->count, TEST_KEYS,                                             "The key was not added again");
+    sxe_dict_add(dic, "a key longer than sixteen bytes 0", 0);
+    for (i = 0, arena_used = 0; i < TEST_KEYS; i += 3)
+        arena_used += snprintf(NULL, 0, "a key longer than sixteen bytes %u", i);
+
+    is(dic->arena_used, arena_used,                                       "Only long keys are kept in the arena");
+    sxe_dict_resize(dic, 4 * dic->size);
+    is(dic->old_size, 0,                                                  "An explicit resize migrates every entry");
+    is(sxe_dict_find(dic, "a key longer than sixteen bytes 9999", 0), 10000, "Long keys are found after a resize");
+    sxe_dict_resize(dic, 0);
+    ok((uint64_t)dic->count * 100 < (uint64_t)dic->size * dic->load,    "Shrinking an inline dictionary keeps it under its load");
+    is(sxe_dict_find(dic, "9998", 0), 9999,                               "Keys are found after shrinking");
+    sxe_dict_delete(dic);
+
     is(sxe_allocations, start_allocations, "No memory was leaked");
     return exit_status();
 }
@@ -76,21 +76,20 @@ sxe_dirwatch_event(EV_P_ ev_io * io, int revents)
         SXEL6("dirwatch_event: fd=%d flags=%08x file=%s", event->wd, event->mask, event->name);
         sxe_list_walker_construct(&walker, &sxe_dirwatch_list);
 
-        while ((dirwatch = (SXE_DIRWATCH *)sxe_list_walker_step(&walker)) != NULL) {
-            if (dirwatch->fd == event->wd) {
-                break;
-            }
-        }
-
-        SXEA1(dirwatch, "No watched directory found with fd %d", event->wd);
-
         flags |= (event->mask & IN_CREATE)     ? SXE_DIRWATCH_CREATED  : 0;
         flags |= (event->mask & IN_MOVED_TO)   ? SXE_DIRWATCH_CREATED  : 0;
         flags |= (event->mask & IN_MODIFY)     ? SXE_DIRWATCH_MODIFIED : 0;
         flags |= (event->mask & IN_DELETE)     ? SXE_DIRWATCH_DELETED  : 0;
         flags |= (event->mask & IN_MOVED_FROM) ? SXE_DIRWATCH_DELETED  : 0;
 
-        dirwatch->notify(EV_A_ event->name, flags, dirwatch->user_data);
+        /* Every watcher of the directory shares the watch id. Events (including the final IN_IGNORED) may still be queued for a
+         * watch removed by sxe_dirwatch_remove(), in which case no watcher is found.
+         */
+        while ((dirwatch = (SXE_DIRWATCH *)sxe_list_walker_step(&walker)) != NULL) {
+            if (dirwatch->fd == event->wd) {
+                dirwatch->notify(EV_A_ event->name, flags, dirwatch->user_data);
+            }
+        }
     }
 
     SXER6("return");
@@ -129,10 +128,13 @@ SXE_EARLY_OUT:
  * @param dirwatch  Pointer to the directory watcher
  * @param directory       Name of directory to watch
  * @param flags     Add one or more of: SXE_DIRWATCH_CREATED, SXE_DIRWATCH_MODIFIED, SXE_DIRWATCH_DELETED
- * @param notify    Function to be called when directory changes
+ * @param notify    Function to be called when directory changes; must not add or remove directory watchers
  * @param user_data Data to pass to the notify callback
  *
  * @exception Aborts if the dirwatch cannot be added to inotify
+ *
+ * @note A directory can have more than one watcher. Watchers of the same directory share an inotify watch, so each of them is
+ *       notified of the changes any of them asked for.
  */
 void
 sxe_dirwatch_add(SXE_DIRWATCH * dirwatch, const char * directory, unsigned flags,
@@ -166,6 +168,40 @@ sxe_dirwatch_add(SXE_DIRWATCH * dirwatch, const char * directory, unsigned flags
     SXER6("return");
 }
 
+/**
+ * Stop watching a directory and remove it from the list of watched directories
+ *
+ * @param dirwatch Pointer to a directory watcher previously passed to sxe_dirwatch_add()
+ *
+ * @note Events already read from inotify for the directory will not be delivered. The inotify watch is only removed when the
+ *       last watcher of the directory is.
+ */
+void
+sxe_dirwatch_remove(SXE_DIRWATCH * dirwatch)
+{
+    SXE_LIST_WALKER walker;
+    SXE_DIRWATCH  * other;
+
+    SXEE6("(dirwatch=%p) // fd=%d", dirwatch, dirwatch->fd);
+    sxe_list_remove(&sxe_dirwatch_list, dirwatch);
+    sxe_list_walker_construct(&walker, &sxe_dirwatch_list);
+
+    while ((other = (SXE_DIRWATCH *)sxe_list_walker_step(&walker)) != NULL) {
+        if (other->fd == dirwatch->fd) {
+            SXEL6("Watch id %d is still used by dirwatch %p", dirwatch->fd, other);
+            goto SXE_EARLY_OUT;
+        }
+    }
+
+    if (inotify_rm_watch(sxe_dirwatch_inotify_fd, dirwatch->fd) < 0) {
+        SXEL2("Error removing watch id %d: %s", dirwatch->fd, strerror(errno));    /* Coverage Exclusion: directory deleted */
+    }
+
+SXE_EARLY_OUT:
+    dirwatch->fd = -1;
+    SXER6("return");
+}
+
 /**
  * Start watching the list of watched directories
  */
@@ -48,10 +48,11 @@ main(void)
     SXE_DIRWATCH dirwatch1;
     SXE_DIRWATCH dirwatch2;
     SXE_DIRWATCH dirwatch3;
+    SXE_DIRWATCH dirwatch4;
     char fname[PATH_MAX];
     tap_ev ev;
 
-    plan_tests(28);
+    plan_tests(40);
 
     sxe_register(1, 0);
     sxe_init();
@@ -148,6 +149,56 @@ main(void)
         is(tap_ev_arg(ev, "user_data"), 3,                                         "Got user_data=3 (%s)", tempdir3);
     }
 
+    /* tempdir2 removed: changes are no longer reported */
+    {
+        int fd;
+
+        sxe_dirwatch_remove(&dirwatch2);
+        snprintf(fname, sizeof fname, "%s/file.XXXXXX", tempdir2);
+        fd = mkstemp(fname);
+        write(fd, "Hello", 5);
+        close(fd);
+        unlink(fname);
+
+        snprintf(fname, sizeof fname, "%s/created", tempdir1);
+        fd = open(fname, O_CREAT|O_RDWR, S_IRWXU);
+        close(fd);
+        unlink(fname);
+
+        is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "test_dirwatch_event",  "Got a dirwatch event");
+        is(tap_ev_arg(ev, "user_data"), 1,                                         "Got user_data=1 (%s), not 2 (%s)", tempdir1, tempdir2);
+        tap_ev_flush();
+    }
+
+    /* tempdir1 watched twice: both watchers are notified, and removing one leaves the other watching */
+    {
+        int fd;
+
+        sxe_dirwatch_add(&dirwatch4, tempdir1, SXE_DIRWATCH_CREATED|SXE_DIRWATCH_DELETED, test_dirwatch_event, (void *)4);
+        snprintf(fname, sizeof fname, "%s/shared", tempdir1);
+        fd = open(fname, O_CREAT|O_RDWR, S_IRWXU);
+        close(fd);
+        unlink(fname);
+
+        is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "test_dirwatch_event",  "Got a dirwatch event");
+        is(tap_ev_arg(ev, "user_data"), 1,                                         "Got user_data=1 (first watcher)");
+        is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "test_dirwatch_event",  "Got a dirwatch event");
+        is(tap_ev_arg(ev, "user_data"), 4,                                         "Got user_data=4 (second watcher)");
+        is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "test_dirwatch_event",  "Got a dirwatch event");
+        is(tap_ev_arg(ev, "user_data"), 1,                                         "Got user_data=1 (first watcher)");
+        is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "test_dirwatch_event",  "Got a dirwatch event");
+        is(tap_ev_arg(ev, "user_data"), 4,                                         "Got user_data=4 (second watcher)");
+
+        sxe_dirwatch_remove(&dirwatch4);
+        fd = open(fname, O_CREAT|O_RDWR, S_IRWXU);
+        close(fd);
+        unlink(fname);
+
+        is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "test_dirwatch_event",  "Got a dirwatch event");
+        is(tap_ev_arg(ev, "user_data"), 1,                                         "Got user_data=1 after removing the second watcher");
+        tap_ev_flush();
+    }
+
     rmdir(tempdir1);
     rmdir(tempdir2);
     rmdir(tempdir3);
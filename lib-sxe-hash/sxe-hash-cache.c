@@ -0,0 +1,267 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Cache mode for hashes: when a hash is full, sxe_hash_take() evicts an element rather than failing. The victim is chosen by a
+ * CLOCK hand sweeping the elements in index order; setting a referenced bit on a hit is much cheaper than moving the element to
+ * the head of an LRU list. To resist scans, the cache is segmented (as in SLRU): an element starts on probation, and is only
+ * promoted to the protected segment if it is found again before the hand reaches it. The hand evicts the first unreferenced
+ * element on probation, demoting unreferenced protected elements (and protected elements beyond the segment's size) as it goes.
+ */
+
+#include <string.h>
+
+#include "sxe-alloc.h"
+#include "sxe-hash-private.h"
+#include "sxe-log.h"
+
+static inline void
+sxe_hash_cache_lock(SXE_HASH * hash)
+{
+    if (hash->options & SXE_HASH_OPTION_LOCKED) {
+        SXEA1(sxe_spinlock_take(&hash->cache->lock) == SXE_SPINLOCK_STATUS_TAKEN, "Failed to take the cache lock of hash %s",
+              sxe_pool_get_name(hash->pool));
+    }
+}
+
+static inline void
+sxe_hash_cache_unlock(SXE_HASH * hash)
+{
+    if (hash->options & SXE_HASH_OPTION_LOCKED) {
+        sxe_spinlock_give(&hash->cache->lock);
+    }
+}
+
+/**
+ * Put a hash in cache mode, so that when it is full, sxe_hash_take() evicts an element instead of returning SXE_HASH_FULL
+ *
+ * @param array             = Pointer to the hash array
+ * @param protected_percent = Percentage of the elements that can be in the protected segment; 0 gives plain CLOCK, which isn't
+ *                            scan resistant, and 80 is a good start
+ * @param evict             = Function called with each element evicted, before it is given back, e.g. to release resources
+ *                            that it owns, or NULL
+ * @param user_data         = Passed to evict
+ *
+ * @note If the hash is already in cache mode, its counters are kept; otherwise, the elements already in it start on probation.
+ *       A hit sets an element's referenced bit, so cache mode adds no writes to lookups of elements that are found repeatedly.
+ *
+ * @note In a locked hash, evictions, adds and gives serialize on the cache's lock. The evict function is called without it, so
+ *       it can use the hash. Until the element has been given back, it stays in the hash, and giving it (e.g. from another
+ *       thread that found it) is left to the eviction.
+ */
+void
+sxe_hash_set_cache(void * array, unsigned protected_percent, SXE_HASH_EVICT_FUNC evict, void * user_data)
+{
+    SXE_HASH * hash = SXE_HASH_ARRAY_TO_IMPL(array);
+    size_t     size = sizeof(SXE_HASH_CACHE) + hash->count;
+    unsigned   number;
+    unsigned   id;
+
+    SXEE6("(hash=%s,protected_percent=%u,evict=%p,user_data=%p)", sxe_pool_get_name(array), protected_percent, evict, user_data);
+    SXEA1(protected_percent <= 100, "Hash %s: %u%% of a cache can't be protected", sxe_pool_get_name(array), protected_percent);
+
+    if (hash->cache == NULL) {
+        SXEA1(hash->cache = sxe_malloc(size), "Unable to allocate %zu bytes of memory for the cache of hash %s", size,
+              sxe_pool_get_name(array));
+        memset(hash->cache, 0, size);
+        sxe_spinlock_construct(&hash->cache->lock);
+        number = sxe_pool_get_number(array);
+
+        for (id = 0; id < number; id++) {
+            if (sxe_hash_element_is_used(hash, id)) {
+                hash->cache->flags[id] = SXE_HASH_CACHE_CACHED;
+                hash->cache->cached++;
+            }
+        }
+    }
+
+    hash->cache->evict         = evict;
+    hash->cache->user_data     = user_data;
+    hash->cache->protected_max = (unsigned)((uint64_t)hash->count * protected_percent / 100);
+    SXER6("return");
+}
+
+/**
+ * Get the cache mode state of a hash, e.g. to read its hit, miss and eviction counters
+ *
+ * @return A pointer to the state, or NULL if the hash is not in cache mode
+ */
+SXE_HASH_CACHE *
+sxe_hash_get_cache(void * array)
+{
+    return SXE_HASH_ARRAY_TO_IMPL(array)->cache;
+}
+
+/* Forget the elements and reset the counters of a cache; called by sxe_hash_reconstruct()
+ */
+void
+sxe_hash_cache_clear(SXE_HASH_CACHE * cache, unsigned count)
+{
+    memset(cache->flags, 0, count);
+    cache->hits            = 0;
+    cache->misses          = 0;
+    cache->evictions       = 0;
+    cache->cached          = 0;
+    cache->protected_count = 0;
+    cache->hand            = 0;
+}
+
+/* Put an element added to a hash on probation; called by sxe_hash_add()
+ */
+void
+sxe_hash_cache_add(SXE_HASH * hash, unsigned id)
+{
+    sxe_hash_cache_lock(hash);
+    __atomic_store_n(&hash->cache->flags[id], SXE_HASH_CACHE_CACHED, __ATOMIC_RELAXED);
+    hash->cache->cached++;
+    sxe_hash_cache_unlock(hash);
+}
+
+/* Forget an element given back to a hash; called by sxe_hash_give(). Taken elements that were never added aren't cached.
+ *
+ * @return false if the element is being evicted, in which case the eviction gives it back and the caller must not
+ */
+bool
+sxe_hash_cache_give(SXE_HASH * hash, unsigned id)
+{
+    uint8_t flags;
+
+    sxe_hash_cache_lock(hash);
+
+    if ((flags = __atomic_load_n(&hash->cache->flags[id], __ATOMIC_RELAXED)) & SXE_HASH_CACHE_EVICTING) {
+        sxe_hash_cache_unlock(hash);
+        SXEL6("Element %u of hash %s is being evicted; leaving the give to the eviction", id, sxe_pool_get_name(hash->pool));
+        return false;
+    }
+
+    __atomic_store_n(&hash->cache->flags[id], 0, __ATOMIC_RELAXED);
+
+    if (flags & SXE_HASH_CACHE_CACHED) {
+        hash->cache->cached--;
+        hash->cache->protected_count -= (flags & SXE_HASH_CACHE_PROTECTED) != 0;
+    }
+
+    sxe_hash_cache_unlock(hash);
+    return true;
+}
+
+/* Move the hand until it finds an element to evict, and forget the element, marking it as being evicted. Called with the cache
+ * locked.
+ */
+static unsigned
+sxe_hash_cache_victim(SXE_HASH * hash)
+{
+    SXE_HASH_CACHE * cache = hash->cache;
+    uint64_t         visits;
+    unsigned         id;
+    uint8_t          flags;
+
+    if (cache->cached == 0) {    /* Every element is taken but not yet added */
+        return SXE_HASH_FULL;
+    }
+
+    /* Each visit clears a referenced bit or demotes an element, so within three sweeps there is an unreferenced element on
+     * probation, unless lookups keep setting referenced bits; in that case, give up on the policy and evict the next element.
+     */
+    for (visits = 0; ; visits++) {
+        id          = cache->hand;
+        cache->hand = id + 1 < hash->count ? id + 1 : 0;
+        flags       = __atomic_load_n(&cache->flags[id], __ATOMIC_RELAXED);
+
+        if (!(flags & SXE_HASH_CACHE_CACHED)) {
+            continue;
+        }
+
+        if (visits >= 3 * (uint64_t)hash->count) {
+            break;
+        }
+
+        if (flags & SXE_HASH_CACHE_PROTECTED) {
+            if (flags & SXE_HASH_CACHE_REFERENCED && cache->protected_count <= cache->protected_max) {
+                __atomic_fetch_and(&cache->flags[id], (uint8_t)~SXE_HASH_CACHE_REFERENCED, __ATOMIC_RELAXED);
+            }
+            else {    /* Demote it, giving it another sweep on probation */
+                __atomic_fetch_and(&cache->flags[id], (uint8_t)~(SXE_HASH_CACHE_PROTECTED | SXE_HASH_CACHE_REFERENCED),
+                                   __ATOMIC_RELAXED);
+                cache->protected_count--;
+            }
+
+            continue;
+        }
+
+        if (flags & SXE_HASH_CACHE_REFERENCED) {
+            if (cache->protected_count < cache->protected_max) {
+                __atomic_store_n(&cache->flags[id], SXE_HASH_CACHE_CACHED | SXE_HASH_CACHE_PROTECTED, __ATOMIC_RELAXED);
+                cache->protected_count++;
+            }
+            else {
+                __atomic_fetch_and(&cache->flags[id], (uint8_t)~SXE_HASH_CACHE_REFERENCED, __ATOMIC_RELAXED);
+            }
+
+            continue;
+        }
+
+        break;
+    }
+
+    flags = __atomic_exchange_n(&cache->flags[id], SXE_HASH_CACHE_EVICTING, __ATOMIC_RELAXED);
+    cache->cached--;
+    cache->protected_count -= (flags & SXE_HASH_CACHE_PROTECTED) != 0;
+    cache->evictions++;
+    return id;
+}
+
+/* Evict an element from a full hash in cache mode; called by sxe_hash_take(). The element is marked as being evicted until it has
+ * been given back, so a give that races with the eviction can't give it twice, or give it after it has been reused.
+ *
+ * @return true if an element was evicted and given back, or false if there was none to evict
+ */
+bool
+sxe_hash_cache_evict(SXE_HASH * hash)
+{
+    unsigned id;
+
+    SXEE6("(hash=%s)", sxe_pool_get_name(hash->pool));
+    sxe_hash_cache_lock(hash);
+    id = sxe_hash_cache_victim(hash);
+    sxe_hash_cache_unlock(hash);
+
+    if (id == SXE_HASH_FULL) {
+        goto SXE_EARLY_OUT;
+    }
+
+    SXEL7("Evicting element %u", id);
+
+    if (hash->cache->evict != NULL) {
+        hash->cache->evict(hash->pool, id, hash->cache->user_data);
+    }
+
+    /* Give the element back with the cache locked, so that it can't be added again (which clears the mark) until it has been
+     * given, and clear the mark, so that it can be given if it is taken but not added.
+     */
+    sxe_hash_cache_lock(hash);
+    __atomic_store_n(&hash->cache->flags[id], 0, __ATOMIC_RELAXED);
+    sxe_hash_give_element(hash, id);
+    sxe_hash_cache_unlock(hash);
+
+SXE_EARLY_OUT:
+    SXER6("return %s", id == SXE_HASH_FULL ? "false" : "true");
+    return id != SXE_HASH_FULL;
+}
@@ -0,0 +1,143 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Epoch based reclamation for concurrent hashes. Readers never write to a hash; instead, each reading thread announces the epoch
+ * in which its current read section started in its own record. A writer that removes something readers may still be looking at
+ * retires it in the current epoch and advances the epoch. Once no reader's announced epoch is at or before the retirement, nothing
+ * can still see it, and it can be reused.
+ */
+
+#include <pthread.h>
+
+#include "sxe-hash-private.h"
+
+uint64_t                  sxe_hash_epoch = 1;
+SXE_HASH_READER           sxe_hash_readers[SXE_HASH_READERS_MAX] __attribute__((aligned(64)));
+__thread SXE_HASH_READER * sxe_hash_reader = NULL;
+
+static unsigned       sxe_hash_readers_used = 0;    /* High water mark of the records ever owned */
+static pthread_key_t  sxe_hash_reader_key;
+static pthread_once_t sxe_hash_reader_once  = PTHREAD_ONCE_INIT;
+
+/* Give up a thread's record when the thread exits
+ */
+static void
+sxe_hash_reader_release(void * record)
+{
+    SXE_HASH_READER * reader = record;
+
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+    reader->depth = 0;
+    __atomic_store_n(&reader->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void
+sxe_hash_reader_key_create(void)
+{
+    SXEA1(pthread_key_create(&sxe_hash_reader_key, sxe_hash_reader_release) == 0, "Failed to create the hash reader key");
+}
+
+/**
+ * Give the calling thread a reader record; called the first time a thread reads a concurrent hash
+ *
+ * @exception Aborts if more than SXE_HASH_READERS_MAX threads are reading at once
+ */
+SXE_HASH_READER *
+sxe_hash_reader_register(void)
+{
+    unsigned i;
+    unsigned used;
+
+    pthread_once(&sxe_hash_reader_once, sxe_hash_reader_key_create);
+
+    for (i = 0; i < SXE_HASH_READERS_MAX; i++) {
+        if (__atomic_load_n(&sxe_hash_readers[i].owned, __ATOMIC_RELAXED) == 0
+         && __sync_bool_compare_and_swap(&sxe_hash_readers[i].owned, 0, 1)) {
+            break;
+        }
+    }
+
+    SXEA1(i < SXE_HASH_READERS_MAX, "More than %u threads are reading concurrent hashes", SXE_HASH_READERS_MAX);
+
+    while ((used = __atomic_load_n(&sxe_hash_readers_used, __ATOMIC_ACQUIRE)) <= i) {
+        __sync_bool_compare_and_swap(&sxe_hash_readers_used, used, i + 1);
+    }
+
+    sxe_hash_reader = &sxe_hash_readers[i];
+    pthread_setspecific(sxe_hash_reader_key, sxe_hash_reader);
+    SXEL6("Thread %ld has hash reader record %u", SXE_GETTID(), i);
+    return sxe_hash_reader;
+}
+
+/**
+ * Begin a read section, during which elements found in concurrent hashes won't be reused even if they are given
+ *
+ * @note Each lookup in a concurrent hash is a read section of its own; callers that read the elements they find must wrap the
+ *       lookup and the reads in sxe_hash_read_begin() and sxe_hash_read_end(). Read sections nest, and should be short, since
+ *       writers can't reuse given elements until they end.
+ */
+void
+sxe_hash_read_begin(void)
+{
+    sxe_hash_reader_enter();
+}
+
+/**
+ * End a read section begun with sxe_hash_read_begin()
+ */
+void
+sxe_hash_read_end(void)
+{
+    SXEA6(sxe_hash_reader != NULL && sxe_hash_reader->depth > 0, "sxe_hash_read_end called outside of a read section");
+    sxe_hash_reader_exit();
+}
+
+/**
+ * Advance the epoch after retiring something
+ *
+ * @return The epoch in which it was retired, to pass to sxe_hash_epoch_is_quiescent()
+ */
+uint64_t
+sxe_hash_epoch_advance(void)
+{
+    return __atomic_fetch_add(&sxe_hash_epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Determine whether every reader has started reading since an epoch, so that nothing retired in it can still be seen
+ */
+bool
+sxe_hash_epoch_is_quiescent(uint64_t retire_epoch)
+{
+    unsigned used = __atomic_load_n(&sxe_hash_readers_used, __ATOMIC_ACQUIRE);
+    unsigned i;
+    uint64_t epoch;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    for (i = 0; i < used; i++) {
+        if ((epoch = __atomic_load_n(&sxe_hash_readers[i].epoch, __ATOMIC_ACQUIRE)) != 0 && epoch <= retire_epoch) {
+            return false;
+        }
+    }
+
+    return true;
+}
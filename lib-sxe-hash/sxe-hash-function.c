@@ -0,0 +1,262 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Hash functions for computed hash sums, chosen at run time according to what the CPU supports. All of them take a key and a
+ * length, use strlen() if the length is 0, and return a 32 bit sum whose low bits (bucket or group) and high bits (open addressing
+ * tag) are both well distributed.
+ */
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#   include <cpuid.h>
+#   include <immintrin.h>
+#endif
+
+#include "sxe-hash-private.h"
+
+static const char * sxe_hash_function_names[] = {"global", "lookup3", "xxh32", "xxh3", "crc32c", "wyhash", "aes", "best"};
+
+/* Software CRC32C (Castagnoli, reflected polynomial 0x82F63B78), a nibble at a time
+ */
+static const uint32_t sxe_hash_crc32c_nibbles[16] = {
+    0x00000000, 0x105ec76f, 0x20bd8ede, 0x30e349b1, 0x417b1dbc, 0x5125dad3, 0x61c69362, 0x7198540d,
+    0x82f63b78, 0x92a8fc17, 0xa24bb5a6, 0xb21572c9, 0xc38d26c4, 0xd3d3e1ab, 0xe330a81a, 0xf36e6f75
+};
+
+/**
+ * Compute the CRC32C of a fixed length or NUL terminated key in software
+ *
+ * @param key    Pointer to the key
+ * @param length Length of the key in bytes or 0 to use strlen
+ *
+ * @return CRC32C of the key; the same as the SSE4.2 crc32 instruction computes
+ *
+ * @note This is the fallback for CPUs without a crc32 instruction; use sxe_hash_function(SXE_HASH_FUNCTION_CRC32C) to get the
+ *       fastest implementation available.
+ */
+unsigned
+sxe_hash_crc32c(const void * key, unsigned length)
+{
+    const uint8_t * bytes = key;
+    uint32_t        crc   = ~0U;
+
+    if (length == 0)
+        length = strlen(key);
+
+    while (length-- > 0) {
+        crc ^= *bytes++;
+        crc  = sxe_hash_crc32c_nibbles[crc & 0xF] ^ (crc >> 4);
+        crc  = sxe_hash_crc32c_nibbles[crc & 0xF] ^ (crc >> 4);
+    }
+
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static unsigned
+sxe_hash_crc32c_sse42(const void * key, unsigned length)
+{
+    const uint8_t * bytes = key;
+    uint64_t        crc   = ~0U;
+    uint64_t        word64;
+    uint32_t        word32;
+    uint16_t        word16;
+
+    if (length == 0)
+        length = strlen(key);
+
+    for (; length >= 8; bytes += 8, length -= 8) {
+        memcpy(&word64, bytes, sizeof(word64));
+        crc = _mm_crc32_u64(crc, word64);
+    }
+
+    if (length & 4) {
+        memcpy(&word32, bytes, sizeof(word32));
+        crc    = _mm_crc32_u32((uint32_t)crc, word32);
+        bytes += 4;
+    }
+
+    if (length & 2) {
+        memcpy(&word16, bytes, sizeof(word16));
+        crc    = _mm_crc32_u16((uint32_t)crc, word16);
+        bytes += 2;
+    }
+
+    if (length & 1) {
+        crc = _mm_crc32_u8((uint32_t)crc, *bytes);
+    }
+
+    return ~(uint32_t)crc;
+}
+#endif
+
+/**
+ * Compute a hash sum of a fixed length or NUL terminated key using wyhash
+ *
+ * @param key    Pointer to the key
+ * @param length Length of the key in bytes or 0 to use strlen
+ *
+ * @return 32 bit hash value
+ */
+unsigned
+sxe_hash_wyhash(const void * key, unsigned length)
+{
+    return sxe_hash_wyhash_sized(key, length == 0 ? strlen(key) : length);
+}
+
+#if defined(__x86_64__)
+/* AES-NI hash: each 16 byte block is xored into a 128 bit state that then goes through an AES round; the tail is read as two
+ * overlapping words so that short keys never need a copy. Two more rounds diffuse the last block through the whole state. Not a
+ * cryptographic hash.
+ */
+__attribute__((target("sse2,aes"))) static unsigned
+sxe_hash_aes_ni(const void * key, unsigned length)
+{
+    const uint8_t * bytes = key;
+    __m128i         round = _mm_set_epi64x(0x243f6a8885a308d3LL, 0x13198a2e03707344LL);    /* Digits of pi */
+    __m128i         state;
+    uint64_t        lo;
+    uint64_t        hi;
+
+    if (length == 0)
+        length = strlen(key);
+
+    state = _mm_set_epi64x(0xa4093822299f31d0LL, (long long)length);
+
+    for (; length > 16; bytes += 16, length -= 16) {
+        state = _mm_aesenc_si128(_mm_xor_si128(state, _mm_loadu_si128((const __m128i *)bytes)), round);
+    }
+
+    if (length >= 8) {
+        lo = sxe_hash_read64(bytes);
+        hi = sxe_hash_read64(bytes + length - 8);
+    }
+    else if (length >= 4) {
+        lo = sxe_hash_read32(bytes);
+        hi = sxe_hash_read32(bytes + length - 4);
+    }
+    else {
+        lo = length ? sxe_hash_read_small(bytes, length) : 0;
+        hi = 0;
+    }
+
+    state = _mm_aesenc_si128(_mm_xor_si128(state, _mm_set_epi64x((long long)hi, (long long)lo)), round);
+    state = _mm_aesenc_si128(state, _mm_set_epi64x(0x082efa98ec4e6c89LL, 0x452821e638d01377LL));
+    state = _mm_aesenc_si128(state, round);
+    lo    = (uint64_t)_mm_cvtsi128_si64(state) ^ (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(state, state));
+    return (unsigned)(lo ^ (lo >> 32));
+}
+#endif
+
+/* Flags for the instructions the hash functions can use, from CPUID
+ */
+#define SXE_HASH_CPU_SSE42 1
+#define SXE_HASH_CPU_AES   2
+
+static unsigned
+sxe_hash_cpu_features(void)
+{
+    unsigned features = 0;
+
+#if defined(__x86_64__)
+    unsigned eax, ebx, ecx, edx;
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        features |= ecx & bit_SSE4_2 ? SXE_HASH_CPU_SSE42 : 0;
+        features |= ecx & bit_AES    ? SXE_HASH_CPU_AES   : 0;
+    }
+#endif
+
+    return features;
+}
+
+/**
+ * Get the fastest implementation of a hash function on this CPU
+ *
+ * @param function SXE_HASH_FUNCTION_LOOKUP3, _XXH32, _XXH3, _CRC32C, _WYHASH, _AES or _BEST
+ *
+ * @return A pointer to the function, or NULL if it isn't available on this CPU or in this build (xxh32 and xxh3 need libxxhash)
+ *
+ * @note SXE_HASH_FUNCTION_CRC32C uses the SSE4.2 crc32 instruction when the CPU has it and falls back to software otherwise. CRC32C
+ *       is the fastest function for short keys, but it is linear: a flipped key bit always flips the same sum bits, so it is only
+ *       a good choice for keys that are already well mixed. SXE_HASH_FUNCTION_BEST is the fastest function that avalanches well,
+ *       which is wyhash (test-sxe-hash-bench -f compares them).
+ */
+SXE_HASH_FUNC
+sxe_hash_function(SXE_HASH_FUNCTION function)
+{
+    unsigned      features = sxe_hash_cpu_features();
+    SXE_HASH_FUNC result   = NULL;
+
+    SXEE6("(function=%s)", sxe_hash_function_name(function));
+
+    switch (function) {
+    case SXE_HASH_FUNCTION_LOOKUP3:
+        result = sxe_hash_lookup3;
+        break;
+
+#ifndef SXE_DISABLE_XXHASH
+    case SXE_HASH_FUNCTION_XXH32:
+        result = sxe_hash_xxh32;
+        break;
+
+    case SXE_HASH_FUNCTION_XXH3:
+        result = sxe_hash_xxh3;
+        break;
+#endif
+
+    case SXE_HASH_FUNCTION_CRC32C:
+        result = sxe_hash_crc32c;
+#if defined(__x86_64__)
+        result = features & SXE_HASH_CPU_SSE42 ? sxe_hash_crc32c_sse42 : result;
+#endif
+        break;
+
+    case SXE_HASH_FUNCTION_BEST:
+    case SXE_HASH_FUNCTION_WYHASH:
+        result = sxe_hash_wyhash;
+        break;
+
+    case SXE_HASH_FUNCTION_AES:
+#if defined(__x86_64__)
+        result = features & SXE_HASH_CPU_AES ? sxe_hash_aes_ni : NULL;
+#endif
+        break;
+
+    default:
+        break;
+    }
+
+    SXE_UNUSED_PARAMETER(features);
+    SXER6("return %p", result);
+    return result;
+}
+
+/**
+ * Get the name of a hash function, for diagnostics
+ */
+const char *
+sxe_hash_function_name(SXE_HASH_FUNCTION function)
+{
+    return (unsigned)function < sizeof(sxe_hash_function_names) / sizeof(sxe_hash_function_names[0])
+           ? sxe_hash_function_names[function] : "unknown";
+}
@@ -0,0 +1,831 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Open addressing (Swiss table) index for sxe_hash. The elements still live in the hash's pool and are identified by their
+ * indices; the table maps keys to those indices. Each slot holds an element index and a copy of the key. Each slot also has a
+ * control byte, kept apart from the slots in groups of SXE_HASH_GROUP_SIZE, that is either empty, deleted, or the top 7 bits of
+ * the key's hash sum. A lookup matches a whole group of controls against the key's tag at once (with SSE2, where available),
+ * compares keys only in slots whose tags match, and stops at the first group with an empty slot.
+ *
+ * A resizable hash doubles its table when it would be more than 7/8 full. Rather than rehashing every element at once, it keeps
+ * the old table and migrates SXE_HASH_MIGRATE_GROUPS of its groups on each change, marking migrated slots deleted so that probes
+ * of the old table still pass through them. Until the migration finishes, lookups that miss in the new table probe the old one.
+ *
+ * Lookups in a concurrent hash take no lock. Changes are serialized by the hash's lock, and publish slots by storing their controls
+ * (a word at a time, with release semantics) after the slot is filled in. A given element's slot is marked retired rather than
+ * deleted, and neither is reused until every reader that might still see them has finished (see sxe-hash-epoch.c). Rehashing out
+ * tombstones builds a new table and publishes it, retiring the old one.
+ */
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "sxe-alloc.h"
+#include "sxe-hash-private.h"
+
+#define SXE_HASH_CONTROL_EMPTY   0x80    /* High bit set: not used. Tags are 0..0x7F     */
+#define SXE_HASH_CONTROL_DELETED 0xFE
+#define SXE_HASH_CONTROL_RETIRED 0xFF    /* Concurrent: deleted, but not yet reusable    */
+#define SXE_HASH_MIGRATE_GROUPS  8       /* Groups of the old table migrated by each change to a resizable hash */
+
+#define SXE_HASH_SLOT(hash, table, groups, slot) \
+    ((table) + (size_t)(groups) * SXE_HASH_GROUP_SIZE + (size_t)(slot) * (hash)->slot_size)
+#define SXE_HASH_SLOT_ID(slot_ptr)          (*(const unsigned *)(slot_ptr))
+#define SXE_HASH_SLOT_ID_SET(slot_ptr, id)  (*(unsigned *)(slot_ptr) = (id))
+#define SXE_HASH_SLOT_KEY(slot_ptr)         ((slot_ptr) + sizeof(unsigned))
+#define SXE_HASH_SUM_TO_TAG(sum)            ((uint8_t)((sum) >> 25))
+
+/* Copy a group of controls. Readers of concurrent hashes load them a word at a time with acquire semantics, pairing with the
+ * release stores of sxe_hash_control_set(), so that a slot's contents are visible before its tag is.
+ */
+static inline void
+sxe_hash_group_load(const SXE_HASH * hash, const uint8_t * group, uint8_t * copy)
+{
+    if (hash->options & SXE_HASH_OPTION_CONCURRENT) {
+        ((uint64_t *)copy)[0] = __atomic_load_n(&((const uint64_t *)group)[0], __ATOMIC_ACQUIRE);
+        ((uint64_t *)copy)[1] = __atomic_load_n(&((const uint64_t *)group)[1], __ATOMIC_ACQUIRE);
+    }
+    else {
+        memcpy(copy, group, SXE_HASH_GROUP_SIZE);
+    }
+}
+
+/* Return a bit mask of the controls in a group that equal a byte
+ */
+static inline unsigned
+sxe_hash_group_match(const uint8_t * group, uint8_t byte)
+{
+#ifdef __SSE2__
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)group), _mm_set1_epi8((char)byte)));
+#else
+    unsigned bits = 0;
+    unsigned i;
+
+    for (i = 0; i < SXE_HASH_GROUP_SIZE; i++) {
+        bits |= (unsigned)(group[i] == byte) << i;
+    }
+
+    return bits;
+#endif
+}
+
+/* Return a bit mask of the used controls (tags) in a group
+ */
+static inline unsigned
+sxe_hash_group_match_used(const uint8_t * group)
+{
+#ifdef __SSE2__
+    return ~(unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group)) & 0xFFFF;
+#else
+    unsigned bits = 0;
+    unsigned i;
+
+    for (i = 0; i < SXE_HASH_GROUP_SIZE; i++) {
+        bits |= (unsigned)(group[i] < SXE_HASH_CONTROL_EMPTY) << i;
+    }
+
+    return bits;
+#endif
+}
+
+/* Return a bit mask of the controls in a group whose slots can be filled: empty or deleted, but not retired
+ */
+static inline unsigned
+sxe_hash_group_match_free(const uint8_t * group)
+{
+    return sxe_hash_group_match(group, SXE_HASH_CONTROL_EMPTY) | sxe_hash_group_match(group, SXE_HASH_CONTROL_DELETED);
+}
+
+/* Set a control. In a concurrent hash, the containing word is stored with release semantics; only the writer holding the lock
+ * changes controls, so the read of the word needs no atomicity.
+ */
+static inline void
+sxe_hash_control_set(const SXE_HASH * hash, uint8_t * table, unsigned slot, uint8_t control)
+{
+    uint64_t word;
+
+    if (hash->options & SXE_HASH_OPTION_CONCURRENT) {
+        word                     = ((uint64_t *)table)[slot / sizeof(uint64_t)];
+        ((uint8_t *)&word)[slot % sizeof(uint64_t)] = control;
+        __atomic_store_n(&((uint64_t *)table)[slot / sizeof(uint64_t)], word, __ATOMIC_RELEASE);
+    }
+    else {
+        table[slot] = control;
+    }
+}
+
+static unsigned
+sxe_hash_open_groups(unsigned element_count)
+{
+    unsigned slots  = element_count + element_count / 7 + 1;    /* Keep the load at or below 7/8 */
+    unsigned groups = 1;
+
+    while (groups * SXE_HASH_GROUP_SIZE < slots) {
+        groups *= 2;
+    }
+
+    return groups;
+}
+
+static unsigned
+sxe_hash_open_slot_size(unsigned key_size)
+{
+    return sizeof(unsigned) + ((key_size + sizeof(unsigned) - 1) & ~(sizeof(unsigned) - 1));
+}
+
+static size_t
+sxe_hash_open_groups_size(unsigned groups, unsigned key_size)
+{
+    size_t slots = (size_t)groups * SXE_HASH_GROUP_SIZE;
+
+    return slots + slots * sxe_hash_open_slot_size(key_size);
+}
+
+/**
+ * Compute the size of the open addressing table of a fixed size hash
+ *
+ * @param element_count = Maximum number of elements in the hash
+ * @param key_size      = Size of the key in bytes
+ *
+ * @return Size in bytes of the control groups and the slots
+ */
+size_t
+sxe_hash_open_table_size(unsigned element_count, unsigned key_size)
+{
+    return sxe_hash_open_groups_size(sxe_hash_open_groups(element_count), key_size);
+}
+
+/* Tables of resizable hashes are allocated separately from the hash, with its memory options
+ */
+static uint8_t *
+sxe_hash_open_table_new(SXE_HASH * hash, unsigned groups)
+{
+    size_t    size = sxe_hash_open_groups_size(groups, hash->key_size);
+    uint8_t * table;
+
+    if (hash->options & SXE_POOL_OPTIONS_MEMORY) {
+        SXEA1((table = sxe_pool_memory_map(size, hash->options & SXE_POOL_OPTIONS_MEMORY, false)) != NULL,
+              "Unable to map %zu bytes of memory for the table of hash %s", size, sxe_pool_get_name(hash->pool));
+    }
+    else {
+        SXEA1((table = sxe_malloc(size)) != NULL, "Unable to allocate %zu bytes of memory for the table of hash %s", size,
+              sxe_pool_get_name(hash->pool));
+    }
+
+    memset(table, SXE_HASH_CONTROL_EMPTY, (size_t)groups * SXE_HASH_GROUP_SIZE);
+    return table;
+}
+
+static void
+sxe_hash_open_table_delete(SXE_HASH * hash, uint8_t * table, unsigned groups)
+{
+    if (hash->options & SXE_POOL_OPTIONS_MEMORY) {
+        sxe_pool_memory_unmap(table, sxe_hash_open_groups_size(groups, hash->key_size), hash->options & SXE_POOL_OPTIONS_MEMORY);
+    }
+    else {
+        sxe_free(table);
+    }
+}
+
+/**
+ * Construct the (empty) open addressing table of a hash; called by sxe_hash_new_plus(), sxe_hash_new_resizable() and
+ * sxe_hash_reconstruct()
+ *
+ * @param hash  = Pointer to the hash
+ * @param table = Pointer to the memory for the table, or NULL to allocate it (resizable hashes)
+ */
+void
+sxe_hash_open_construct(SXE_HASH * hash, uint8_t * table)
+{
+    hash->groups         = sxe_hash_open_groups(hash->options & SXE_HASH_OPTION_RESIZABLE ? hash->segment : hash->count);
+    hash->slot_size      = sxe_hash_open_slot_size(hash->key_size);
+    hash->table          = table != NULL ? table : sxe_hash_open_table_new(hash, hash->groups);
+    hash->empty          = hash->groups * SXE_HASH_GROUP_SIZE;
+    hash->deleted        = 0;
+    hash->old_table      = NULL;
+    hash->old_groups     = 0;
+    hash->migrated       = 0;
+    hash->retire_epoch   = 0;
+    hash->retired_tables = NULL;
+    sxe_spinlock_construct(&hash->lock);
+
+    if (table != NULL) {
+        memset(table, SXE_HASH_CONTROL_EMPTY, (size_t)hash->groups * SXE_HASH_GROUP_SIZE);
+    }
+}
+
+/**
+ * Free the separately allocated tables of a resizable or concurrent hash; called by sxe_hash_delete() and sxe_hash_reconstruct()
+ */
+void
+sxe_hash_open_destruct(SXE_HASH * hash)
+{
+    SXE_HASH_RETIRED_TABLE * retired;
+
+    if (!(hash->options & (SXE_HASH_OPTION_RESIZABLE | SXE_HASH_OPTION_CONCURRENT))) {
+        return;
+    }
+
+    sxe_hash_open_table_delete(hash, hash->table, hash->groups);
+
+    if (hash->old_table != NULL) {
+        sxe_hash_open_table_delete(hash, hash->old_table, hash->old_groups);
+    }
+
+    while ((retired = hash->retired_tables) != NULL) {
+        hash->retired_tables = retired->next;
+        sxe_hash_open_table_delete(hash, retired->table, retired->groups);
+        sxe_free(retired);
+    }
+}
+
+/**
+ * Relocate the open addressing table of a hash mapped or copied from another process; called by sxe_hash_relocate()
+ *
+ * @param hash  = Pointer to the hash
+ * @param table = Pointer to the table, if it is part of the hash's memory, or NULL
+ * @param copy  = Pointer to a copy of a separately allocated table (concurrent hashes) to allocate and fill the table from, or NULL
+ *
+ * @note Tables retired by a concurrent hash are not kept, and nothing in this process can be reading its retired elements, so they
+ *       can be reclaimed at once
+ */
+void
+sxe_hash_open_relocate(SXE_HASH * hash, uint8_t * table, const uint8_t * copy)
+{
+    if (copy != NULL) {
+        table = sxe_hash_open_table_new(hash, hash->groups);
+        memcpy(table, copy, sxe_hash_open_groups_size(hash->groups, hash->key_size));
+    }
+
+    hash->table          = table;
+    hash->old_table      = NULL;
+    hash->old_groups     = 0;
+    hash->migrated       = 0;
+    hash->retire_epoch   = 0;
+    hash->retired_tables = NULL;
+    sxe_spinlock_construct(&hash->lock);
+}
+
+static inline void
+sxe_hash_open_lock(SXE_HASH * hash, bool reader)
+{
+    SXE_SPINLOCK_STATUS status;
+
+    if (!(hash->options & SXE_HASH_OPTION_LOCKED)) {
+        return;
+    }
+
+    status = reader ? sxe_spinlock_take_read(&hash->lock) : sxe_spinlock_take(&hash->lock);
+    SXEA1(status == SXE_SPINLOCK_STATUS_TAKEN, "Failed to take the lock of hash %s", sxe_pool_get_name(hash->pool));
+}
+
+static inline void
+sxe_hash_open_unlock(SXE_HASH * hash, bool reader)
+{
+    if (!(hash->options & SXE_HASH_OPTION_LOCKED)) {
+        return;
+    }
+
+    if (reader) {
+        sxe_spinlock_give_read(&hash->lock);
+    }
+    else {
+        sxe_spinlock_give(&hash->lock);
+    }
+}
+
+/* Find the slot of a key with a given hash sum in a table, or of a specific element if id is not SXE_HASH_KEY_NOT_FOUND, among the
+ * used slots or, if retired is true, among the retired slots. Inlined into lookups specialized for a key size.
+ */
+static inline __attribute__((always_inline)) unsigned
+sxe_hash_open_find_sized(SXE_HASH * hash, const uint8_t * table, unsigned groups, const void * key, unsigned sum, unsigned id,
+                         bool retired, unsigned key_size)
+{
+    uint8_t         match = retired ? SXE_HASH_CONTROL_RETIRED : SXE_HASH_SUM_TO_TAG(sum);
+    unsigned        mask  = groups - 1;
+    unsigned        group = sum & mask;
+    unsigned        probe;
+    unsigned        bits;
+    unsigned        slot;
+    const uint8_t * slot_ptr;
+    uint8_t         controls[SXE_HASH_GROUP_SIZE] __attribute__((aligned(SXE_HASH_GROUP_SIZE)));
+
+    for (probe = 1; probe <= groups; probe++) {
+        sxe_hash_group_load(hash, &table[group * SXE_HASH_GROUP_SIZE], controls);
+
+        for (bits = sxe_hash_group_match(controls, match); bits != 0; bits &= bits - 1) {
+            slot     = group * SXE_HASH_GROUP_SIZE + __builtin_ctz(bits);
+            slot_ptr = SXE_HASH_SLOT(hash, table, groups, slot);
+
+            if (id == SXE_HASH_KEY_NOT_FOUND ? sxe_hash_key_equal(SXE_HASH_SLOT_KEY(slot_ptr), key, key_size)
+                                             : SXE_HASH_SLOT_ID(slot_ptr) == id) {
+                return slot;
+            }
+        }
+
+        if (sxe_hash_group_match(controls, SXE_HASH_CONTROL_EMPTY) != 0) {
+            break;
+        }
+
+        group = (group + probe) & mask;
+    }
+
+    return SXE_HASH_KEY_NOT_FOUND;
+}
+
+static unsigned
+sxe_hash_open_find_sum(SXE_HASH * hash, const uint8_t * table, unsigned groups, const void * key, unsigned sum, unsigned id,
+                       bool retired)
+{
+    return sxe_hash_open_find_sized(hash, table, groups, key, sum, id, retired, hash->key_size);
+}
+
+static unsigned
+sxe_hash_open_find(SXE_HASH * hash, const uint8_t * table, unsigned groups, const void * key, unsigned id, bool retired)
+{
+    return sxe_hash_open_find_sum(hash, table, groups, key, hash->hash_key(key, hash->key_size), id, retired);
+}
+
+/* Put a key and element index in the first free slot in the key's probe sequence in a table of hash->groups groups: the current
+ * table, or one being built by a rehash. Groups are probed triangularly, which visits every group when the number of groups is a
+ * power of 2. Retired slots are copied when a concurrent hash is rehashed.
+ */
+static void
+sxe_hash_open_insert(SXE_HASH * hash, uint8_t * table, const void * key, unsigned id, bool retired)
+{
+    uint8_t * controls = table;
+    unsigned  sum      = hash->hash_key(key, hash->key_size);
+    unsigned  mask     = hash->groups - 1;
+    unsigned  group    = sum & mask;
+    unsigned  probe;
+    unsigned  bits;
+    unsigned  slot;
+    uint8_t * slot_ptr;
+
+    for (probe = 1; (bits = sxe_hash_group_match_free(&controls[group * SXE_HASH_GROUP_SIZE])) == 0; probe++) {
+        SXEA6(probe <= hash->groups, "Open addressing table of hash %s has no free slots", sxe_pool_get_name(hash->pool));
+        group = (group + probe) & mask;
+    }
+
+    slot = group * SXE_HASH_GROUP_SIZE + __builtin_ctz(bits);
+
+    if (controls[slot] == SXE_HASH_CONTROL_EMPTY) {
+        hash->empty--;
+    }
+    else {
+        hash->deleted--;
+    }
+
+    slot_ptr = SXE_HASH_SLOT(hash, table, hash->groups, slot);
+    SXE_HASH_SLOT_ID_SET(slot_ptr, id);
+    memcpy(SXE_HASH_SLOT_KEY(slot_ptr), key, hash->key_size);
+    sxe_hash_control_set(hash, controls, slot, retired ? SXE_HASH_CONTROL_RETIRED : SXE_HASH_SUM_TO_TAG(sum));
+}
+
+/* Migrate up to <count> groups of the old table into the current one, and free the old table once they are all migrated. Concurrent
+ * hashes never have an old table; the tables they retire are freed by sxe_hash_open_reclaim().
+ */
+static void
+sxe_hash_open_migrate(SXE_HASH * hash, unsigned count)
+{
+    const uint8_t * slot_ptr;
+    unsigned        slot;
+    unsigned        bits;
+
+    if (hash->options & SXE_HASH_OPTION_CONCURRENT) {
+        return;
+    }
+
+    for (; count > 0 && hash->migrated < hash->old_groups; count--, hash->migrated++) {
+        slot = hash->migrated * SXE_HASH_GROUP_SIZE;
+
+        for (bits = sxe_hash_group_match_used(&hash->old_table[slot]); bits != 0; bits &= bits - 1) {
+            slot_ptr = SXE_HASH_SLOT(hash, hash->old_table, hash->old_groups, slot + __builtin_ctz(bits));
+            sxe_hash_open_insert(hash, hash->table, SXE_HASH_SLOT_KEY(slot_ptr), SXE_HASH_SLOT_ID(slot_ptr), false);
+            hash->old_table[slot + __builtin_ctz(bits)] = SXE_HASH_CONTROL_DELETED;
+        }
+    }
+
+    if (hash->old_table != NULL && hash->migrated == hash->old_groups) {
+        SXEL6("Finished migrating %u groups of hash %s", hash->old_groups, sxe_pool_get_name(hash->pool));
+        sxe_hash_open_table_delete(hash, hash->old_table, hash->old_groups);
+        hash->old_table  = NULL;
+        hash->old_groups = 0;
+        hash->migrated   = 0;
+    }
+}
+
+/* Double the table of a resizable hash; the old table's elements are migrated by subsequent changes
+ */
+static void
+sxe_hash_open_grow(SXE_HASH * hash)
+{
+    sxe_hash_open_migrate(hash, ~0U);    /* Finish any migration still in progress */
+    SXEL6("Growing hash %s from %u to %u groups", sxe_pool_get_name(hash->pool), hash->groups, 2 * hash->groups);
+    hash->old_table  = hash->table;
+    hash->old_groups = hash->groups;
+    hash->migrated   = 0;
+    hash->groups     = 2 * hash->groups;
+    hash->table      = sxe_hash_open_table_new(hash, hash->groups);
+    hash->empty      = hash->groups * SXE_HASH_GROUP_SIZE;
+    hash->deleted    = 0;
+}
+
+/* Rebuild the table to clear out tombstones; lookups of missing keys stop only at empty slots. A concurrent hash builds a new
+ * table from the current one and only then publishes it, retiring the current one, since readers may be probing it. It never
+ * waits for readers, so there may be several retired tables waiting to be freed.
+ */
+static void
+sxe_hash_open_rehash(SXE_HASH * hash)
+{
+    SXE_POOL_WALKER          walker;
+    SXE_HASH_RETIRED_TABLE * retired;
+    uint8_t                * table = hash->table;
+    uint8_t                * new_table;
+    const uint8_t          * slot_ptr;
+    unsigned                 slot;
+    unsigned                 id;
+
+    sxe_hash_open_migrate(hash, ~0U);    /* Every used element must be in the current table */
+    SXEL6("Rehashing open addressing hash %s to clear %u deleted slots", sxe_pool_get_name(hash->pool), hash->deleted);
+    hash->empty   = hash->groups * SXE_HASH_GROUP_SIZE;
+    hash->deleted = 0;
+
+    if (!(hash->options & SXE_HASH_OPTION_CONCURRENT)) {
+        memset(table, SXE_HASH_CONTROL_EMPTY, (size_t)hash->groups * SXE_HASH_GROUP_SIZE);
+        sxe_pool_walker_construct(&walker, hash->pool, SXE_HASH_OPEN_USED);
+
+        while ((id = sxe_pool_walker_step(&walker)) != SXE_POOL_NO_INDEX) {
+            sxe_hash_open_insert(hash, table, SXE_HASH_ELEMENT_KEY(hash, id), id, false);
+        }
+
+        return;
+    }
+
+    SXEA1((retired = sxe_malloc(sizeof(*retired))) != NULL, "Hash %s: failed to allocate a retired table record",
+          sxe_pool_get_name(hash->pool));
+    new_table = sxe_hash_open_table_new(hash, hash->groups);    /* Not visible to readers until every slot is copied */
+
+    for (slot = 0; slot < hash->groups * SXE_HASH_GROUP_SIZE; slot++) {
+        if (table[slot] < SXE_HASH_CONTROL_EMPTY || table[slot] == SXE_HASH_CONTROL_RETIRED) {
+            slot_ptr = SXE_HASH_SLOT(hash, table, hash->groups, slot);
+            sxe_hash_open_insert(hash, new_table, SXE_HASH_SLOT_KEY(slot_ptr), SXE_HASH_SLOT_ID(slot_ptr),
+                                 table[slot] == SXE_HASH_CONTROL_RETIRED);
+        }
+    }
+
+    __atomic_store_n(&hash->table, new_table, __ATOMIC_RELEASE);    /* Publish; the slots were filled before */
+    retired->table       = table;
+    retired->groups      = hash->groups;
+    retired->epoch       = sxe_hash_epoch_advance();
+    retired->next        = hash->retired_tables;
+    hash->retired_tables = retired;
+}
+
+/* Reclaim what a concurrent hash has retired that no reader can still see: tables replaced by rehashes, deleted slots, and the
+ * elements that were in them. The caller holds the write lock, so this never waits for readers, who may be waiting for the lock.
+ *
+ * @return true if anything was reclaimed
+ */
+static bool
+sxe_hash_open_reclaim(SXE_HASH * hash)
+{
+    SXE_HASH_RETIRED_TABLE ** link;
+    SXE_HASH_RETIRED_TABLE  * retired;
+    SXE_POOL_WALKER           walker;
+    unsigned                  slot;
+    unsigned                  id;
+    bool                      reclaimed = false;
+
+    for (link = &hash->retired_tables; (retired = *link) != NULL; ) {
+        if (!sxe_hash_epoch_is_quiescent(retired->epoch)) {
+            link = &retired->next;
+            continue;
+        }
+
+        *link = retired->next;
+        sxe_hash_open_table_delete(hash, retired->table, retired->groups);
+        sxe_free(retired);
+        reclaimed = true;
+    }
+
+    if (sxe_pool_get_number_in_state(hash->pool, SXE_HASH_OPEN_RETIRED) == 0 || !sxe_hash_epoch_is_quiescent(hash->retire_epoch)) {
+        return reclaimed;
+    }
+
+    sxe_pool_walker_construct(&walker, hash->pool, SXE_HASH_OPEN_RETIRED);
+
+    while ((id = sxe_pool_walker_step(&walker)) != SXE_POOL_NO_INDEX) {
+        slot = sxe_hash_open_find(hash, hash->table, hash->groups, SXE_HASH_ELEMENT_KEY(hash, id), id, true);
+        SXEA1(slot != SXE_HASH_KEY_NOT_FOUND, "Retired element %u of hash %s is not in its table", id,
+              sxe_pool_get_name(hash->pool));
+
+        /* If the slot's group has an empty slot, no probe ever continued past it, so the slot can be made empty too.
+         */
+        if (sxe_hash_group_match(&hash->table[slot & ~(SXE_HASH_GROUP_SIZE - 1)], SXE_HASH_CONTROL_EMPTY) != 0) {
+            sxe_hash_control_set(hash, hash->table, slot, SXE_HASH_CONTROL_EMPTY);
+            hash->empty++;
+        }
+        else {
+            sxe_hash_control_set(hash, hash->table, slot, SXE_HASH_CONTROL_DELETED);
+            hash->deleted++;
+        }
+    }
+
+    sxe_pool_set_all_elements_state(hash->pool, SXE_HASH_OPEN_RETIRED, SXE_HASH_UNUSED_BUCKET);
+    return true;
+}
+
+/* Look for a key in the current table, which the caller has loaded (concurrent hashes) or locked, and in the old table of a
+ * resizable hash that is being migrated
+ */
+static unsigned
+sxe_hash_open_look_sum(SXE_HASH * hash, const uint8_t * table, const void * key, unsigned sum)
+{
+    unsigned slot;
+
+    if ((slot = sxe_hash_open_find_sum(hash, table, hash->groups, key, sum, SXE_HASH_KEY_NOT_FOUND, false)) != SXE_HASH_KEY_NOT_FOUND) {
+        return SXE_HASH_SLOT_ID(SXE_HASH_SLOT(hash, table, hash->groups, slot));
+    }
+
+    if (!(hash->options & SXE_HASH_OPTION_CONCURRENT) && hash->old_table != NULL
+     && (slot = sxe_hash_open_find_sum(hash, hash->old_table, hash->old_groups, key, sum, SXE_HASH_KEY_NOT_FOUND, false))
+        != SXE_HASH_KEY_NOT_FOUND) {
+        return SXE_HASH_SLOT_ID(SXE_HASH_SLOT(hash, hash->old_table, hash->old_groups, slot));
+    }
+
+    return SXE_HASH_KEY_NOT_FOUND;
+}
+
+/* Start and end a lookup: a read section in a concurrent hash, otherwise a read lock if the hash is locked
+ */
+static inline const uint8_t *
+sxe_hash_open_look_begin(SXE_HASH * hash)
+{
+    if (hash->options & SXE_HASH_OPTION_CONCURRENT) {
+        sxe_hash_reader_enter();
+        return __atomic_load_n(&hash->table, __ATOMIC_ACQUIRE);
+    }
+
+    sxe_hash_open_lock(hash, true);
+    return hash->table;
+}
+
+static inline void
+sxe_hash_open_look_end(SXE_HASH * hash)
+{
+    if (hash->options & SXE_HASH_OPTION_CONCURRENT) {
+        sxe_hash_reader_exit();
+    }
+    else {
+        sxe_hash_open_unlock(hash, true);
+    }
+}
+
+/* Define sxe_hash_open_look_<SIZE>(), a lookup specialized for keys of SIZE bytes. The sum is inlined where possible and keys are
+ * compared as integers or vectors. Only the current table is probed inline; a miss while a resizable hash is being migrated falls
+ * back to sxe_hash_open_look_sum().
+ */
+#define SXE_HASH_OPEN_LOOK_SIZED(SIZE)                                                                                            \
+    static unsigned                                                                                                               \
+    sxe_hash_open_look_##SIZE(SXE_HASH * hash, const void * key)                                                                  \
+    {                                                                                                                             \
+        unsigned        sum   = sxe_hash_sum_sized(hash, key, SIZE);                                                              \
+        const uint8_t * table = sxe_hash_open_look_begin(hash);                                                                   \
+        unsigned        id    = SXE_HASH_KEY_NOT_FOUND;                                                                           \
+        unsigned        slot;                                                                                                     \
+                                                                                                                                  \
+        if ((slot = sxe_hash_open_find_sized(hash, table, hash->groups, key, sum, SXE_HASH_KEY_NOT_FOUND, false, SIZE))           \
+            != SXE_HASH_KEY_NOT_FOUND) {                                                                                          \
+            id = SXE_HASH_SLOT_ID(SXE_HASH_SLOT(hash, table, hash->groups, slot));                                                \
+        }                                                                                                                         \
+        else if (!(hash->options & SXE_HASH_OPTION_CONCURRENT) && hash->old_table != NULL) {                                      \
+            id = sxe_hash_open_look_sum(hash, table, key, sum);                                                                   \
+        }                                                                                                                         \
+                                                                                                                                  \
+        sxe_hash_open_look_end(hash);                                                                                             \
+        return id;                                                                                                                \
+    }
+
+SXE_HASH_FIXED_KEY_SIZES(SXE_HASH_OPEN_LOOK_SIZED);
+
+#define SXE_HASH_OPEN_LOOK_CASE(SIZE) case SIZE: return sxe_hash_open_look_##SIZE(hash, key);
+
+/**
+ * Look for a key in an open addressing hash; called by sxe_hash_look()
+ *
+ * @return Index of the element found or SXE_HASH_KEY_NOT_FOUND
+ *
+ * @note Keys of 4, 8, 16 and 20 bytes (IPv4 and IPv6 addresses, 64 bit ids and SHA1s) are looked up by specialized code
+ */
+unsigned
+sxe_hash_open_look(SXE_HASH * hash, const void * key)
+{
+    const uint8_t * table;
+    unsigned        sum;
+    unsigned        id;
+
+    switch (hash->key_size) {
+    SXE_HASH_FIXED_KEY_SIZES(SXE_HASH_OPEN_LOOK_CASE)
+    }
+
+    sum   = hash->hash_key(key, hash->key_size);
+    table = sxe_hash_open_look_begin(hash);
+    id    = sxe_hash_open_look_sum(hash, table, key, sum);
+    sxe_hash_open_look_end(hash);
+    return id;
+}
+
+/**
+ * Look for a batch of keys in an open addressing hash, given their hash sums; called by sxe_hash_look_batch()
+ *
+ * @param keys  = Array of count keys, each hash->key_size bytes
+ * @param sums  = Array of the keys' hash sums
+ * @param count = Number of keys
+ * @param skip  = Array of flags set for keys not to look for (rejected by the hash's filter), or NULL
+ * @param ids   = Array in which to return the index of each element found, or SXE_HASH_KEY_NOT_FOUND
+ *
+ * @note The control group of every key is prefetched, then the slot of the first tag that matches in each group, so that the
+ *       cache misses of the batch overlap rather than being taken one after another.
+ */
+void
+sxe_hash_open_look_batch(SXE_HASH * hash, const uint8_t * keys, const unsigned * sums, unsigned count, const bool * skip,
+                         unsigned * ids)
+{
+    const uint8_t * table = sxe_hash_open_look_begin(hash);
+    unsigned        mask  = hash->groups - 1;
+    unsigned        group;
+    unsigned        bits;
+    unsigned        i;
+    uint8_t         controls[SXE_HASH_GROUP_SIZE] __attribute__((aligned(SXE_HASH_GROUP_SIZE)));
+
+    for (i = 0; i < count; i++) {
+        if (skip == NULL || !skip[i]) {
+            __builtin_prefetch(&table[(sums[i] & mask) * SXE_HASH_GROUP_SIZE]);
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (skip != NULL && skip[i]) {
+            continue;
+        }
+
+        group = sums[i] & mask;
+        sxe_hash_group_load(hash, &table[group * SXE_HASH_GROUP_SIZE], controls);
+
+        if ((bits = sxe_hash_group_match(controls, SXE_HASH_SUM_TO_TAG(sums[i]))) != 0) {
+            __builtin_prefetch(SXE_HASH_SLOT(hash, table, hash->groups, group * SXE_HASH_GROUP_SIZE + __builtin_ctz(bits)));
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        ids[i] = skip != NULL && skip[i] ? SXE_HASH_KEY_NOT_FOUND
+                                         : sxe_hash_open_look_sum(hash, table, keys + (size_t)i * hash->key_size, sums[i]);
+    }
+
+    sxe_hash_open_look_end(hash);
+}
+
+/**
+ * Add an element taken with sxe_hash_take() to an open addressing hash; called by sxe_hash_add()
+ */
+void
+sxe_hash_open_add(SXE_HASH * hash, unsigned id)
+{
+    unsigned used;
+
+    sxe_hash_open_lock(hash, false);
+    used = sxe_pool_get_number_in_state(hash->pool, SXE_HASH_OPEN_USED) + 1;    /* Including the new element */
+
+    if (hash->options & SXE_HASH_OPTION_RESIZABLE) {
+        if (used > hash->groups * SXE_HASH_GROUP_SIZE / 8 * 7 && hash->groups < sxe_hash_open_groups(hash->count)) {
+            sxe_hash_open_grow(hash);
+        }
+
+        sxe_hash_open_migrate(hash, SXE_HASH_MIGRATE_GROUPS);
+    }
+    else if (hash->options & SXE_HASH_OPTION_CONCURRENT) {
+        sxe_hash_open_reclaim(hash);
+    }
+
+    /* Keep at least 1/16th of the slots empty. At most 7/8ths are ever used, so a rehash always frees at least 1/16th.
+     */
+    if (hash->empty <= hash->groups * SXE_HASH_GROUP_SIZE / 16) {
+        sxe_hash_open_rehash(hash);
+    }
+
+    sxe_hash_open_insert(hash, hash->table, SXE_HASH_ELEMENT_KEY(hash, id), id, false);
+    sxe_pool_set_indexed_element_state(hash->pool, id, SXE_HASH_NEW_BUCKET, SXE_HASH_OPEN_USED);
+    sxe_hash_open_unlock(hash, false);
+}
+
+/**
+ * Give an element back to an open addressing hash, removing it from the table if it was added; called by sxe_hash_give()
+ *
+ * @note In a concurrent hash, the element isn't reused until no reader can still be looking at it
+ */
+void
+sxe_hash_open_give(SXE_HASH * hash, unsigned id)
+{
+    unsigned state;
+    unsigned slot;
+    unsigned new_state = SXE_HASH_UNUSED_BUCKET;
+
+    sxe_hash_open_lock(hash, false);
+    state = sxe_pool_index_to_state(hash->pool, id);
+
+    if (state == SXE_HASH_OPEN_USED) {
+        if ((slot = sxe_hash_open_find(hash, hash->table, hash->groups, SXE_HASH_ELEMENT_KEY(hash, id), id, false))
+            != SXE_HASH_KEY_NOT_FOUND) {
+            if (hash->options & SXE_HASH_OPTION_CONCURRENT) {
+                sxe_hash_control_set(hash, hash->table, slot, SXE_HASH_CONTROL_RETIRED);
+                new_state = SXE_HASH_OPEN_RETIRED;
+            }
+
+            /* If the slot's group has an empty slot, no probe ever continued past it, so the slot can be made empty too.
+             */
+            else if (sxe_hash_group_match(&hash->table[slot & ~(SXE_HASH_GROUP_SIZE - 1)], SXE_HASH_CONTROL_EMPTY) != 0) {
+                hash->table[slot] = SXE_HASH_CONTROL_EMPTY;
+                hash->empty++;
+            }
+            else {
+                hash->table[slot] = SXE_HASH_CONTROL_DELETED;
+                hash->deleted++;
+            }
+        }
+        else {
+            SXEA1(hash->old_table != NULL
+                  && (slot = sxe_hash_open_find(hash, hash->old_table, hash->old_groups, SXE_HASH_ELEMENT_KEY(hash, id), id,
+                                                false)) != SXE_HASH_KEY_NOT_FOUND,
+                  "Element %u of hash %s is not in its table", id, sxe_pool_get_name(hash->pool));
+            hash->old_table[slot] = SXE_HASH_CONTROL_DELETED;    /* The old table is only probed until it is freed */
+        }
+    }
+
+    sxe_pool_set_indexed_element_state(hash->pool, id, state, new_state);
+
+    if (new_state == SXE_HASH_OPEN_RETIRED) {
+        hash->retire_epoch = sxe_hash_epoch_advance();
+        sxe_hash_open_reclaim(hash);
+    }
+    else if (hash->old_table != NULL) {
+        sxe_hash_open_migrate(hash, SXE_HASH_MIGRATE_GROUPS);
+    }
+
+    sxe_hash_open_unlock(hash, false);
+}
+
+/**
+ * Reclaim the elements given to a concurrent hash once no reader can still see them, waiting for readers if need be; called by
+ * sxe_hash_take() when the hash is full
+ *
+ * @return true if anything was reclaimed
+ *
+ * @note The wait is done without the hash's lock, so that readers waiting for it can finish. The calling thread's own read section
+ *       would never end, so it must not be in one.
+ */
+bool
+sxe_hash_open_reclaim_wait(SXE_HASH * hash)
+{
+    uint64_t retire_epoch;
+    bool     reclaimed;
+
+    SXEA1(sxe_hash_reader == NULL || sxe_hash_reader->depth == 0, "Hash %s: can't wait for readers from within a read section",
+          sxe_pool_get_name(hash->pool));
+    sxe_hash_open_lock(hash, false);
+
+    while (!(reclaimed = sxe_hash_open_reclaim(hash)) && sxe_pool_get_number_in_state(hash->pool, SXE_HASH_OPEN_RETIRED) > 0) {
+        retire_epoch = hash->retire_epoch;
+        sxe_hash_open_unlock(hash, false);
+
+        while (!sxe_hash_epoch_is_quiescent(retire_epoch)) {
+            SXE_YIELD();
+        }
+
+        sxe_hash_open_lock(hash, false);
+    }
+
+    sxe_hash_open_unlock(hash, false);
+    return reclaimed;
+}
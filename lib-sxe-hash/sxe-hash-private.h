@@ -19,6 +19,262 @@
  * THE SOFTWARE.
  */
 
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "sxe-hash.h"
 
 #define SXE_HASH_ARRAY_TO_IMPL(array) ((SXE_HASH *)sxe_pool_to_base(array) - 1)
+#define SXE_HASH_ELEMENT_KEY(hash, id) ((uint8_t *)(hash)->pool + (size_t)(id) * (hash)->size + (hash)->key_offset)
+
+#define SXE_HASH_UNUSED_BUCKET    0
+#define SXE_HASH_NEW_BUCKET       1
+#define SXE_HASH_BUCKETS_RESERVED 2
+
+/* Open addressing hashes have no buckets; elements in the table are in a single state
+ */
+#define SXE_HASH_OPEN_USED        2
+#define SXE_HASH_OPEN_RETIRED     3    /* Concurrent: given, but readers may still see it */
+#define SXE_HASH_OPEN_STATES      4
+
+#define SXE_HASH_ALIGN_TABLE(offset) (((offset) + 63) & ~(size_t)63)    /* Control groups start on a cache line */
+
+extern uint64_t                  sxe_hash_epoch;     /* Current epoch; starts at 1 so that 0 means not reading */
+extern SXE_HASH_READER           sxe_hash_readers[SXE_HASH_READERS_MAX];
+extern __thread SXE_HASH_READER * sxe_hash_reader;   /* This thread's record, or NULL if it hasn't read yet    */
+
+/* Start a read section. The announcement must be visible before any of the hash is read, hence the full fence.
+ */
+static inline void
+sxe_hash_reader_enter(void)
+{
+    SXE_HASH_READER * reader = sxe_hash_reader != NULL ? sxe_hash_reader : sxe_hash_reader_register();
+
+    if (reader->depth++ == 0) {
+        __atomic_store_n(&reader->epoch, __atomic_load_n(&sxe_hash_epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+static inline void
+sxe_hash_reader_exit(void)
+{
+    if (--sxe_hash_reader->depth == 0) {
+        __atomic_store_n(&sxe_hash_reader->epoch, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/* Determine whether an element has been added to a hash (rather than being free, taken or, in a concurrent hash, retired)
+ */
+static inline bool
+sxe_hash_element_is_used(SXE_HASH * hash, unsigned id)
+{
+    unsigned state = sxe_pool_index_to_state(hash->pool, id);
+
+    return hash->options & SXE_HASH_OPTION_OPEN_ADDRESSING ? state == SXE_HASH_OPEN_USED : state >= SXE_HASH_BUCKETS_RESERVED;
+}
+
+/* Count a lookup in a hash in cache mode and mark the element found, if any, as referenced. The flag is only written if it isn't
+ * already set, so hits on hot elements don't keep dirtying the flags' cache line. Lookups take no lock, so the counters are
+ * updated without a locked instruction, and concurrent lookups may lose counts.
+ */
+static inline void
+sxe_hash_cache_look(SXE_HASH_CACHE * cache, unsigned id)
+{
+    if (id == SXE_HASH_KEY_NOT_FOUND) {
+        __atomic_store_n(&cache->misses, __atomic_load_n(&cache->misses, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_store_n(&cache->hits, __atomic_load_n(&cache->hits, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+
+    if (!(__atomic_load_n(&cache->flags[id], __ATOMIC_RELAXED) & SXE_HASH_CACHE_REFERENCED)) {
+        __atomic_fetch_or(&cache->flags[id], SXE_HASH_CACHE_REFERENCED, __ATOMIC_RELAXED);
+    }
+}
+
+/* wyhash (final version 4, by Wang Yi; public domain) with its default secret and a seed of 0, folded to 32 bits
+ */
+static const uint64_t sxe_hash_wyhash_secret[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL,
+                                                   0x4d5a2da51de1aa47ULL};
+
+static inline void
+sxe_hash_wymum(uint64_t * a, uint64_t * b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t product = (__uint128_t)*a * *b;
+
+    *a = (uint64_t)product;
+    *b = (uint64_t)(product >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl, lo, hi;
+
+    lo  = t + (rm1 << 32);
+    c  += lo < t;
+    hi  = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    *a  = lo;
+    *b  = hi;
+#endif
+}
+
+static inline uint64_t
+sxe_hash_wymix(uint64_t a, uint64_t b)
+{
+    sxe_hash_wymum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t
+sxe_hash_read64(const uint8_t * bytes)
+{
+    uint64_t word;
+
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+static inline uint64_t
+sxe_hash_read32(const uint8_t * bytes)
+{
+    uint32_t word;
+
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+/* Read 1 to 3 bytes into a word
+ */
+static inline uint64_t
+sxe_hash_read_small(const uint8_t * bytes, unsigned length)
+{
+    return ((uint64_t)bytes[0] << 16) | ((uint64_t)bytes[length >> 1] << 8) | bytes[length - 1];
+}
+
+/* 64 bit wyhash of a key of a given, nonzero length; when the length is a constant, the compiler drops the branches for other
+ * lengths
+ */
+static inline __attribute__((always_inline)) uint64_t
+sxe_hash_wyhash64_sized(const void * key, unsigned length)
+{
+    const uint64_t * secret = sxe_hash_wyhash_secret;
+    const uint8_t  * bytes  = key;
+    uint64_t         seed;
+    uint64_t         a;
+    uint64_t         b;
+    unsigned         left;
+
+    seed = sxe_hash_wymix(secret[0], secret[1]);
+
+    if (length <= 16) {
+        if (length >= 4) {
+            a = (sxe_hash_read32(bytes) << 32) | sxe_hash_read32(bytes + ((length >> 3) << 2));
+            b = (sxe_hash_read32(bytes + length - 4) << 32) | sxe_hash_read32(bytes + length - 4 - ((length >> 3) << 2));
+        }
+        else {
+            a = sxe_hash_read_small(bytes, length);
+            b = 0;
+        }
+    }
+    else {
+        left = length;
+
+        if (left >= 48) {
+            uint64_t seed1 = seed;
+            uint64_t seed2 = seed;
+
+            do {
+                seed   = sxe_hash_wymix(sxe_hash_read64(bytes)      ^ secret[1], sxe_hash_read64(bytes + 8)  ^ seed);
+                seed1  = sxe_hash_wymix(sxe_hash_read64(bytes + 16) ^ secret[2], sxe_hash_read64(bytes + 24) ^ seed1);
+                seed2  = sxe_hash_wymix(sxe_hash_read64(bytes + 32) ^ secret[3], sxe_hash_read64(bytes + 40) ^ seed2);
+                bytes += 48;
+                left  -= 48;
+            } while (left >= 48);
+
+            seed ^= seed1 ^ seed2;
+        }
+
+        for (; left > 16; bytes += 16, left -= 16) {
+            seed = sxe_hash_wymix(sxe_hash_read64(bytes) ^ secret[1], sxe_hash_read64(bytes + 8) ^ seed);
+        }
+
+        a = sxe_hash_read64(bytes + left - 16);
+        b = sxe_hash_read64(bytes + left - 8);
+    }
+
+    a ^= secret[1];
+    b ^= seed;
+    sxe_hash_wymum(&a, &b);
+    return sxe_hash_wymix(a ^ secret[0] ^ length, b ^ secret[1]);
+}
+
+/* wyhash of a key of a given, nonzero length, folded to 32 bits
+ */
+static inline __attribute__((always_inline)) unsigned
+sxe_hash_wyhash_sized(const void * key, unsigned length)
+{
+    uint64_t sum = sxe_hash_wyhash64_sized(key, length);
+
+    return (unsigned)(sum ^ (sum >> 32));
+}
+
+/* Compare keys of a size known at compile time as integers or vectors rather than with memcmp()
+ */
+static inline __attribute__((always_inline)) bool
+sxe_hash_key_equal(const void * key1, const void * key2, unsigned size)
+{
+    const uint8_t * bytes1 = key1;
+    const uint8_t * bytes2 = key2;
+
+    switch (size) {
+    case 4:
+        return sxe_hash_read32(bytes1) == sxe_hash_read32(bytes2);
+
+    case 8:
+        return sxe_hash_read64(bytes1) == sxe_hash_read64(bytes2);
+
+#ifdef __SSE2__
+    case 16:
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)bytes1),
+                                                _mm_loadu_si128((const __m128i *)bytes2))) == 0xFFFF;
+
+    case 20:
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)bytes1),
+                                                _mm_loadu_si128((const __m128i *)bytes2))) == 0xFFFF
+            && sxe_hash_read32(bytes1 + 16) == sxe_hash_read32(bytes2 + 16);
+#else
+    case 16:
+        return ((sxe_hash_read64(bytes1) ^ sxe_hash_read64(bytes2)) | (sxe_hash_read64(bytes1 + 8) ^ sxe_hash_read64(bytes2 + 8))) == 0;
+
+    case 20:
+        return ((sxe_hash_read64(bytes1) ^ sxe_hash_read64(bytes2)) | (sxe_hash_read64(bytes1 + 8) ^ sxe_hash_read64(bytes2 + 8))
+              | (sxe_hash_read32(bytes1 + 16) ^ sxe_hash_read32(bytes2 + 16))) == 0;
+#endif
+
+    default:
+        return memcmp(bytes1, bytes2, size) == 0;
+    }
+}
+
+/* Hash sum of a key of a size known at compile time. Prehashed keys and wyhash are inlined; other functions are called.
+ */
+static inline __attribute__((always_inline)) unsigned
+sxe_hash_sum_sized(const SXE_HASH * hash, const void * key, unsigned size)
+{
+    if (hash->function == SXE_HASH_FUNCTION_WYHASH) {
+        return sxe_hash_wyhash_sized(key, size);
+    }
+
+    if (hash->function == SXE_HASH_FUNCTION_GLOBAL && !(hash->options & SXE_HASH_OPTION_COMPUTED_HASH)) {
+        return (unsigned)sxe_hash_read32(key);    /* Prehashed: the first word of the key */
+    }
+
+    return hash->hash_key(key, size);
+}
+
+/* Call MACRO(SIZE) for each key size that lookups are specialized for
+ */
+#define SXE_HASH_FIXED_KEY_SIZES(MACRO) MACRO(4) MACRO(8) MACRO(16) MACRO(20)
@@ -0,0 +1,282 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Hash snapshots: the memory of a hash (the SXE_HASH, its pool and its open addressing table) written to a file, so that a
+ * program can load a big hash at startup with an mmap instead of rebuilding it. The pool is addressed relative to its base (see
+ * SXE_PTR_FIX), so loading only has to validate the snapshot and fix up the few pointers in the SXE_HASH (sxe_hash_relocate()).
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "sxe-hash-private.h"
+
+#define SXE_HASH_SNAPSHOT_MAGIC   0x48534148455853ULL    /* "SXEHASH" */
+#define SXE_HASH_SNAPSHOT_VERSION 3
+#define SXE_HASH_SNAPSHOT_BLOCK   (1U << 20)              /* Checksums are chained a block at a time */
+
+/* Header at the start of a snapshot file; the hash's memory follows it, a cache line in, then the table of a concurrent hash, then
+ * the hash's filter
+ */
+typedef struct SXE_HASH_SNAPSHOT_HEADER {
+    uint64_t magic;
+    unsigned version;
+    unsigned impl_size;     /* sizeof(SXE_HASH) in the program that saved the snapshot; guards against layout changes */
+    uint64_t hash_size;     /* Bytes of the hash's memory (see sxe_hash_memory_size())                                 */
+    uint64_t table_size;    /* Bytes of the separately allocated table of a concurrent hash, or 0                      */
+    uint64_t filter_size;   /* Bytes of the hash's filter, or 0 if it has none                                         */
+    uint32_t checksum;      /* Chained CRC32C of everything after the header                                           */
+    uint32_t global;        /* SXE_HASH_FUNCTION sxe_hash_sum was when a hash that uses it was saved, or _GLOBAL if unused */
+    char     pad[64 - 5 * sizeof(uint64_t) - 2 * sizeof(uint32_t)];
+} SXE_HASH_SNAPSHOT_HEADER;
+
+/* Chain the CRC32Cs of the blocks of a region onto a checksum
+ */
+static uint32_t
+sxe_hash_snapshot_checksum(uint32_t checksum, const void * memory, size_t size)
+{
+    SXE_HASH_FUNC  crc32c = sxe_hash_function(SXE_HASH_FUNCTION_CRC32C);
+    const uint8_t * block = memory;
+    uint32_t        chain[2];
+    unsigned        length;
+
+    for (; size > 0; block += length, size -= length) {
+        length   = size < SXE_HASH_SNAPSHOT_BLOCK ? (unsigned)size : SXE_HASH_SNAPSHOT_BLOCK;
+        chain[0] = checksum;
+        chain[1] = crc32c(block, length);
+        checksum = crc32c(chain, sizeof(chain));
+    }
+
+    return checksum;
+}
+
+/* Identify the hash sum function of a hash that uses the global sxe_hash_sum, so that a snapshot of it is only loaded by a
+ * program whose sxe_hash_sum is the same function
+ *
+ * @return The function, SXE_HASH_FUNCTION_GLOBAL if the hash doesn't use sxe_hash_sum, or SXE_HASH_FUNCTION_BEST if it is a
+ *         function that isn't one of the SXE_HASH_FUNCTIONs
+ */
+static unsigned
+sxe_hash_snapshot_global(SXE_HASH * hash, SXE_HASH_FUNC hash_sum)
+{
+    unsigned function;
+
+    if (hash->function != SXE_HASH_FUNCTION_GLOBAL || !(hash->options & SXE_HASH_OPTION_COMPUTED_HASH)) {
+        return SXE_HASH_FUNCTION_GLOBAL;
+    }
+
+    for (function = SXE_HASH_FUNCTION_LOOKUP3; function < SXE_HASH_FUNCTION_BEST; function++) {
+        if (sxe_hash_function(function) == hash_sum) {
+            break;
+        }
+    }
+
+    return function;
+}
+
+/**
+ * Save a snapshot of a hash to a file
+ *
+ * @param array = Pointer to the hash array
+ * @param path  = Path of the snapshot file; it is written under a temporary name and renamed, so a reader never sees a partial
+ *                snapshot
+ *
+ * @return true on success, false if the snapshot couldn't be written
+ *
+ * @note The hash must not be changed while it is saved. Resizable hashes can't be saved, and neither can hashes that use a
+ *       global sum function (see sxe_hash_override_sum()) that isn't one of the SXE_HASH_FUNCTIONs.
+ */
+bool
+sxe_hash_save(void * array, const char * path)
+{
+    SXE_HASH_SNAPSHOT_HEADER header;
+    SXE_HASH               * hash = SXE_HASH_ARRAY_TO_IMPL(array);
+    FILE                   * file;
+    char                     temporary[PATH_MAX];
+    bool                     result = false;
+
+    SXEE6("(hash=%s,path=%s)", sxe_pool_get_name(array), path);
+    SXEA1(!(hash->options & SXE_HASH_OPTION_RESIZABLE), "Hash %s: resizable hashes can't be saved", sxe_pool_get_name(array));
+
+    memset(&header, 0, sizeof(header));
+    header.magic       = SXE_HASH_SNAPSHOT_MAGIC;
+    header.version     = SXE_HASH_SNAPSHOT_VERSION;
+    header.impl_size   = sizeof(SXE_HASH);
+    header.hash_size   = sxe_hash_memory_size(hash);
+    header.table_size  = hash->options & SXE_HASH_OPTION_CONCURRENT ? sxe_hash_open_table_size(hash->count, hash->key_size) : 0;
+    header.filter_size = hash->filter != NULL ? sxe_hash_filter_get_size(hash->filter) : 0;
+    header.global      = sxe_hash_snapshot_global(hash, hash->hash_key);
+    header.checksum    = sxe_hash_snapshot_checksum(0, hash, header.hash_size);
+    header.checksum    = sxe_hash_snapshot_checksum(header.checksum, hash->table, header.table_size);
+    header.checksum    = sxe_hash_snapshot_checksum(header.checksum, hash->filter, header.filter_size);
+
+    if (header.global == SXE_HASH_FUNCTION_BEST) {
+        SXEL3("Hash %s: its global sum function isn't a standard function, so no other program can load the snapshot",
+              sxe_pool_get_name(array));
+        goto SXE_EARLY_OUT;
+    }
+
+    if ((unsigned)snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= sizeof(temporary)) {
+        SXEL3("Hash %s: snapshot path %s is too long", sxe_pool_get_name(array), path);
+        goto SXE_EARLY_OUT;
+    }
+
+    if ((file = fopen(temporary, "wb")) == NULL) {
+        SXEL3("Hash %s: failed to create snapshot %s: %s", sxe_pool_get_name(array), temporary, strerror(errno));
+        goto SXE_EARLY_OUT;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(hash, header.hash_size, 1, file) != 1
+     || (header.table_size != 0 && fwrite(hash->table, header.table_size, 1, file) != 1)
+     || (header.filter_size != 0 && fwrite(hash->filter, header.filter_size, 1, file) != 1)) {
+        SXEL3("Hash %s: failed to write snapshot %s: %s", sxe_pool_get_name(array), temporary, strerror(errno));
+        fclose(file);
+        unlink(temporary);
+        goto SXE_EARLY_OUT;
+    }
+
+    if (fclose(file) != 0 || rename(temporary, path) < 0) {
+        SXEL3("Hash %s: failed to complete snapshot %s: %s", sxe_pool_get_name(array), path, strerror(errno));
+        unlink(temporary);
+        goto SXE_EARLY_OUT;
+    }
+
+    result = true;
+
+SXE_EARLY_OUT:
+    SXER6("return %s", result ? "true" : "false");
+    return result;
+}
+
+/**
+ * Load a hash from a snapshot saved by sxe_hash_save(), possibly by another process or before a restart
+ *
+ * @param memmap = Pointer to a memory map object that will hold the mapping of the snapshot
+ * @param path   = Path of the snapshot file
+ *
+ * @return A pointer to the hash array, or NULL if there is no snapshot at path or it is not a valid snapshot
+ *
+ * @note The snapshot is mapped copy on write, so the hash can be changed without changing the file, and the pages that aren't
+ *       changed are shared by every process that loads the same snapshot. Except for the table of a concurrent hash and the
+ *       filter, which are copied, nothing is read until it is used, other than to verify the checksum.
+ *
+ * @note A hash that uses the global sum function can only be loaded if sxe_hash_sum is the function it was saved with.
+ *
+ * @note Never call sxe_hash_delete() on a loaded hash; call sxe_hash_unload().
+ */
+void *
+sxe_hash_load(SXE_MMAP * memmap, const char * path)
+{
+    SXE_HASH_SNAPSHOT_HEADER * header;
+    SXE_HASH                 * hash;
+    SXE_HASH_FILTER          * filter = NULL;
+    struct stat                status;
+    const uint8_t            * table;
+    void                     * array  = NULL;
+    size_t                     remaining;
+
+    SXEE6("(memmap=%p,path=%s)", memmap, path);
+
+    if (stat(path, &status) < 0 || (size_t)status.st_size < sizeof(SXE_HASH_SNAPSHOT_HEADER) + sizeof(SXE_HASH)) {
+        SXEL3("Hash snapshot %s does not exist or is too small to be valid", path);
+        goto SXE_EARLY_OUT;
+    }
+
+    sxe_mmap_open_private(memmap, path);
+    header    = memmap->addr;
+    hash      = (SXE_HASH *)(header + 1);
+    remaining = memmap->size - sizeof(SXE_HASH_SNAPSHOT_HEADER);
+
+    /* Each size is checked against what's left of the file, so that a corrupt size can't wrap their sum
+     */
+    if (header->magic != SXE_HASH_SNAPSHOT_MAGIC || header->version != SXE_HASH_SNAPSHOT_VERSION
+     || header->impl_size != sizeof(SXE_HASH) || (hash->options & SXE_HASH_OPTION_RESIZABLE)
+     || header->hash_size != sxe_hash_memory_size(hash)
+     || header->table_size != (hash->options & SXE_HASH_OPTION_CONCURRENT ? sxe_hash_open_table_size(hash->count, hash->key_size)
+                                                                            : 0)
+     || header->hash_size > remaining || header->table_size > remaining - header->hash_size
+     || header->filter_size != remaining - header->hash_size - header->table_size) {
+        SXEL3("Hash snapshot %s is not a valid version %u hash snapshot", path, SXE_HASH_SNAPSHOT_VERSION);
+        goto SXE_ERROR_OUT;
+    }
+
+    table = (const uint8_t *)hash + header->hash_size;
+
+    if (sxe_hash_snapshot_checksum(sxe_hash_snapshot_checksum(sxe_hash_snapshot_checksum(0, hash, header->hash_size), table,
+                                                              header->table_size),
+                                   table + header->table_size, header->filter_size) != header->checksum) {
+        SXEL3("Hash snapshot %s is corrupt (checksum mismatch)", path);
+        goto SXE_ERROR_OUT;
+    }
+
+    if (hash->function != SXE_HASH_FUNCTION_GLOBAL
+     && (hash->function >= SXE_HASH_FUNCTION_BEST || sxe_hash_function(hash->function) == NULL)) {
+        SXEL3("Hash snapshot %s uses hash function %u, which is not available", path, hash->function);
+        goto SXE_ERROR_OUT;
+    }
+
+    if (header->global != sxe_hash_snapshot_global(hash, sxe_hash_sum)) {
+        SXEL3("Hash snapshot %s was saved with global sum function %s, but sxe_hash_sum is not that function", path,
+              sxe_hash_function_name(header->global));
+        goto SXE_ERROR_OUT;
+    }
+
+    if (header->filter_size != 0 && (filter = sxe_hash_filter_copy(table + header->table_size, header->filter_size)) == NULL) {
+        SXEL3("Hash snapshot %s has an invalid filter", path);
+        goto SXE_ERROR_OUT;
+    }
+
+    array = sxe_hash_relocate(hash, header->table_size != 0 ? table : NULL, filter);
+    goto SXE_EARLY_OUT;
+
+SXE_ERROR_OUT:
+    sxe_mmap_close(memmap);
+
+SXE_EARLY_OUT:
+    SXER6("return array=%p", array);
+    return array;
+}
+
+/**
+ * Unload a hash loaded by sxe_hash_load(); the snapshot file is unchanged
+ *
+ * @param array  = Pointer to the hash array
+ * @param memmap = Pointer to the memory map object passed to sxe_hash_load()
+ */
+void
+sxe_hash_unload(void * array, SXE_MMAP * memmap)
+{
+    SXE_HASH * hash = SXE_HASH_ARRAY_TO_IMPL(array);
+
+    SXEE6("(hash=%s,memmap=%p)", sxe_pool_get_name(array), memmap);
+    sxe_hash_open_destruct(hash);    /* Frees the copied table of a concurrent hash */
+
+    if (hash->filter != NULL) {
+        sxe_hash_filter_delete(hash->filter);
+    }
+
+    sxe_mmap_close(memmap);
+    SXER6("return");
+}
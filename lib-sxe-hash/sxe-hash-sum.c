@@ -3,10 +3,16 @@
 #include "lookup3.h"
 #include "sxe-hash.h"
 
-/* Default sum function that uses lookup3
+/**
+ * Compute a hash sum of a fixed length or NUL terminated key using lookup3; the default sum function
+ *
+ * @param key    Pointer to the key
+ * @param length Length of the key in bytes or 0 to use strlen
+ *
+ * @return 32 bit hash value
  */
-static unsigned
-sxe_hash_def(const void *key, unsigned length)
+unsigned
+sxe_hash_lookup3(const void *key, unsigned length)
 {
     if (length == 0)
         length = strlen(key);
@@ -26,7 +32,7 @@ sxe_hash_def(const void *key, unsigned length)
  *
  * @return 32 bit hash value
  */
-unsigned (*sxe_hash_sum)(const void *key, unsigned length) = sxe_hash_def;
+unsigned (*sxe_hash_sum)(const void *key, unsigned length) = sxe_hash_lookup3;
 
 /**
  * Override the default hash sum function (lookup3)
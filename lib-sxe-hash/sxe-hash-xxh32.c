@@ -1,4 +1,5 @@
-/* Module that overrides lookup3 with XXH32 hash function. Calling these functions will require the libxxhash DLL.
+/* Module that provides the XXH32 and XXH3 hash functions and can override lookup3 with XXH32. Calling these functions will require
+ * the libxxhash DLL.
  */
 
 #ifndef SXE_DISABLE_XXHASH
@@ -25,6 +26,26 @@ sxe_hash_xxh32(const void *key, unsigned length)
     return XXH32(key, length, 17);
 }
 
+/**
+ * Compute a hash sum of a fixed length or NUL terminated key using XXH3 (64 bit), folded to 32 bits
+ *
+ * @param key    Pointer to the key
+ * @param length Length of the key in bytes or 0 to use strlen
+ *
+ * @return 32 bit hash value
+ */
+unsigned
+sxe_hash_xxh3(const void *key, unsigned length)
+{
+    XXH64_hash_t sum;
+
+    if (length == 0)
+        length = strlen(key);    /* COVERAGE EXCLUSION - Need a test */
+
+    sum = XXH3_64bits(key, length);
+    return (unsigned)(sum ^ (sum >> 32));
+}
+
 /**
  * Override the default hash sum function (lookup3) with xx32
  *
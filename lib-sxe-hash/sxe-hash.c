@@ -24,9 +24,7 @@
 #include "sxe-alloc.h"
 #include "sxe-hash-private.h"
 
-#define SXE_HASH_UNUSED_BUCKET    0
-#define SXE_HASH_NEW_BUCKET       1
-#define SXE_HASH_BUCKETS_RESERVED 2
+#define SXE_HASH_BATCH 16    /* Keys whose cache misses sxe_hash_look_batch() overlaps; about the number a core can have pending */
 
 /**
  * Default hash key function; returns the first word of the key; useful when key is a SHA1
@@ -45,6 +43,27 @@ sxe_prehashed_key_hash(const void * key, unsigned size)
     return *(const unsigned *)key;
 }
 
+/* Compute the number of pool states, the offset of the open addressing table (if any) and the total size of a hash. The tables of
+ * resizable and concurrent hashes are allocated separately.
+ */
+static size_t
+sxe_hash_layout(unsigned element_count, unsigned element_size, unsigned key_size, unsigned options, unsigned * states_out,
+                size_t * table_offset_out)
+{
+    unsigned states = options & SXE_HASH_OPTION_OPEN_ADDRESSING ? SXE_HASH_OPEN_STATES : element_count + SXE_HASH_BUCKETS_RESERVED;
+    size_t   size   = sizeof(SXE_HASH) + sxe_pool_size(element_count, element_size, states);
+
+    *states_out       = states;
+    *table_offset_out = 0;
+
+    if (options & SXE_HASH_OPTION_OPEN_ADDRESSING && !(options & (SXE_HASH_OPTION_RESIZABLE | SXE_HASH_OPTION_CONCURRENT))) {
+        *table_offset_out = SXE_HASH_ALIGN_TABLE(size);
+        size              = *table_offset_out + sxe_hash_open_table_size(element_count, key_size);
+    }
+
+    return size;
+}
+
 /**
  * Allocate and contruct a hash
  *
@@ -55,46 +74,342 @@ sxe_prehashed_key_hash(const void * key, unsigned size)
  * @param key_size      = Size of the key in bytes
  * @param options       = SXE_HASH_OPTION_UNLOCKED  | SXE_HASH_OPTION_LOCKED        (single threaded  or use locking)
  *                      + SXE_HASH_OPTION_PREHASHED | SXE_HASH_OPTION_COMPUTED_HASH (key is prehashed or use lookup3)
+ *                      + SXE_HASH_OPTION_HUGE_PAGES, SXE_HASH_OPTION_PREFAULT, SXE_HASH_OPTION_NUMA_NODE(node) (for big hashes)
+ *                      + SXE_HASH_OPTION_OPEN_ADDRESSING (index the elements in an open addressing table rather than chaining them)
+ *                      + SXE_HASH_OPTION_CONCURRENT (lookups take no lock; implies SXE_HASH_OPTION_OPEN_ADDRESSING and _LOCKED)
+ *                      To create a hash that grows, use sxe_hash_new_resizable()
  *
  * @return A pointer to an array of hash elements
+ *
+ * @note Open addressing hashes keep a copy of each key in the table, so lookups usually touch one control group and one slot,
+ *       and only touch the element when it is found.
+ *
+ * @note Elements given to a concurrent hash are not reused until every read section open at the time has ended. A thread that
+ *       uses an element it looked up while other threads may give it should do so between sxe_hash_read_begin() and
+ *       sxe_hash_read_end(). Concurrent hashes are for read mostly data: each give is a write to a shared epoch counter.
  */
 void *
 sxe_hash_new_plus(const char * name, unsigned element_count, unsigned element_size, unsigned key_offset, unsigned key_size,
                   unsigned options)
 {
     SXE_HASH * hash;
-    unsigned   size;
+    size_t     size;
+    size_t     table_offset;
+    unsigned   states;
 
     SXEE6("sxe_hash_new_plus(name=%s,element_count=%u,element_size=%u,key_offset=%u,key_size=%u,options=%u)", name, element_count,
            element_size, key_offset, key_size, options);
-    size = sizeof(SXE_HASH) + sxe_pool_size(element_count, element_size, element_count + SXE_HASH_BUCKETS_RESERVED);
-    SXEA1((hash = sxe_malloc(size)) != NULL, "Unable to allocate %u bytes of memory for hash %s", size, name);
+    SXEA1(!(options & SXE_HASH_OPTION_RESIZABLE), "Hash %s: use sxe_hash_new_resizable() to create a resizable hash", name);
+
+    if (options & SXE_HASH_OPTION_CONCURRENT) {
+        options |= SXE_HASH_OPTION_OPEN_ADDRESSING | SXE_HASH_OPTION_LOCKED;    /* Writers still serialize on the lock */
+    }
+
+    size = sxe_hash_layout(element_count, element_size, key_size, options, &states, &table_offset);
+
+    if (options & SXE_POOL_OPTIONS_MEMORY) {
+        SXEA1((hash = sxe_pool_memory_map(size, options & SXE_POOL_OPTIONS_MEMORY, false)) != NULL,
+              "Unable to map %zu bytes of memory for hash %s", size, name);
+    }
+    else {
+        SXEA1((hash = sxe_malloc(size)) != NULL, "Unable to allocate %zu bytes of memory for hash %s", size, name);
+    }
+
     SXEL6("Base address of hash %s = %p", name, hash);
 
     /* Note: hash + 1 == pool base */
-    hash->pool   = sxe_pool_construct(hash + 1, name, element_count, element_size, element_count + SXE_HASH_BUCKETS_RESERVED,
+    hash->pool   = sxe_pool_construct(hash + 1, name, element_count, element_size, states,
                                       options & SXE_HASH_OPTION_LOCKED ? SXE_POOL_OPTION_LOCKED : 0);
-    hash->count      = element_count;
+    hash->count        = element_count;
+    hash->size         = element_size;
+    hash->key_offset   = key_offset;
+    hash->key_size     = key_size;
+    hash->options      = options;
+    hash->hash_key     = options & SXE_HASH_OPTION_COMPUTED_HASH ? sxe_hash_sum : sxe_prehashed_key_hash;
+    hash->function     = SXE_HASH_FUNCTION_GLOBAL;
+    hash->filter       = NULL;
+    hash->cache        = NULL;
+    hash->segment      = element_count;
+
+    if (options & SXE_HASH_OPTION_OPEN_ADDRESSING) {
+        sxe_hash_open_construct(hash, options & SXE_HASH_OPTION_CONCURRENT ? NULL : (uint8_t *)hash + table_offset);
+    }
+
+    SXER6("return array=%p", hash->pool);
+    return hash->pool;
+}
+
+/**
+ * Allocate and construct a resizable open addressing hash, which starts with room for <initial_count> elements and grows to up
+ * to <maximum_count> elements as they are taken
+ *
+ * @param name          = Name of the hash, used in diagnostics
+ * @param initial_count = Number of elements the hash starts with, and grows by when it runs out
+ * @param maximum_count = Maximum number of elements in the hash
+ * @param element_size  = Size of each element in the hash in bytes
+ * @param key_offset    = Offset of start of key from start of element in bytes
+ * @param key_size      = Size of the key in bytes
+ * @param options       = As for sxe_hash_new_plus(), other than SXE_HASH_OPTION_PREFAULT and SXE_HASH_OPTION_CONCURRENT;
+ *                        SXE_HASH_OPTION_OPEN_ADDRESSING is implied
+ *
+ * @return A pointer to an array of hash elements
+ *
+ * @note Address space is reserved for <maximum_count> elements, so the array and the indices of its elements never move. The
+ *       table doubles whenever it would be more than 7/8 full; the elements of the old table are migrated a few groups at a time
+ *       by each sxe_hash_add() and sxe_hash_give(), so there is never a pause to rehash the whole table.
+ */
+void *
+sxe_hash_new_resizable(const char * name, unsigned initial_count, unsigned maximum_count, unsigned element_size,
+                       unsigned key_offset, unsigned key_size, unsigned options)
+{
+    SXE_HASH * hash;
+    size_t     size;
+    size_t     table_offset;
+    unsigned   states;
+
+    SXEE6("(name=%s,initial_count=%u,maximum_count=%u,element_size=%u,key_offset=%u,key_size=%u,options=%u)", name,
+          initial_count, maximum_count, element_size, key_offset, key_size, options);
+    SXEA1(!(options & SXE_HASH_OPTION_CONCURRENT), "Hash %s: resizable hashes can't be concurrent", name);
+    options = (options & ~SXE_HASH_OPTION_PREFAULT) | SXE_HASH_OPTION_OPEN_ADDRESSING | SXE_HASH_OPTION_RESIZABLE;
+    size    = sxe_pool_memory_mapped_size(sxe_hash_layout(maximum_count, element_size, key_size, options, &states, &table_offset),
+                                          options & SXE_POOL_OPTIONS_MEMORY);
+    SXEA1((hash = sxe_pool_memory_map(size, options & SXE_POOL_OPTIONS_MEMORY, true)) != NULL,
+          "Unable to reserve %zu bytes of memory for hash %s", size, name);
+    sxe_pool_memory_commit(hash, sizeof(SXE_HASH));
+
+    hash->pool       = sxe_pool_construct_growable(hash + 1, name, initial_count, maximum_count, element_size, states,
+                                                   options & SXE_HASH_OPTION_LOCKED ? SXE_POOL_OPTION_LOCKED : 0);
+    hash->count      = maximum_count;
     hash->size       = element_size;
     hash->key_offset = key_offset;
     hash->key_size   = key_size;
     hash->options    = options;
     hash->hash_key   = options & SXE_HASH_OPTION_COMPUTED_HASH ? sxe_hash_sum : sxe_prehashed_key_hash;
+    hash->function   = SXE_HASH_FUNCTION_GLOBAL;
+    hash->filter     = NULL;
+    hash->cache      = NULL;
+    hash->segment    = initial_count;
+    sxe_hash_open_construct(hash, NULL);
 
     SXER6("return array=%p", hash->pool);
     return hash->pool;
 }
 
+/**
+ * Choose the function a hash computes its keys' hash sums with, instead of sxe_hash_sum or the prehashed key
+ *
+ * @param array    = Pointer to the hash array, which must be empty
+ * @param function = SXE_HASH_FUNCTION_* (see sxe_hash_function())
+ *
+ * @return true, or false if the function isn't available on this CPU or in this build, in which case the hash is unchanged
+ *
+ * @note The choice is kept as a SXE_HASH_FUNCTION and survives sxe_hash_reconstruct(), which finds the implementation again
+ */
+bool
+sxe_hash_set_function(void * array, SXE_HASH_FUNCTION function)
+{
+    SXE_HASH    * hash     = SXE_HASH_ARRAY_TO_IMPL(array);
+    SXE_HASH_FUNC hash_key = sxe_hash_function(function);
+
+    SXEE6("(hash=%s,function=%s)", sxe_pool_get_name(array), sxe_hash_function_name(function));
+    SXEA1(sxe_pool_get_number_in_state(array, SXE_HASH_UNUSED_BUCKET) == sxe_pool_get_number(array),
+          "Hash %s: the function can only be set while the hash is empty", sxe_pool_get_name(array));
+
+    if (hash_key == NULL) {
+        SXEL3("Hash function %s is not available on this CPU or in this build", sxe_hash_function_name(function));
+        goto SXE_EARLY_OUT;
+    }
+
+    hash->hash_key = hash_key;
+
+    if (function == SXE_HASH_FUNCTION_BEST) {
+        for (function = SXE_HASH_FUNCTION_LOOKUP3; sxe_hash_function(function) != hash_key; function++) {
+        }
+    }
+
+    hash->function = function;
+
+SXE_EARLY_OUT:
+    SXER6("return %s", hash_key != NULL ? "true" : "false");
+    return hash_key != NULL;
+}
+
+/**
+ * Put a filter in front of a hash, so that lookups of most keys that aren't in it are rejected after reading one cache line
+ *
+ * @param array            = Pointer to the hash array
+ * @param bits_per_element = Bits of filter per element of the hash (10 gives about 1% false positives), or 0 to remove the filter
+ *
+ * @note The filter is built from the elements already in the hash and kept up to date by sxe_hash_add(). Elements given back stay
+ *       in the filter, so after many gives, when its false positive rate (see sxe_hash_filter_get_false_positive_rate()) gets too
+ *       high, set the filter again to rebuild it. The filter is saved and loaded with the hash by sxe_hash_save() and
+ *       sxe_hash_load().
+ * @note A filter costs hits an extra cache miss and a sum of the key, so it only pays off for hashes where most lookups miss and
+ *       the table is much bigger than the cache, e.g. chained hashes with long chains of misses.
+ * @note The old filter is freed immediately, and lookups read the filter without a lock, so this must not be called while other
+ *       threads may be looking up keys in the hash; callers sharing a hash between threads must hold their own lock over it.
+ */
+void
+sxe_hash_set_filter(void * array, unsigned bits_per_element)
+{
+    SXE_HASH * hash = SXE_HASH_ARRAY_TO_IMPL(array);
+    unsigned   number;
+    unsigned   id;
+
+    SXEE6("(hash=%s,bits_per_element=%u)", sxe_pool_get_name(array), bits_per_element);
+
+    if (hash->filter != NULL) {
+        sxe_hash_filter_delete(hash->filter);
+        hash->filter = NULL;
+    }
+
+    if (bits_per_element == 0) {
+        goto SXE_EARLY_OUT;
+    }
+
+    hash->filter = sxe_hash_filter_new(hash->count, bits_per_element);
+    number       = sxe_pool_get_number(array);
+
+    for (id = 0; id < number; id++) {
+        if (sxe_hash_element_is_used(hash, id)) {
+            sxe_hash_filter_add(hash->filter, sxe_hash_filter_sum(SXE_HASH_ELEMENT_KEY(hash, id), hash->key_size));
+        }
+    }
+
+SXE_EARLY_OUT:
+    SXER6("return");
+}
+
+/**
+ * Get the filter in front of a hash, e.g. to read its counters
+ *
+ * @return A pointer to the filter, or NULL if the hash has none
+ */
+SXE_HASH_FILTER *
+sxe_hash_get_filter(void * array)
+{
+    return SXE_HASH_ARRAY_TO_IMPL(array)->filter;
+}
+
+/**
+ * Compute the size of the memory of a hash: the hash, its pool and, unless it is allocated separately, its open addressing table;
+ * called by sxe_hash_save() and sxe_hash_load()
+ */
+size_t
+sxe_hash_memory_size(const SXE_HASH * hash)
+{
+    size_t   table_offset;
+    unsigned states;
+
+    return sxe_hash_layout(hash->count, hash->size, hash->key_size, hash->options, &states, &table_offset);
+}
+
+/* Size of the memory mapping (or reservation, if resizable) asked for by a hash
+ */
+static size_t
+sxe_hash_mapped_size(SXE_HASH * hash)
+{
+    if (hash->options & SXE_HASH_OPTION_RESIZABLE) {
+        return sxe_pool_memory_mapped_size(sxe_hash_memory_size(hash), hash->options & SXE_POOL_OPTIONS_MEMORY);
+    }
+
+    return sxe_hash_memory_size(hash);
+}
+
 void
 sxe_hash_reconstruct(void * array)
 {
     SXE_HASH * hash = SXE_HASH_ARRAY_TO_IMPL(array);
+    size_t     table_offset;
+    unsigned   states;
+
     SXEE6("sxe_hash_reconstruct(hash=%s)", sxe_pool_get_name(array));
-    hash->pool  = sxe_pool_construct(hash + 1, sxe_pool_get_name(array),
-                                     hash->count, hash->size, hash->count + SXE_HASH_BUCKETS_RESERVED,
+    sxe_hash_layout(hash->count, hash->size, hash->key_size, hash->options, &states, &table_offset);
+
+    if (hash->function != SXE_HASH_FUNCTION_GLOBAL) {
+        SXEA1(hash->hash_key = sxe_hash_function(hash->function), "Hash %s: function %s is not available on this CPU",
+              sxe_pool_get_name(array), sxe_hash_function_name(hash->function));
+    }
+
+    if (hash->filter != NULL) {
+        sxe_hash_filter_clear(hash->filter);
+    }
+
+    if (hash->cache != NULL) {
+        sxe_hash_cache_clear(hash->cache, hash->count);
+    }
+
+    if (hash->options & SXE_HASH_OPTION_RESIZABLE) {
+        sxe_hash_open_destruct(hash);
+        hash->pool = sxe_pool_construct_growable(hash + 1, sxe_pool_get_name(array), hash->segment, hash->count, hash->size,
+                                                 states, hash->options & SXE_HASH_OPTION_LOCKED ? SXE_POOL_OPTION_LOCKED : 0);
+        sxe_hash_open_construct(hash, NULL);
+        goto SXE_EARLY_OUT;
+    }
+
+    hash->pool  = sxe_pool_construct(hash + 1, sxe_pool_get_name(array), hash->count, hash->size, states,
                                      hash->options & SXE_HASH_OPTION_LOCKED ? SXE_POOL_OPTION_LOCKED : 0);
+
+    if (hash->options & SXE_HASH_OPTION_CONCURRENT) {
+        sxe_hash_open_destruct(hash);
+        sxe_hash_open_construct(hash, NULL);
+    }
+    else if (hash->options & SXE_HASH_OPTION_OPEN_ADDRESSING) {
+        sxe_hash_open_construct(hash, (uint8_t *)hash + table_offset);
+    }
+
+SXE_EARLY_OUT:
     SXER6("return");
 }
+/**
+ * Relocate a hash whose memory was mapped or copied from another process, fixing up the pointers into the address space of the
+ * process that last used it; called by sxe_hash_load()
+ *
+ * @param hash   = Pointer to the memory of the hash
+ * @param table  = Pointer to a copy of the separately allocated table of a concurrent hash, or NULL
+ * @param filter = Pointer to the hash's filter, which the hash takes ownership of, or NULL
+ *
+ * @return A pointer to the array of hash elements
+ *
+ * @note Unlike sxe_hash_reconstruct(), the elements are kept. Resizable hashes can't be relocated.
+ */
+void *
+sxe_hash_relocate(SXE_HASH * hash, const uint8_t * table, SXE_HASH_FILTER * filter)
+{
+    size_t   table_offset;
+    unsigned states;
+
+    SXEE6("sxe_hash_relocate(hash=%p,table=%p,filter=%p)", hash, table, filter);
+    SXEA1(!(hash->options & SXE_HASH_OPTION_RESIZABLE), "Resizable hashes can't be relocated");
+    sxe_hash_layout(hash->count, hash->size, hash->key_size, hash->options, &states, &table_offset);
+
+    /* Note: hash + 1 == pool base */
+    hash->pool = sxe_pool_relocate(hash + 1);
+    sxe_pool_override_locked(hash->pool);    /* No other process can be using the copy */
+    hash->filter = filter;
+    hash->cache  = NULL;    /* Cache mode isn't saved; set it again after loading */
+
+    if (hash->function != SXE_HASH_FUNCTION_GLOBAL) {
+        SXEA1(hash->hash_key = sxe_hash_function(hash->function), "Hash %s: function %s is not available on this CPU",
+              sxe_pool_get_name(hash->pool), sxe_hash_function_name(hash->function));
+    }
+    else {
+        hash->hash_key = hash->options & SXE_HASH_OPTION_COMPUTED_HASH ? sxe_hash_sum : sxe_prehashed_key_hash;
+    }
+
+    if (hash->options & SXE_HASH_OPTION_CONCURRENT) {
+        SXEA1(table != NULL, "Hash %s: a concurrent hash can't be relocated without a copy of its table",
+              sxe_pool_get_name(hash->pool));
+        sxe_hash_open_relocate(hash, NULL, table);
+    }
+    else if (hash->options & SXE_HASH_OPTION_OPEN_ADDRESSING) {
+        sxe_hash_open_relocate(hash, (uint8_t *)hash + table_offset, NULL);
+    }
+
+    SXER6("return array=%p", hash->pool);
+    return hash->pool;
+}
+
 /**
  * Delete a hash created with sxe_hash_new()
  *
@@ -104,8 +419,28 @@ void
 sxe_hash_delete(void * array)
 {
     SXE_HASH * hash = SXE_HASH_ARRAY_TO_IMPL(array);
+
     SXEE6("sxe_hash_delete(hash=%s)", sxe_pool_get_name(array));
-    sxe_free(hash);
+
+    if (hash->filter != NULL) {
+        sxe_hash_filter_delete(hash->filter);
+    }
+
+    if (hash->cache != NULL) {
+        sxe_free(hash->cache);
+    }
+
+    if (hash->options & (SXE_HASH_OPTION_RESIZABLE | SXE_HASH_OPTION_CONCURRENT)) {
+        sxe_hash_open_destruct(hash);
+    }
+
+    if (hash->options & (SXE_POOL_OPTIONS_MEMORY | SXE_HASH_OPTION_RESIZABLE)) {
+        sxe_pool_memory_unmap(hash, sxe_hash_mapped_size(hash), hash->options & SXE_POOL_OPTIONS_MEMORY);
+    }
+    else {
+        sxe_free(hash);
+    }
+
     SXER6("return");
 }
 
@@ -117,6 +452,12 @@ sxe_hash_delete(void * array)
  * @return The index of the element or SXE_HASH_FULL if the hash is full
  *
  * @note The element is moved to the new queue until the caller adds it to the hash
+ *
+ * @note If a concurrent hash has no free elements, but has elements that were given, this waits for the readers that might
+ *       still see them to finish, then reuses one, so it must not be called in a read section
+ *
+ * @note If the hash is in cache mode (see sxe_hash_set_cache()) and full, an element is evicted and reused; SXE_HASH_FULL is
+ *       only returned if every element has been taken but not added
  */
 unsigned
 sxe_hash_take(void * array)
@@ -125,7 +466,11 @@ sxe_hash_take(void * array)
     unsigned   id;
 
     SXEE6("sxe_hash_take(hash=%s)", sxe_pool_get_name(array));
-    id = sxe_pool_set_oldest_element_state(hash->pool, SXE_HASH_UNUSED_BUCKET, SXE_HASH_NEW_BUCKET);
+
+    while ((id = sxe_pool_set_oldest_element_state(hash->pool, SXE_HASH_UNUSED_BUCKET, SXE_HASH_NEW_BUCKET)) == SXE_POOL_NO_INDEX
+        && ((hash->options & SXE_HASH_OPTION_CONCURRENT && sxe_hash_open_reclaim_wait(hash))
+         || (hash->cache != NULL && sxe_hash_cache_evict(hash)))) {
+    }
 
     if (id == SXE_POOL_NO_INDEX) {
         id = SXE_HASH_FULL;
@@ -135,6 +480,46 @@ sxe_hash_take(void * array)
     return id;
 }
 
+/* Look for a key in the chain of its bucket. Inlined into lookups specialized for a key size.
+ */
+static inline __attribute__((always_inline)) unsigned
+sxe_hash_look_in_bucket_sized(SXE_HASH * hash, void * array, const void * key, unsigned bucket, unsigned key_size)
+{
+    SXE_POOL_WALKER walker;
+    unsigned        id;
+
+    sxe_pool_walker_construct(&walker, array, bucket);
+
+    while ((id = sxe_pool_walker_step(&walker)) != SXE_HASH_KEY_NOT_FOUND) {
+        if (sxe_hash_key_equal((char *)array + id * hash->size + hash->key_offset, key, key_size)) {
+            break;
+        }
+    }
+
+    return id;
+}
+
+static unsigned
+sxe_hash_look_in_bucket(SXE_HASH * hash, void * array, const void * key, unsigned bucket)
+{
+    return sxe_hash_look_in_bucket_sized(hash, array, key, bucket, hash->key_size);
+}
+
+/* Define sxe_hash_look_chained_<SIZE>(), a lookup in a chained hash specialized for keys of SIZE bytes
+ */
+#define SXE_HASH_LOOK_CHAINED_SIZED(SIZE)                                                                            \
+    static unsigned                                                                                                  \
+    sxe_hash_look_chained_##SIZE(SXE_HASH * hash, void * array, const void * key)                                    \
+    {                                                                                                                \
+        unsigned bucket = sxe_hash_sum_sized(hash, key, SIZE) % hash->count + SXE_HASH_BUCKETS_RESERVED;             \
+                                                                                                                     \
+        return sxe_hash_look_in_bucket_sized(hash, array, key, bucket, SIZE);                                        \
+    }
+
+SXE_HASH_FIXED_KEY_SIZES(SXE_HASH_LOOK_CHAINED_SIZED);
+
+#define SXE_HASH_LOOK_CHAINED_CASE(SIZE) case SIZE: id = sxe_hash_look_chained_##SIZE(hash, array, key); goto SXE_FILTER_OUT;
+
 /**
  * Look for a key in the hash
  *
@@ -142,35 +527,138 @@ sxe_hash_take(void * array)
  * @param key   = Pointer to the key value
  *
  * @return Index of the element found or SXE_HASH_KEY_NOT_FOUND
+ *
+ * @note Lookups of keys of 4, 8, 16 and 20 bytes (IPv4 and IPv6 addresses, 64 bit ids and SHA1s) are specialized for the key size:
+ *       keys are compared as integers or vectors, and prehashed sums and wyhash (see sxe_hash_set_function()) are inlined
+ *
+ * @note If the hash has a filter (see sxe_hash_set_filter()), it is consulted first. If the hash is in cache mode (see
+ *       sxe_hash_set_cache()), the lookup is counted and the element found is marked as referenced.
  */
 unsigned
 sxe_hash_look(void * array, const void * key)
 {
-    SXE_HASH      * hash = SXE_HASH_ARRAY_TO_IMPL(array);
-    unsigned        id   = SXE_HASH_KEY_NOT_FOUND;
-    unsigned        bucket;
-    SXE_POOL_WALKER walker;
+    SXE_HASH * hash = SXE_HASH_ARRAY_TO_IMPL(array);
+    unsigned   id   = SXE_HASH_KEY_NOT_FOUND;
+    unsigned   bucket;
 
     SXEE6("sxe_hash_look(hash=%s,key=%p)", sxe_pool_get_name(array), key);
+
+    if (hash->filter != NULL && !sxe_hash_filter_may_contain(hash->filter, sxe_hash_filter_sum(key, hash->key_size))) {
+        goto SXE_EARLY_OUT;
+    }
+
+    if (hash->options & SXE_HASH_OPTION_OPEN_ADDRESSING) {
+        id = sxe_hash_open_look(hash, key);
+        goto SXE_FILTER_OUT;
+    }
+
+    switch (hash->key_size) {
+    SXE_HASH_FIXED_KEY_SIZES(SXE_HASH_LOOK_CHAINED_CASE)
+    }
+
     bucket = hash->hash_key(key, hash->key_size) % hash->count + SXE_HASH_BUCKETS_RESERVED;
     SXEL6("Looking in bucket %u", bucket);
-    sxe_pool_walker_construct(&walker, array, bucket);
+    id = sxe_hash_look_in_bucket(hash, array, key, bucket);
 
-    while ((id = sxe_pool_walker_step(&walker)) != SXE_HASH_KEY_NOT_FOUND) {
-        if (memcmp((char *)array + id * hash->size + hash->key_offset, key, hash->key_size) == 0) {
-            break;
-        }
+SXE_FILTER_OUT:
+    if (hash->filter != NULL && id == SXE_HASH_KEY_NOT_FOUND) {
+        sxe_hash_filter_miss(hash->filter);
+    }
+
+SXE_EARLY_OUT:
+    if (hash->cache != NULL) {
+        sxe_hash_cache_look(hash->cache, id);
     }
 
     SXER6(id == SXE_HASH_KEY_NOT_FOUND ? "%sSXE_HASH_KEY_NOT_FOUND" : "%s%u", "return id=", id);
     return id;
 }
 
+/**
+ * Look for a batch of keys in the hash
+ *
+ * @param array = Pointer to the hash array
+ * @param keys  = Array of count keys, each the hash's key size
+ * @param count = Number of keys
+ * @param ids   = Array in which to return the index of each element found, or SXE_HASH_KEY_NOT_FOUND
+ *
+ * @note Keys are looked up SXE_HASH_BATCH at a time: all of their hash sums are computed, then what each lookup will read first
+ *       is prefetched, then the lookups are done. In hashes much bigger than the cache, this overlaps the cache misses of the
+ *       lookups rather than taking them one after another. Keys rejected by the hash's filter, if any, are not looked up.
+ */
+void
+sxe_hash_look_batch(void * array, const void * keys, unsigned count, unsigned * ids)
+{
+    SXE_HASH      * hash = SXE_HASH_ARRAY_TO_IMPL(array);
+    const uint8_t * key;
+    unsigned        sums[SXE_HASH_BATCH];
+    bool            skip[SXE_HASH_BATCH];
+    unsigned        first;
+    unsigned        batch;
+    unsigned        i;
+    unsigned        id;
+
+    SXEE6("sxe_hash_look_batch(hash=%s,keys=%p,count=%u,ids=%p)", sxe_pool_get_name(array), keys, count, ids);
+
+    for (first = 0; first < count; first += batch) {
+        batch = count - first < SXE_HASH_BATCH ? count - first : SXE_HASH_BATCH;
+        key   = (const uint8_t *)keys + (size_t)first * hash->key_size;
+
+        for (i = 0; i < batch; i++) {
+            skip[i] = hash->filter != NULL
+                   && !sxe_hash_filter_may_contain(hash->filter, sxe_hash_filter_sum(key + (size_t)i * hash->key_size,
+                                                                                       hash->key_size));
+            sums[i] = skip[i] ? 0 : hash->hash_key(key + (size_t)i * hash->key_size, hash->key_size);
+        }
+
+        if (hash->options & SXE_HASH_OPTION_OPEN_ADDRESSING) {
+            sxe_hash_open_look_batch(hash, key, sums, batch, hash->filter != NULL ? skip : NULL, &ids[first]);
+        }
+        else {
+            /* Prefetch the head of each key's chain, then the first element in it
+             */
+            for (i = 0; i < batch; i++) {
+                sums[i] = sums[i] % hash->count + SXE_HASH_BUCKETS_RESERVED;
+
+                if (!skip[i]) {
+                    sxe_pool_prefetch_state(array, sums[i]);
+                }
+            }
+
+            for (i = 0; i < batch; i++) {
+                if (!skip[i] && (id = sxe_pool_get_oldest_element_index(array, sums[i])) != SXE_POOL_NO_INDEX) {
+                    __builtin_prefetch((char *)array + (size_t)id * hash->size + hash->key_offset);
+                }
+            }
+
+            for (i = 0; i < batch; i++) {
+                ids[first + i] = skip[i] ? SXE_HASH_KEY_NOT_FOUND
+                                         : sxe_hash_look_in_bucket(hash, array, key + (size_t)i * hash->key_size, sums[i]);
+            }
+        }
+
+        for (i = 0; hash->filter != NULL && i < batch; i++) {
+            if (!skip[i] && ids[first + i] == SXE_HASH_KEY_NOT_FOUND) {
+                sxe_hash_filter_miss(hash->filter);
+            }
+        }
+
+        for (i = 0; hash->cache != NULL && i < batch; i++) {
+            sxe_hash_cache_look(hash->cache, ids[first + i]);
+        }
+    }
+
+    SXER6("return");
+}
+
 /**
  * Add an element to the hash
  *
  * @param array = Pointer to the hash array
  * @param id    = Index of the element to hash
+ *
+ * @note Adding to a concurrent hash never waits for readers: tables replaced by rehashes are freed once no reader can still be
+ *       probing them. It can be called in a read section; sxe_hash_take() can't, if the hash may be full.
  */
 void
 sxe_hash_add(void * array, unsigned id)
@@ -181,10 +669,25 @@ sxe_hash_add(void * array, unsigned id)
 
     SXEE6("sxe_hash_add(hash=%s,id=%u)", sxe_pool_get_name(array), id);
 
+    if (hash->filter != NULL) {    /* Before the element can be found, so that no lookup that can see it is rejected */
+        sxe_hash_filter_add(hash->filter, sxe_hash_filter_sum(SXE_HASH_ELEMENT_KEY(hash, id), hash->key_size));
+    }
+
+    if (hash->options & SXE_HASH_OPTION_OPEN_ADDRESSING) {
+        sxe_hash_open_add(hash, id);
+        goto SXE_EARLY_OUT;
+    }
+
     key = &((char *)array)[id * hash->size + hash->key_offset];
     bucket = hash->hash_key(key, hash->key_size) % hash->count + SXE_HASH_BUCKETS_RESERVED;
     SXEL6("Adding element %u to bucket %u", id, bucket);
     sxe_pool_set_indexed_element_state(array, id, SXE_HASH_NEW_BUCKET, bucket);
+
+SXE_EARLY_OUT:
+    if (hash->cache != NULL) {
+        sxe_hash_cache_add(hash, id);
+    }
+
     SXER6("return");
 }
 
@@ -194,6 +697,26 @@ sxe_hash_give(void * array, unsigned id)
     SXE_HASH * hash  = SXE_HASH_ARRAY_TO_IMPL(array);
 
     SXEE6("sxe_hash_give(hash=%s,id=%u)", sxe_pool_get_name(array), id);
-    sxe_pool_set_indexed_element_state(hash->pool, id, sxe_pool_index_to_state(array, id), SXE_HASH_UNUSED_BUCKET);
+
+    if (hash->cache != NULL && !sxe_hash_cache_give(hash, id)) {
+        goto SXE_EARLY_OUT;    /* The element is being evicted, and the eviction will give it */
+    }
+
+    sxe_hash_give_element(hash, id);
+
+SXE_EARLY_OUT:
     SXER6("return");
 }
+
+/* Remove an element from the hash and free it, leaving the cache alone; called by sxe_hash_give() and sxe_hash_cache_evict()
+ */
+void
+sxe_hash_give_element(SXE_HASH * hash, unsigned id)
+{
+    if (hash->options & SXE_HASH_OPTION_OPEN_ADDRESSING) {
+        sxe_hash_open_give(hash, id);
+    }
+    else {
+        sxe_pool_set_indexed_element_state(hash->pool, id, sxe_pool_index_to_state(hash->pool, id), SXE_HASH_UNUSED_BUCKET);
+    }
+}
@@ -26,6 +26,7 @@
 
 #include "sha1.h"
 #include "sxe-pool.h"
+#include "sxe-spinlock.h"
 #include "sxe-util.h"
 
 #define SXE_HASH_KEY_NOT_FOUND       ~0U
@@ -36,6 +37,16 @@
 #define SXE_HASH_OPTION_LOCKED        SXE_BIT_OPTION(0)
 #define SXE_HASH_OPTION_PREHASHED     0
 #define SXE_HASH_OPTION_COMPUTED_HASH SXE_BIT_OPTION(1)
+#define SXE_HASH_OPTION_OPEN_ADDRESSING SXE_BIT_OPTION(2)    /* Index elements in a Swiss table rather than chaining them */
+#define SXE_HASH_OPTION_RESIZABLE       SXE_BIT_OPTION(3)    /* Set by sxe_hash_new_resizable(); don't use directly       */
+#define SXE_HASH_OPTION_CONCURRENT      SXE_BIT_OPTION(8)    /* Lookups take no lock (implies open addressing and locked) */
+
+/* Memory options for big hashes; these are passed through to sxe_pool_memory_map() (see sxe_pool_new())
+ */
+#define SXE_HASH_OPTION_HUGE_PAGES      SXE_POOL_OPTION_HUGE_PAGES
+#define SXE_HASH_OPTION_HUGE_PAGES_1G   SXE_POOL_OPTION_HUGE_PAGES_1G
+#define SXE_HASH_OPTION_PREFAULT        SXE_POOL_OPTION_PREFAULT
+#define SXE_HASH_OPTION_NUMA_NODE(node) SXE_POOL_OPTION_NUMA_NODE(node)
 
 /* For backward compatibility. Lookup3 (the default algorithm) can now be overridden.
  */
@@ -48,16 +59,114 @@ typedef struct SXE_HASH_KEY_VALUE_PAIR {
     unsigned    value;
 } SXE_HASH_KEY_VALUE_PAIR;
 
+/* Hash functions for computed hash sums (see sxe_hash_function()). SXE_HASH_FUNCTION_GLOBAL means the hash uses sxe_hash_sum
+ * (or the key, if prehashed); the others are chosen per hash with sxe_hash_set_function().
+ */
+typedef enum SXE_HASH_FUNCTION {
+    SXE_HASH_FUNCTION_GLOBAL,
+    SXE_HASH_FUNCTION_LOOKUP3,
+    SXE_HASH_FUNCTION_XXH32,
+    SXE_HASH_FUNCTION_XXH3,
+    SXE_HASH_FUNCTION_CRC32C,
+    SXE_HASH_FUNCTION_WYHASH,
+    SXE_HASH_FUNCTION_AES,
+    SXE_HASH_FUNCTION_BEST       /* The fastest that avalanches well; resolved to one of the above when chosen */
+} SXE_HASH_FUNCTION;
+
+/* Blocked Bloom filter in front of a hash (see sxe_hash_set_filter()) or a cdb instance. Each key sets one bit in each of the
+ * SXE_HASH_FILTER_WORDS words of one cache line sized block, so a lookup of a key that was never added is usually rejected after
+ * reading a single cache line. The filter is one block of memory, header included, so it can be saved and copied as is.
+ */
+#define SXE_HASH_FILTER_WORDS      8
+#define SXE_HASH_FILTER_BLOCK_SIZE (SXE_HASH_FILTER_WORDS * sizeof(uint64_t))
+
+typedef struct SXE_HASH_FILTER {
+    uint64_t magic;              /* SXE_HASH_FILTER_MAGIC, which includes the version of the layout             */
+    uint64_t blocks;             /* Number of blocks                                                            */
+    uint64_t keys;               /* Number of keys added                                                        */
+    uint64_t rejected;           /* Number of lookups rejected                                                  */
+    uint64_t false_positives;    /* Number of lookups passed for keys that weren't found (see sxe_hash_filter_miss()) */
+    uint64_t reserved[3];
+    uint64_t words[];            /* blocks * SXE_HASH_FILTER_WORDS words, starting on a cache line              */
+} SXE_HASH_FILTER;
+
+/* Cache mode (see sxe_hash_set_cache()): when the hash is full, sxe_hash_take() evicts an element chosen by a CLOCK hand sweeping
+ * the elements. Each element has a flags byte; lookups that find it set its referenced bit. The cached elements are split into a
+ * probationary and a protected segment: new elements start on probation and are promoted if referenced again before the hand
+ * comes round, so keys that are only seen once (e.g. a crawler's) are evicted before the working set.
+ */
+#define SXE_HASH_CACHE_CACHED     0x01    /* Element is in the hash                          */
+#define SXE_HASH_CACHE_PROTECTED  0x02    /* Element is in the protected segment             */
+#define SXE_HASH_CACHE_REFERENCED 0x04    /* Element was found since the hand last passed it */
+#define SXE_HASH_CACHE_EVICTING   0x08    /* Element is being evicted; only the evicting thread gives it back */
+
+typedef void (* SXE_HASH_EVICT_FUNC)(void * array, unsigned id, void * user_data);
+
+typedef struct SXE_HASH_CACHE {
+    SXE_HASH_EVICT_FUNC evict;              /* Called with each element evicted, before it is given back, or NULL */
+    void              * user_data;          /* Passed to evict                                                    */
+    uint64_t            hits;               /* Number of lookups that found their key; approximate if concurrent  */
+    uint64_t            misses;             /* Number of lookups that didn't; approximate if concurrent           */
+    uint64_t            evictions;          /* Number of elements evicted                                         */
+    unsigned            cached;             /* Number of elements in the hash                                     */
+    unsigned            protected_count;    /* Number of them in the protected segment                            */
+    unsigned            protected_max;      /* Maximum number in the protected segment                            */
+    unsigned            hand;               /* Index of the next element the hand looks at                        */
+    SXE_SPINLOCK        lock;               /* Taken by adds, gives and evictions if the hash is locked           */
+    uint8_t             flags[];            /* SXE_HASH_CACHE_* flags of each element                             */
+} SXE_HASH_CACHE;
+
+/* A table replaced by a rehash of a concurrent hash; it is freed once no reader that might still be probing it is reading
+ */
+typedef struct SXE_HASH_RETIRED_TABLE {
+    struct SXE_HASH_RETIRED_TABLE * next;      /* Next older retired table, or NULL */
+    uint8_t                       * table;
+    unsigned                        groups;
+    uint64_t                        epoch;     /* Epoch the table was retired in    */
+} SXE_HASH_RETIRED_TABLE;
+
+/* Open addressing hashes keep a one byte control per slot: the top 7 bits of the key's hash sum if used, otherwise empty or
+ * deleted. Controls are matched a group at a time, and the key is only compared when its 7 bit tag matches.
+ */
+#define SXE_HASH_GROUP_SIZE 16
+
 typedef struct SXE_HASH {
-    void      * pool;
-    unsigned    count;
-    unsigned    size;
-    unsigned    key_offset;
-    unsigned    key_size;
-    unsigned    options;
-    unsigned (* hash_key)(const void * key, unsigned size);
+    void       * pool;
+    unsigned     count;
+    unsigned     size;
+    unsigned     key_offset;
+    unsigned     key_size;
+    unsigned     options;
+    unsigned  (* hash_key)(const void * key, unsigned size);
+    unsigned     function;        /* SXE_HASH_FUNCTION hash_key was chosen by, or SXE_HASH_FUNCTION_GLOBAL                  */
+    uint8_t    * table;           /* Open addressing: control groups followed by the slots                                   */
+    unsigned     groups;          /* Open addressing: number of groups of SXE_HASH_GROUP_SIZE slots; a power of 2          */
+    unsigned     slot_size;       /* Open addressing: size of a slot (element index followed by a copy of the key)         */
+    unsigned     empty;           /* Open addressing: number of empty slots                                                */
+    unsigned     deleted;         /* Open addressing: number of deleted slots (tombstones)                                 */
+    uint8_t    * old_table;       /* Resizable: table being migrated, or NULL                                              */
+    unsigned     old_groups;      /* Resizable: number of groups in the old table                                          */
+    unsigned     migrated;        /* Resizable: number of groups of the old table migrated so far                          */
+    unsigned     segment;         /* Resizable: number of elements the pool starts with and grows by                       */
+    uint64_t     retire_epoch;    /* Concurrent: epoch of the latest retirement; reclaimed once no reader predates it      */
+    SXE_HASH_RETIRED_TABLE * retired_tables;    /* Concurrent: tables replaced by rehashes but not yet freed, newest first */
+    SXE_SPINLOCK lock;            /* Open addressing: taken for reading by lookups and for writing by changes, if locked  */
+    SXE_HASH_FILTER * filter;     /* Filter consulted before each lookup (see sxe_hash_set_filter()), or NULL              */
+    SXE_HASH_CACHE  * cache;      /* Cache mode state (see sxe_hash_set_cache()), or NULL                                 */
 } SXE_HASH;
 
+/* Readers of concurrent hashes announce the epoch they started reading in, so that writers know when no reader can still see a
+ * given element or slot. Each thread that reads has one of SXE_HASH_READERS_MAX records, each in its own cache line.
+ */
+#define SXE_HASH_READERS_MAX 128
+
+typedef struct SXE_HASH_READER {
+    volatile uint64_t epoch;    /* Epoch when the current read section started, or 0 if not reading */
+    unsigned          depth;    /* Nesting depth of sxe_hash_read_begin() and lookups               */
+    volatile unsigned owned;    /* Set while a thread owns the record                               */
+    uint8_t           pad[64 - sizeof(uint64_t) - 2 * sizeof(unsigned)];
+} SXE_HASH_READER;
+
 typedef unsigned (*SXE_HASH_FUNC)(const void *, unsigned);    // Type signature for a hash function
 
 extern uint32_t (*sxe_hash_sum)(const void *key, unsigned length);
@@ -19,14 +19,546 @@
  * THE SOFTWARE.
  */
 
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>    /* For snprintf on Windows */
 #include <inttypes.h>
 
 #include "sha1.h"
 #include "sxe-hash.h"
+#include "sxe-log.h"
+#include "sxe-test-get-temp-file-name.h"
 #include "sxe-time.h"
 
+static SXE_TIME
+bench_look(SOPHOS_SHA1 * hash, const SOPHOS_SHA1 * keys, unsigned number, bool hits)
+{
+    SXE_TIME start_time = sxe_time_get();
+    unsigned found      = 0;
+    unsigned i;
+
+    for (i = 0; i < number; i++) {
+        found += sxe_hash_look(hash, &keys[i]) != SXE_HASH_KEY_NOT_FOUND;
+    }
+
+    SXEA1(found == (hits ? number : 0), "Expected %u hits, got %u", hits ? number : 0, found);
+    return sxe_time_get() - start_time;
+}
+
+/* Compare lookups of prehashed SHA1 keys in chained and open addressing hashes at 50% and 90% load
+ */
+static void
+bench_engines(unsigned count)
+{
+    static const unsigned loads[] = {50, 90};
+    static const struct {
+        const char * name;
+        unsigned     options;
+    } engines[] = {{"chained", SXE_HASH_OPTION_UNLOCKED}, {"open", SXE_HASH_OPTION_UNLOCKED | SXE_HASH_OPTION_OPEN_ADDRESSING}};
+    SOPHOS_SHA1 * keys;
+    SOPHOS_SHA1 * hash;
+    SXE_TIME      elapsed;
+    unsigned      number;
+    unsigned      engine;
+    unsigned      load;
+    unsigned      i;
+    unsigned      id;
+    char          key[16];
+
+    sxe_log_set_level(SXE_LOG_LEVEL_WARNING);
+    SXEA1(keys = malloc(2 * (size_t)count * sizeof(*keys)), "Failed to allocate %u keys", 2 * count);
+
+    for (i = 0; i < 2 * count; i++) {
+        snprintf(key, sizeof(key), "%08x", i);
+        sophos_sha1(key, 8, (char *)&keys[i]);
+    }
+
+    for (load = 0; load < sizeof(loads) / sizeof(loads[0]); load++) {
+        number = (unsigned)((uint64_t)count * loads[load] / 100);
+
+        for (engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+            hash = sxe_hash_new_plus("benchhash", count, sizeof(SXE_HASH_KEY_VALUE_PAIR), 0, sizeof(SOPHOS_SHA1),
+                                     engines[engine].options);
+
+            for (i = 0; i < number; i++) {
+                id = sxe_hash_take(hash);
+                memcpy(&((SXE_HASH_KEY_VALUE_PAIR *)hash)[id].sha1, &keys[i], sizeof(keys[i]));
+                sxe_hash_add(hash, id);
+            }
+
+            elapsed = bench_look(hash, keys, number, true);
+            printf("%-7s %u%% of %u: %10u hits per second\n", engines[engine].name, loads[load], count,
+                   (unsigned)(((uint64_t)number << SXE_TIME_BITS_IN_FRACTION) / elapsed));
+            elapsed = bench_look(hash, &keys[count], number, false);
+            printf("%-7s %u%% of %u: %10u misses per second\n", engines[engine].name, loads[load], count,
+                   (unsigned)(((uint64_t)number << SXE_TIME_BITS_IN_FRACTION) / elapsed));
+            sxe_hash_delete(hash);
+        }
+    }
+
+    free(keys);
+}
+
+#define BENCH_SUMS        (1 << 22)
+#define BENCH_AVALANCHE   10000
+#define BENCH_BUFFER_SIZE 4096
+
+static uint64_t bench_random_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t
+bench_random(void)
+{
+    bench_random_state ^= bench_random_state << 13;
+    bench_random_state ^= bench_random_state >> 7;
+    bench_random_state ^= bench_random_state << 17;
+    return bench_random_state;
+}
+
+/* Worst bias of any sum bit when one bit of a key is flipped, over up to 64 bits spread across the key: 0 if every sum bit flips
+ * half the time, 1 if some sum bit never or always flips
+ */
+static double
+bench_avalanche(SXE_HASH_FUNC hash_sum, unsigned length)
+{
+    static unsigned flips[64][32];
+    uint8_t         key[256];
+    unsigned        step = (length * 8 + 63) / 64;
+    unsigned        bits = length * 8 / step;
+    unsigned        sum;
+    unsigned        diff;
+    unsigned        bit;
+    unsigned        out;
+    unsigned        i;
+    double          bias = 0;
+    double          p;
+
+    memset(flips, 0, sizeof(flips));
+
+    for (i = 0; i < BENCH_AVALANCHE; i++) {
+        for (bit = 0; bit < length; bit++) {
+            key[bit] = (uint8_t)bench_random();
+        }
+
+        sum = hash_sum(key, length);
+
+        for (bit = 0; bit < bits; bit++) {
+            key[bit * step / 8] ^= 1 << (bit * step % 8);
+            diff                 = hash_sum(key, length) ^ sum;
+            key[bit * step / 8] ^= 1 << (bit * step % 8);
+
+            for (out = 0; out < 32; out++) {
+                flips[bit][out] += (diff >> out) & 1;
+            }
+        }
+    }
+
+    for (bit = 0; bit < bits; bit++) {
+        for (out = 0; out < 32; out++) {
+            p    = (double)flips[bit][out] / BENCH_AVALANCHE;
+            bias = p > 0.5 ? (2 * p - 1 > bias ? 2 * p - 1 : bias) : (1 - 2 * p > bias ? 1 - 2 * p : bias);
+        }
+    }
+
+    return bias;
+}
+
+/* Compare the throughput and quality of the hash functions available on this CPU for key lengths from 4 to 256 bytes
+ */
+static void
+bench_functions(void)
+{
+    static const unsigned lengths[] = {4, 8, 16, 20, 32, 64, 128, 256};
+    static uint8_t        buffer[BENCH_BUFFER_SIZE];
+    SXE_HASH_FUNCTION     function;
+    SXE_HASH_FUNC         hash_sum;
+    SXE_TIME              elapsed;
+    unsigned              length;
+    unsigned              total = 0;
+    unsigned              i;
+    unsigned              l;
+
+    sxe_log_set_level(SXE_LOG_LEVEL_WARNING);
+
+    for (i = 0; i < BENCH_BUFFER_SIZE; i++) {
+        buffer[i] = (uint8_t)bench_random();
+    }
+
+    printf("%-8s %6s %12s %10s %10s\n", "function", "length", "sums/second", "MB/second", "avalanche");
+
+    for (function = SXE_HASH_FUNCTION_LOOKUP3; function < SXE_HASH_FUNCTION_BEST; function++) {
+        if ((hash_sum = sxe_hash_function(function)) == NULL) {
+            printf("%-8s not available\n", sxe_hash_function_name(function));
+            continue;
+        }
+
+        for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            SXE_TIME start_time = sxe_time_get();
+
+            length = lengths[l];
+
+            for (i = 0; i < BENCH_SUMS; i++) {
+                total += hash_sum(&buffer[(i * 61 + total % 3) % (BENCH_BUFFER_SIZE - length)], length);
+            }
+
+            elapsed = sxe_time_get() - start_time;
+            printf("%-8s %6u %12u %10.0f %10.3f\n", sxe_hash_function_name(function), length,
+                   (unsigned)(((uint64_t)BENCH_SUMS << SXE_TIME_BITS_IN_FRACTION) / elapsed),
+                   (double)BENCH_SUMS * length / sxe_time_to_double_seconds(elapsed) / 1e6, bench_avalanche(hash_sum, length));
+        }
+    }
+
+    for (function = SXE_HASH_FUNCTION_LOOKUP3; sxe_hash_function(function) != sxe_hash_function(SXE_HASH_FUNCTION_BEST); function++) {
+    }
+
+    printf("best is %s (total of sums %u)\n", sxe_hash_function_name(function), total);
+}
+
+/* Lookups of keys of 4, 8, 16 and 20 bytes in chained and open addressing hashes of count elements at 50% load, with prehashed
+ * sums, lookup3 through sxe_hash_sum and wyhash chosen with sxe_hash_set_function()
+ */
+static void
+bench_fixed(unsigned count)
+{
+    static const unsigned sizes[] = {4, 8, 16, 20};
+    static const struct {
+        const char      * name;
+        unsigned          options;
+        SXE_HASH_FUNCTION function;
+    } engines[] = {{"chained prehashed", 0, SXE_HASH_FUNCTION_GLOBAL},
+                   {"chained lookup3",   SXE_HASH_OPTION_COMPUTED_HASH, SXE_HASH_FUNCTION_GLOBAL},
+                   {"chained wyhash",    0, SXE_HASH_FUNCTION_WYHASH},
+                   {"open prehashed",    SXE_HASH_OPTION_OPEN_ADDRESSING, SXE_HASH_FUNCTION_GLOBAL},
+                   {"open lookup3",      SXE_HASH_OPTION_OPEN_ADDRESSING | SXE_HASH_OPTION_COMPUTED_HASH, SXE_HASH_FUNCTION_GLOBAL},
+                   {"open wyhash",       SXE_HASH_OPTION_OPEN_ADDRESSING, SXE_HASH_FUNCTION_WYHASH}};
+    uint8_t  (* keys)[20];
+    uint8_t  (* hash)[20];
+    SXE_TIME    start_time;
+    SXE_TIME    elapsed;
+    unsigned    number = count / 2;
+    unsigned    engine;
+    unsigned    found;
+    unsigned    size;
+    unsigned    i;
+    unsigned    j;
+    unsigned    id;
+
+    sxe_log_set_level(SXE_LOG_LEVEL_WARNING);
+    SXEA1(keys = malloc((size_t)number * sizeof(*keys)), "Failed to allocate %u keys", number);
+
+    for (i = 0; i < number; i++) {
+        for (j = 0; j < sizeof(*keys); j++) {
+            keys[i][j] = (uint8_t)bench_random();
+        }
+    }
+
+    for (size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++) {
+        for (engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+            hash = sxe_hash_new_plus("benchhash", count, sizeof(*hash), 0, sizes[size], engines[engine].options);
+
+            if (engines[engine].function != SXE_HASH_FUNCTION_GLOBAL) {
+                sxe_hash_set_function(hash, engines[engine].function);
+            }
+
+            for (i = 0; i < number; i++) {
+                id = sxe_hash_take(hash);
+                memcpy(hash[id], keys[i], sizeof(*keys));
+                sxe_hash_add(hash, id);
+            }
+
+            start_time = sxe_time_get();
+            found      = 0;
+
+            for (j = 0; j < 4; j++) {
+                for (i = 0; i < number; i++) {
+                    found += sxe_hash_look(hash, keys[i]) != SXE_HASH_KEY_NOT_FOUND;
+                }
+            }
+
+            elapsed = sxe_time_get() - start_time;
+            SXEA1(found == 4 * number, "Expected %u hits, got %u", 4 * number, found);
+            printf("%2u byte keys, %-17s: %10u hits per second\n", sizes[size], engines[engine].name,
+                   (unsigned)(((uint64_t)4 * number << SXE_TIME_BITS_IN_FRACTION) / elapsed));
+            sxe_hash_delete(hash);
+        }
+    }
+
+    free(keys);
+}
+
+#define BENCH_BATCH 256
+
+/* Compare single and batched lookups of prehashed SHA1 keys in chained and open addressing hashes of count elements at 90% load
+ */
+static void
+bench_batch(unsigned count)
+{
+    static const struct {
+        const char * name;
+        unsigned     options;
+    } engines[] = {{"chained", SXE_HASH_OPTION_UNLOCKED}, {"open", SXE_HASH_OPTION_UNLOCKED | SXE_HASH_OPTION_OPEN_ADDRESSING}};
+    SOPHOS_SHA1 * keys;
+    SOPHOS_SHA1 * hash;
+    SXE_TIME      start_time;
+    SXE_TIME      elapsed;
+    unsigned      ids[BENCH_BATCH];
+    unsigned      number = (unsigned)((uint64_t)count * 90 / 100);
+    unsigned      engine;
+    unsigned      found;
+    unsigned      i;
+    unsigned      j;
+    unsigned      id;
+    char          key[16];
+
+    sxe_log_set_level(SXE_LOG_LEVEL_WARNING);
+    SXEA1(keys = malloc((size_t)number * sizeof(*keys)), "Failed to allocate %u keys", number);
+
+    for (i = 0; i < number; i++) {
+        snprintf(key, sizeof(key), "%08x", i);
+        sophos_sha1(key, 8, (char *)&keys[i]);
+    }
+
+    for (engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+        hash = sxe_hash_new_plus("benchhash", count, sizeof(SXE_HASH_KEY_VALUE_PAIR), 0, sizeof(SOPHOS_SHA1),
+                                 engines[engine].options);
+
+        for (i = 0; i < number; i++) {
+            id = sxe_hash_take(hash);
+            memcpy(&((SXE_HASH_KEY_VALUE_PAIR *)hash)[id].sha1, &keys[i], sizeof(keys[i]));
+            sxe_hash_add(hash, id);
+        }
+
+        elapsed = bench_look(hash, keys, number, true);
+        printf("%-7s single of %u: %10u hits per second\n", engines[engine].name, count,
+               (unsigned)(((uint64_t)number << SXE_TIME_BITS_IN_FRACTION) / elapsed));
+
+        start_time = sxe_time_get();
+        found      = 0;
+
+        for (i = 0; i < number; i += BENCH_BATCH) {
+            sxe_hash_look_batch(hash, &keys[i], number - i < BENCH_BATCH ? number - i : BENCH_BATCH, ids);
+
+            for (j = 0; j < BENCH_BATCH && i + j < number; j++) {
+                found += ids[j] != SXE_HASH_KEY_NOT_FOUND;
+            }
+        }
+
+        elapsed = sxe_time_get() - start_time;
+        SXEA1(found == number, "Expected %u hits, got %u", number, found);
+        printf("%-7s batch  of %u: %10u hits per second\n", engines[engine].name, count,
+               (unsigned)(((uint64_t)number << SXE_TIME_BITS_IN_FRACTION) / elapsed));
+        sxe_hash_delete(hash);
+    }
+
+    free(keys);
+}
+
+/* Compare hits and misses of prehashed SHA1 keys in chained and open addressing hashes of count elements at 90% load, with and
+ * without a filter of 10 bits per element in front of them
+ */
+static void
+bench_filter(unsigned count)
+{
+    static const struct {
+        const char * name;
+        unsigned     options;
+    } engines[] = {{"chained", SXE_HASH_OPTION_UNLOCKED}, {"open", SXE_HASH_OPTION_UNLOCKED | SXE_HASH_OPTION_OPEN_ADDRESSING}};
+    SOPHOS_SHA1 * keys;
+    SOPHOS_SHA1 * hash;
+    SXE_TIME      elapsed;
+    unsigned      number = (unsigned)((uint64_t)count * 90 / 100);
+    unsigned      engine;
+    unsigned      bits;
+    unsigned      i;
+    unsigned      id;
+    char          key[16];
+
+    sxe_log_set_level(SXE_LOG_LEVEL_WARNING);
+    SXEA1(keys = malloc(2 * (size_t)number * sizeof(*keys)), "Failed to allocate %u keys", 2 * number);
+
+    for (i = 0; i < 2 * number; i++) {
+        snprintf(key, sizeof(key), "%08x", i);
+        sophos_sha1(key, 8, (char *)&keys[i]);
+    }
+
+    for (engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+        hash = sxe_hash_new_plus("benchhash", count, sizeof(SXE_HASH_KEY_VALUE_PAIR), 0, sizeof(SOPHOS_SHA1),
+                                 engines[engine].options);
+
+        for (i = 0; i < number; i++) {
+            id = sxe_hash_take(hash);
+            memcpy(&((SXE_HASH_KEY_VALUE_PAIR *)hash)[id].sha1, &keys[i], sizeof(keys[i]));
+            sxe_hash_add(hash, id);
+        }
+
+        for (bits = 0; bits <= 10; bits += 10) {
+            sxe_hash_set_filter(hash, bits);
+            elapsed = bench_look(hash, keys, number, true);
+            printf("%-7s %2u bit filter of %u: %10u hits per second\n", engines[engine].name, bits, count,
+                   (unsigned)(((uint64_t)number << SXE_TIME_BITS_IN_FRACTION) / elapsed));
+            elapsed = bench_look(hash, &keys[number], number, false);
+            printf("%-7s %2u bit filter of %u: %10u misses per second", engines[engine].name, bits, count,
+                   (unsigned)(((uint64_t)number << SXE_TIME_BITS_IN_FRACTION) / elapsed));
+
+            if (bits) {
+                printf(" (%.2f%% false positives)", 100.0 * sxe_hash_filter_get_false_positive_rate(sxe_hash_get_filter(hash)));
+            }
+
+            printf("\n");
+        }
+
+        sxe_hash_delete(hash);
+    }
+
+    free(keys);
+}
+
+#define BENCH_READER_LOOKS (1 << 22)
+
+static SOPHOS_SHA1 * bench_keys;
+static SOPHOS_SHA1 * bench_hash;
+static unsigned      bench_number;
+static unsigned      bench_done;    /* Number of readers done */
+
+static void *
+bench_reader(void * arg)
+{
+    unsigned found = 0;
+    unsigned i;
+
+    for (i = (unsigned)(uintptr_t)arg; i < (unsigned)(uintptr_t)arg + BENCH_READER_LOOKS; i++) {
+        found += sxe_hash_look(bench_hash, &bench_keys[i % bench_number]) != SXE_HASH_KEY_NOT_FOUND;
+    }
+
+    __atomic_add_fetch(&bench_done, 1, __ATOMIC_RELEASE);
+
+    return (void *)(uintptr_t)found;
+}
+
+/* Compare lookups by reader threads in a locked and a concurrent open addressing hash of count elements, while a writer gives and
+ * adds the last 1/16th of the keys
+ */
+static void
+bench_concurrent(unsigned readers)
+{
+    static const struct {
+        const char * name;
+        unsigned     options;
+    } engines[] = {{"locked", SXE_HASH_OPTION_LOCKED | SXE_HASH_OPTION_OPEN_ADDRESSING}, {"concurrent", SXE_HASH_OPTION_CONCURRENT}};
+    pthread_t * threads;
+    SXE_TIME    start_time;
+    SXE_TIME    elapsed;
+    unsigned    count = 1 << 20;
+    unsigned    engine;
+    unsigned    writes;
+    unsigned    i;
+    unsigned    id;
+    char        key[16];
+
+    sxe_log_set_level(SXE_LOG_LEVEL_WARNING);
+    bench_number = count / 2;
+    SXEA1(bench_keys = malloc((size_t)bench_number * sizeof(*bench_keys)), "Failed to allocate %u keys", bench_number);
+    SXEA1(threads = malloc(readers * sizeof(*threads)), "Failed to allocate %u threads", readers);
+
+    for (i = 0; i < bench_number; i++) {
+        snprintf(key, sizeof(key), "%08x", i);
+        sophos_sha1(key, 8, (char *)&bench_keys[i]);
+    }
+
+    for (engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+        bench_hash = sxe_hash_new_plus("benchhash", count, sizeof(SXE_HASH_KEY_VALUE_PAIR), 0, sizeof(SOPHOS_SHA1),
+                                       engines[engine].options);
+
+        for (i = 0; i < bench_number; i++) {
+            id = sxe_hash_take(bench_hash);
+            memcpy(&((SXE_HASH_KEY_VALUE_PAIR *)bench_hash)[id].sha1, &bench_keys[i], sizeof(bench_keys[i]));
+            sxe_hash_add(bench_hash, id);
+        }
+
+        start_time = sxe_time_get();
+        bench_done = 0;
+
+        for (i = 0; i < readers; i++) {
+            SXEA1(pthread_create(&threads[i], NULL, bench_reader, (void *)(uintptr_t)(i * (bench_number / readers))) == 0,
+                  "Failed to create reader thread %u", i);
+        }
+
+        for (writes = 0; __atomic_load_n(&bench_done, __ATOMIC_ACQUIRE) < readers; writes++) {
+            i = bench_number - bench_number / 16 + writes % (bench_number / 16);
+            sxe_hash_give(bench_hash, sxe_hash_look(bench_hash, &bench_keys[i]));
+            id = sxe_hash_take(bench_hash);
+            memcpy(&((SXE_HASH_KEY_VALUE_PAIR *)bench_hash)[id].sha1, &bench_keys[i], sizeof(bench_keys[i]));
+            sxe_hash_add(bench_hash, id);
+        }
+
+        for (i = 0; i < readers; i++) {
+            pthread_join(threads[i], NULL);
+        }
+
+        elapsed = sxe_time_get() - start_time;
+        printf("%-10s %u readers: %10u lookups and %8u writes per second\n", engines[engine].name, readers,
+               (unsigned)(((uint64_t)readers * BENCH_READER_LOOKS << SXE_TIME_BITS_IN_FRACTION) / elapsed),
+               (unsigned)(((uint64_t)writes << SXE_TIME_BITS_IN_FRACTION) / elapsed));
+        sxe_hash_delete(bench_hash);
+    }
+
+    free(threads);
+    free(bench_keys);
+}
+
+/* Compare the time to rebuild a hash of prehashed SHA1 keys with the time to save it and to load it from its snapshot
+ */
+static void
+bench_snapshot(unsigned count)
+{
+    SOPHOS_SHA1 * keys;
+    SOPHOS_SHA1 * hash;
+    SXE_MMAP      memmap;
+    SXE_TIME      start_time;
+    SXE_TIME      elapsed;
+    char          path[PATH_MAX];
+    unsigned      path_used;
+    unsigned      i;
+    unsigned      id;
+    char          key[16];
+
+    sxe_log_set_level(SXE_LOG_LEVEL_WARNING);
+    sxe_test_get_temp_file_name("test-sxe-hash-bench", path, sizeof(path), &path_used);
+    SXEA1(keys = malloc((size_t)count * sizeof(*keys)), "Failed to allocate %u keys", count);
+
+    for (i = 0; i < count; i++) {
+        snprintf(key, sizeof(key), "%08x", i);
+        sophos_sha1(key, 8, (char *)&keys[i]);
+    }
+
+    start_time = sxe_time_get();
+    hash       = sxe_hash_new_plus("benchhash", count, sizeof(SXE_HASH_KEY_VALUE_PAIR), 0, sizeof(SOPHOS_SHA1),
+                                   SXE_HASH_OPTION_UNLOCKED | SXE_HASH_OPTION_OPEN_ADDRESSING);
+
+    for (i = 0; i < count; i++) {
+        id = sxe_hash_take(hash);
+        memcpy(&((SXE_HASH_KEY_VALUE_PAIR *)hash)[id].sha1, &keys[i], sizeof(keys[i]));
+        sxe_hash_add(hash, id);
+    }
+
+    printf("build    %u elements: %8.3f seconds\n", count, sxe_time_to_double_seconds(sxe_time_get() - start_time));
+    start_time = sxe_time_get();
+    SXEA1(sxe_hash_save(hash, path), "Failed to save the hash to %s", path);
+    printf("save     %u elements: %8.3f seconds\n", count, sxe_time_to_double_seconds(sxe_time_get() - start_time));
+    sxe_hash_delete(hash);
+
+    start_time = sxe_time_get();
+    SXEA1(hash = sxe_hash_load(&memmap, path), "Failed to load the hash from %s", path);
+    printf("load     %u elements: %8.3f seconds\n", count, sxe_time_to_double_seconds(sxe_time_get() - start_time));
+    elapsed = bench_look(hash, keys, count, true);
+    printf("loaded   %u elements: %10u hits per second\n", count, (unsigned)(((uint64_t)count << SXE_TIME_BITS_IN_FRACTION) / elapsed));
+    sxe_hash_unload(hash, &memmap);
+    unlink(path);
+    free(keys);
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -36,14 +568,54 @@ main(int argc, char * argv[])
     unsigned      id;
     char          key[10];
 
-    (void)argv;
-
     if (argc == 1) {
         fprintf(stderr, "To benchmark hash, run: build-linux-32-release/test-sxe-hash-bench with options:\n");
         fprintf(stderr, "    -s = sha1 of 8 byte keys; -l = lookup3 of 8 byte keys\n");
+        fprintf(stderr, "    -o [count] = compare lookups in chained and open addressing hashes of count (default 4M) elements\n");
+        fprintf(stderr, "    -b [count] = compare single and batched lookups in hashes of count (default 4M) elements\n");
+        fprintf(stderr, "    -m [count] = compare hits and misses in hashes of count (default 4M) elements with and without a filter\n");
+        fprintf(stderr, "    -k [count] = lookups of 4, 8, 16 and 20 byte keys in hashes of count (default 64K) elements\n");
+        fprintf(stderr, "    -f = compare the throughput and avalanche of the hash functions available for keys of 4 to 256 bytes\n");
+        fprintf(stderr, "    -c [readers] = compare lookups by readers (default 4) in locked and concurrent hashes during writes\n");
+        fprintf(stderr, "    -r [count] = compare rebuilding a hash of count (default 4M) elements with saving and loading it\n");
         exit(0);
     }
 
+    if (strcmp(argv[1], "-b") == 0) {
+        bench_batch(argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : 1 << 22);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "-m") == 0) {
+        bench_filter(argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : 1 << 22);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "-c") == 0) {
+        bench_concurrent(argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : 4);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "-k") == 0) {
+        bench_fixed(argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : 1 << 16);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "-f") == 0) {
+        bench_functions();
+        return 0;
+    }
+
+    if (strcmp(argv[1], "-r") == 0) {
+        bench_snapshot(argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : 1 << 22);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "-o") == 0) {
+        bench_engines(argc > 2 ? (unsigned)strtoul(argv[2], NULL, 0) : 1 << 22);
+        return 0;
+    }
+
     hash = sxe_hash_new_plus("testhash", 1 << 16, sizeof(SXE_SHA1), 0, sizeof(SXE_SHA1), SXE_HASH_OPTION_UNLOCKED);
     start_time = sxe_time_get();
 
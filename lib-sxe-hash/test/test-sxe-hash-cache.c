@@ -0,0 +1,187 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hash-element.h"
+#include "sxe-hash.h"
+#include "sxe-log.h"
+#include "tap.h"
+
+#define TEST_SIZE   100
+#define TEST_HOT    40     /* Keys in the working set      */
+#define TEST_ROUNDS 50
+#define TEST_SCAN   100    /* Keys seen once in each round */
+
+static unsigned test_evicted;
+static unsigned test_evicted_id;
+static bool     test_evict_race = false;    /* Whether the next eviction is raced by a give and a take */
+
+static void
+test_evict(void * array, unsigned id, void * user_data)
+{
+    TEST_ELEMENT * element;
+    unsigned       other;
+
+    SXEA1(user_data == &test_evicted, "Evict function got the wrong user data");
+    SXEA1(sxe_hash_look(array, ((TEST_ELEMENT *)array)[id].key) == id, "Evicted element %u is not in the hash", id);
+    test_evicted++;
+    test_evicted_id = id;
+
+    if (test_evict_race) {    /* As another thread would, give the element being evicted, then take one and add a key to it */
+        test_evict_race = false;
+        sxe_hash_give(array, id);
+        SXEA1((other = sxe_hash_take(array)) != SXE_HASH_FULL, "A cache is never full");
+        element = &((TEST_ELEMENT *)array)[other];
+        test_key(element->key, TEST_SIZE + 1);
+        element->value = TEST_SIZE + 1;
+        sxe_hash_add(array, other);
+    }
+}
+
+/* Look a key up, adding it if it's missing
+ *
+ * @return true if it was found
+ */
+static bool
+test_get(TEST_ELEMENT * array, unsigned i)
+{
+    char     key[sizeof(((TEST_ELEMENT *)0)->key)];
+    unsigned id;
+
+    test_key(key, i);
+
+    if ((id = sxe_hash_look(array, key)) != SXE_HASH_KEY_NOT_FOUND) {
+        SXEA1(array[id].value == i, "Element %u has value %u, not %u", id, array[id].value, i);
+        return true;
+    }
+
+    SXEA1((id = sxe_hash_take(array)) != SXE_HASH_FULL, "A cache is never full");
+    memcpy(array[id].key, key, sizeof(key));
+    array[id].value = i;
+    sxe_hash_add(array, id);
+    return false;
+}
+
+/* Each round, get the working set once, then scan keys that are never seen again
+ *
+ * @return The number of hits in the working set after the first round
+ */
+static unsigned
+test_scan(const char * name, unsigned options, unsigned protected_percent)
+{
+    TEST_ELEMENT * array;
+    unsigned       hits = 0;
+    unsigned       round;
+    unsigned       i;
+
+    array = sxe_hash_new_plus(name, TEST_SIZE, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key), sizeof(array->key),
+                              options | SXE_HASH_OPTION_COMPUTED_HASH);
+    sxe_hash_set_cache(array, protected_percent, NULL, NULL);
+
+    for (round = 0; round < TEST_ROUNDS; round++) {
+        for (i = 0; i < TEST_HOT; i++) {
+            hits += test_get(array, i) && round > 0;
+        }
+
+        for (i = 0; i < TEST_SCAN; i++) {
+            test_get(array, TEST_HOT + round * TEST_SCAN + i);
+        }
+    }
+
+    is(sxe_hash_get_cache(array)->cached, TEST_SIZE,                        "%s: the cache is full", name);
+    sxe_hash_delete(array);
+    return hits;
+}
+
+int
+main(void)
+{
+    TEST_ELEMENT   * array;
+    SXE_HASH_CACHE * cache;
+    char             key[sizeof(((TEST_ELEMENT *)0)->key)];
+    unsigned         clock_hits;
+    unsigned         slru_hits;
+    unsigned         found;
+    unsigned         i;
+
+    plan_tests(21);
+    array = sxe_hash_new_plus("cache", TEST_SIZE, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key), sizeof(array->key),
+                              SXE_HASH_OPTION_COMPUTED_HASH);
+    ok(sxe_hash_get_cache(array) == NULL,                                   "A new hash is not a cache");
+
+    for (i = 0; i < TEST_SIZE; i++) {
+        test_get(array, i);
+    }
+
+    sxe_hash_set_cache(array, 80, test_evict, &test_evicted);
+    ok((cache = sxe_hash_get_cache(array)) != NULL,                          "The hash is a cache");
+    is(cache->cached, TEST_SIZE,                                             "The elements already in the hash are cached");
+
+    for (found = 0, i = 0; i < TEST_SIZE; i += 2) {
+        found += test_get(array, i);    /* Reference the even keys */
+    }
+
+    is(found, TEST_SIZE / 2,                                                 "Referenced the even keys");
+    ok(!test_get(array, TEST_SIZE),                                          "Added a key to the full cache");
+    is(test_evicted, 1,                                                      "One element was evicted");
+    test_key(key, TEST_SIZE);
+    is(sxe_hash_look(array, key), test_evicted_id,                           "The evicted element was reused");
+    is(array[test_evicted_id].value, TEST_SIZE,                              "The key was added in its place");
+
+    for (found = 0, i = 0; i < TEST_SIZE; i += 2) {
+        found += test_get(array, i);
+    }
+
+    is(found, TEST_SIZE / 2,                                                 "Only an unreferenced element was evicted");
+    is(cache->evictions, 1,                                                  "Evictions are counted");
+    is(cache->hits, TEST_SIZE + 2,                                           "Hits are counted");    /* Including test_evict()'s */
+    is(cache->misses, 1,                                                     "Misses are counted");
+
+    test_evict_race = true;
+    test_evicted    = 0;
+    ok(!test_get(array, TEST_SIZE + 2),                                      "Added a key while a give raced with its eviction");
+    is(test_evicted, 2,                                                      "The racing take evicted another element");
+
+    for (found = 0, i = TEST_SIZE + 1; i <= TEST_SIZE + 2; i++) {
+        found += test_get(array, i);
+    }
+
+    is(found, 2,                                                             "The racing give didn't give the element twice");
+    is(cache->cached, TEST_SIZE,                                             "The cache is still full");
+
+    sxe_hash_reconstruct(array);
+    ok(cache->cached == 0 && cache->hits == 0,                               "Reconstructing the hash clears the cache");
+
+    for (i = 0; i < TEST_SIZE; i++) {
+        SXEA1(sxe_hash_take(array) != SXE_HASH_FULL, "Failed to take element %u of an empty hash", i);
+    }
+
+    is(sxe_hash_take(array), SXE_HASH_FULL,                                  "A cache whose elements were taken but not added is full");
+    sxe_hash_delete(array);
+
+    clock_hits = test_scan("clock", SXE_HASH_OPTION_OPEN_ADDRESSING, 0);
+    slru_hits  = test_scan("slru",  SXE_HASH_OPTION_OPEN_ADDRESSING | SXE_HASH_OPTION_LOCKED, 80);
+    diag("Working set hits: CLOCK %u, segmented %u of %u", clock_hits, slru_hits, (TEST_ROUNDS - 1) * TEST_HOT);
+    ok(slru_hits > 2 * clock_hits,                                           "The segmented cache resists scans");
+    return exit_status();
+}
@@ -0,0 +1,276 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hash-element.h"
+#include "sxe-alloc.h"
+#include "sxe-hash.h"
+#include "sxe-hash-private.h"
+#include "sxe-log.h"
+#include "tap.h"
+
+#define TEST_COUNT   64
+#define TEST_STABLE  1000    /* Keys that are never given in the threaded test   */
+#define TEST_CHURN   200000  /* Number of keys the writer adds and gives         */
+#define TEST_READERS 3
+#define TEST_REHASH  2000    /* Number of rehashes the writer forces             */
+
+static TEST_ELEMENT * test_array;
+static volatile bool  test_writing = true;
+
+static unsigned
+test_add(TEST_ELEMENT * array, unsigned i)
+{
+    unsigned id;
+
+    if ((id = sxe_hash_take(array)) != SXE_HASH_FULL) {
+        test_key(array[id].key, i);
+        array[id].value = i;
+        sxe_hash_add(array, id);
+    }
+
+    return id;
+}
+
+static unsigned
+test_look(TEST_ELEMENT * array, unsigned i)
+{
+    char key[sizeof(array->key)];
+
+    test_key(key, i);
+    return sxe_hash_look(array, key);
+}
+
+/* Look up stable keys, checking that they're always found, and churned keys, checking that an element that is found is the one
+ * looked for, which it can't be if the element was reused while still being read.
+ */
+static void *
+test_reader(void * arg)
+{
+    uintptr_t errors = 0;
+    unsigned  i;
+    unsigned  id;
+
+    (void)arg;
+
+    for (i = 0; __atomic_load_n(&test_writing, __ATOMIC_ACQUIRE); i++) {
+        sxe_hash_read_begin();
+
+        if ((id = test_look(test_array, i % TEST_STABLE)) == SXE_HASH_KEY_NOT_FOUND || test_array[id].value != i % TEST_STABLE) {
+            errors++;
+        }
+
+        if ((id = test_look(test_array, TEST_STABLE + i % TEST_CHURN)) != SXE_HASH_KEY_NOT_FOUND
+         && test_array[id].value != TEST_STABLE + i % TEST_CHURN) {
+            errors++;
+        }
+
+        sxe_hash_read_end();
+    }
+
+    return (void *)errors;
+}
+
+int
+main(void)
+{
+    uint64_t       start_allocations = sxe_allocations;
+    pthread_t      readers[TEST_READERS];
+    TEST_ELEMENT * array;
+    SXE_HASH     * hash;
+    void         * errors;
+    uintptr_t      total_errors;
+    uint8_t      * table;
+    char           keys[TEST_COUNT][sizeof(array->key)];
+    unsigned       ids[TEST_COUNT];
+    unsigned       found;
+    unsigned       i;
+    unsigned       id;
+
+    plan_tests(25);
+    sxe_log_set_level(SXE_LOG_LEVEL_INFORMATION);    /* Don't log each of the many operations */
+
+    array = sxe_hash_new_plus("concurrent", TEST_COUNT, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key), sizeof(array->key),
+                              SXE_HASH_OPTION_COMPUTED_HASH | SXE_HASH_OPTION_CONCURRENT);
+    hash  = SXE_HASH_ARRAY_TO_IMPL(array);
+    is(hash->options & (SXE_HASH_OPTION_OPEN_ADDRESSING | SXE_HASH_OPTION_LOCKED),
+       SXE_HASH_OPTION_OPEN_ADDRESSING | SXE_HASH_OPTION_LOCKED, "Concurrent hashes are locked open addressing hashes");
+
+    for (i = 0; i < TEST_COUNT && test_add(array, i) != SXE_HASH_FULL; i++) {
+    }
+
+    is(i,                    TEST_COUNT,    "Filled the hash");
+    is(sxe_hash_take(array), SXE_HASH_FULL, "Hash with nothing given is full");
+
+    for (i = 0; i < TEST_COUNT; i++) {
+        test_key(keys[i], i);
+    }
+
+    sxe_hash_look_batch(array, keys, TEST_COUNT, ids);
+
+    for (i = 0, found = 0; i < TEST_COUNT; i++) {
+        found += ids[i] != SXE_HASH_KEY_NOT_FOUND && array[ids[i]].value == i;
+    }
+
+    is(found, TEST_COUNT,   "Batched lookups found all keys");
+
+    /* An element given while a read section is open is retired, not reused
+     */
+    sxe_hash_read_begin();
+    sxe_hash_give(array, test_look(array, 0));
+    is(test_look(array, 0), SXE_HASH_KEY_NOT_FOUND,                                    "Given key is not found");
+    is(sxe_pool_get_number_in_state(array, SXE_HASH_OPEN_RETIRED), 1,                  "Given element is retired");
+    is(sxe_pool_get_number_in_state(array, SXE_HASH_UNUSED_BUCKET), 0,                 "Given element is not free");
+    ok(!sxe_hash_epoch_is_quiescent(hash->retire_epoch),                               "Open read section predates the give");
+    sxe_hash_read_end();
+    ok(sxe_hash_epoch_is_quiescent(hash->retire_epoch),                                "Quiescent once the read section ends");
+
+    /* The next change reclaims retired elements
+     */
+    sxe_hash_give(array, test_look(array, 1));
+    is(sxe_pool_get_number_in_state(array, SXE_HASH_OPEN_RETIRED), 0,                  "Retired elements were reclaimed");
+    is(sxe_pool_get_number_in_state(array, SXE_HASH_UNUSED_BUCKET), 2,                 "Given elements are free");
+    ok(test_add(array, 0) != SXE_HASH_FULL && test_add(array, 1) != SXE_HASH_FULL,     "Took the reclaimed elements");
+
+    /* Taking from a full hash with retired elements reclaims them
+     */
+    sxe_hash_read_begin();
+    sxe_hash_give(array, test_look(array, 2));
+    sxe_hash_read_end();
+    ok((id = sxe_hash_take(array)) != SXE_HASH_FULL,                                   "Took a retired element once reclaimed");
+    test_key(array[id].key, 2);
+    array[id].value = 2;
+    sxe_hash_add(array, id);
+
+    /* Churn keys, reclaiming each given element on the next change
+     */
+    for (i = TEST_COUNT; i < 20 * TEST_COUNT; i++) {
+        sxe_hash_give(array, test_look(array, i - TEST_COUNT));
+        test_add(array, i);
+    }
+
+    for (i = 19 * TEST_COUNT, found = 0; i < 20 * TEST_COUNT; i++) {
+        found += test_look(array, i) != SXE_HASH_KEY_NOT_FOUND;
+    }
+
+    is(found, TEST_COUNT,                                                              "Found all of the churned keys");
+
+    /* Fake a table full of tombstones to force a rehash while reading
+     */
+    sxe_hash_give(array, test_look(array, 19 * TEST_COUNT + 2));    /* So that take won't wait for this thread's read section */
+    sxe_hash_give(array, test_look(array, 19 * TEST_COUNT + 3));
+    sxe_hash_read_begin();
+    table = hash->table;
+    sxe_hash_give(array, test_look(array, 19 * TEST_COUNT));
+    hash->empty = 1;
+    test_add(array, 19 * TEST_COUNT);
+    ok(hash->table != table && hash->retired_tables != NULL && hash->retired_tables->table == table, "Rehash retired the table");
+    is(sxe_pool_get_number_in_state(array, SXE_HASH_OPEN_RETIRED), 1,                  "Retired element was rehashed");
+    table       = hash->table;
+    hash->empty = 1;
+    test_add(array, 19 * TEST_COUNT + 3);
+    ok(hash->table != table && hash->retired_tables->next != NULL,                    "Rehashed again without waiting for readers");
+    sxe_hash_read_end();
+    sxe_hash_give(array, test_look(array, 19 * TEST_COUNT + 1));
+    ok(hash->retired_tables == NULL,                                                   "Retired table was reclaimed");
+
+    for (i = 19 * TEST_COUNT, found = 0; i < 20 * TEST_COUNT; i++) {
+        found += test_look(array, i) != SXE_HASH_KEY_NOT_FOUND;
+    }
+
+    is(found, TEST_COUNT - 2,                                                          "Found all but the keys given");
+    sxe_hash_delete(array);
+
+    /* Readers look up stable keys while a writer churns others
+     */
+    test_array = sxe_hash_new_plus("threaded", 2 * TEST_STABLE, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key),
+                                   sizeof(array->key), SXE_HASH_OPTION_COMPUTED_HASH | SXE_HASH_OPTION_CONCURRENT);
+
+    for (i = 0; i < TEST_STABLE; i++) {
+        test_add(test_array, i);
+    }
+
+    for (i = 0; i < TEST_READERS; i++) {
+        SXEA1(pthread_create(&readers[i], NULL, test_reader, NULL) == 0, "Failed to create reader thread %u", i);
+    }
+
+    for (i = 0; i < TEST_CHURN; i++) {
+        if (i >= TEST_STABLE / 2) {
+            sxe_hash_give(test_array, test_look(test_array, TEST_STABLE + i - TEST_STABLE / 2));
+        }
+
+        test_add(test_array, TEST_STABLE + i);
+    }
+
+    __atomic_store_n(&test_writing, false, __ATOMIC_RELEASE);
+
+    for (i = 0, total_errors = 0; i < TEST_READERS; i++) {
+        pthread_join(readers[i], &errors);
+        total_errors += (uintptr_t)errors;
+    }
+
+    is(total_errors, 0,                                                                "Readers saw no missing or reused elements");
+
+    for (i = 0, found = 0; i < TEST_STABLE; i++) {
+        found += test_look(test_array, i) != SXE_HASH_KEY_NOT_FOUND;
+    }
+
+    is(found, TEST_STABLE,                                                             "Found all stable keys");
+    ok(sxe_hash_epoch_is_quiescent(SXE_HASH_ARRAY_TO_IMPL(test_array)->retire_epoch), "No readers are left");
+
+    /* Readers look up stable keys while the writer forces a rehash on every add, so that a table being filled would be seen
+     */
+    hash = SXE_HASH_ARRAY_TO_IMPL(test_array);
+    __atomic_store_n(&test_writing, true, __ATOMIC_RELEASE);
+
+    for (i = 0; i < TEST_READERS; i++) {
+        SXEA1(pthread_create(&readers[i], NULL, test_reader, NULL) == 0, "Failed to create reader thread %u", i);
+    }
+
+    for (i = TEST_CHURN; i < TEST_CHURN + TEST_REHASH; i++) {
+        sxe_hash_give(test_array, test_look(test_array, TEST_STABLE + i - TEST_STABLE / 2));
+        sxe_hash_open_reclaim_wait(hash);    /* So that reclaiming doesn't free up enough slots to make a rehash unnecessary */
+        table       = hash->table;
+        hash->empty = 1;    /* Fake a table full of tombstones */
+        test_add(test_array, TEST_STABLE + i);
+        found = hash->table != table;
+
+        if (!found)
+            break;
+    }
+
+    __atomic_store_n(&test_writing, false, __ATOMIC_RELEASE);
+
+    for (i = 0, total_errors = 0; i < TEST_READERS; i++) {
+        pthread_join(readers[i], &errors);
+        total_errors += (uintptr_t)errors;
+    }
+
+    ok(found,                                                                          "Every add rehashed the table");
+    is(total_errors, 0,                                                                "Readers found all keys during rehashes");
+    sxe_hash_delete(test_array);
+
+    is(sxe_allocations, start_allocations, "No memory was leaked");
+    return exit_status();
+}
@@ -0,0 +1,220 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hash-element.h"
+#include "sxe-hash.h"
+#include "sxe-log.h"
+#include "sxe-test-get-temp-file-name.h"
+#include "tap.h"
+
+#define TEST_COUNT  10000
+#define TEST_MISSES 100000
+
+static uint64_t
+test_sum(unsigned i)
+{
+    char key[sizeof(((TEST_ELEMENT *)0)->key)];
+
+    test_key(key, i);
+    return sxe_hash_filter_sum(key, sizeof(key));
+}
+
+/* Count the keys TEST_COUNT to TEST_COUNT + TEST_MISSES - 1, which were never added, that a filter passes
+ */
+static unsigned
+test_count_passed(SXE_HASH_FILTER * filter)
+{
+    unsigned passed = 0;
+    unsigned i;
+
+    for (i = TEST_COUNT; i < TEST_COUNT + TEST_MISSES; i++) {
+        passed += sxe_hash_filter_check(filter, test_sum(i));
+    }
+
+    return passed;
+}
+
+/* Fill a hash with a filter in front of it and check that every element is found and most missing keys are rejected
+ */
+static void
+test_hash(const char * name, unsigned options)
+{
+    TEST_ELEMENT    * array;
+    SXE_HASH_FILTER * filter;
+    char              keys[2 * TEST_COUNT][sizeof(((TEST_ELEMENT *)0)->key)];
+    unsigned          ids[2 * TEST_COUNT];
+    unsigned          found;
+    unsigned          i;
+    unsigned          id;
+
+    array = sxe_hash_new_plus(name, TEST_COUNT, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key), sizeof(array->key),
+                              options | SXE_HASH_OPTION_COMPUTED_HASH);
+
+    for (i = 0; i < TEST_COUNT / 2; i++) {    /* Half before the filter is set, to check that it is built from them */
+        id = sxe_hash_take(array);
+        test_key(array[id].key, i);
+        array[id].value = i;
+        sxe_hash_add(array, id);
+    }
+
+    ok(sxe_hash_get_filter(array) == NULL,                                       "%s: a new hash has no filter", name);
+    sxe_hash_set_filter(array, 10);
+    ok((filter = sxe_hash_get_filter(array)) != NULL,                            "%s: the hash has a filter", name);
+    is(filter->keys, TEST_COUNT / 2,                                             "%s: the filter was built from the elements", name);
+
+    for (; i < TEST_COUNT; i++) {
+        id = sxe_hash_take(array);
+        test_key(array[id].key, i);
+        array[id].value = i;
+        sxe_hash_add(array, id);
+    }
+
+    is(filter->keys, TEST_COUNT,                                                 "%s: added elements were added to the filter", name);
+
+    for (i = 0; i < 2 * TEST_COUNT; i++) {
+        test_key(keys[i], i);
+    }
+
+    for (found = 0, i = 0; i < 2 * TEST_COUNT; i++) {
+        found += (id = sxe_hash_look(array, keys[i])) != SXE_HASH_KEY_NOT_FOUND && array[id].value == i;
+    }
+
+    is(found, TEST_COUNT,                                                        "%s: every element is found", name);
+    is(filter->rejected + filter->false_positives, TEST_COUNT,                   "%s: every miss was counted", name);
+    ok(sxe_hash_filter_get_false_positive_rate(filter) < 0.03,                   "%s: at most 3%% of misses passed (%.2f%%)", name,
+       100.0 * sxe_hash_filter_get_false_positive_rate(filter));
+
+    sxe_hash_look_batch(array, keys, 2 * TEST_COUNT, ids);
+
+    for (found = 0, i = 0; i < 2 * TEST_COUNT; i++) {
+        found += ids[i] != SXE_HASH_KEY_NOT_FOUND && array[ids[i]].value == i;
+    }
+
+    is(found, TEST_COUNT,                                                        "%s: every element is found in batches", name);
+    is(filter->rejected + filter->false_positives, 2 * TEST_COUNT,               "%s: every batched miss was counted", name);
+
+    sxe_hash_reconstruct(array);
+    is(filter->keys, 0,                                                          "%s: reconstructing the hash clears the filter", name);
+    sxe_hash_set_filter(array, 0);
+    ok(sxe_hash_get_filter(array) == NULL,                                       "%s: the filter was removed", name);
+    sxe_hash_delete(array);
+}
+
+int
+main(void)
+{
+    SXE_HASH_FILTER * filter;
+    SXE_HASH_FILTER * copy;
+    TEST_ELEMENT    * array;
+    SXE_MMAP          memmap;
+    char              path[PATH_MAX];
+    char              key[sizeof(((TEST_ELEMENT *)0)->key)];
+    unsigned          path_used;
+    unsigned          missing;
+    unsigned          passed_8;
+    unsigned          passed_10;
+    unsigned          i;
+    unsigned          id;
+
+    plan_tests(13 + 2 * 11 + 5);
+
+    filter = sxe_hash_filter_new(TEST_COUNT, 10);
+    is(sxe_hash_filter_get_size(filter), sizeof(SXE_HASH_FILTER) + (TEST_COUNT * 10 + 511) / 512 * SXE_HASH_FILTER_BLOCK_SIZE,
+                                                                                 "A filter has 10 bits per key");
+    ok(!sxe_hash_filter_check(filter, test_sum(0)),                              "An empty filter rejects keys");
+
+    for (i = 0; i < TEST_COUNT; i++) {
+        sxe_hash_filter_add(filter, test_sum(i));
+    }
+
+    is(filter->keys, TEST_COUNT,                                                 "Added keys are counted");
+
+    for (missing = 0, i = 0; i < TEST_COUNT; i++) {
+        missing += !sxe_hash_filter_check(filter, test_sum(i));
+    }
+
+    is(missing, 0,                                                               "No false negatives");
+    passed_10 = test_count_passed(filter);
+    ok(passed_10 < TEST_MISSES / 50,                                             "At 10 bits per key, %.2f%% of missing keys pass",
+       100.0 * passed_10 / TEST_MISSES);
+    is(filter->rejected + filter->false_positives, 0,                            "Checks are not counted");
+
+    for (missing = 0, i = TEST_COUNT; i < TEST_COUNT + 100; i++) {
+        missing += !sxe_hash_filter_may_contain(filter, test_sum(i));
+    }
+
+    is(filter->rejected, missing,                                                "Rejected lookups are counted");
+    sxe_hash_filter_miss(filter);
+    is(filter->false_positives, 1,                                               "False positives are counted");
+
+    ok(sxe_hash_filter_copy(filter, sxe_hash_filter_get_size(filter) - 1) == NULL, "Can't copy a filter image of the wrong size");
+    ok((copy = sxe_hash_filter_copy(filter, sxe_hash_filter_get_size(filter))) != NULL, "Copied a filter");
+    is(test_count_passed(copy), passed_10,                                       "The copy passes the same keys");
+    sxe_hash_filter_clear(copy);
+    is(test_count_passed(copy), 0,                                               "A cleared filter rejects every key");
+    sxe_hash_filter_delete(copy);
+    sxe_hash_filter_delete(filter);
+
+    filter = sxe_hash_filter_new(TEST_COUNT, 8);
+
+    for (i = 0; i < TEST_COUNT; i++) {
+        sxe_hash_filter_add(filter, test_sum(i));
+    }
+
+    passed_8 = test_count_passed(filter);
+    ok(passed_8 > passed_10,                                                     "At 8 bits per key, more (%.2f%%) missing keys pass",
+       100.0 * passed_8 / TEST_MISSES);
+    sxe_hash_filter_delete(filter);
+
+    test_hash("chained", 0);
+    test_hash("open",    SXE_HASH_OPTION_OPEN_ADDRESSING);
+
+    /* A filter is saved and loaded with its hash
+     */
+    sxe_test_get_temp_file_name("test-sxe-hash-filter", path, sizeof(path), &path_used);
+    array = sxe_hash_new_plus("snapshot", TEST_COUNT, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key), sizeof(array->key),
+                              SXE_HASH_OPTION_OPEN_ADDRESSING | SXE_HASH_OPTION_COMPUTED_HASH);
+    sxe_hash_set_filter(array, 10);
+
+    for (i = 0; i < TEST_COUNT; i++) {
+        id = sxe_hash_take(array);
+        test_key(array[id].key, i);
+        array[id].value = i;
+        sxe_hash_add(array, id);
+    }
+
+    ok(sxe_hash_save(array, path),                                               "Saved a hash with a filter");
+    sxe_hash_delete(array);
+    ok((array = sxe_hash_load(&memmap, path)) != NULL,                           "Loaded the hash");
+    ok((filter = sxe_hash_get_filter(array)) != NULL,                            "The loaded hash has a filter");
+    is(filter->keys, TEST_COUNT,                                                 "The loaded filter has every key");
+    test_key(key, TEST_COUNT - 1);
+    ok((id = sxe_hash_look(array, key)) != SXE_HASH_KEY_NOT_FOUND && array[id].value == TEST_COUNT - 1,
+                                                                                 "Elements are found in the loaded hash");
+    sxe_hash_unload(array, &memmap);
+    unlink(path);
+    return exit_status();
+}
@@ -0,0 +1,173 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sxe-alloc.h"
+#include "sxe-hash.h"
+#include "sxe-log.h"
+#include "tap.h"
+
+#define TEST_KEYS    10000
+#define TEST_BINS    4096     /* Bins for the low bits of sums (buckets or groups) */
+#define TEST_TAGS    128      /* Bins for the top 7 bits of sums (open addressing tags) */
+#define TEST_ELEMENTS 1000
+
+typedef struct TEST_ELEMENT {
+    unsigned value;
+    char     key[12];
+} TEST_ELEMENT;
+
+/* Chi-squared of the counts in bins divided by its degrees of freedom; about 1 if the sums are uniformly distributed
+ */
+static double
+test_chi2(const unsigned * counts, unsigned bins, unsigned keys)
+{
+    double expected = (double)keys / bins;
+    double chi2     = 0;
+    unsigned i;
+
+    for (i = 0; i < bins; i++) {
+        chi2 += (counts[i] - expected) * (counts[i] - expected) / expected;
+    }
+
+    return chi2 / (bins - 1);
+}
+
+/* Use a function in a hash, optionally filling and reconstructing it first, and check that every key added is found
+ */
+static unsigned
+test_hash_with(SXE_HASH_FUNCTION function, unsigned options, bool reconstruct)
+{
+    TEST_ELEMENT * array = sxe_hash_new_plus("test-function", TEST_ELEMENTS, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key),
+                                             sizeof(array->key), options);
+    unsigned       found = 0;
+    unsigned       i;
+    unsigned       id;
+    unsigned       pass;
+
+    sxe_hash_set_function(array, function);
+
+    for (pass = reconstruct ? 0 : 1; pass < 2; pass++) {
+        if (pass == 1 && reconstruct) {
+            sxe_hash_reconstruct(array);    /* Empties the hash, but keeps its function */
+        }
+
+        for (i = 0; i < TEST_ELEMENTS; i++) {
+            id = sxe_hash_take(array);
+            memset(array[id].key, 0, sizeof(array[id].key));
+            snprintf(array[id].key, sizeof(array[id].key), "key-%u", i + (pass == 0 ? TEST_ELEMENTS : 0));
+            array[id].value = i;
+            sxe_hash_add(array, id);
+        }
+    }
+
+    for (i = 0; i < TEST_ELEMENTS; i++) {
+        char key[sizeof(array->key)];
+
+        memset(key, 0, sizeof(key));
+        snprintf(key, sizeof(key), "key-%u", i);
+        id     = sxe_hash_look(array, key);
+        found += id != SXE_HASH_KEY_NOT_FOUND && array[id].value == i;
+    }
+
+    sxe_hash_delete(array);
+    return found;
+}
+
+static void
+test_function(SXE_HASH_FUNCTION function)
+{
+    SXE_HASH_FUNC hash_sum = sxe_hash_function(function);
+    const char  * name     = sxe_hash_function_name(function);
+    unsigned      bins[TEST_BINS];
+    unsigned      tags[TEST_TAGS];
+    unsigned      sum;
+    unsigned      i;
+    char          key[16];
+    void        * array;
+
+    if (hash_sum == NULL) {
+        array = sxe_hash_new_plus("test-function", TEST_ELEMENTS, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key),
+                                  sizeof(((TEST_ELEMENT *)0)->key), SXE_HASH_OPTION_COMPUTED_HASH);
+        ok(!sxe_hash_set_function(array, function), "%s: Can't be chosen when it isn't available", name);
+        sxe_hash_delete(array);
+        skip(4, "%s: Not available on this CPU or in this build", name);
+        return;
+    }
+
+    is(hash_sum("hello, world", 0), hash_sum("hello, world", 12), "%s: A length of 0 means use strlen", name);
+
+    memset(bins, 0, sizeof(bins));
+    memset(tags, 0, sizeof(tags));
+
+    for (i = 0; i < TEST_KEYS; i++) {
+        snprintf(key, sizeof(key), "%08x", i);
+        sum = hash_sum(key, 8);
+        bins[sum % TEST_BINS]++;
+        tags[sum >> 25]++;
+    }
+
+    ok(test_chi2(bins, TEST_BINS, TEST_KEYS) < 1.3, "%s: Low bits of sums are uniform (chi2/df %.2f)", name,
+       test_chi2(bins, TEST_BINS, TEST_KEYS));
+    ok(test_chi2(tags, TEST_TAGS, TEST_KEYS) < 2.0, "%s: Top 7 bits of sums are uniform (chi2/df %.2f)", name,
+       test_chi2(tags, TEST_TAGS, TEST_KEYS));
+    is(test_hash_with(function, SXE_HASH_OPTION_COMPUTED_HASH, false), TEST_ELEMENTS, "%s: All keys found in a chained hash", name);
+    is(test_hash_with(function, SXE_HASH_OPTION_OPEN_ADDRESSING, false), TEST_ELEMENTS,
+       "%s: All keys found in an open addressing hash", name);
+}
+
+int
+main(void)
+{
+    uint64_t          start_allocations;
+    SXE_HASH_FUNCTION function;
+    SXE_HASH_FUNC     crc32c;
+    uint8_t           bytes[64];
+    unsigned          length;
+    unsigned          agree = 0;
+
+    plan_tests(3 + 5 * (SXE_HASH_FUNCTION_BEST - SXE_HASH_FUNCTION_LOOKUP3 + 1) + 2);
+    sxe_alloc_diagnostics = true;
+    start_allocations     = sxe_allocations;
+
+    is(sxe_hash_crc32c("123456789", 9), 0xE3069283, "Software CRC32C of the check string is correct");
+    SXEA1(crc32c = sxe_hash_function(SXE_HASH_FUNCTION_CRC32C), "CRC32C is always available");
+    is(crc32c("123456789", 9), 0xE3069283, "Dispatched CRC32C of the check string is correct");
+
+    for (length = 0; length < sizeof(bytes); length++) {
+        bytes[length] = (uint8_t)(length * 37 + 11);
+        agree        += crc32c(bytes, length + 1) == sxe_hash_crc32c(bytes, length + 1);
+    }
+
+    is(agree, sizeof(bytes), "Dispatched and software CRC32C agree on keys of 1 to %zu bytes", sizeof(bytes));
+
+    for (function = SXE_HASH_FUNCTION_LOOKUP3; function <= SXE_HASH_FUNCTION_BEST; function++) {
+        test_function(function);
+    }
+
+    is(test_hash_with(SXE_HASH_FUNCTION_BEST, SXE_HASH_OPTION_OPEN_ADDRESSING, true), TEST_ELEMENTS,
+       "best: All keys found in an open addressing hash after it is reconstructed");
+    is(sxe_allocations, start_allocations, "No memory was leaked");
+    return exit_status();
+}
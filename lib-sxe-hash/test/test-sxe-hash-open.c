@@ -0,0 +1,189 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash-element.h"
+#include "sxe-alloc.h"
+#include "sxe-hash.h"
+#include "sxe-hash-private.h"
+#include "sxe-log.h"
+#include "tap.h"
+
+#define TEST_COUNT 1790    /* Fills the table to 7/8ths */
+
+static unsigned
+test_add(TEST_ELEMENT * array, unsigned i)
+{
+    unsigned id;
+
+    if ((id = sxe_hash_take(array)) == SXE_HASH_FULL) {
+        return id;
+    }
+
+    test_key(array[id].key, i);
+    array[id].value = i;
+    sxe_hash_add(array, id);
+    return id;
+}
+
+static unsigned
+test_look_id(TEST_ELEMENT * array, unsigned i)
+{
+    char key[sizeof(array->key)];
+
+    test_key(key, i);
+    return sxe_hash_look(array, key);
+}
+
+static unsigned
+test_look(TEST_ELEMENT * array, unsigned i)
+{
+    unsigned id = test_look_id(array, i);
+
+    return id == SXE_HASH_KEY_NOT_FOUND ? SXE_HASH_KEY_NOT_FOUND : array[id].value;
+}
+
+/* Look up keys first .. first + count - 1 in batches, returning the number found with the right values
+ */
+static unsigned
+test_look_batch(TEST_ELEMENT * array, unsigned first, unsigned count)
+{
+    char   (* keys)[sizeof(array->key)] = malloc(count * sizeof(*keys));
+    unsigned * ids                      = malloc(count * sizeof(*ids));
+    unsigned   found                    = 0;
+    unsigned   i;
+
+    for (i = 0; i < count; i++) {
+        test_key(keys[i], first + i);
+    }
+
+    sxe_hash_look_batch(array, keys, count, ids);
+
+    for (i = 0; i < count; i++) {
+        found += ids[i] != SXE_HASH_KEY_NOT_FOUND && array[ids[i]].value == first + i;
+    }
+
+    free(keys);
+    free(ids);
+    return found;
+}
+
+static void
+test_open_hash(unsigned options, const char * name)
+{
+    TEST_ELEMENT * array = sxe_hash_new_plus(name, TEST_COUNT, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key),
+                                             sizeof(array->key), SXE_HASH_OPTION_OPEN_ADDRESSING | options);
+    SXE_HASH     * hash  = SXE_HASH_ARRAY_TO_IMPL(array);
+    unsigned       found = 0;
+    unsigned       round;
+    unsigned       i;
+    unsigned       id;
+
+    ok(hash->groups * SXE_HASH_GROUP_SIZE >= TEST_COUNT + TEST_COUNT / 7, "%s: Table has room for %u elements at 7/8 load",
+       name, TEST_COUNT);
+    is(test_look(array, 0),                     SXE_HASH_KEY_NOT_FOUND, "%s: Key not found in an empty hash", name);
+
+    for (i = 0; i < TEST_COUNT; i++) {
+        if (test_add(array, i) == SXE_HASH_FULL) {
+            break;
+        }
+    }
+
+    is(i,                                       TEST_COUNT,             "%s: Added %u keys", name, TEST_COUNT);
+    is(test_add(array, TEST_COUNT),             SXE_HASH_FULL,          "%s: Hash is full", name);
+
+    for (i = 0; i < TEST_COUNT; i++) {
+        found += test_look(array, i) == i;
+    }
+
+    is(found,                                   TEST_COUNT,             "%s: Found all %u keys", name, TEST_COUNT);
+    is(test_look(array, TEST_COUNT),            SXE_HASH_KEY_NOT_FOUND, "%s: Key that was never added is not found", name);
+    is(test_look_batch(array, 0, TEST_COUNT + 10), TEST_COUNT,          "%s: Batched lookups found all keys, and no others", name);
+
+    /* Repeatedly give half of the elements and add them again, leaving tombstones that must eventually be rehashed away
+     */
+    for (round = 0; round < 8; round++) {
+        for (i = round & 1; i < TEST_COUNT; i += 2) {
+            sxe_hash_give(array, test_look_id(array, i));
+        }
+
+        for (i = round & 1; i < TEST_COUNT; i += 2) {
+            test_add(array, i);
+        }
+    }
+
+    for (found = 0, i = 0; i < TEST_COUNT; i++) {
+        found += test_look(array, i) == i;
+    }
+
+    is(found,                                   TEST_COUNT,             "%s: Found all keys after giving and adding them again",
+       name);
+    ok(hash->empty > hash->groups * SXE_HASH_GROUP_SIZE / 16,             "%s: Table still has empty slots", name);
+
+    id = sxe_hash_take(array);
+    is(id,                                      SXE_HASH_FULL,          "%s: Still full", name);
+
+    /* Pretend tombstones have used up the empty slots, and check that the next add rehashes the table
+     */
+    sxe_hash_give(array, test_look_id(array, 0));
+    hash->empty = hash->groups * SXE_HASH_GROUP_SIZE / 16;
+    test_add(array, 0);
+    is(hash->empty,                             hash->groups * SXE_HASH_GROUP_SIZE - TEST_COUNT,
+       "%s: Rehash left only the used slots full", name);
+    is(hash->deleted,                           0,                      "%s: Rehash cleared the deleted slots", name);
+
+    for (found = 0, i = 0; i < TEST_COUNT; i++) {
+        found += test_look(array, i) == i;
+    }
+
+    is(found,                                   TEST_COUNT,             "%s: Found all keys after the rehash", name);
+    is(test_look_batch(array, 0, TEST_COUNT),   TEST_COUNT,             "%s: Batched lookups found all keys after the rehash",
+       name);
+
+    for (i = 0; i < TEST_COUNT; i++) {
+        sxe_hash_give(array, test_look_id(array, i));
+    }
+
+    is(hash->empty,                             hash->groups * SXE_HASH_GROUP_SIZE - hash->deleted,
+       "%s: Every used slot was emptied or deleted", name);
+    is(test_look(array, 1),                     SXE_HASH_KEY_NOT_FOUND, "%s: Given key is not found", name);
+
+    id = sxe_hash_take(array);
+    sxe_hash_give(array, id);    /* Taken but never added */
+    is(sxe_pool_get_number_in_state(array, SXE_HASH_UNUSED_BUCKET), TEST_COUNT, "%s: All elements are free", name);
+
+    sxe_hash_delete(array);
+}
+
+int
+main(void)
+{
+    uint64_t start_allocations = sxe_allocations;
+
+    plan_tests(35);
+    test_open_hash(SXE_HASH_OPTION_COMPUTED_HASH,                          "open");
+    test_open_hash(SXE_HASH_OPTION_COMPUTED_HASH | SXE_HASH_OPTION_LOCKED, "open-locked");
+    is(sxe_allocations, start_allocations, "No memory was leaked");
+    return exit_status();
+}
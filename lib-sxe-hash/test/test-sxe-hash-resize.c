@@ -0,0 +1,151 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sxe-alloc.h"
+#include "sxe-hash.h"
+#include "sxe-hash-private.h"
+#include "sxe-log.h"
+#include "tap.h"
+
+#define TEST_INITIAL 64
+#define TEST_MAXIMUM 100000
+#define TEST_KEYS    20000
+
+typedef struct TEST_ELEMENT {
+    unsigned value;
+    char     key[12];
+} TEST_ELEMENT;
+
+static unsigned
+test_look(TEST_ELEMENT * array, unsigned i)
+{
+    char     key[sizeof(array->key)];
+    unsigned id;
+
+    memset(key, 0, sizeof(key));
+    snprintf(key, sizeof(key), "key-%u", i);
+    return (id = sxe_hash_look(array, key)) == SXE_HASH_KEY_NOT_FOUND ? SXE_HASH_KEY_NOT_FOUND : array[id].value;
+}
+
+static unsigned
+test_count_found(TEST_ELEMENT * array, unsigned first, unsigned last, unsigned step)
+{
+    unsigned found = 0;
+    unsigned i;
+
+    for (i = first; i < last; i += step) {
+        found += test_look(array, i) == i;
+    }
+
+    return found;
+}
+
+static void
+test_resizable(unsigned options, const char * name)
+{
+    TEST_ELEMENT * array = sxe_hash_new_resizable(name, TEST_INITIAL, TEST_MAXIMUM, sizeof(TEST_ELEMENT),
+                                                  offsetof(TEST_ELEMENT, key), sizeof(array->key), options);
+    SXE_HASH     * hash  = SXE_HASH_ARRAY_TO_IMPL(array);
+    unsigned       initial_groups = hash->groups;
+    unsigned       migrating_at   = 0;
+    unsigned       found_migrating = 0;
+    unsigned       i;
+    unsigned       id;
+
+    ok(hash->options & SXE_HASH_OPTION_OPEN_ADDRESSING, "%s: Resizable hashes use open addressing", name);
+    is(sxe_pool_get_number(array), TEST_INITIAL,        "%s: Pool starts with %u elements", name, TEST_INITIAL);
+
+    for (i = 0; i < TEST_KEYS; i++) {
+        if ((id = sxe_hash_take(array)) == SXE_HASH_FULL) {
+            break;
+        }
+
+        memset(array[id].key, 0, sizeof(array->key));
+        snprintf(array[id].key, sizeof(array->key), "key-%u", i);
+        array[id].value = i;
+        sxe_hash_add(array, id);
+
+        /* Once, part way through migrating a big table, check that every key is found in one table or the other
+         */
+        if (migrating_at == 0 && hash->old_table != NULL && hash->old_groups >= 256 && hash->migrated >= hash->old_groups / 2) {
+            migrating_at    = i + 1;
+            found_migrating = test_count_found(array, 0, i + 1, 1);
+        }
+    }
+
+    is(i,                                       TEST_KEYS,              "%s: Added %u keys without filling up", name, TEST_KEYS);
+    ok(hash->groups > initial_groups,                                     "%s: Table grew from %u to %u groups", name,
+       initial_groups, hash->groups);
+    ok(hash->groups * SXE_HASH_GROUP_SIZE / 8 * 7 >= TEST_KEYS,            "%s: Table is at most 7/8 full", name);
+    ok(migrating_at != 0,                                                 "%s: Caught the table migrating", name);
+    is(found_migrating,                         migrating_at,           "%s: Found all %u keys while migrating", name,
+       migrating_at);
+    is(test_count_found(array, 0, TEST_KEYS, 1), TEST_KEYS,             "%s: Found all keys", name);
+    is(test_look(array, TEST_KEYS),             SXE_HASH_KEY_NOT_FOUND, "%s: Key that was never added is not found", name);
+
+    /* Give back every other key, some of which may still be in the old table
+     */
+    for (i = 0; i < TEST_KEYS; i += 2) {
+        char key[sizeof(array->key)];
+
+        memset(key, 0, sizeof(key));
+        snprintf(key, sizeof(key), "key-%u", i);
+        sxe_hash_give(array, sxe_hash_look(array, key));
+    }
+
+    is(test_count_found(array, 0, TEST_KEYS, 2), 0,                     "%s: Given keys are gone", name);
+    is(test_count_found(array, 1, TEST_KEYS, 2), TEST_KEYS / 2,         "%s: Other keys are still found", name);
+
+    sxe_hash_reconstruct(array);
+    is(hash->groups,                            initial_groups,         "%s: Reconstructed hash is back to its initial size",
+       name);
+    is(test_look(array, 1),                     SXE_HASH_KEY_NOT_FOUND, "%s: Reconstructed hash is empty", name);
+    sxe_hash_delete(array);
+}
+
+int
+main(void)
+{
+    uint64_t       start_allocations = sxe_allocations;
+    TEST_ELEMENT * array;
+    unsigned       i;
+
+    plan_tests(2 * 13 + 3);
+    sxe_log_set_level(SXE_LOG_LEVEL_INFORMATION);    /* Don't log each of the many operations */
+    test_resizable(SXE_HASH_OPTION_COMPUTED_HASH,                          "resizable");
+    test_resizable(SXE_HASH_OPTION_COMPUTED_HASH | SXE_HASH_OPTION_LOCKED, "resizable-locked");
+
+    array = sxe_hash_new_resizable("small", 4, 10, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key), sizeof(array->key),
+                                   SXE_HASH_OPTION_COMPUTED_HASH);
+
+    for (i = 0; i < 10 && sxe_hash_take(array) != SXE_HASH_FULL; i++) {
+    }
+
+    is(i,                      10,            "Took the maximum number of elements");
+    is(sxe_hash_take(array),   SXE_HASH_FULL, "Hash is full at its maximum");
+    sxe_hash_delete(array);
+
+    is(sxe_allocations, start_allocations, "No memory was leaked");
+    return exit_status();
+}
@@ -0,0 +1,186 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hash-element.h"
+#include "sxe-hash.h"
+#include "sxe-log.h"
+#include "sxe-test-get-temp-file-name.h"
+#include "tap.h"
+
+#define TEST_COUNT 1000
+
+static unsigned
+test_look(TEST_ELEMENT * array, unsigned i)
+{
+    char key[sizeof(((TEST_ELEMENT *)0)->key)];
+
+    test_key(key, i);
+    return sxe_hash_look(array, key);
+}
+
+/* A global sum function that isn't one of the SXE_HASH_FUNCTIONs
+ */
+static unsigned
+test_sum(const void * key, unsigned length)
+{
+    return sxe_hash_lookup3(key, length) ^ 0x5A5A5A5A;
+}
+
+/* Count the elements 0 to TEST_COUNT - 1 that are found with their values
+ */
+static unsigned
+test_count_found(TEST_ELEMENT * array)
+{
+    unsigned found = 0;
+    unsigned i;
+    unsigned id;
+
+    for (i = 0; i < TEST_COUNT; i++) {
+        if ((id = test_look(array, i)) != SXE_HASH_KEY_NOT_FOUND && array[id].value == i) {
+            found++;
+        }
+    }
+
+    return found;
+}
+
+/* Fill a hash, save it, load it and check that the loaded hash has every element and can be changed without changing the file
+ */
+static void
+test_snapshot(const char * path, const char * name, unsigned options, SXE_HASH_FUNCTION function)
+{
+    TEST_ELEMENT * array;
+    TEST_ELEMENT * loaded;
+    SXE_MMAP       memmap;
+    unsigned       i;
+    unsigned       id;
+
+    array = sxe_hash_new_plus(name, TEST_COUNT, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key), sizeof(array->key),
+                              options | SXE_HASH_OPTION_COMPUTED_HASH);
+
+    if (function != SXE_HASH_FUNCTION_GLOBAL) {
+        sxe_hash_set_function(array, function);
+    }
+
+    for (i = 0; i < TEST_COUNT; i++) {
+        id = sxe_hash_take(array);
+        test_key(array[id].key, i);
+        array[id].value = i;
+        sxe_hash_add(array, id);
+    }
+
+    ok(sxe_hash_save(array, path),                                            "%s: saved the hash", name);
+    sxe_hash_delete(array);
+
+    ok((loaded = sxe_hash_load(&memmap, path)) != NULL,                       "%s: loaded the hash", name);
+    is(test_count_found(loaded), TEST_COUNT,                                  "%s: all elements are found with their values", name);
+    is_eq(sxe_pool_get_name(loaded), name,                                    "%s: the loaded hash has its name", name);
+
+    for (i = 0; i < TEST_COUNT / 2; i++) {
+        sxe_hash_give(loaded, test_look(loaded, i));
+    }
+
+    is(test_count_found(loaded), TEST_COUNT / 2,                              "%s: elements can be given", name);
+    ok((id = sxe_hash_take(loaded)) != SXE_HASH_FULL,                         "%s: elements can be taken", name);
+    test_key(loaded[id].key, 0);
+    loaded[id].value = 0;
+    sxe_hash_add(loaded, id);
+    is(test_look(loaded, 0), id,                                              "%s: elements can be added", name);
+    sxe_hash_unload(loaded, &memmap);
+
+    ok((loaded = sxe_hash_load(&memmap, path)) != NULL,                       "%s: loaded the hash again", name);
+    is(test_count_found(loaded), TEST_COUNT,                                  "%s: changes were not written to the snapshot", name);
+    sxe_hash_unload(loaded, &memmap);
+}
+
+int
+main(void)
+{
+    char           path[PATH_MAX];
+    unsigned       path_used;
+    SXE_MMAP       memmap;
+    TEST_ELEMENT * array;
+    TEST_ELEMENT * loaded;
+    SXE_HASH_FUNC  hash_sum;
+    FILE         * file;
+    long           size;
+    uint64_t       filter_size;
+
+    plan_tests(5 * 9 + 4 + 5);
+    sxe_test_get_temp_file_name("test-sxe-hash-snapshot", path, sizeof(path), &path_used);
+    unlink(path);
+    ok(sxe_hash_load(&memmap, path) == NULL,                                  "Can't load a snapshot that doesn't exist");
+
+    test_snapshot(path, "chained",    0,                               SXE_HASH_FUNCTION_GLOBAL);
+    test_snapshot(path, "open",       SXE_HASH_OPTION_OPEN_ADDRESSING, SXE_HASH_FUNCTION_WYHASH);
+    test_snapshot(path, "locked",     SXE_HASH_OPTION_OPEN_ADDRESSING | SXE_HASH_OPTION_LOCKED, SXE_HASH_FUNCTION_GLOBAL);
+    test_snapshot(path, "concurrent", SXE_HASH_OPTION_CONCURRENT,      SXE_HASH_FUNCTION_LOOKUP3);
+
+    /* A hash that uses the global sum function is only loaded where sxe_hash_sum is the same function
+     */
+    hash_sum = sxe_hash_override_sum(sxe_hash_function(SXE_HASH_FUNCTION_WYHASH));
+    array    = sxe_hash_new_plus("global", TEST_COUNT, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key),
+                                 sizeof(array->key), SXE_HASH_OPTION_COMPUTED_HASH);
+    ok(sxe_hash_save(array, path),                                            "Saved a hash that uses wyhash as the global sum");
+    sxe_hash_delete(array);
+    sxe_hash_override_sum(hash_sum);
+    ok(sxe_hash_load(&memmap, path) == NULL,                                  "Can't load it where the global sum is lookup3");
+    sxe_hash_override_sum(sxe_hash_function(SXE_HASH_FUNCTION_WYHASH));
+    ok((loaded = sxe_hash_load(&memmap, path)) != NULL,                       "Can load it where the global sum is wyhash");
+    sxe_hash_unload(loaded, &memmap);
+
+    sxe_hash_override_sum(test_sum);
+    array = sxe_hash_new_plus("custom", TEST_COUNT, sizeof(TEST_ELEMENT), offsetof(TEST_ELEMENT, key), sizeof(array->key),
+                              SXE_HASH_OPTION_COMPUTED_HASH);
+    ok(!sxe_hash_save(array, path),                                           "Can't save a hash with a nonstandard global sum");
+    sxe_hash_delete(array);
+    sxe_hash_override_sum(hash_sum);
+    test_snapshot(path, "restored",   0,                               SXE_HASH_FUNCTION_GLOBAL);
+
+    SXEA1((file = fopen(path, "r+b")) != NULL, "Failed to open %s", path);
+    SXEA1(fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0, "Failed to get the size of %s", path);
+    SXEA1(fseek(file, size / 2, SEEK_SET) == 0 && fputc('X', file) != EOF, "Failed to corrupt %s", path);
+    fclose(file);
+    ok(sxe_hash_load(&memmap, path) == NULL,                                  "Can't load a snapshot with a bad checksum");
+
+    /* A filter size (at offset 32 in the header) far bigger than the file */
+    SXEA1((file = fopen(path, "r+b")) != NULL, "Failed to open %s", path);
+    SXEA1(fseek(file, 32, SEEK_SET) == 0 && fread(&filter_size, sizeof(filter_size), 1, file) == 1, "Failed to read %s", path);
+    filter_size += 1ULL << 63;
+    SXEA1(fseek(file, 32, SEEK_SET) == 0 && fwrite(&filter_size, sizeof(filter_size), 1, file) == 1, "Failed to write %s", path);
+    fclose(file);
+    ok(sxe_hash_load(&memmap, path) == NULL,                                  "Can't load a snapshot with a huge filter size");
+
+    SXEA1(truncate(path, size - 1) == 0, "Failed to truncate %s", path);
+    ok(sxe_hash_load(&memmap, path) == NULL,                                  "Can't load a truncated snapshot");
+
+    SXEA1((file = fopen(path, "r+b")) != NULL, "Failed to open %s", path);
+    fputc('X', file);    /* Corrupt the magic number */
+    fclose(file);
+    ok(sxe_hash_load(&memmap, path) == NULL,                                  "Can't load a snapshot with a bad magic number");
+    unlink(path);
+    return exit_status();
+}
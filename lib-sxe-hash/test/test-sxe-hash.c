@@ -87,6 +87,19 @@ test_hash_sha1(void)
     sxe_hash_delete(hash); /* for coverage */
 }
 
+static void
+test_hash_huge_pages(void)
+{
+    const unsigned length = SXE_HASH_SHA1_AS_HEX_LENGTH;
+    SXE_HASH     * hash;
+
+    hash = sxe_hash_new_plus("test-hash-huge", 1000, sizeof(SXE_HASH_KEY_VALUE_PAIR), 0, sizeof(SXE_SHA1),
+                             SXE_HASH_OPTION_UNLOCKED | SXE_HASH_OPTION_HUGE_PAGES | SXE_HASH_OPTION_PREFAULT
+                             | SXE_HASH_OPTION_NUMA_NODE(0));
+    ok(sxe_hash_set(hash, SHA1_1ST, length, 1) != SXE_HASH_FULL, "huge pages: Inserted a key into a mapped hash");
+    is(sxe_hash_get(hash, SHA1_1ST, length),    1,                "huge pages: Got correct value for the key");
+    sxe_hash_delete(hash);    /* Unmapped rather than freed; the leak check in main covers the choice */
+}
 
 typedef struct TEST_HASH_STRING_PAYLOAD
 {
@@ -240,10 +253,106 @@ test_hash_xxh32(void)
 }
 #endif
 
+/* Batched lookups must find exactly what single lookups do, including in chains with more than one element
+ */
+static void
+test_hash_look_batch(void)
+{
+    char     (* array)[12] = sxe_hash_new_plus("batch-hash", 64, sizeof(*array), 0, sizeof(*array),
+                                               SXE_HASH_OPTION_UNLOCKED | SXE_HASH_OPTION_COMPUTED_HASH);
+    char        keys[50][sizeof(*array)];
+    unsigned    ids[50];
+    unsigned    matched = 0;
+    unsigned    found   = 0;
+    unsigned    i;
+    unsigned    id;
+
+    memset(keys, 0, sizeof(keys));
+
+    for (i = 0; i < 50; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "batch-%u", i);
+
+        if (i < 40) {
+            id = sxe_hash_take(array);
+            memcpy(array[id], keys[i], sizeof(keys[i]));
+            sxe_hash_add(array, id);
+        }
+    }
+
+    sxe_hash_look_batch(array, keys, 50, ids);
+
+    for (i = 0; i < 50; i++) {
+        matched += ids[i] == sxe_hash_look(array, keys[i]);
+        found   += ids[i] != SXE_HASH_KEY_NOT_FOUND;
+    }
+
+    is(matched, 50, "Batched lookups of 50 keys match single lookups");
+    is(found,   40, "Batched lookups found the 40 keys added");
+    sxe_hash_delete(array);
+}
+
+/* Lookups of keys of 4, 8, 16 and 20 bytes are specialized; check them with each engine and a prehashed, a global and an inlined sum
+ */
+static void
+test_hash_fixed_keys(void)
+{
+    static const unsigned sizes[] = {4, 8, 16, 20};
+    uint8_t  (* array)[20];
+    uint8_t     key[20];
+    unsigned    engine;
+    unsigned    found;
+    unsigned    missed;
+    unsigned    size;
+    unsigned    i;
+    unsigned    j;
+    unsigned    id;
+
+    for (size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++) {
+        found  = 0;
+        missed = 0;
+
+        for (engine = 0; engine < 4; engine++) {
+            array = sxe_hash_new_plus("fixed-hash", 100, sizeof(*array), 0, sizes[size],
+                                      (engine & 1 ? SXE_HASH_OPTION_OPEN_ADDRESSING : 0)
+                                    | (engine < 2 ? SXE_HASH_OPTION_COMPUTED_HASH : 0));
+
+            if (engine == 2) {
+                sxe_hash_set_function(array, SXE_HASH_FUNCTION_WYHASH);
+            }
+
+            for (i = 0; i < 100; i++) {
+                id = sxe_hash_take(array);
+
+                for (j = 0; j < sizes[size]; j++) {
+                    array[id][j] = (uint8_t)(j < sizeof(i) ? i >> (8 * j) : i * 31 + j);
+                }
+
+                sxe_hash_add(array, id);
+            }
+
+            for (i = 0; i < 100; i++) {
+                for (j = 0; j < sizes[size]; j++) {
+                    key[j] = (uint8_t)(j < sizeof(i) ? i >> (8 * j) : i * 31 + j);
+                }
+
+                id     = sxe_hash_look(array, key);
+                found += id != SXE_HASH_KEY_NOT_FOUND && memcmp(array[id], key, sizes[size]) == 0;
+                key[sizes[size] - 1] ^= 0x80;    /* Differs only in its last byte */
+                missed += sxe_hash_look(array, key) == SXE_HASH_KEY_NOT_FOUND;
+            }
+
+            sxe_hash_delete(array);
+        }
+
+        is(found,  400, "All keys of %u bytes found in chained and open addressing hashes", sizes[size]);
+        is(missed, 400, "No keys of %u bytes that differ in their last byte found", sizes[size]);
+    }
+}
+
 int
 main(void)
 {
-    plan_tests(58);
+    plan_tests(70);
 
     uint64_t start_allocations = sxe_allocations;
     sxe_alloc_diagnostics      = true;
@@ -251,6 +360,9 @@ main(void)
     test_hash_sha1();
     test_hash_sha1_variable_data();
     test_hash_sha1_reconstruct();
+    test_hash_huge_pages();
+    test_hash_look_batch();
+    test_hash_fixed_keys();
     test_hash_string();    // Stubbed above
 
 #ifndef SXE_DISABLE_XXHASH
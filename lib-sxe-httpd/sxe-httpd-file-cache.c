@@ -0,0 +1,529 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* The file cache keeps the files of a static content directory open, along with their size, modification time and precomputed
+ * ETag, Last-Modified and Content-Type header values, so that a hit costs no open(), fstat() or close() system calls. Files are
+ * served with sxe_sendfile() from an explicit offset, so any number of responses can share an fd. The directory is watched with
+ * sxe_dirwatch, and a file that is modified, replaced or deleted is dropped from the cache; its fd is closed once the last
+ * response sending it is done.
+ */
+
+#include "sxe-httpd.h"
+
+#ifdef SXE_HTTPD_HAS_FILE_CACHE
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sxe-hash.h"
+#include "sxe-log.h"
+#include "sxe-pool.h"
+
+static const struct {
+    const char * extension;
+    const char * content_type;
+} sxe_httpd_file_content_types[] = {
+    {"css",  "text/css"},
+    {"gif",  "image/gif"},
+    {"htm",  "text/html"},
+    {"html", "text/html"},
+    {"ico",  "image/x-icon"},
+    {"jpeg", "image/jpeg"},
+    {"jpg",  "image/jpeg"},
+    {"js",   "application/javascript"},
+    {"json", "application/json"},
+    {"pdf",  "application/pdf"},
+    {"png",  "image/png"},
+    {"svg",  "image/svg+xml"},
+    {"txt",  "text/plain"},
+    {"xml",  "application/xml"},
+};
+
+static const char *
+sxe_httpd_file_content_type(const char * name)
+{
+    const char * extension = strrchr(name, '.');
+    unsigned     i;
+
+    if (extension != NULL) {
+        for (i = 0; i < sizeof(sxe_httpd_file_content_types) / sizeof(sxe_httpd_file_content_types[0]); i++) {
+            if (strcasecmp(extension + 1, sxe_httpd_file_content_types[i].extension) == 0) {
+                return sxe_httpd_file_content_types[i].content_type;
+            }
+        }
+    }
+
+    return "application/octet-stream";
+}
+
+static const char *
+sxe_httpd_file_state_to_string(unsigned state)
+{
+    switch (state) {
+    case SXE_HTTPD_FILE_FREE:   return "FREE";
+    case SXE_HTTPD_FILE_CACHED: return "CACHED";
+    case SXE_HTTPD_FILE_STALE:  return "STALE";
+    }
+
+    return NULL;                                                /* not a state - just keeps the compiler happy */
+}
+
+/* Close an unreferenced file that is no longer findable by name and return it to the free queue
+ */
+static void
+sxe_httpd_file_cache_close(SXE_HTTPD_FILE_CACHE * cache, unsigned id, unsigned state)
+{
+    SXEE6("(cache=%p, id=%u, state=%s)", cache, id, sxe_httpd_file_state_to_string(state));
+    SXEA6(cache->files[id].references == 0, "File %u is still being sent by %u responses", id, cache->files[id].references);
+    close(cache->files[id].fd);
+    cache->files[id].fd = -1;
+    sxe_pool_set_indexed_element_state(cache->files, id, state, SXE_HTTPD_FILE_FREE);
+    SXER6("return");
+}
+
+/* Drop a cached file so that it can no longer be found by name
+ */
+static void
+sxe_httpd_file_cache_drop(SXE_HTTPD_FILE_CACHE * cache, unsigned id)
+{
+    SXEE6("(cache=%p, id=%u) // name=%s", cache, id, cache->names[cache->files[id].name_id].name);
+    sxe_hash_give(cache->names, cache->files[id].name_id);
+
+    if (cache->files[id].references == 0) {
+        sxe_httpd_file_cache_close(cache, id, SXE_HTTPD_FILE_CACHED);
+    }
+    else {
+        sxe_pool_set_indexed_element_state(cache->files, id, SXE_HTTPD_FILE_CACHED, SXE_HTTPD_FILE_STALE);
+    }
+
+    SXER6("return");
+}
+
+static void
+sxe_httpd_file_cache_event_dirwatch(EV_P_ const char * file, int revents, void * user_data)
+{
+    SXE_HTTPD_FILE_CACHE * cache = user_data;
+
+    SXE_UNUSED_PARAMETER(loop);
+    SXE_UNUSED_PARAMETER(revents);
+    SXEE6("(file=%s, revents=%d, cache=%p)", file, revents, cache);
+    sxe_httpd_file_cache_invalidate(cache, file, strlen(file));
+    SXER6("return");
+}
+
+/**
+ * Construct a cache of the open files in a directory
+ *
+ * @param cache     Pointer to the file cache
+ * @param directory Directory to serve files from; subdirectories are not served
+ * @param files     Maximum number of files to keep open; should exceed the maximum number of concurrent connections so that
+ *                  there is always an unreferenced file to evict
+ *
+ * @return SXE_RETURN_OK or SXE_RETURN_ERROR_INVALID if the directory can't be opened
+ *
+ * @exception Aborts if the directory can't be watched
+ *
+ * @note Requires sxe_init() to have been called; the directory is watched from the sxe main loop
+ */
+SXE_RETURN
+sxe_httpd_file_cache_construct(SXE_HTTPD_FILE_CACHE * cache, const char * directory, unsigned files)
+{
+    SXE_RETURN result = SXE_RETURN_ERROR_INVALID;
+    unsigned   i;
+
+    SXEE6("(cache=%p, directory=%s, files=%u)", cache, directory, files);
+    SXEA1(files > 0, "A file cache must be able to hold at least one file");
+
+    if ((cache->directory_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        SXEL3("Can't open file cache directory '%s': %s", directory, strerror(errno));
+        goto SXE_EARLY_OUT;
+    }
+
+    cache->files = sxe_pool_new("httpd-files", files, sizeof(SXE_HTTPD_FILE), SXE_HTTPD_FILE_NUMBER_OF_STATES, 0);
+    sxe_pool_set_state_to_string(cache->files, sxe_httpd_file_state_to_string);
+    cache->names = sxe_hash_new_plus("httpd-file-names", files, sizeof(SXE_HTTPD_FILE_NAME), 0, SXE_HTTPD_FILE_NAME_MAXIMUM + 1,
+                                     SXE_HASH_OPTION_UNLOCKED | SXE_HASH_OPTION_COMPUTED_HASH);
+    cache->hits   = 0;
+    cache->misses = 0;
+
+    for (i = 0; i < files; i++) {
+        cache->files[i].fd = -1;
+    }
+
+    sxe_dirwatch_init();
+    sxe_dirwatch_add(&cache->dirwatch, directory, SXE_DIRWATCH_CREATED | SXE_DIRWATCH_MODIFIED | SXE_DIRWATCH_DELETED,
+                     sxe_httpd_file_cache_event_dirwatch, cache);
+    sxe_dirwatch_start();
+    result = SXE_RETURN_OK;
+
+SXE_EARLY_OUT:
+    SXER6("return %s", sxe_return_to_string(result));
+    return result;
+}
+
+/**
+ * Destroy a file cache, closing all of its files
+ *
+ * @param cache Pointer to the file cache
+ *
+ * @exception Aborts in debug builds if a response is still sending one of the cache's files
+ */
+void
+sxe_httpd_file_cache_destruct(SXE_HTTPD_FILE_CACHE * cache)
+{
+    unsigned id;
+
+    SXEE6("(cache=%p)", cache);
+    sxe_dirwatch_remove(&cache->dirwatch);
+
+    while ((id = sxe_pool_get_oldest_element_index(cache->files, SXE_HTTPD_FILE_CACHED)) != SXE_POOL_NO_INDEX) {
+        sxe_httpd_file_cache_drop(cache, id);
+    }
+
+    SXEA6(sxe_pool_get_number_in_state(cache->files, SXE_HTTPD_FILE_STALE) == 0, "Destroying a file cache that's still in use");
+    sxe_hash_delete(cache->names);
+    sxe_pool_delete(cache->files);
+    close(cache->directory_fd);
+    SXER6("return");
+}
+
+/**
+ * Drop a file from the cache; called automatically when the file changes on disk
+ *
+ * @param cache       Pointer to the file cache
+ * @param name        Name of the file in the cache's directory
+ * @param name_length Length of the name
+ */
+void
+sxe_httpd_file_cache_invalidate(SXE_HTTPD_FILE_CACHE * cache, const char * name, unsigned name_length)
+{
+    char     key[SXE_HTTPD_FILE_NAME_MAXIMUM + 1];
+    unsigned name_id;
+
+    SXEE6("(cache=%p, name=%.*s)", cache, name_length, name);
+
+    if (name_length > SXE_HTTPD_FILE_NAME_MAXIMUM) {
+        goto SXE_EARLY_OUT;
+    }
+
+    memset(key, '\0', sizeof(key));
+    memcpy(key, name, name_length);
+
+    if ((name_id = sxe_hash_look(cache->names, key)) != SXE_HASH_KEY_NOT_FOUND) {
+        SXEL6("Invalidating cached file %s", key);
+        sxe_httpd_file_cache_drop(cache, cache->names[name_id].file_id);
+    }
+
+SXE_EARLY_OUT:
+    SXER6("return");
+}
+
+/* Get a reference to an open file, opening it if it's not cached
+ */
+static SXE_RETURN
+sxe_httpd_file_cache_get(SXE_HTTPD_FILE_CACHE * cache, const char * name, unsigned name_length, unsigned * id_out)
+{
+    SXE_RETURN       result = SXE_RETURN_ERROR_INVALID;
+    char             key[SXE_HTTPD_FILE_NAME_MAXIMUM + 1];
+    unsigned         name_id;
+    unsigned         id;
+    int              fd;
+    struct stat      status;
+    struct tm        broken_time;
+    SXE_HTTPD_FILE * file;
+    SXE_POOL_WALKER  walker;
+
+    SXEE6("(cache=%p, name=%.*s)", cache, name_length, name);
+
+    /* Only plain file names in the cache's directory can be served */
+    if (name_length == 0 || name_length > SXE_HTTPD_FILE_NAME_MAXIMUM || name[0] == '.' || memchr(name, '/', name_length) != NULL
+     || memchr(name, '\0', name_length) != NULL)
+    {
+        SXEL6("Invalid file name '%.*s'", name_length, name);
+        goto SXE_EARLY_OUT;
+    }
+
+    memset(key, '\0', sizeof(key));
+    memcpy(key, name, name_length);
+
+    if ((name_id = sxe_hash_look(cache->names, key)) != SXE_HASH_KEY_NOT_FOUND) {
+        id = cache->names[name_id].file_id;
+        sxe_pool_touch_indexed_element(cache->files, id);    /* Keep the CACHED queue in least recently used order */
+        cache->hits++;
+        goto SXE_EARLY_OUT_FOUND;
+    }
+
+    cache->misses++;
+
+    if ((fd = openat(cache->directory_fd, key, O_RDONLY | O_CLOEXEC)) < 0) {
+        SXEL6("Can't open file '%s': %s", key, strerror(errno));
+        goto SXE_EARLY_OUT;
+    }
+
+    if (fstat(fd, &status) < 0 || !S_ISREG(status.st_mode) || status.st_size > UINT_MAX) {
+        SXEL6("File '%s' is not a regular file of less than 4G", key);
+        close(fd);
+        goto SXE_EARLY_OUT;
+    }
+
+    /* If the cache is full, evict the least recently used file that isn't being sent */
+    if ((id = sxe_pool_set_oldest_element_state(cache->files, SXE_HTTPD_FILE_FREE, SXE_HTTPD_FILE_CACHED)) == SXE_POOL_NO_INDEX) {
+        sxe_pool_walker_construct(&walker, cache->files, SXE_HTTPD_FILE_CACHED);
+
+        while ((id = sxe_pool_walker_step(&walker)) != SXE_POOL_NO_INDEX) {
+            if (cache->files[id].references == 0) {
+                break;
+            }
+        }
+
+        if (id == SXE_POOL_NO_INDEX) {
+            SXEL3("File cache is full of files that are being sent; can't cache '%s'", key);
+            close(fd);
+            result = SXE_RETURN_NO_UNUSED_ELEMENTS;
+            goto SXE_EARLY_OUT;
+        }
+
+        SXEL6("Evicting file %u (%s) from the file cache", id, cache->names[cache->files[id].name_id].name);
+        sxe_httpd_file_cache_drop(cache, id);
+        id = sxe_pool_set_oldest_element_state(cache->files, SXE_HTTPD_FILE_FREE, SXE_HTTPD_FILE_CACHED);
+    }
+
+    name_id = sxe_hash_take(cache->names);
+    SXEA1(name_id != SXE_HASH_FULL, "File name hash is full, but the file pool had a free file");
+    memcpy(cache->names[name_id].name, key, sizeof(key));
+    cache->names[name_id].file_id = id;
+    sxe_hash_add(cache->names, name_id);
+
+    file               = &cache->files[id];
+    file->fd           = fd;
+    file->references   = 0;
+    file->name_id      = name_id;
+    file->size         = status.st_size;
+    file->mtime        = status.st_mtime;
+    file->content_type = sxe_httpd_file_content_type(key);
+    snprintf(file->etag, sizeof(file->etag), "\"%llx-%llx\"", (unsigned long long)status.st_mtime,
+             (unsigned long long)status.st_size);
+    gmtime_r(&status.st_mtime, &broken_time);
+    strftime(file->last_modified, sizeof(file->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &broken_time);
+
+SXE_EARLY_OUT_FOUND:
+    cache->files[id].references++;
+    *id_out = id;
+    result  = SXE_RETURN_OK;
+
+SXE_EARLY_OUT:
+    SXER6("return %s", sxe_return_to_string(result));
+    return result;
+}
+
+/**
+ * Release a reference to an open file; called by sxe_httpd when a response that was sending the file is done
+ *
+ * @param cache Pointer to the file cache
+ * @param id    Index of the file
+ */
+void
+sxe_httpd_file_cache_release(SXE_HTTPD_FILE_CACHE * cache, unsigned id)
+{
+    SXEE6("(cache=%p, id=%u)", cache, id);
+    SXEA6(cache->files[id].references > 0, "File %u is not referenced", id);
+
+    if (--cache->files[id].references == 0 && sxe_pool_index_to_state(cache->files, id) == SXE_HTTPD_FILE_STALE) {
+        sxe_httpd_file_cache_close(cache, id, SXE_HTTPD_FILE_STALE);
+    }
+
+    SXER6("return");
+}
+
+/**
+ * Parse the value of a Range header
+ *
+ * @param range  Value of the Range header
+ * @param length Length of the value
+ * @param size   Size of the entity the range is for
+ * @param first  Set to the offset of the first byte in the range
+ * @param last   Set to the offset of the last byte in the range
+ *
+ * @return SXE_RETURN_OK, SXE_RETURN_OUT_OF_RANGE if the range can't be satisfied (416), or SXE_RETURN_ERROR_INVALID if the
+ *         header is malformed or has multiple ranges and should be ignored
+ */
+SXE_RETURN
+sxe_httpd_parse_range(const char * range, unsigned length, off_t size, off_t * first, off_t * last)
+{
+    SXE_RETURN         result = SXE_RETURN_ERROR_INVALID;
+    unsigned           i      = SXE_LITERAL_LENGTH("bytes=");
+    unsigned long long start  = 0;
+    unsigned long long end    = 0;
+    bool               have_start = false;
+    bool               have_end   = false;
+
+    SXEE6("(range=%.*s, size=%lld)", length, range, (long long)size);
+
+    if (length < i || strncasecmp(range, "bytes=", i) != 0) {
+        goto SXE_EARLY_OUT;
+    }
+
+    for (; i < length && range[i] >= '0' && range[i] <= '9'; i++, have_start = true) {
+        start = start * 10 + range[i] - '0';
+    }
+
+    if (i == length || range[i++] != '-') {
+        goto SXE_EARLY_OUT;
+    }
+
+    for (; i < length && range[i] >= '0' && range[i] <= '9'; i++, have_end = true) {
+        end = end * 10 + range[i] - '0';
+    }
+
+    if (i != length || (!have_start && !have_end) || (have_end && have_start && end < start)) {
+        goto SXE_EARLY_OUT;    /* Trailing junk (including multiple ranges) or an invalid range */
+    }
+
+    result = SXE_RETURN_OUT_OF_RANGE;
+
+    if (!have_start) {         /* Suffix range: the last 'end' bytes */
+        if (end == 0 || size == 0) {
+            goto SXE_EARLY_OUT;
+        }
+
+        *first = end >= (unsigned long long)size ? 0 : size - (off_t)end;
+        *last  = size - 1;
+    }
+    else {
+        if (start >= (unsigned long long)size) {
+            goto SXE_EARLY_OUT;
+        }
+
+        *first = start;
+        *last  = !have_end || end >= (unsigned long long)size ? size - 1 : (off_t)end;
+    }
+
+    result = SXE_RETURN_OK;
+
+SXE_EARLY_OUT:
+    SXER6("return %s", sxe_return_to_string(result));
+    return result;
+}
+
+/**
+ * Respond to a GET or HEAD request with a file from a file cache and end the response
+ *
+ * @param cache        Pointer to the file cache
+ * @param request      Request to respond to
+ * @param name         Name of the file in the cache's directory
+ * @param name_length  Length of the name
+ * @param range        Value of the request's Range header or NULL if none
+ * @param range_length Length of the Range header value
+ * @param handler      Function to call back when the response has been completely sent or NULL to fire and forget
+ * @param user_data    User data passed back to handler
+ *
+ * @return SXE_RETURN_OK or SXE_RETURN_IN_PROGRESS if the response was started, SXE_RETURN_ERROR_INVALID if there is no such
+ *         file (the caller should respond 404), or SXE_RETURN_NO_UNUSED_ELEMENTS if the file can't be cached or responded with
+ *         for lack of resources
+ *
+ * @note A single byte range is answered with 206 Partial Content, an unsatisfiable one with 416, and multiple ranges are
+ *       ignored (the whole file is sent)
+ */
+SXE_RETURN
+sxe_httpd_file_cache_respond(SXE_HTTPD_FILE_CACHE * cache, SXE_HTTPD_REQUEST * request, const char * name, unsigned name_length,
+                             const char * range, unsigned range_length, sxe_httpd_on_sent_handler handler, void * user_data)
+{
+    SXE            * this = request->sxe;
+    SXE_RETURN       result;
+    SXE_HTTPD_FILE * file;
+    unsigned         id;
+    off_t            first;
+    off_t            last;
+    bool             partial = false;
+    char             value[64];
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("(cache=%p, request=%p, name=%.*s, range=%.*s)", cache, request, name_length, name, range ? range_length : 0,
+           range ? range : "");
+
+    if ((result = sxe_httpd_file_cache_get(cache, name, name_length, &id)) != SXE_RETURN_OK) {
+        goto SXE_EARLY_OUT;
+    }
+
+    file  = &cache->files[id];
+    first = 0;
+    last  = file->size - 1;
+
+    if (range != NULL) {
+        switch (sxe_httpd_parse_range(range, range_length, file->size, &first, &last)) {
+        case SXE_RETURN_OK:
+            partial = true;
+            break;
+
+        case SXE_RETURN_OUT_OF_RANGE:
+            snprintf(value, sizeof(value), "bytes */%lld", (long long)file->size);
+            sxe_httpd_file_cache_release(cache, id);
+            sxe_httpd_response_simple(request, handler, user_data, 416, "Range Not Satisfiable", NULL, "Content-Range", value,
+                                      NULL);
+            goto SXE_EARLY_OUT;
+
+        default:
+            break;
+        }
+    }
+
+    if ((result = sxe_httpd_response_start(request, partial ? 206 : 200, partial ? "Partial Content" : "OK")) != SXE_RETURN_OK) {
+        sxe_httpd_file_cache_release(cache, id);    /* Coverage Exclusion: todo: test running out of send buffers */
+        goto SXE_EARLY_OUT;                         /* Coverage Exclusion: todo: test running out of send buffers */
+    }
+
+    sxe_httpd_response_header(request, "Content-Type",  file->content_type, 0);
+    sxe_httpd_response_header(request, "Last-Modified", file->last_modified, SXE_HTTPD_FILE_DATE_LENGTH);
+    sxe_httpd_response_header(request, "ETag",          file->etag, 0);
+    sxe_httpd_response_header(request, "Accept-Ranges", "bytes", SXE_LITERAL_LENGTH("bytes"));
+
+    if (partial) {
+        snprintf(value, sizeof(value), "bytes %lld-%lld/%lld", (long long)first, (long long)last, (long long)file->size);
+        sxe_httpd_response_header(request, "Content-Range", value, 0);
+    }
+
+    snprintf(value, sizeof(value), "%lld", (long long)(last - first + 1));
+    sxe_httpd_response_header(request, HTTPD_CONTENT_LENGTH, value, 0);
+
+    if (request->method == SXE_HTTP_METHOD_HEAD || last < first) {
+        sxe_httpd_file_cache_release(cache, id);
+        result = sxe_httpd_response_end(request, handler, user_data);
+        goto SXE_EARLY_OUT;
+    }
+
+    /* The file reference is released and the response ended by sxe_httpd once the file has been sent */
+    request->sendfile_cache    = cache;
+    request->sendfile_cache_id = id;
+    result = sxe_httpd_response_sendfile_range(request, file->fd, first, last - first + 1, handler, user_data);
+
+SXE_EARLY_OUT:
+    SXER6I("return %s", sxe_return_to_string(result));
+    return result;
+}
+
+#endif
+
+/* vim: set expandtab list: */
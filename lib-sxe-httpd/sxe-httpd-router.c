@@ -0,0 +1,523 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* The router maps (method, path) to a handler. Routes are registered at startup, then compiled into a radix trie held in a
+ * single array of nodes, whose edge labels are held in a single array of bytes. A lookup makes one pass over the bytes of the
+ * path, preferring a static match to a :name capture to a *name capture, and only backtracking when a more specific branch
+ * fails to match the rest of the path.
+ */
+
+#include <string.h>
+
+#include "sxe-alloc.h"
+#include "sxe-httpd.h"
+#include "sxe-log.h"
+
+/* Uncompressed trie built by sxe_httpd_router_compile(), with one node per pattern byte
+ */
+typedef struct SXE_HTTPD_ROUTER_BUILD_NODE {
+    unsigned first_child;      /* static children, in increasing byte order */
+    unsigned next_sibling;
+    unsigned param_child;
+    unsigned wildcard_child;
+    unsigned route;
+    char     byte;             /* byte on the static edge into the node */
+} SXE_HTTPD_ROUTER_BUILD_NODE;
+
+typedef struct SXE_HTTPD_ROUTER_COMPILER {
+    SXE_HTTPD_ROUTER            * router;
+    SXE_HTTPD_ROUTER_BUILD_NODE * build;
+    unsigned                      build_count;
+    unsigned                      labels_used;
+} SXE_HTTPD_ROUTER_COMPILER;
+
+/**
+ * Construct a router
+ *
+ * @param router        Pointer to the router
+ * @param route_maximum Maximum number of routes that can be added
+ */
+void
+sxe_httpd_router_construct(SXE_HTTPD_ROUTER * router, unsigned route_maximum)
+{
+    SXEE6("(router=%p, route_maximum=%u)", router, route_maximum);
+    SXEA1((router->routes = sxe_calloc(route_maximum, sizeof(SXE_HTTPD_ROUTE))) != NULL, "Couldn't allocate %u routes",
+          route_maximum);
+    router->route_count   = 0;
+    router->route_maximum = route_maximum;
+    router->pattern_bytes = 0;
+    router->nodes         = NULL;
+    router->node_count    = 0;
+    router->labels        = NULL;
+    SXER6("return");
+}
+
+void
+sxe_httpd_router_destruct(SXE_HTTPD_ROUTER * router)
+{
+    unsigned i;
+
+    SXEE6("(router=%p)", router);
+
+    for (i = 0; i < router->route_count; i++) {
+        sxe_free(router->routes[i].pattern);
+    }
+
+    sxe_free(router->routes);
+    sxe_free(router->nodes);
+    sxe_free(router->labels);
+    router->routes = NULL;
+    router->nodes  = NULL;
+    router->labels = NULL;
+    SXER6("return");
+}
+
+/**
+ * Add a route to a router that has not yet been compiled
+ *
+ * @param router    Pointer to the router
+ * @param method    Method to route or SXE_HTTPD_ROUTE_ANY_METHOD
+ * @param pattern   Path pattern (e.g. "/users/:id/files/\*path"); copied
+ * @param handler   Function to call when a request matches the route
+ * @param user_data User data passed to the handler
+ *
+ * @return SXE_RETURN_OK, SXE_RETURN_ERROR_INVALID if the pattern is malformed, or SXE_RETURN_NO_UNUSED_ELEMENTS if the router
+ *         is full
+ */
+SXE_RETURN
+sxe_httpd_router_add(SXE_HTTPD_ROUTER * router, SXE_HTTP_METHOD method, const char * pattern, sxe_httpd_route_handler handler,
+                     void * user_data)
+{
+    SXE_RETURN        result = SXE_RETURN_ERROR_INVALID;
+    SXE_HTTPD_ROUTE * route;
+    unsigned          length = strlen(pattern);
+    unsigned          i;
+    unsigned          name;
+
+    SXEE6("(router=%p, method=%u, pattern=%s, handler=%p, user_data=%p)", router, method, pattern, handler, user_data);
+    SXEA1(router->nodes == NULL, "Routes can't be added to a compiled router");
+
+    if (router->route_count >= router->route_maximum) {
+        SXEL3("Can't add route '%s': router already has the maximum of %u routes", pattern, router->route_maximum);
+        result = SXE_RETURN_NO_UNUSED_ELEMENTS;
+        goto SXE_EARLY_OUT;
+    }
+
+    if (pattern[0] != '/') {
+        SXEL3("Route '%s' doesn't begin with '/'", pattern);
+        goto SXE_EARLY_OUT;
+    }
+
+    route              = &router->routes[router->route_count];
+    route->param_count = 0;
+
+    for (i = 1; i < length; i++) {
+        if (pattern[i] != ':' && pattern[i] != '*') {
+            continue;
+        }
+
+        if (pattern[i - 1] != '/' || route->param_count >= SXE_HTTPD_ROUTE_PARAM_MAXIMUM) {
+            SXEL3("Route '%s' has a capture that's not a whole segment or has more than %u captures", pattern,
+                  SXE_HTTPD_ROUTE_PARAM_MAXIMUM);
+            goto SXE_EARLY_OUT;
+        }
+
+        name = i + 1;
+
+        while (i + 1 < length && pattern[i + 1] != '/') {
+            i++;
+        }
+
+        if (i + 1 == name || (pattern[name - 1] == '*' && i + 1 != length)) {
+            SXEL3("Route '%s' has a capture with no name or a *capture that's not the last segment", pattern);
+            goto SXE_EARLY_OUT;
+        }
+
+        route->param_names[route->param_count]        = name;
+        route->param_name_lengths[route->param_count] = i + 1 - name;
+        route->param_count++;
+    }
+
+    route->method    = method;
+    route->pattern   = sxe_strdup(pattern);
+    route->handler   = handler;
+    route->user_data = user_data;
+    route->next      = SXE_HTTPD_ROUTER_NONE;
+    SXEA1(route->pattern != NULL, "Couldn't allocate route pattern '%s'", pattern);
+    router->pattern_bytes += length;
+    router->route_count++;
+    result = SXE_RETURN_OK;
+
+SXE_EARLY_OUT:
+    SXER6("return %s", sxe_return_to_string(result));
+    return result;
+}
+
+static unsigned
+sxe_httpd_router_build_node(SXE_HTTPD_ROUTER_COMPILER * compiler, char byte)
+{
+    SXE_HTTPD_ROUTER_BUILD_NODE * node = &compiler->build[compiler->build_count];
+
+    node->first_child    = SXE_HTTPD_ROUTER_NONE;
+    node->next_sibling   = SXE_HTTPD_ROUTER_NONE;
+    node->param_child    = SXE_HTTPD_ROUTER_NONE;
+    node->wildcard_child = SXE_HTTPD_ROUTER_NONE;
+    node->route          = SXE_HTTPD_ROUTER_NONE;
+    node->byte           = byte;
+    return compiler->build_count++;
+}
+
+/* Find or add the static child of a build node for a byte, keeping the children in byte order
+ */
+static unsigned
+sxe_httpd_router_build_child(SXE_HTTPD_ROUTER_COMPILER * compiler, unsigned parent, char byte)
+{
+    unsigned * link = &compiler->build[parent].first_child;
+    unsigned   child;
+
+    while (*link != SXE_HTTPD_ROUTER_NONE && (unsigned char)compiler->build[*link].byte < (unsigned char)byte) {
+        link = &compiler->build[*link].next_sibling;
+    }
+
+    if (*link != SXE_HTTPD_ROUTER_NONE && compiler->build[*link].byte == byte) {
+        return *link;
+    }
+
+    child                                    = sxe_httpd_router_build_node(compiler, byte);
+    compiler->build[child].next_sibling      = *link;
+    *link                                    = child;
+    return child;
+}
+
+/* Fill compiled node 'flat' from build node 'b', merging chains of nodes that have nothing but a single static child
+ */
+static void
+sxe_httpd_router_flatten(SXE_HTTPD_ROUTER_COMPILER * compiler, unsigned b, unsigned flat, bool static_edge)
+{
+    SXE_HTTPD_ROUTER            * router = compiler->router;
+    SXE_HTTPD_ROUTER_BUILD_NODE * build  = compiler->build;
+    SXE_HTTPD_ROUTER_NODE       * node   = &router->nodes[flat];
+    unsigned                      child;
+    unsigned                      i;
+
+    node->label        = compiler->labels_used;
+    node->label_length = 0;
+
+    if (static_edge) {
+        router->labels[compiler->labels_used++] = build[b].byte;
+        node->label_length++;
+    }
+
+    while (build[b].route == SXE_HTTPD_ROUTER_NONE && build[b].param_child == SXE_HTTPD_ROUTER_NONE
+        && build[b].wildcard_child == SXE_HTTPD_ROUTER_NONE && build[b].first_child != SXE_HTTPD_ROUTER_NONE
+        && build[build[b].first_child].next_sibling == SXE_HTTPD_ROUTER_NONE)
+    {
+        b = build[b].first_child;
+        router->labels[compiler->labels_used++] = build[b].byte;
+        node->label_length++;
+    }
+
+    node->route       = build[b].route;
+    node->children    = router->node_count;
+    node->child_count = 0;
+
+    for (child = build[b].first_child; child != SXE_HTTPD_ROUTER_NONE; child = build[child].next_sibling) {
+        node->child_count++;
+    }
+
+    router->node_count  += node->child_count;
+    node->param_child    = build[b].param_child    == SXE_HTTPD_ROUTER_NONE ? SXE_HTTPD_ROUTER_NONE : router->node_count++;
+    node->wildcard_child = build[b].wildcard_child == SXE_HTTPD_ROUTER_NONE ? SXE_HTTPD_ROUTER_NONE : router->node_count++;
+
+    for (child = build[b].first_child, i = 0; child != SXE_HTTPD_ROUTER_NONE; child = build[child].next_sibling, i++) {
+        sxe_httpd_router_flatten(compiler, child, router->nodes[flat].children + i, true);
+    }
+
+    if (router->nodes[flat].param_child != SXE_HTTPD_ROUTER_NONE) {
+        sxe_httpd_router_flatten(compiler, build[b].param_child, router->nodes[flat].param_child, false);
+    }
+
+    if (router->nodes[flat].wildcard_child != SXE_HTTPD_ROUTER_NONE) {
+        sxe_httpd_router_flatten(compiler, build[b].wildcard_child, router->nodes[flat].wildcard_child, false);
+    }
+}
+
+/**
+ * Compile the routes added to a router into a radix trie; must be called before routing any requests
+ *
+ * @param router Pointer to the router
+ *
+ * @return SXE_RETURN_OK or SXE_RETURN_ERROR_INVALID if two routes have the same pattern and method
+ */
+SXE_RETURN
+sxe_httpd_router_compile(SXE_HTTPD_ROUTER * router)
+{
+    SXE_RETURN                result = SXE_RETURN_ERROR_INVALID;
+    SXE_HTTPD_ROUTER_COMPILER compiler;
+    SXE_HTTPD_ROUTE         * route;
+    const char              * pattern;
+    unsigned                  size   = router->pattern_bytes + 1;
+    unsigned                  node;
+    unsigned                  other;
+    unsigned                  i;
+    unsigned                  r;
+
+    SXEE6("(router=%p) // routes=%u", router, router->route_count);
+    SXEA1(router->nodes == NULL, "Router has already been compiled");
+    SXEA1((compiler.build = sxe_malloc(size * sizeof(*compiler.build))) != NULL, "Couldn't allocate %u build nodes", size);
+    compiler.router      = router;
+    compiler.build_count = 0;
+    compiler.labels_used = 0;
+    sxe_httpd_router_build_node(&compiler, '\0');
+
+    for (r = 0; r < router->route_count; r++) {
+        route   = &router->routes[r];
+        pattern = route->pattern;
+
+        for (node = 0, i = 0; pattern[i] != '\0'; i++) {
+            if (pattern[i] == ':' || pattern[i] == '*') {
+                unsigned * capture = pattern[i] == ':' ? &compiler.build[node].param_child : &compiler.build[node].wildcard_child;
+
+                if (*capture == SXE_HTTPD_ROUTER_NONE) {
+                    *capture = sxe_httpd_router_build_node(&compiler, '\0');    /* Note: build is never reallocated */
+                }
+
+                node = *capture;
+
+                while (pattern[i + 1] != '\0' && pattern[i + 1] != '/') {
+                    i++;
+                }
+
+                continue;
+            }
+
+            node = sxe_httpd_router_build_child(&compiler, node, pattern[i]);
+        }
+
+        for (other = compiler.build[node].route; other != SXE_HTTPD_ROUTER_NONE; other = router->routes[other].next) {
+            if (router->routes[other].method == route->method) {
+                SXEL3("Route '%s' was added twice for method %u", pattern, route->method);
+                goto SXE_ERROR_OUT;
+            }
+        }
+
+        route->next                = compiler.build[node].route;
+        compiler.build[node].route = r;
+    }
+
+    SXEA1((router->nodes  = sxe_malloc(compiler.build_count * sizeof(*router->nodes))) != NULL, "Couldn't allocate router nodes");
+    SXEA1((router->labels = sxe_malloc(compiler.build_count)) != NULL,                           "Couldn't allocate router labels");
+    router->node_count = 1;
+    sxe_httpd_router_flatten(&compiler, 0, 0, false);
+    SXEL6("Compiled %u routes with %u pattern bytes into %u nodes", router->route_count, router->pattern_bytes, router->node_count);
+    result = SXE_RETURN_OK;
+
+SXE_ERROR_OUT:
+    sxe_free(compiler.build);
+    SXER6("return %s", sxe_return_to_string(result));
+    return result;
+}
+
+/* Choose the route for a method from the routes that end at a node, preferring one for the method to one for any method
+ */
+static unsigned
+sxe_httpd_router_select(const SXE_HTTPD_ROUTER * router, unsigned route, SXE_HTTP_METHOD method, SXE_HTTPD_ROUTE_MATCH * match)
+{
+    unsigned any = SXE_HTTPD_ROUTER_NONE;
+
+    for (; route != SXE_HTTPD_ROUTER_NONE; route = router->routes[route].next) {
+        if (router->routes[route].method == method) {
+            return route;
+        }
+
+        if (router->routes[route].method == SXE_HTTPD_ROUTE_ANY_METHOD) {
+            any = route;
+        }
+        else {
+            match->allowed |= 1U << router->routes[route].method;
+        }
+    }
+
+    return any;
+}
+
+static unsigned
+sxe_httpd_router_match_node(const SXE_HTTPD_ROUTER * router, unsigned n, SXE_HTTP_METHOD method, const char * url,
+                            unsigned length, unsigned position, SXE_HTTPD_ROUTE_MATCH * match)
+{
+    const SXE_HTTPD_ROUTER_NODE * node = &router->nodes[n];
+    const char                  * end;
+    unsigned                      low;
+    unsigned                      high;
+    unsigned                      middle;
+    unsigned                      route;
+
+    if (node->label_length > length - position || memcmp(&url[position], &router->labels[node->label], node->label_length) != 0) {
+        return SXE_HTTPD_ROUTER_NONE;
+    }
+
+    position += node->label_length;
+
+    if (position == length) {
+        if ((route = sxe_httpd_router_select(router, node->route, method, match)) != SXE_HTTPD_ROUTER_NONE) {
+            return route;
+        }
+    }
+    else if (node->child_count > 0) {
+        /* Binary search the static children by the first byte of their labels */
+        for (low = node->children, high = node->children + node->child_count; low < high;) {
+            middle = (low + high) / 2;
+
+            if ((unsigned char)router->labels[router->nodes[middle].label] < (unsigned char)url[position]) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+
+        if (low < node->children + node->child_count && router->labels[router->nodes[low].label] == url[position]
+         && (route = sxe_httpd_router_match_node(router, low, method, url, length, position, match)) != SXE_HTTPD_ROUTER_NONE)
+        {
+            return route;
+        }
+    }
+
+    if (node->param_child != SXE_HTTPD_ROUTER_NONE && position < length && url[position] != '/') {
+        end                                      = memchr(&url[position], '/', length - position);
+        match->params[match->param_count]        = &url[position];
+        match->param_lengths[match->param_count] = (end == NULL ? &url[length] : end) - &url[position];
+        match->param_count++;
+
+        if ((route = sxe_httpd_router_match_node(router, node->param_child, method, url, length,
+                                                 position + match->param_lengths[match->param_count - 1], match))
+            != SXE_HTTPD_ROUTER_NONE)
+        {
+            return route;
+        }
+
+        match->param_count--;
+    }
+
+    if (node->wildcard_child != SXE_HTTPD_ROUTER_NONE) {
+        if ((route = sxe_httpd_router_select(router, router->nodes[node->wildcard_child].route, method, match))
+            != SXE_HTTPD_ROUTER_NONE)
+        {
+            match->params[match->param_count]        = &url[position];
+            match->param_lengths[match->param_count] = length - position;
+            match->param_count++;
+            return route;
+        }
+    }
+
+    return SXE_HTTPD_ROUTER_NONE;
+}
+
+/**
+ * Find the route for a request
+ *
+ * @param router     Pointer to a compiled router
+ * @param method     Method of the request
+ * @param url        URL of the request; any query string is ignored
+ * @param url_length Length of the URL
+ * @param match      Set to the matched route and captured parameters, which point into the URL
+ *
+ * @return Pointer to the route or NULL if none matched; if the path matched routes for other methods, match->allowed is set
+ */
+const SXE_HTTPD_ROUTE *
+sxe_httpd_router_match(const SXE_HTTPD_ROUTER * router, SXE_HTTP_METHOD method, const char * url, unsigned url_length,
+                       SXE_HTTPD_ROUTE_MATCH * match)
+{
+    const char * query;
+    unsigned     route;
+
+    SXEE6("(router=%p, method=%u, url=%.*s)", router, method, url_length, url);
+    SXEA6(router->nodes != NULL, "Router has not been compiled");
+
+    if ((query = memchr(url, '?', url_length)) != NULL) {
+        url_length = query - url;
+    }
+
+    match->allowed     = 0;
+    match->param_count = 0;
+    route              = sxe_httpd_router_match_node(router, 0, method, url, url_length, 0, match);
+    match->route       = route == SXE_HTTPD_ROUTER_NONE ? NULL : &router->routes[route];
+
+    SXER6("return route=%s", match->route == NULL ? "NULL" : match->route->pattern);
+    return match->route;
+}
+
+/**
+ * Route a request to its handler; typically called from the on_request handler
+ *
+ * @param router     Pointer to a compiled router
+ * @param request    Request to route
+ * @param url        URL of the request
+ * @param url_length Length of the URL
+ *
+ * @return true if the request was routed, false if no route matched
+ *
+ * @note The captured parameters passed to the handler point into the URL, so are only valid until the handler returns
+ */
+bool
+sxe_httpd_router_dispatch(const SXE_HTTPD_ROUTER * router, SXE_HTTPD_REQUEST * request, const char * url, unsigned url_length)
+{
+    SXE                   * this = request->sxe;
+    SXE_HTTPD_ROUTE_MATCH   match;
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("(router=%p, request=%p, url=%.*s)", router, request, url_length, url);
+
+    if (sxe_httpd_router_match(router, request->method, url, url_length, &match) != NULL) {
+        (*match.route->handler)(request, &match, match.route->user_data);
+    }
+
+    SXER6I("return %s", match.route != NULL ? "true" : "false");
+    return match.route != NULL;
+}
+
+/**
+ * Get a captured parameter by name
+ *
+ * @param match  Pointer to a successful match
+ * @param name   Name of the :name or *name capture in the route's pattern
+ * @param length Set to the length of the parameter's value
+ *
+ * @return Pointer to the value or NULL if the route has no such parameter
+ */
+const char *
+sxe_httpd_route_match_get_param(const SXE_HTTPD_ROUTE_MATCH * match, const char * name, unsigned * length)
+{
+    const SXE_HTTPD_ROUTE * route       = match->route;
+    unsigned                name_length = strlen(name);
+    unsigned                i;
+
+    for (i = 0; i < match->param_count; i++) {
+        if (route->param_name_lengths[i] == name_length && memcmp(&route->pattern[route->param_names[i]], name, name_length) == 0) {
+            *length = match->param_lengths[i];
+            return match->params[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* vim: set expandtab list: */
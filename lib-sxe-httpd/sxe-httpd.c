@@ -32,6 +32,8 @@
 /* Pointer substraction is signed but index is unsigned */
 #define SXE_HTTPD_REQUEST_INDEX(base_ptr, object_ptr) ((SXE_CAST(uintptr_t, object_ptr) - SXE_CAST(uintptr_t, base_ptr))/sizeof(SXE_HTTPD_REQUEST))
 
+#define SXE_HTTPD_DIGITS2(s)         (((s)[0] - '0') * 10 + (s)[1] - '0')    /* Value of two decimal digits */
+
 #define SXE_HTTPD_BUFFER_SIZE(s)     (sizeof(SXE_BUFFER) + (s)->buffer_size)
 #define SXE_HTTPD_BUFFER(s, idx)     (SXE_BUFFER *)(((char *)(s)->buffers) + (idx * SXE_HTTPD_BUFFER_SIZE(s)))
 #define SXE_HTTPD_BUFFER_INDEX(s, b) ((SXE_CAST(uintptr_t, (b)) - SXE_CAST(uintptr_t, (s)->buffers)) / SXE_HTTPD_BUFFER_SIZE((s)))
@@ -42,34 +44,114 @@ typedef enum {
     SXE_HTTPD_BUFFER_NUMBER_OF_STATES
 } SXE_HTTPD_BUFFER_STATE;
 
+/* Decide whether a request may queue more output. A request is refused once it reaches its byte or buffer budget. When more
+ * than half of the buffer pool is in use, a request is also refused more buffers once it holds its fair share of the pool (the
+ * pool divided by the number of connections holding buffers). A request holding no buffers is always allowed one; if the pool is
+ * empty, it waits on the server's out_waiters list and is drained when a buffer is freed, so every connection makes progress.
+ */
+static bool
+sxe_httpd_output_allowed(SXE_HTTPD_REQUEST * request, bool need_buffer)
+{
+    SXE_HTTPD * self = request->server;
+
+    if (self->out_budget_bytes != 0 && request->out_bytes >= self->out_budget_bytes) {
+        return false;
+    }
+
+    if (!need_buffer || request->out_buffers == 0) {
+        return true;
+    }
+
+    if (self->out_budget_buffers != 0 && request->out_buffers >= self->out_budget_buffers) {
+        return false;
+    }
+
+    if (sxe_pool_get_number_in_state(self->buffers, SXE_HTTPD_BUFFER_FREE) >= self->buffer_count / 2) {
+        return true;
+    }
+
+    return request->out_buffers < self->buffer_count / self->out_connections;
+}
+
 static inline SXE_BUFFER *
-sxe_httpd_get_buffer(SXE_HTTPD *self)
+sxe_httpd_get_buffer(SXE_HTTPD_REQUEST * request)
 {
+    SXE_HTTPD  * self   = request->server;
     SXE_BUFFER * buffer = NULL;
     unsigned     id;
 
-    SXEE6("sxe_httpd_get_buffer()");
+    SXEE6("sxe_httpd_get_buffer(request=%p)", request);
+
+    if (!sxe_httpd_output_allowed(request, true)) {
+        SXEL6("sxe_httpd_get_buffer: request holding %u buffers and %u bytes is over its output budget", request->out_buffers,
+              request->out_bytes);
+        request->out_blocked = true;
+        goto SXE_EARLY_OUT;
+    }
+
     id = sxe_pool_set_oldest_element_state(self->buffers, SXE_HTTPD_BUFFER_FREE, SXE_HTTPD_BUFFER_USED);
 
     if (id == SXE_POOL_NO_INDEX) {
-        SXEL3("Warning: sxe_httpd_get_buffer: no buffers available, increase buffers or lower concurrency");   /* Coverage exclusion: todo: test running out of send buffers */
-        goto SXE_EARLY_OUT;                                                                                     /* Coverage exclusion: todo: test running out of send buffers */
+        SXEL3("Warning: sxe_httpd_get_buffer: no buffers available, increase buffers or lower concurrency");
+        request->out_blocked = true;
+
+        /* No send of this request's buffers will complete to drain it, so wait for another request to free one */
+        if (request->out_buffers == 0 && !request->out_waiting) {
+            sxe_list_push(&self->out_waiters, request);
+            request->out_waiting = true;
+        }
+
+        goto SXE_EARLY_OUT;
     }
 
     buffer = SXE_HTTPD_BUFFER(self, id);
     sxe_buffer_construct(buffer, (char *)(buffer + 1), 0, self->buffer_size);
 
+    if (request->out_buffers++ == 0) {
+        self->out_connections++;
+    }
+
 SXE_EARLY_OUT:
     SXER6("return %p", buffer);
     return buffer;
 }
 
+/* Drain requests that were refused a buffer while holding none, now that buffers have been freed. The request giving the buffers
+ * back is skipped, since it may be in the middle of building a response.
+ */
+static void
+sxe_httpd_drain_waiters(SXE_HTTPD * self, SXE_HTTPD_REQUEST * giver)
+{
+    SXE_HTTPD_REQUEST * request;
+    unsigned            skipped = 0;
+
+    while (SXE_LIST_GET_LENGTH(&self->out_waiters) > skipped
+        && sxe_pool_get_number_in_state(self->buffers, SXE_HTTPD_BUFFER_FREE) > 0) {
+        request = sxe_list_shift(&self->out_waiters);
+
+        if (request == giver) {
+            sxe_list_push(&self->out_waiters, request);
+            skipped++;
+            continue;
+        }
+
+        request->out_waiting = false;
+
+        if (request->out_blocked && self->on_drain != NULL) {    /* Not already drained by a completed send */
+            request->out_blocked = false;
+            (*self->on_drain)(request);
+        }
+    }
+}
+
 static inline void
-sxe_httpd_give_buffers(SXE_HTTPD * self, SXE_LIST * buffers)
+sxe_httpd_give_buffers(SXE_HTTPD_REQUEST * request, SXE_LIST * buffers)
 {
-    SXE_LIST keep; /* application-provided buffers */
+    SXE_HTTPD * self  = request->server;
+    SXE_LIST    keep; /* application-provided buffers */
+    bool        freed = false;
 
-    SXEE6("sxe_httpd_give_buffers(buffers=%p)", buffers);
+    SXEE6("sxe_httpd_give_buffers(request=%p,buffers=%p)", request, buffers);
     sxe_buffer_list_construct(&keep);
 
     while (!SXE_LIST_IS_EMPTY(buffers)) {
@@ -79,6 +161,12 @@ sxe_httpd_give_buffers(SXE_HTTPD * self, SXE_LIST * buffers)
         SXEA1(buffer, "pulled a null pointer out of a non-empty list???");
         if (id < self->buffer_count) {
             sxe_pool_set_indexed_element_state(self->buffers, id, SXE_HTTPD_BUFFER_USED, SXE_HTTPD_BUFFER_FREE);
+            SXEA1(request->out_buffers > 0, "Request is giving back more buffers than it took");
+            freed = true;
+
+            if (--request->out_buffers == 0) {
+                self->out_connections--;
+            }
         }
         else {
             sxe_list_push(&keep, buffer);
@@ -89,9 +177,32 @@ sxe_httpd_give_buffers(SXE_HTTPD * self, SXE_LIST * buffers)
         sxe_list_push(buffers, sxe_list_shift(&keep));
     }
 
+    if (freed && !SXE_LIST_IS_EMPTY(&self->out_waiters)) {
+        sxe_httpd_drain_waiters(self, request);
+    }
+
     SXER6("return");
 }
 
+/* Called once a request's queued output has been sent. If output was refused before the send completed, tell the application
+ * it can produce more, unless the on_sent handler has already used up the budget again, in which case the drain handler is
+ * called after the next send.
+ */
+static void
+sxe_httpd_output_drained(SXE_HTTPD_REQUEST * request, bool blocked, SXE_RETURN final_result)
+{
+    if (!blocked || final_result != SXE_RETURN_OK || request->server->on_drain == NULL) {
+        return;
+    }
+
+    if (!sxe_httpd_output_allowed(request, true)) {
+        request->out_blocked = true;    /* Coverage exclusion: on_sent handler refilled the queue */
+        return;                         /* Coverage exclusion: on_sent handler refilled the queue */
+    }
+
+    (*request->server->on_drain)(request);
+}
+
 static void
 sxe_httpd_default_connect_handler(SXE_HTTPD_REQUEST *request) /* Coverage Exclusion - todo: win32 coverage */
 {
@@ -236,6 +347,71 @@ sxe_httpd_set_close_handler(SXE_HTTPD *self, sxe_httpd_close_handler new_handler
     return old_handler;
 }
 
+/**
+ * Set the handler that supplies validators for conditional requests
+ *
+ * @param self        HTTPD server
+ * @param new_handler Validate handler or NULL to leave conditional requests to the respond handler
+ *
+ * @return The previous validate handler
+ */
+sxe_httpd_validate_handler
+sxe_httpd_set_validate_handler(SXE_HTTPD *self, sxe_httpd_validate_handler new_handler)
+{
+    sxe_httpd_validate_handler old_handler = self->on_validate;
+    self->on_validate = new_handler;
+    return old_handler;
+}
+
+/**
+ * Set the handler that is called when a request that was refused output can accept more
+ *
+ * @param self        HTTPD server
+ * @param new_handler Drain handler or NULL
+ *
+ * @return The previous drain handler
+ */
+sxe_httpd_drain_handler
+sxe_httpd_set_drain_handler(SXE_HTTPD *self, sxe_httpd_drain_handler new_handler)
+{
+    sxe_httpd_drain_handler old_handler = self->on_drain;
+    self->on_drain = new_handler;
+    return old_handler;
+}
+
+/**
+ * Limit the output each connection can queue
+ *
+ * @param self    HTTPD server
+ * @param buffers Maximum number of server buffers a connection can hold or 0 for no limit
+ * @param bytes   Maximum number of unsent bytes a connection can queue or 0 for no limit
+ *
+ * @note Output that would exceed the budget is refused with SXE_RETURN_NO_UNUSED_ELEMENTS; the application should flush
+ *       with sxe_httpd_response_send() and wait for the drain handler before producing more. Regardless of the budget,
+ *       once more than half of the buffer pool is in use, connections are limited to a fair share of the pool.
+ */
+void
+sxe_httpd_set_output_budget(SXE_HTTPD *self, unsigned buffers, unsigned bytes)
+{
+    SXEE6("(self=%p, buffers=%u, bytes=%u)", self, buffers, bytes);
+    self->out_budget_buffers = buffers;
+    self->out_budget_bytes   = bytes;
+    SXER6("return");
+}
+
+/**
+ * Determine whether a request can queue more output
+ *
+ * @param request Request being responded to
+ *
+ * @return true if another server buffer of output would be accepted, false if the producer should pause until drained
+ */
+bool
+sxe_httpd_response_is_writable(SXE_HTTPD_REQUEST * request)
+{
+    return sxe_httpd_output_allowed(request, true);
+}
+
 const char *
 sxe_httpd_state_to_string(unsigned state)
 {
@@ -252,25 +428,59 @@ sxe_httpd_state_to_string(unsigned state)
     return NULL;                                                /* not a state - just keeps the compiler happy */
 }
 
-static void
-sxe_httpd_clear_request(SXE_HTTPD_REQUEST *request)
+/* Reset the per-request fields so a keep-alive connection can take its next request. The slot, its SXE, the message parser and
+ * the read buffer are left in place. The caller must already have returned the server buffers in the output queue.
+ */
+static inline void
+sxe_httpd_recycle_request(SXE_HTTPD_REQUEST *request)
 {
-    SXE *this = request->sxe;
-
-    SXE_UNUSED_PARAMETER(this);
-    SXEE6I("sxe_httpd_clear_request(request=%p)", request);
-
     request->in_content_length = 0;
     request->in_content_seen   = 0;
     request->out_started       = false;
     request->out_eoh           = false;
+    request->out_bytes         = 0;
+    request->out_blocked       = false;
     request->paused            = false;
 
+    if (request->out_waiting) {
+        sxe_list_remove(&request->server->out_waiters, request);
+        request->out_waiting = false;
+    }
+
+    if (request->validated || request->etag_condition) {
+        request->validated      = false;
+        request->etag_condition = false;
+        request->etag_matched   = false;
+        request->date_matched   = false;
+    }
+
     /* This is necessary if the application adds buffers, but doesn't ever
      * remove them during an on_sent callback, because it doesn't need to free
      * the buffers to some resource pool. Ensure we don't accidentally end up
      * with the application's buffers in the wrong response. */
     sxe_buffer_list_construct(&request->out_buffer_list);
+}
+
+static void
+sxe_httpd_clear_request(SXE_HTTPD_REQUEST *request)
+{
+    SXE *this = request->sxe;
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("sxe_httpd_clear_request(request=%p)", request);
+
+#ifdef SXE_HTTPD_HAS_FILE_CACHE
+    /* Connection closed while a cached file was being sent */
+    if (request->sendfile_cache != NULL) {
+        sxe_httpd_file_cache_release(request->sendfile_cache, request->sendfile_cache_id);
+        request->sendfile_cache = NULL;
+    }
+#endif
+
+    /* Return any server buffers still queued (e.g. the connection closed mid-response) to the pool.
+     */
+    sxe_httpd_give_buffers(request, &request->out_buffer_list);
+    sxe_httpd_recycle_request(request);
     SXER6I("return");
 }
 
@@ -492,6 +702,172 @@ sxe_httpd_parse_version(const char * version_string, unsigned version_length)
     return version;
 }
 
+/* Ask the application for the validators of the requested resource, keeping a copy so the url can be consumed
+ */
+static void
+sxe_httpd_validate(SXE_HTTPD_REQUEST * request, const char * url, unsigned url_length)
+{
+    SXE        * this  = request->sxe;
+    const char * etag  = NULL;
+    time_t       mtime = 0;
+    size_t       etag_length;
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("(request=%p,url='%.*s')", request, url_length, url);
+
+    if (!(*request->server->on_validate)(request, url, url_length, &etag, &mtime)) {
+        goto SXE_EARLY_OUT;
+    }
+
+    request->validator_etag[0] = '\0';
+    request->validator_mtime   = mtime;
+
+    if (etag != NULL) {
+        if ((etag_length = strlen(etag)) > SXE_HTTPD_ETAG_MAXIMUM) {
+            SXEL3I("%s: Ignoring ETag longer than %u characters for url '%.*s'", __func__, SXE_HTTPD_ETAG_MAXIMUM, url_length, url);
+        }
+        else {
+            memcpy(request->validator_etag, etag, etag_length + 1);
+        }
+    }
+
+    request->validated = request->validator_etag[0] != '\0' || request->validator_mtime != 0;
+
+SXE_EARLY_OUT:
+    SXER6I("return // validated=%s", SXE_BOOL_TO_STR(request->validated));
+}
+
+/* Does an If-None-Match header value match an ETag? Uses the weak comparison function (RFC 7232 section 2.3.2).
+ */
+static bool
+sxe_httpd_etag_matches(const char * list, unsigned length, const char * etag)
+{
+    unsigned     etag_length;
+    unsigned     tag_length;
+    unsigned     i = 0;
+    const char * end;
+
+    etag        = etag[0] == 'W' && etag[1] == '/' ? etag + 2 : etag;
+    etag_length = strlen(etag);
+
+    while (i < length) {
+        if (list[i] == ' ' || list[i] == '\t' || list[i] == ',') {
+            i++;
+            continue;
+        }
+
+        if (list[i] == '*') {
+            return true;
+        }
+
+        if (i + 1 < length && list[i] == 'W' && list[i + 1] == '/') {
+            i += 2;
+        }
+
+        if (i < length && list[i] == '"') {
+            if ((end = memchr(&list[i + 1], '"', length - i - 1)) == NULL) {
+                return false;
+            }
+
+            tag_length = end + 1 - &list[i];
+
+            if (tag_length == etag_length && memcmp(&list[i], etag, etag_length) == 0) {
+                return true;
+            }
+
+            i += tag_length;
+            continue;
+        }
+
+        while (i < length && list[i] != ',') {    /* Skip a malformed entity tag */
+            i++;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Parse an HTTP date in the preferred IMF-fixdate format (e.g. "Sun, 06 Nov 1994 08:49:37 GMT")
+ *
+ * @param date   The date string
+ * @param length The length of the date string
+ * @param time_out Set to the date as a UNIX time on success
+ *
+ * @return SXE_RETURN_OK or SXE_RETURN_ERROR_INVALID if the date is not an IMF-fixdate (e.g. one of the obsolete formats)
+ */
+SXE_RETURN
+sxe_httpd_parse_date(const char * date, unsigned length, time_t * time_out)
+{
+    static const char     months[]   = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    static const unsigned digits[]   = {5, 6, 12, 13, 14, 15, 17, 18, 20, 21, 23, 24};
+    SXE_RETURN            result     = SXE_RETURN_ERROR_INVALID;
+    unsigned              i;
+    int                   year;
+    int                   mon;
+    int                   era;
+    unsigned              yoe;
+    unsigned              days;
+
+    SXEE6("(date='%.*s')", length, date);
+
+    if (length != SXE_HTTPD_FILE_DATE_LENGTH || date[3] != ',' || date[4] != ' ' || date[7] != ' ' || date[11] != ' '
+     || date[16] != ' ' || date[19] != ':' || date[22] != ':' || date[25] != ' ' || memcmp(&date[26], "GMT", 3) != 0)
+    {
+        goto SXE_EARLY_OUT;
+    }
+
+    for (i = 0; i < sizeof(digits) / sizeof(digits[0]); i++) {
+        if (!isdigit((unsigned char)date[digits[i]])) {
+            goto SXE_EARLY_OUT;
+        }
+    }
+
+    for (mon = 1; memcmp(&months[(mon - 1) * 3], &date[8], 3) != 0; mon++) {
+        if (mon == 12) {
+            goto SXE_EARLY_OUT;
+        }
+    }
+
+    /* Days since the epoch of a proleptic Gregorian date; years start in March so that the leap day is last */
+    year      = SXE_HTTPD_DIGITS2(&date[12]) * 100 + SXE_HTTPD_DIGITS2(&date[14]) - (mon <= 2);
+    era       = year / 400;
+    yoe       = (unsigned)(year - era * 400);
+    days      = yoe * 365 + yoe / 4 - yoe / 100 + (153 * (mon > 2 ? mon - 3 : mon + 9) + 2) / 5 + SXE_HTTPD_DIGITS2(&date[5]) - 1;
+    *time_out = ((time_t)era * 146097 + days - 719468) * 86400
+              + SXE_HTTPD_DIGITS2(&date[17]) * 3600 + SXE_HTTPD_DIGITS2(&date[20]) * 60 + SXE_HTTPD_DIGITS2(&date[23]);
+    result    = SXE_RETURN_OK;
+
+SXE_EARLY_OUT:
+    SXER6("return %s", sxe_return_to_string(result));
+    return result;
+}
+
+/* Answer a request whose conditions show the client's copy is current. The response is fixed apart from the ETag.
+ */
+static void
+sxe_httpd_response_not_modified(SXE_HTTPD_REQUEST * request)
+{
+    SXE  * this = request->sxe;
+    char   response[sizeof("HTTP/1.1 304 Not Modified\r\nETag: \r\n\r\n") + SXE_HTTPD_ETAG_MAXIMUM];
+    int    length;
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("(request=%p)", request);
+
+    if (request->validator_etag[0] != '\0') {
+        length = snprintf(response, sizeof(response), "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n\r\n", request->validator_etag);
+        sxe_httpd_response_copy_raw_data(request, response, length);
+    }
+    else {
+        sxe_httpd_response_copy_raw_data(request, "HTTP/1.1 304 Not Modified\r\n\r\n",
+                                         SXE_LITERAL_LENGTH("HTTP/1.1 304 Not Modified\r\n\r\n"));
+    }
+
+    sxe_httpd_response_end(request, NULL, NULL);
+    SXER6I("return");
+}
+
 /* Note: This function should be called after the whole request line is received */
 static SXE_RETURN
 sxe_httpd_parse_request_line(SXE_HTTPD_REQUEST * request)
@@ -561,6 +937,10 @@ sxe_httpd_parse_request_line(SXE_HTTPD_REQUEST * request)
                           url_string,     url_length,
                           version_string, version_length);
 
+    if (server->on_validate != NULL && (request->method == SXE_HTTP_METHOD_GET || request->method == SXE_HTTP_METHOD_HEAD)) {
+        sxe_httpd_validate(request, url_string, url_length);
+    }
+
 SXE_ERROR_OUT:
     SXER6I("return result=%s", sxe_return_to_string(result));
     return result;
@@ -600,6 +980,7 @@ sxe_httpd_event_read(SXE * this, int additional_length)
     SXE_HTTPD         * server;
     SXE_HTTPD_REQUEST * request_pool;
     unsigned            state;
+    unsigned            pool_state;         /* state of the request in the pool; parse states are committed on the way out */
     char              * start;
     char              * end;
     unsigned            length;
@@ -621,6 +1002,8 @@ sxe_httpd_event_read(SXE * this, int additional_length)
     server       = request->server;
     request_pool = server->requests;
     request_id   = SXE_HTTPD_REQUEST_INDEX(request_pool, request);
+    state        = sxe_pool_index_to_state(request_pool, request_id);
+    pool_state   = state;
 
     /* If the application requested a pause, do not process the read event,
      * just let it queue up in the buffer. sxe_httpd_pause() pauses the
@@ -633,12 +1016,14 @@ sxe_httpd_event_read(SXE * this, int additional_length)
         goto SXE_EARLY_OUT; /* coverage exclusion: spurious - see block comment for details. */
     }
 
-    state = sxe_pool_index_to_state(request_pool, request_id);
+    /* Moving a request between pool states costs a list move and a time stamp, so the parse states a request passes through
+     * during one read event are tracked in 'state' and only the last one is committed to the pool. A small request arriving in
+     * a single read goes from IDLE to REQ_RESPONSE in one pool operation.
+     */
     switch (state) {
     case SXE_HTTPD_CONN_IDLE:
         SXEL7I("state IDLE -> LINE");
         sxe_http_message_construct(message, SXE_BUF(this), SXE_BUF_USED(this));
-        sxe_pool_set_indexed_element_state(request_pool, request_id, state, SXE_HTTPD_CONN_REQ_LINE);
         state = SXE_HTTPD_CONN_REQ_LINE;
         /* FALLTHRU */
 
@@ -666,7 +1051,6 @@ sxe_httpd_event_read(SXE * this, int additional_length)
         }
 
         SXEL7I("state LINE -> REQ_HEADERS");
-        sxe_pool_set_indexed_element_state(request_pool, request_id, state, SXE_HTTPD_CONN_REQ_HEADERS);
         state = SXE_HTTPD_CONN_REQ_HEADERS;
 
         /* FALLTHRU */
@@ -745,6 +1129,27 @@ sxe_httpd_event_read(SXE * this, int additional_length)
                 SXEL7I("content-length: %u", request->in_content_length);
             }
 
+            /* Evaluate conditional headers as they arrive; the values may be consumed before the end of the headers
+             */
+            if (request->validated) {
+                time_t if_modified_since;
+
+                /* Repeated If-None-Match headers are one comma separated list, so any of them may match */
+                if (key_length == SXE_LITERAL_LENGTH("If-None-Match") && strncasecmp(key, "If-None-Match", key_length) == 0) {
+                    request->etag_condition = true;
+                    request->etag_matched   = request->etag_matched
+                                           || (request->validator_etag[0] != '\0'
+                                            && sxe_httpd_etag_matches(value, value_length, request->validator_etag));
+                }
+                else if (key_length == SXE_LITERAL_LENGTH("If-Modified-Since")
+                      && strncasecmp(key, "If-Modified-Since", key_length) == 0)
+                {
+                    request->date_matched = request->validator_mtime != 0
+                                         && sxe_httpd_parse_date(value, value_length, &if_modified_since) == SXE_RETURN_OK
+                                         && request->validator_mtime <= if_modified_since;
+                }
+            }
+
             SXEL7I("About to call on_header handler with key '%.*s' and value '%.*s'", key_length, key, value_length, value);
             (*request->server->on_header)(request, key, key_length, value, value_length);
         }
@@ -755,7 +1160,6 @@ sxe_httpd_event_read(SXE * this, int additional_length)
         (*server->on_eoh)(request);
         request->in_content_seen = 0;
         SXEL7I("state REQ_EOH -> REQ_BODY");
-        sxe_pool_set_indexed_element_state(request_pool, request_id, state, SXE_HTTPD_CONN_REQ_BODY);
         state = SXE_HTTPD_CONN_REQ_BODY;
 
         /* FALLTHRU */
@@ -778,8 +1182,19 @@ sxe_httpd_event_read(SXE * this, int additional_length)
 
         if (request->in_content_length <= request->in_content_seen) {
             SXEL7I("state REQ_BODY -> REQ_RESPONSE");
-            sxe_pool_set_indexed_element_state(request_pool, request_id, state, SXE_HTTPD_CONN_REQ_RESPONSE);
-            state = SXE_HTTPD_CONN_REQ_RESPONSE;
+            sxe_pool_set_indexed_element_state(request_pool, request_id, pool_state, SXE_HTTPD_CONN_REQ_RESPONSE);
+            state      = SXE_HTTPD_CONN_REQ_RESPONSE;
+            pool_state = SXE_HTTPD_CONN_REQ_RESPONSE;
+
+            /* If-None-Match takes precedence over If-Modified-Since (RFC 7232 section 6) */
+            if (request->validated && request->in_content_length == 0
+             && (request->etag_condition ? request->etag_matched : request->date_matched))
+            {
+                SXEL6I("Client's copy of the resource is current; responding 304 Not Modified");
+                sxe_httpd_response_not_modified(request);
+                goto SXE_EARLY_OUT;
+            }
+
             (*server->on_respond)(request);
         }
 
@@ -801,11 +1216,25 @@ SXE_ERROR_OUT:
     sxe_buf_clear(this);
     sxe_httpd_response_simple(request, NULL, NULL, response_status_code, response_reason, NULL,
                               HTTPD_CONNECTION_CLOSE_HEADER, HTTPD_CONNECTION_CLOSE_VALUE, NULL);
-    /* Set the state to BAD so from now on it will just early out (sink mode) */
-    sxe_pool_set_indexed_element_state(request_pool, request_id, SXE_HTTPD_CONN_IDLE, SXE_HTTPD_CONN_BAD);
+    /* Set the state to BAD so from now on it will just early out (sink mode). Sending the response may already have recycled the
+     * request or closed it, so the transition is from whatever state the pool now has the request in.
+     */
+    pool_state = sxe_pool_index_to_state(request_pool, request_id);
+
+    if (pool_state != SXE_HTTPD_CONN_FREE) {
+        sxe_pool_set_indexed_element_state(request_pool, request_id, pool_state, SXE_HTTPD_CONN_BAD);
+        pool_state = SXE_HTTPD_CONN_BAD;
+    }
+
+    state    = pool_state;
     consumed = 0;
 
 SXE_EARLY_OUT:
+    /* Commit the parse state unless a handler has closed the request in the meantime */
+    if (state != pool_state && sxe_pool_index_to_state(request_pool, request_id) == pool_state) {
+        sxe_pool_set_indexed_element_state(request_pool, request_id, pool_state, state);
+    }
+
     state = sxe_pool_index_to_state(request_pool, request_id);
     if (consumed > 0 && !request->paused && state != SXE_HTTPD_CONN_FREE) {
         sxe_buf_resume(this, SXE_BUF_RESUME_IMMEDIATE);    /* sxe_consume() pauses; unpause unless sxe_httpd_pause() was called. */
@@ -819,19 +1248,19 @@ sxe_httpd_response_start(SXE_HTTPD_REQUEST * request, int code, const char * sta
 {
     SXE_RETURN   result = SXE_RETURN_NO_UNUSED_ELEMENTS;
     SXE        * this = request->sxe;
-    SXE_HTTPD  * self = request->server;
     SXE_BUFFER * buffer;
     int          len;
 
     SXEE6I("sxe_httpd_response_start(request=%p,code=%d,status=%s)", request, code, status);
-    buffer = sxe_httpd_get_buffer(self);
-    SXEA6I(!sxe_buffer_is_overflow(buffer), "Newly allocated buffer is in overflow state");
+    buffer = sxe_httpd_get_buffer(request);
 
     if (buffer != NULL) {
+        SXEA6I(!sxe_buffer_is_overflow(buffer), "Newly allocated buffer is in overflow state");
         len = sxe_buffer_printf(buffer, "HTTP/1.1 %d %s\r\n", code, status);
         SXEA1I(!sxe_buffer_is_overflow(buffer), "Status message is longer (%u) than the buffer size (%u)", len,
                sxe_buffer_length(buffer));
         sxe_list_push(&request->out_buffer_list, buffer);
+        request->out_bytes  += len;
         request->out_started = true;
         result = SXE_RETURN_OK;
     }
@@ -863,20 +1292,22 @@ sxe_httpd_response_header(SXE_HTTPD_REQUEST * request, const char * header, cons
     {
         len = sxe_buffer_printf(buffer, "%s: %.*s\r\n", header, value_length, value);
         SXEA1I(!sxe_buffer_is_overflow(buffer), "Buffer overflowed even though we checked to make sure there was room");
-        result = SXE_RETURN_OK;
+        request->out_bytes += len;
+        result              = SXE_RETURN_OK;
         SXEL6I("sxe_httpd_response_header(): wrote %u bytes to buffer %u: now %u bytes", len,
                SXE_LIST_GET_LENGTH(&request->out_buffer_list), sxe_buffer_length(buffer));
         goto SXE_EARLY_OUT;
     }
 
     /* Write the header into its own buffer */
-    buffer = sxe_httpd_get_buffer(self);
+    buffer = sxe_httpd_get_buffer(request);
 
     if (buffer != NULL) {
         len = sxe_buffer_printf(buffer, "%s: %.*s\r\n", header, value_length, value);
         SXEA1I(!sxe_buffer_is_overflow(buffer), "Header is longer (%u) than the buffer size (%u)", len, self->buffer_size);
         sxe_list_push(&request->out_buffer_list, buffer);
-        result = SXE_RETURN_OK;
+        request->out_bytes += len;
+        result              = SXE_RETURN_OK;
     }
 
 SXE_EARLY_OUT:
@@ -905,7 +1336,6 @@ sxe_httpd_response_eoh(SXE_HTTPD_REQUEST *request)
 {
     SXE_RETURN   result = SXE_RETURN_NO_UNUSED_ELEMENTS;
     SXE        * this = request->sxe;
-    SXE_HTTPD  * self = request->server;
     SXE_BUFFER * buffer;
 
     SXE_UNUSED_PARAMETER(this);
@@ -921,7 +1351,7 @@ sxe_httpd_response_eoh(SXE_HTTPD_REQUEST *request)
         SXEL6I("sxe_httpd_response_eoh(): wrote EOH to buffer %u: now %u bytes",
                SXE_LIST_GET_LENGTH(&request->out_buffer_list), sxe_buffer_length(buffer));
     }
-    else if ((buffer = sxe_httpd_get_buffer(self)) == NULL) {
+    else if ((buffer = sxe_httpd_get_buffer(request)) == NULL) {
         SXEL2("Failed to allocate an HTTPD buffer");    /* COVERAGE EXCLUSION: TODO: Cover buffer exhaustion */
         goto SXE_EARLY_OUT;                             /* COVERAGE EXCLUSION: TODO: Cover buffer exhaustion */
     }
@@ -930,8 +1360,9 @@ sxe_httpd_response_eoh(SXE_HTTPD_REQUEST *request)
         sxe_list_push(&request->out_buffer_list, buffer);
     }
 
-    request->out_eoh = true;
-    result = SXE_RETURN_OK;
+    request->out_bytes += 2;
+    request->out_eoh    = true;
+    result              = SXE_RETURN_OK;
 
 SXE_EARLY_OUT:
     SXER6I("return %s", sxe_return_to_string(result));
@@ -959,7 +1390,7 @@ sxe_httpd_copy_data_to_buffer_list(SXE_HTTPD_REQUEST * request, SXE_LIST * buffe
 
     /* Grab as many buffers as necessary to hold 'length' bytes. */
     for (used = 0; used < length; used += self->buffer_size) {
-        if ((buffer = sxe_httpd_get_buffer(self)) == NULL) {
+        if ((buffer = sxe_httpd_get_buffer(request)) == NULL) {
             goto SXE_EARLY_OUT;   /* Coverage exclusion: todo: test running out of send buffers */
         }
 
@@ -1014,8 +1445,8 @@ sxe_httpd_response_copy_body_data(SXE_HTTPD_REQUEST *request, const char *chunk,
 {
     SXE_RETURN   result = SXE_RETURN_NO_UNUSED_ELEMENTS;
     SXE        * this = request->sxe;
-    SXE_HTTPD  * self = request->server;
     SXE_LIST     buffer_list;
+    SXE_BUFFER * buffer;
 
     SXE_UNUSED_PARAMETER(this);
     SXEE6I("(request=%p, chunk=%p, length=%u)", request, chunk, length);
@@ -1035,12 +1466,13 @@ sxe_httpd_response_copy_body_data(SXE_HTTPD_REQUEST *request, const char *chunk,
         }
     }
 
-    while (!SXE_LIST_IS_EMPTY(&buffer_list)) {
-        sxe_list_push(&request->out_buffer_list, sxe_list_shift(&buffer_list));
+    while ((buffer = sxe_list_shift(&buffer_list)) != NULL) {
+        request->out_bytes += sxe_buffer_length(buffer);
+        sxe_list_push(&request->out_buffer_list, buffer);
     }
 
 SXE_EARLY_OUT:
-    sxe_httpd_give_buffers(self, &buffer_list); /* Return any new buffers to the pool if anything went wrong. */
+    sxe_httpd_give_buffers(request, &buffer_list); /* Return any new buffers to the pool if anything went wrong. */
     SXER6I("return %s", sxe_return_to_string(result));
     return result;
 }
@@ -1050,7 +1482,6 @@ sxe_httpd_response_add_body_data(SXE_HTTPD_REQUEST *request, const char *chunk,
 {
     SXE_RETURN   result = SXE_RETURN_NO_UNUSED_ELEMENTS;
     SXE        * this = request->sxe;
-    SXE_HTTPD  * self = request->server;
     SXE_BUFFER * buffer;
 
     SXE_UNUSED_PARAMETER(this);
@@ -1066,12 +1497,13 @@ sxe_httpd_response_add_body_data(SXE_HTTPD_REQUEST *request, const char *chunk,
         }
     }
 
-    if ((buffer = sxe_httpd_get_buffer(self)) == NULL) {
+    if ((buffer = sxe_httpd_get_buffer(request)) == NULL) {
         goto SXE_EARLY_OUT;                  /* Coverage exclusion: todo: test running out of send buffers */
     }
 
     sxe_buffer_construct_const(buffer, chunk, length);
     sxe_list_push(&request->out_buffer_list, buffer);
+    request->out_bytes += length;
 
 SXE_EARLY_OUT:
     SXER6I("return %s", sxe_return_to_string(result));
@@ -1102,7 +1534,6 @@ sxe_httpd_response_copy_raw_data(SXE_HTTPD_REQUEST *request, const char *chunk,
 {
     SXE_RETURN   result = SXE_RETURN_NO_UNUSED_ELEMENTS;
     SXE        * this = request->sxe;
-    SXE_HTTPD  * self = request->server;
     SXE_LIST     buffer_list;
     SXE_BUFFER * buffer;
 
@@ -1118,6 +1549,7 @@ sxe_httpd_response_copy_raw_data(SXE_HTTPD_REQUEST *request, const char *chunk,
     }
 
     while ((buffer = sxe_list_shift(&buffer_list)) != NULL) {
+        request->out_bytes += sxe_buffer_length(buffer);
         sxe_list_push(&request->out_buffer_list, buffer);
     }
 
@@ -1125,7 +1557,7 @@ sxe_httpd_response_copy_raw_data(SXE_HTTPD_REQUEST *request, const char *chunk,
     request->out_eoh = true;
 
 SXE_EARLY_OUT:
-    sxe_httpd_give_buffers(self, &buffer_list);
+    sxe_httpd_give_buffers(request, &buffer_list);
     SXER6I("return %s", sxe_return_to_string(result));
     return result;
 }
@@ -1136,7 +1568,8 @@ SXE_EARLY_OUT:
  * @param request Pointer to an HTTP request object
  * @param buffer  Pointer to the SXE_BUFFER to append
  *
- * @return SXE_RETURN_OK or SXE_RETURN_NO_UNUSED_ELEMENTS if a buffer could not be allocated for the EOH marker
+ * @return SXE_RETURN_OK or SXE_RETURN_NO_UNUSED_ELEMENTS if a buffer could not be allocated for the EOH marker or the
+ *         request is over its output byte budget
  *
  * @note The buffer is appended to the response queue, so the data in the
  *       buffer must not be modified until the data has been sent. A callback
@@ -1163,8 +1596,15 @@ sxe_httpd_response_add_body_buffer(SXE_HTTPD_REQUEST *request, SXE_BUFFER *buffe
         }
     }
 
+    if (!sxe_httpd_output_allowed(request, false)) {
+        SXEL6I("Request with %u bytes queued is over its output budget", request->out_bytes);
+        request->out_blocked = true;
+        goto SXE_EARLY_OUT;
+    }
+
     sxe_list_push(&request->out_buffer_list, buffer);
-    result = SXE_RETURN_OK;
+    request->out_bytes += sxe_buffer_length(buffer);
+    result              = SXE_RETURN_OK;
 
 SXE_EARLY_OUT:
     SXER6I("return %s", sxe_return_to_string(result));
@@ -1177,7 +1617,7 @@ SXE_EARLY_OUT:
  * @param request Pointer to an HTTP request object
  * @param buffer  Pointer to the SXE_BUFFER to append
  *
- * @return SXE_RETURN_OK
+ * @return SXE_RETURN_OK or SXE_RETURN_NO_UNUSED_ELEMENTS if the request is over its output byte budget
  *
  * @note The buffer is appended to the response queue, so the data in the
  *       buffer must not be modified until the data has been sent. A callback
@@ -1195,10 +1635,18 @@ sxe_httpd_response_add_raw_buffer(SXE_HTTPD_REQUEST *request, SXE_BUFFER *buffer
 
     SXEE6I("(request=%p, buffer=%p)", request, buffer);
 
-    request->out_eoh = true;
+    if (!sxe_httpd_output_allowed(request, false)) {
+        SXEL6I("Request with %u bytes queued is over its output budget", request->out_bytes);
+        request->out_blocked = true;
+        goto SXE_EARLY_OUT;
+    }
+
+    request->out_eoh    = true;
     sxe_list_push(&request->out_buffer_list, buffer);
-    result = SXE_RETURN_OK;
+    request->out_bytes += sxe_buffer_length(buffer);
+    result              = SXE_RETURN_OK;
 
+SXE_EARLY_OUT:
     SXER6I("return %s", sxe_return_to_string(result));
     return result;
 }
@@ -1209,9 +1657,24 @@ sxe_httpd_event_sendfile_done(SXE * this, SXE_RETURN final_result)
 {
     SXE_HTTPD_REQUEST * request = SXE_USER_DATA(this);
     SXE_BUFFER        * buffer;
+    bool                blocked;
 
     SXEE6I("(request=%p, final_result=%s)", request, sxe_return_to_string(final_result));
 
+    /* A file from a file cache is the whole body, so the response is ended on the application's behalf
+     */
+#ifdef SXE_HTTPD_HAS_FILE_CACHE
+    if (request->sendfile_cache != NULL) {
+        sxe_httpd_file_cache_release(request->sendfile_cache, request->sendfile_cache_id);
+        request->sendfile_cache = NULL;
+        sxe_httpd_response_end(request, request->on_sent_handler, request->on_sent_userdata);
+        goto SXE_EARLY_OUT;
+    }
+#endif
+
+    blocked              = request->out_blocked;
+    request->out_blocked = false;
+
     if (request->on_sent_handler) {
         (*request->on_sent_handler)(request, final_result, request->on_sent_userdata);
     }
@@ -1226,6 +1689,9 @@ sxe_httpd_event_sendfile_done(SXE * this, SXE_RETURN final_result)
         sxe_list_remove(&request->out_buffer_list, buffer);
     }
 
+    sxe_httpd_output_drained(request, blocked, final_result);
+
+SXE_EARLY_OUT:
     SXER6I("return");
 }
 
@@ -1237,7 +1703,8 @@ sxe_httpd_event_sendfile_ready(SXE * this, SXE_RETURN final_result)
 
     SXEE6I("(request=%p, final_result=%s)", request, sxe_return_to_string(final_result));
 
-    sxe_httpd_give_buffers(self, &request->out_buffer_list);
+    sxe_httpd_give_buffers(request, &request->out_buffer_list);
+    request->out_bytes = 0;
 
     if (final_result == SXE_RETURN_OK) {
         sxe_sendfile(this, request->sendfile_fd, &request->sendfile_offset, request->sendfile_length, sxe_httpd_event_sendfile_done);
@@ -1250,20 +1717,32 @@ sxe_httpd_event_sendfile_ready(SXE * this, SXE_RETURN final_result)
     SXER6I("return");
 }
 
+/**
+ * Send part of a file as (the rest of) the response body
+ *
+ * @param request   Request being responded to
+ * @param fd        File to send; its file offset is neither used nor changed, so the fd can be shared between responses
+ * @param offset    Offset in the file of the first byte to send
+ * @param length    Number of bytes to send
+ * @param handler   Function to call back when the file has been sent
+ * @param user_data User data passed back to handler
+ */
 SXE_RETURN
-sxe_httpd_response_sendfile(SXE_HTTPD_REQUEST *request, int fd, unsigned length, sxe_httpd_on_sent_handler handler, void *user_data)
+sxe_httpd_response_sendfile_range(SXE_HTTPD_REQUEST * request, int fd, off_t offset, unsigned length,
+                                  sxe_httpd_on_sent_handler handler, void * user_data)
 {
     SXE_RETURN   result = SXE_RETURN_NO_UNUSED_ELEMENTS;
     SXE        * this   = request->sxe;
 
-    SXEE6I("(request=%p,fd=%d,length=%u,handler=%p,user_data=%p)", request, fd, length, handler, user_data);
+    SXEE6I("(request=%p,fd=%d,offset=%lld,length=%u,handler=%p,user_data=%p)", request, fd, (long long)offset, length, handler,
+           user_data);
     SXEA6I(request->out_started, "%s() called before sxe_httpd_response_start()", __func__);
 
     request->on_sent_handler  = handler;
     request->on_sent_userdata = user_data;
     request->sendfile_fd      = fd;
     request->sendfile_length  = length;
-    request->sendfile_offset  = lseek(fd, 0, SEEK_CUR);
+    request->sendfile_offset  = offset;
 
     if (!request->out_eoh) {
         if (sxe_httpd_response_eoh(request) != SXE_RETURN_OK) {
@@ -1281,17 +1760,26 @@ SXE_EARLY_OUT:
     SXER6I("return %s", sxe_return_to_string(result));
     return result;
 }
+
+SXE_RETURN
+sxe_httpd_response_sendfile(SXE_HTTPD_REQUEST *request, int fd, unsigned length, sxe_httpd_on_sent_handler handler, void *user_data)
+{
+    return sxe_httpd_response_sendfile_range(request, fd, lseek(fd, 0, SEEK_CUR), length, handler, user_data);
+}
 #endif
 
 static void
 sxe_httpd_event_response_sent(SXE * this, SXE_RETURN final_result)
 {
     SXE_HTTPD_REQUEST * request = SXE_USER_DATA(this);
-    SXE_HTTPD         * self    = request->server;
     SXE_BUFFER        * buffer;
+    bool                blocked;
 
     SXEE6I("(request=%p, final_result=%s)", request, sxe_return_to_string(final_result));
-    sxe_httpd_give_buffers(self, &request->out_buffer_list);
+    sxe_httpd_give_buffers(request, &request->out_buffer_list);
+    blocked              = request->out_blocked;
+    request->out_blocked = false;
+    request->out_bytes   = 0;
 
     if (request->on_sent_handler) {
         (*request->on_sent_handler)(request, final_result, request->on_sent_userdata);
@@ -1307,6 +1795,7 @@ sxe_httpd_event_response_sent(SXE * this, SXE_RETURN final_result)
         sxe_list_remove(&request->out_buffer_list, buffer);
     }
 
+    sxe_httpd_output_drained(request, blocked, final_result);
     SXER6I("return");
 }
 
@@ -1342,15 +1831,19 @@ sxe_httpd_event_response_done(SXE * this, SXE_RETURN final_result)
 
     SXEE6I("(request=%p, final_result=%s)", request, sxe_return_to_string(final_result));
 
-    sxe_httpd_give_buffers(self, &request->out_buffer_list);
+    sxe_httpd_give_buffers(request, &request->out_buffer_list);
 
     if (request->on_sent_handler) {
         (*request->on_sent_handler)(request, final_result, request->on_sent_userdata);
     }
 
-    sxe_httpd_clear_request(request);
+    /* The buffers have been given back and a cached file is released before the response is ended, so the request only needs
+     * recycling. If the on_sent handler closed the connection, the request has already been cleared.
+     */
     state = sxe_pool_index_to_state(request_pool, request_id);
     if (state != SXE_HTTPD_CONN_FREE) {
+        SXEA6I(request->sendfile_cache == NULL, "Response ended while a cached file is still being sent");
+        sxe_httpd_recycle_request(request);
         sxe_pool_set_indexed_element_state(request_pool, request_id, state, SXE_HTTPD_CONN_IDLE);
         sxe_buf_resume(this, SXE_BUF_RESUME_IMMEDIATE);
     }
@@ -1523,6 +2016,13 @@ sxe_httpd_construct(SXE_HTTPD * self, unsigned connections, unsigned buffer_coun
     self->on_body      = sxe_httpd_default_body_handler;
     self->on_respond   = sxe_httpd_default_respond_handler;
     self->on_close     = sxe_httpd_default_close_handler;
+    self->on_validate  = NULL;
+    self->on_drain     = NULL;
+
+    self->out_budget_buffers = 0;
+    self->out_budget_bytes   = 0;
+    self->out_connections    = 0;
+    SXE_LIST_CONSTRUCT(&self->out_waiters, 0, SXE_HTTPD_REQUEST, out_wait_node);
 
     SXER6("return");
 }
@@ -23,15 +23,29 @@
 #ifndef __SXE_HTTPD_H__
 #define __SXE_HTTPD_H__
 
+/* The file cache watches its directory with sxe_dirwatch, which is only implemented on Linux
+ */
+#if !defined(_WIN32) && !defined(__APPLE__) && !defined(__FreeBSD__)
+#define SXE_HTTPD_HAS_FILE_CACHE 1
+#endif
+
 #include "sxe.h"
 #include "sxe-http.h"
 #include "sxe-list.h"
 #include "sxe-util.h"
 
+#ifdef SXE_HTTPD_HAS_FILE_CACHE
+#include "sxe-dirwatch.h"
+#endif
+
 #define HTTPD_CONTENT_LENGTH          "Content-Length"
 #define HTTPD_CONNECTION_CLOSE_HEADER "Connection"
 #define HTTPD_CONNECTION_CLOSE_VALUE  "close"
 
+#define SXE_HTTPD_FILE_NAME_MAXIMUM   127    /* Longest file name that can be served from a file cache */
+#define SXE_HTTPD_ETAG_MAXIMUM        40     /* Longest ETag, including quotes, that can be validated or cached */
+#define SXE_HTTPD_FILE_DATE_LENGTH    29     /* Length of an HTTP date (e.g. "Sun, 06 Nov 1994 08:49:37 GMT") */
+
 /* NOTE: Order of states is important! */
 typedef enum {
     SXE_HTTPD_CONN_FREE = 0,           /* not connected */
@@ -57,12 +71,25 @@ typedef void (*sxe_httpd_body_handler)(struct SXE_HTTPD_REQUEST *, const char *c
 typedef void (*sxe_httpd_respond_handler)(struct SXE_HTTPD_REQUEST *);
 typedef void (*sxe_httpd_close_handler)(struct SXE_HTTPD_REQUEST *);
 
+/* This handler is invoked for GET and HEAD requests once the request line has been parsed. If the application has validators
+ * for the resource, it sets *etag (quoted, optionally W/ prefixed) and/or *mtime and returns true; sxe_httpd then answers 304
+ * Not Modified to requests whose If-None-Match or If-Modified-Since headers show the client's copy is current, without calling
+ * the respond handler.
+ */
+typedef bool (*sxe_httpd_validate_handler)(struct SXE_HTTPD_REQUEST *, const char *url, unsigned ulen, const char **etag,
+                                           time_t *mtime);
+
 /* This handler is invoked when any of the sxe_httpd_response_*() functions
  * have sent the entire response or portion of the response; or when an I/O
  * error occurs.
  */
 typedef void (*sxe_httpd_on_sent_handler)(struct SXE_HTTPD_REQUEST *, SXE_RETURN, void *);
 
+/* This handler is invoked when output that was refused because the request was over its output budget (see
+ * sxe_httpd_set_output_budget()) or the buffer pool was exhausted has been sent, and the request can accept more output.
+ */
+typedef void (*sxe_httpd_drain_handler)(struct SXE_HTTPD_REQUEST *);
+
 #define SXE_HTTPD_REQUEST_USER_DATA(request)              ((request)->user_data)
 #define SXE_HTTPD_REQUEST_USER_DATA_AS_UNSIGNED(request)  SXE_CAST(uintptr_t, (request)->user_data)
 #define SXE_HTTPD_REQUEST_SERVER_USER_DATA(request)       ((request)->server->user_data)
@@ -81,10 +108,23 @@ typedef struct SXE_HTTPD_REQUEST {
     unsigned                   in_content_seen;      /* number of body bytes read */
     bool                       paused;               /* are input events paused? */
 
+    /* Conditional request handling */
+    bool                       validated;            /* did the validate handler supply validators for the resource? */
+    bool                       etag_condition;       /* was there an If-None-Match header? */
+    bool                       etag_matched;         /* did If-None-Match match the resource's ETag? */
+    bool                       date_matched;         /* is the resource unmodified since If-Modified-Since? */
+    time_t                     validator_mtime;      /* resource's modification time or 0 if unknown */
+    char                       validator_etag[SXE_HTTPD_ETAG_MAXIMUM + 1];    /* resource's ETag or "" if unknown */
+
     /* Output handling */
     bool                       out_started;          /* have we called sxe_httpd_response_start() yet? */
     bool                       out_eoh;              /* have we send the EOH marker yet? */
     SXE_LIST                   out_buffer_list;      /* the output queue */
+    unsigned                   out_buffers;          /* number of server buffers held by the output queue */
+    unsigned                   out_bytes;            /* number of bytes queued and not yet sent */
+    bool                       out_blocked;          /* has output been refused since the queue was last drained? */
+    bool                       out_waiting;          /* is the request on the server's list of requests waiting for a buffer? */
+    SXE_LIST_NODE              out_wait_node;        /* links the request into the server's out_waiters list */
 
     /* Handle sxe_send() and sxe_sendfile() */
     sxe_httpd_on_sent_handler  on_sent_handler;
@@ -92,6 +132,8 @@ typedef struct SXE_HTTPD_REQUEST {
     int                        sendfile_fd;
     unsigned                   sendfile_length;
     off_t                      sendfile_offset;
+    struct SXE_HTTPD_FILE_CACHE * sendfile_cache;    /* file cache that sendfile_fd belongs to or NULL */
+    unsigned                   sendfile_cache_id;    /* index of the open file in the file cache */
 } SXE_HTTPD_REQUEST;
 
 static inline SXE * sxe_httpd_request_get_sxe(SXE_HTTPD_REQUEST * request) { return request->sxe; };    /* For diagnostics */
@@ -110,11 +152,115 @@ typedef struct SXE_HTTPD {
     sxe_httpd_body_handler    on_body;
     sxe_httpd_respond_handler on_respond;
     sxe_httpd_close_handler   on_close;
+    sxe_httpd_validate_handler on_validate;          /* NULL if conditional requests are not handled by sxe_httpd */
+    sxe_httpd_drain_handler   on_drain;              /* NULL if the application doesn't want to know */
+    unsigned                  out_budget_buffers;    /* maximum server buffers per connection or 0 for no limit */
+    unsigned                  out_budget_bytes;      /* maximum bytes queued per connection or 0 for no limit */
+    unsigned                  out_connections;       /* number of connections holding server buffers */
+    SXE_LIST                  out_waiters;           /* requests refused a buffer while holding none; drained when one is freed */
 } SXE_HTTPD;
 
 #define SXE_HTTPD_SET_HANDLER(httpd, handler, function) sxe_httpd_set_ ## handler ## _handler((httpd), function)
 
+#ifdef SXE_HTTPD_HAS_FILE_CACHE
+
+/* States of the open files in a file cache
+ */
+typedef enum {
+    SXE_HTTPD_FILE_FREE = 0,           /* no file open */
+    SXE_HTTPD_FILE_CACHED,             /* open and findable by name; the queue is kept in least recently used order */
+    SXE_HTTPD_FILE_STALE,              /* changed on disk; closed once the last response sending it is done */
+    SXE_HTTPD_FILE_NUMBER_OF_STATES
+} SXE_HTTPD_FILE_STATE;
+
+/* An open file, with everything needed to build its response headers precomputed
+ */
+typedef struct SXE_HTTPD_FILE {
+    int          fd;
+    unsigned     references;                                         /* number of responses currently sending the file */
+    unsigned     name_id;                                            /* index of the file's name in the cache's name hash */
+    off_t        size;
+    time_t       mtime;
+    const char * content_type;
+    char         etag[SXE_HTTPD_ETAG_MAXIMUM + 1];
+    char         last_modified[SXE_HTTPD_FILE_DATE_LENGTH + 1];
+} SXE_HTTPD_FILE;
+
+/* Maps a file name to the index of its open file
+ */
+typedef struct SXE_HTTPD_FILE_NAME {
+    char     name[SXE_HTTPD_FILE_NAME_MAXIMUM + 1];                  /* '\0' padded; this is the hash key */
+    unsigned file_id;
+} SXE_HTTPD_FILE_NAME;
+
+typedef struct SXE_HTTPD_FILE_CACHE {
+    SXE_HTTPD_FILE      * files;                                     /* pool of open files */
+    SXE_HTTPD_FILE_NAME * names;                                     /* hash of file names to open files */
+    int                   directory_fd;
+    SXE_DIRWATCH          dirwatch;                                  /* invalidates files when they change on disk */
+    unsigned              hits;
+    unsigned              misses;
+} SXE_HTTPD_FILE_CACHE;
+
+#endif
+
+#define SXE_HTTPD_ROUTE_ANY_METHOD      SXE_HTTP_METHOD_INVALID    /* Register a route for all methods */
+#define SXE_HTTPD_ROUTE_PARAM_MAXIMUM   8                          /* Most :name and *name captures in a route pattern */
+#define SXE_HTTPD_ROUTER_NONE           (~0U)
+
+struct SXE_HTTPD_ROUTE_MATCH;
+
+typedef void (*sxe_httpd_route_handler)(struct SXE_HTTPD_REQUEST *, const struct SXE_HTTPD_ROUTE_MATCH *, void *);
+
+/* A registered route. Patterns are paths in which a segment may be a ":name" capture (one or more bytes up to the next '/') or,
+ * as the last segment, a "*name" capture (the rest of the path, possibly empty).
+ */
+typedef struct SXE_HTTPD_ROUTE {
+    SXE_HTTP_METHOD          method;
+    char                   * pattern;
+    unsigned                 param_count;
+    unsigned                 param_names[SXE_HTTPD_ROUTE_PARAM_MAXIMUM];     /* offsets of the capture names in the pattern */
+    unsigned                 param_name_lengths[SXE_HTTPD_ROUTE_PARAM_MAXIMUM];
+    sxe_httpd_route_handler  handler;
+    void                   * user_data;
+    unsigned                 next;                   /* next route with the same pattern (other methods) */
+} SXE_HTTPD_ROUTE;
+
+typedef struct SXE_HTTPD_ROUTE_MATCH {
+    const SXE_HTTPD_ROUTE * route;                   /* matched route or NULL */
+    unsigned                allowed;                 /* if no route matched, bit mask (1 << method) of methods the path has */
+    unsigned                param_count;
+    const char            * params[SXE_HTTPD_ROUTE_PARAM_MAXIMUM];           /* captured values, pointing into the url */
+    unsigned                param_lengths[SXE_HTTPD_ROUTE_PARAM_MAXIMUM];
+} SXE_HTTPD_ROUTE_MATCH;
+
+/* Node of a compiled router. The static children of a node are contiguous and sorted by the first byte of their labels.
+ */
+typedef struct SXE_HTTPD_ROUTER_NODE {
+    unsigned label;                                  /* offset in the router's labels of the bytes matched to enter the node */
+    unsigned label_length;
+    unsigned children;                               /* index of the first static child */
+    unsigned child_count;
+    unsigned param_child;                            /* node entered by a :name capture or SXE_HTTPD_ROUTER_NONE */
+    unsigned wildcard_child;                         /* node entered by a *name capture or SXE_HTTPD_ROUTER_NONE */
+    unsigned route;                                  /* first route ending at this node or SXE_HTTPD_ROUTER_NONE */
+} SXE_HTTPD_ROUTER_NODE;
+
+typedef struct SXE_HTTPD_ROUTER {
+    SXE_HTTPD_ROUTE       * routes;
+    unsigned                route_count;
+    unsigned                route_maximum;
+    unsigned                pattern_bytes;           /* total length of all patterns */
+    SXE_HTTPD_ROUTER_NODE * nodes;                   /* compiled radix trie, or NULL until sxe_httpd_router_compile() */
+    unsigned                node_count;
+    char                  * labels;
+} SXE_HTTPD_ROUTER;
+
 #include "sxe-httpd-proto.h"
+#ifdef SXE_HTTPD_HAS_FILE_CACHE
+#include "sxe-httpd-file-cache-proto.h"
+#endif
+#include "sxe-httpd-router-proto.h"
 
 #endif
 
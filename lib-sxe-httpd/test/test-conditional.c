@@ -0,0 +1,152 @@
+/* Copyright 2010 Sophos Limited. All rights reserved. Sophos is a registered
+ * trademark of Sophos Limited.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "tap.h"
+#include "sxe-httpd.h"
+#include "sxe-test.h"
+#include "sxe-util.h"
+
+#define TEST_WAIT  5.0
+#define TEST_MTIME 784111777    /* Sun, 06 Nov 1994 08:49:37 GMT */
+
+static bool
+http_validate(SXE_HTTPD_REQUEST * request, const char * url, unsigned url_length, const char ** etag, time_t * mtime)
+{
+    SXE * this   = request->sxe;
+    bool  result = false;
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("%s(url='%.*s')", __func__, url_length, url);
+
+    if (url_length == SXE_LITERAL_LENGTH("/res") && memcmp(url, "/res", url_length) == 0) {
+        *etag  = "\"v1\"";
+        *mtime = TEST_MTIME;
+        result = true;
+    }
+
+    SXER6I("return %s", SXE_BOOL_TO_STR(result));
+    return result;
+}
+
+static void
+http_respond(SXE_HTTPD_REQUEST * request)
+{
+    SXE * this = request->sxe;
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("%s()", __func__);
+    tap_ev_push(__func__, 1, "request", request);
+    sxe_httpd_response_simple(request, NULL, NULL, 200, "OK", "body", NULL);
+    SXER6I("return");
+}
+
+static void
+client_connect(SXE * this)
+{
+    SXEE6I("%s()", __func__);
+    tap_ev_push(__func__, 1, "this", this);
+    SXER6I("return");
+}
+
+static void
+client_read(SXE * this, int length)
+{
+    SXE_UNUSED_PARAMETER(length);
+    SXEE6I("%s(length=%u)", __func__, length);
+    tap_ev_push(__func__, 3, "this", this, "buf", tap_dup(SXE_BUF(this), SXE_BUF_USED(this)), "used", SXE_BUF_USED(this));
+    sxe_buf_clear(this);
+    SXER6I("return");
+}
+
+#define NOT_MODIFIED "HTTP/1.1 304 Not Modified\r\nETag: \"v1\"\r\n\r\n"
+#define OK_RESPONSE  "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nbody"
+
+/* Send a request and check whether it was answered by the respond handler or with a 304
+ */
+static void
+test_request(SXE * client, const char * request, bool not_modified, const char * what)
+{
+    char        readbuf[256];
+    const char *expected = not_modified ? NOT_MODIFIED : OK_RESPONSE;
+    tap_ev      ev;
+
+    sxe_write(client, request, strlen(request));
+
+    if (not_modified) {
+        test_ev_wait_read(TEST_WAIT, &ev, client, "client_read", readbuf, strlen(expected), "client");
+    }
+    else {
+        is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "http_respond",     "Respond handler called: %s", what);
+        test_ev_wait_read(TEST_WAIT, &ev, client, "client_read", readbuf, strlen(expected), "client");
+    }
+
+    is_strncmp(readbuf, expected, strlen(expected), "Got %s: %s", not_modified ? "304" : "200", what);
+}
+
+int
+main(void)
+{
+    SXE_HTTPD httpd;
+    tap_ev    ev;
+    SXE     * listener;
+    SXE     * c;
+    time_t    date;
+
+    plan_tests(34);
+
+    is(sxe_httpd_parse_date("Sun, 06 Nov 1994 08:49:37 GMT", 29, &date), SXE_RETURN_OK,        "Parsed an IMF-fixdate");
+    is(date, TEST_MTIME,                                                                          "Got the right time");
+    is(sxe_httpd_parse_date("Tue, 29 Feb 2028 23:59:59 GMT", 29, &date), SXE_RETURN_OK,        "Parsed a leap day");
+    is(date, 1835481599,                                                                          "Got the right time");
+    is(sxe_httpd_parse_date("Sunday, 06-Nov-94 08:49:37 GMT", 30, &date), SXE_RETURN_ERROR_INVALID, "RFC 850 date is ignored");
+    is(sxe_httpd_parse_date("Sun, 06 Nov 1994 08:49:37 UTC", 29, &date), SXE_RETURN_ERROR_INVALID,  "Non GMT date is ignored");
+    is(sxe_httpd_parse_date("Sun, 06 Nob 1994 08:49:37 GMT", 29, &date), SXE_RETURN_ERROR_INVALID,  "Bad month is ignored");
+
+    sxe_register(4, 0);        /* http listener and connections */
+    sxe_register(8, 0);        /* http clients */
+    sxe_init();
+
+    sxe_httpd_construct(&httpd, 3, 10, 512, 0);
+    SXE_HTTPD_SET_HANDLER(&httpd, respond,  http_respond);
+    is(SXE_HTTPD_SET_HANDLER(&httpd, validate, http_validate), NULL,                             "No validate handler by default");
+    listener = sxe_httpd_listen(&httpd, "0.0.0.0", 0);
+    c = sxe_new_tcp(NULL, "0.0.0.0", 0, client_connect, client_read, NULL);
+    sxe_connect(c, "127.0.0.1", SXE_LOCAL_PORT(listener));
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "client_connect",                        "Client connected to HTTPD");
+
+    test_request(c, "GET /res HTTP/1.1\r\n\r\n",                                     false, "unconditional");
+    test_request(c, "GET /res HTTP/1.1\r\nIf-None-Match: \"v1\"\r\n\r\n",            true,  "matching ETag");
+    test_request(c, "GET /res HTTP/1.1\r\nIf-None-Match: \"v0\", W/\"v1\"\r\n\r\n",  true,  "weakly matching ETag in a list");
+    test_request(c, "GET /res HTTP/1.1\r\nIf-None-Match: \"v1\"\r\nIf-None-Match: \"v0\"\r\n\r\n",
+                                                                                     true,  "matching ETag in repeated headers");
+    test_request(c, "HEAD /res HTTP/1.1\r\nIf-None-Match: *\r\n\r\n",               true,  "wildcard ETag");
+    test_request(c, "GET /res HTTP/1.1\r\nIf-None-Match: \"v0\"\r\n"
+                    "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n",       false, "If-None-Match takes precedence");
+    test_request(c, "GET /res HTTP/1.1\r\nIf-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n", true, "not modified since");
+    test_request(c, "GET /res HTTP/1.1\r\nIf-Modified-Since: Sun, 06 Nov 1994 08:49:36 GMT\r\n\r\n", false, "modified since");
+    test_request(c, "GET /other HTTP/1.1\r\nIf-None-Match: *\r\n\r\n",              false, "resource without validators");
+    test_request(c, "GET /res HTTP/1.1\r\n\r\n",                                     false, "conditions don't persist");
+
+    return exit_status();
+}
@@ -0,0 +1,309 @@
+/* Copyright 2010 Sophos Limited. All rights reserved. Sophos is a registered
+ * trademark of Sophos Limited.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tap.h"
+#include "sxe-hash.h"
+#include "sxe-httpd.h"
+#include "sxe-pool.h"
+#include "sxe-test.h"
+#include "sxe-util.h"
+
+#define TEST_WAIT 5.0
+
+#ifndef SXE_HTTPD_HAS_FILE_CACHE
+
+int
+main(void)
+{
+    plan_skip_all("No file cache on this platform");
+    return 0;
+}
+
+#else
+
+static SXE_HTTPD_FILE_CACHE cache;
+
+static void
+handle_sent(SXE_HTTPD_REQUEST *request, SXE_RETURN final, void *user_data)
+{
+    SXE * this = request->sxe;
+    SXE_UNUSED_PARAMETER(this);
+    SXE_UNUSED_PARAMETER(user_data);
+    SXEE6I("%s(final=%s)", __func__, sxe_return_to_string(final));
+    tap_ev_push(__func__, 2, "request", request, "final", final);
+    SXER6I("return");
+}
+
+static void
+http_respond(SXE_HTTPD_REQUEST *request)
+{
+    SXE * this = request->sxe;
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("%s()", __func__);
+    tap_ev_push(__func__, 1, "request", request);
+    SXER6I("return");
+}
+
+static void
+client_connect(SXE * this)
+{
+    SXEE6I("%s()", __func__);
+    tap_ev_push(__func__, 1, "this", this);
+    SXER6I("return");
+}
+
+static void
+client_read(SXE * this, int length)
+{
+    SXE_UNUSED_PARAMETER(length);
+    SXEE6I("%s(length=%u)", __func__, length);
+    tap_ev_push(__func__, 3, "this", this, "buf", tap_dup(SXE_BUF(this), SXE_BUF_USED(this)), "used", SXE_BUF_USED(this));
+    sxe_buf_clear(this);
+    SXER6I("return");
+}
+
+static void
+write_file(const char * path, const char * content)
+{
+    int fd;
+
+    SXEA1((fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644)) >= 0, "Failed to create %s: %s", path, strerror(errno));
+    SXEA1(write(fd, content, strlen(content)) == (ssize_t)strlen(content), "Failed to write %s", path);
+    close(fd);
+}
+
+static SXE_HTTPD_REQUEST *
+get(SXE * client, const char * request_line)
+{
+    tap_ev ev;
+
+    sxe_write(client, request_line, strlen(request_line));
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "http_respond", "HTTPD ready to respond to %.*s",
+          (int)(strlen(request_line) - 4), request_line);
+    return SXE_CAST_NOCONST(SXE_HTTPD_REQUEST *, tap_ev_arg(ev, "request"));
+}
+
+/* Get the index of a file's name in the cache, or SXE_HASH_KEY_NOT_FOUND if the file can't be found by name
+ */
+static unsigned
+look(const char * name)
+{
+    char key[SXE_HTTPD_FILE_NAME_MAXIMUM + 1];
+
+    memset(key, '\0', sizeof(key));
+    memcpy(key, name, strlen(name));
+    return sxe_hash_look(cache.names, key);
+}
+
+static bool
+is_cached(const char * name)
+{
+    return look(name) != SXE_HASH_KEY_NOT_FOUND;
+}
+
+/* Wait for the response to be sent and check that the client got exactly what was expected
+ */
+static void
+check_response(SXE * client, const char * expected, const char * what)
+{
+    char   readbuf[1024];
+    tap_ev ev;
+
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "handle_sent", "HTTPD finished sending %s", what);
+    test_ev_wait_read(TEST_WAIT, &ev, client, "client_read", readbuf, strlen(expected), "client");
+    is_strncmp(readbuf, expected, strlen(expected), "Client got the expected %s", what);
+}
+
+/* Ask for the headers of a file in the cache's directory and check the response
+ */
+static void
+head(SXE * client, const char * name, off_t size)
+{
+    char             request_line[256];
+    char             expected[1024];
+    SXE_HTTPD_FILE * file;
+
+    snprintf(request_line, sizeof(request_line), "HEAD /%s HTTP/1.1\r\n\r\n", name);
+    sxe_httpd_file_cache_respond(&cache, get(client, request_line), name, strlen(name), NULL, 0, handle_sent, NULL);
+    file = &cache.files[cache.names[look(name)].file_id];
+    snprintf(expected, sizeof(expected), "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nLast-Modified: %s\r\nETag: %s\r\n"
+             "Accept-Ranges: bytes\r\nContent-Length: %lld\r\n\r\n", file->last_modified, file->etag, (long long)size);
+    check_response(client, expected, "HEAD response");
+}
+
+int
+main(void)
+{
+    char                tempdir[] = "tmp-XXXXXX";
+    char                path[PATH_MAX];
+    char                other[PATH_MAX];
+    char                expected[1024];
+    SXE_HTTPD           httpd;
+    SXE_HTTPD_REQUEST * request;
+    SXE_HTTPD_FILE    * file;
+    tap_ev              ev;
+    SXE               * listener;
+    SXE               * c;
+    off_t               first;
+    off_t               last;
+    unsigned            i;
+    unsigned            id;
+    unsigned            id2;
+    int                 fd;
+
+    plan_tests(69);
+
+    is(sxe_httpd_parse_range("bytes=2-4", 9, 13, &first, &last), SXE_RETURN_OK,             "Range 2-4 is valid");
+    ok(first == 2 && last == 4,                                                                "Range 2-4 is bytes 2 to 4");
+    is(sxe_httpd_parse_range("bytes=-5", 8, 13, &first, &last), SXE_RETURN_OK,               "Suffix range -5 is valid");
+    ok(first == 8 && last == 12,                                                               "Suffix range -5 is bytes 8 to 12");
+    is(sxe_httpd_parse_range("bytes=10-", 9, 13, &first, &last), SXE_RETURN_OK,              "Range 10- is valid");
+    ok(first == 10 && last == 12,                                                              "Range 10- is bytes 10 to 12");
+    is(sxe_httpd_parse_range("bytes=5-99", 10, 13, &first, &last), SXE_RETURN_OK,            "Range 5-99 is valid");
+    ok(first == 5 && last == 12,                                                               "Range 5-99 is truncated to bytes 5 to 12");
+    is(sxe_httpd_parse_range("bytes=13-", 9, 13, &first, &last), SXE_RETURN_OUT_OF_RANGE,    "Range 13- can't be satisfied");
+    is(sxe_httpd_parse_range("bytes=0-1,5-6", 13, 13, &first, &last), SXE_RETURN_ERROR_INVALID, "Multiple ranges are ignored");
+    is(sxe_httpd_parse_range("bytes=4-2", 9, 13, &first, &last), SXE_RETURN_ERROR_INVALID,   "Backward range is ignored");
+    is(sxe_httpd_parse_range("lines=1-2", 9, 13, &first, &last), SXE_RETURN_ERROR_INVALID,   "Unknown unit is ignored");
+
+    sxe_register(4, 0);        /* http listener and connections */
+    sxe_register(8, 0);        /* http clients */
+    sxe_init();
+
+    SXEA1(mkdtemp(tempdir), "Failed to create tempdir: %s", strerror(errno));
+    snprintf(path, sizeof(path), "%s/hello.txt", tempdir);
+    write_file(path, "Hello, world\n");
+    snprintf(other, sizeof(other), "%s/a.txt", tempdir);
+    write_file(other, "A\n");
+    snprintf(other, sizeof(other), "%s/b.txt", tempdir);
+    write_file(other, "B\n");
+    is(sxe_httpd_file_cache_construct(&cache, "no-such-directory", 2), SXE_RETURN_ERROR_INVALID, "Can't cache a missing directory");
+    is(sxe_httpd_file_cache_construct(&cache, tempdir, 2), SXE_RETURN_OK,                    "Constructed a file cache");
+
+    sxe_httpd_construct(&httpd, 3, 10, 512, 0);
+    SXE_HTTPD_SET_HANDLER(&httpd, respond, http_respond);
+    listener = sxe_httpd_listen(&httpd, "0.0.0.0", 0);
+    c = sxe_new_tcp(NULL, "0.0.0.0", 0, client_connect, client_read, NULL);
+    sxe_connect(c, "127.0.0.1", SXE_LOCAL_PORT(listener));
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "client_connect",                     "Client connected to HTTPD");
+
+    /* Miss: the file is opened and sent whole */
+    request = get(c, "GET /hello.txt HTTP/1.1\r\n\r\n");
+    sxe_httpd_file_cache_respond(&cache, request, "hello.txt", 9, NULL, 0, handle_sent, NULL);
+    file = &cache.files[sxe_pool_get_oldest_element_index(cache.files, SXE_HTTPD_FILE_CACHED)];
+    is_eq(file->content_type, "text/plain",                                                   "Content type is based on the extension");
+    snprintf(expected, sizeof(expected), "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nLast-Modified: %s\r\nETag: %s\r\n"
+             "Accept-Ranges: bytes\r\nContent-Length: 13\r\n\r\nHello, world\n", file->last_modified, file->etag);
+    check_response(c, expected, "whole file");
+    ok(cache.hits == 0 && cache.misses == 1,                                                   "Cache missed");
+    is(file->references, 0,                                                                    "File is no longer referenced");
+
+    /* Hit: a range is sent from the already open file */
+    request = get(c, "GET /hello.txt HTTP/1.1\r\nRange: bytes=7-11\r\n\r\n");
+    sxe_httpd_file_cache_respond(&cache, request, "hello.txt", 9, "bytes=7-11", 10, handle_sent, NULL);
+    snprintf(expected, sizeof(expected), "HTTP/1.1 206 Partial Content\r\nContent-Type: text/plain\r\nLast-Modified: %s\r\n"
+             "ETag: %s\r\nAccept-Ranges: bytes\r\nContent-Range: bytes 7-11/13\r\nContent-Length: 5\r\n\r\nworld",
+             file->last_modified, file->etag);
+    check_response(c, expected, "partial file");
+    ok(cache.hits == 1 && cache.misses == 1,                                                   "Cache hit");
+
+    request = get(c, "GET /hello.txt HTTP/1.1\r\nRange: bytes=20-\r\n\r\n");
+    sxe_httpd_file_cache_respond(&cache, request, "hello.txt", 9, "bytes=20-", 9, handle_sent, NULL);
+    check_response(c, "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */13\r\nContent-Length: 0\r\n\r\n",
+                   "unsatisfiable range");
+
+    request = get(c, "GET /nope.txt HTTP/1.1\r\n\r\n");
+    is(sxe_httpd_file_cache_respond(&cache, request, "nope.txt", 8, NULL, 0, handle_sent, NULL), SXE_RETURN_ERROR_INVALID,
+       "Missing file can't be served");
+    is(sxe_httpd_file_cache_respond(&cache, request, "../hello.txt", 12, NULL, 0, handle_sent, NULL), SXE_RETURN_ERROR_INVALID,
+       "File outside the directory can't be served");
+    sxe_httpd_response_simple(request, handle_sent, NULL, 404, "Not Found", NULL, NULL);
+    check_response(c, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", "not found");
+
+    /* Changing the file on disk drops it from the cache */
+    write_file(path, "Goodbye\n");
+
+    for (i = 0; i < 500 && sxe_pool_get_number_in_state(cache.files, SXE_HTTPD_FILE_CACHED) != 0; i++) {
+        test_process_all_libev_events();
+        usleep(10000);
+    }
+
+    is(sxe_pool_get_number_in_state(cache.files, SXE_HTTPD_FILE_CACHED), 0,                  "Modified file was invalidated");
+    request = get(c, "HEAD /hello.txt HTTP/1.1\r\n\r\n");
+    sxe_httpd_file_cache_respond(&cache, request, "hello.txt", 9, NULL, 0, handle_sent, NULL);
+    file = &cache.files[sxe_pool_get_oldest_element_index(cache.files, SXE_HTTPD_FILE_CACHED)];
+    snprintf(expected, sizeof(expected), "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nLast-Modified: %s\r\nETag: %s\r\n"
+             "Accept-Ranges: bytes\r\nContent-Length: 8\r\n\r\n", file->last_modified, file->etag);
+    check_response(c, expected, "HEAD response for the modified file");
+    ok(cache.hits == 2 && cache.misses == 3,                                                   "Cache missed on the modified file");
+
+    /* A file that changes while it's being sent is kept open until the response sending it is done */
+    id = file - cache.files;
+    fd = file->fd;
+    file->references++;    /* As if a response were still sending it */
+    sxe_httpd_file_cache_invalidate(&cache, "hello.txt", 9);
+    is(sxe_pool_index_to_state(cache.files, id), SXE_HTTPD_FILE_STALE,                         "Referenced file is stale once changed");
+    ok(!is_cached("hello.txt"),                                                                "Stale file can't be found by name");
+    ok(fcntl(fd, F_GETFD) >= 0,                                                                "Stale file is still open");
+    sxe_httpd_file_cache_release(&cache, id);
+    is(sxe_pool_index_to_state(cache.files, id), SXE_HTTPD_FILE_FREE,                          "Stale file is freed once released");
+    ok(fcntl(fd, F_GETFD) < 0,                                                                 "Released stale file was closed");
+
+    /* Filling the cache evicts the least recently used file */
+    head(c, "a.txt", 2);
+    head(c, "b.txt", 2);
+    is(sxe_pool_get_number_in_state(cache.files, SXE_HTTPD_FILE_CACHED), 2,                  "Cache is full");
+    head(c, "hello.txt", 8);
+    ok(cache.hits == 2 && cache.misses == 6,                                                   "Cache missed on all three files");
+    ok(!is_cached("a.txt") && is_cached("b.txt") && is_cached("hello.txt"),                    "Least recently used file was evicted");
+
+    /* A file that's being sent is never evicted */
+    id  = cache.names[look("b.txt")].file_id;
+    id2 = cache.names[look("hello.txt")].file_id;
+    cache.files[id].references++;
+    cache.files[id2].references++;
+    request = get(c, "HEAD /a.txt HTTP/1.1\r\n\r\n");
+    is(sxe_httpd_file_cache_respond(&cache, request, "a.txt", 5, NULL, 0, handle_sent, NULL), SXE_RETURN_NO_UNUSED_ELEMENTS,
+       "Can't cache a file when every cached file is being sent");
+    sxe_httpd_response_simple(request, handle_sent, NULL, 503, "Service Unavailable", NULL, NULL);
+    check_response(c, "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n", "service unavailable");
+    ok(is_cached("b.txt") && is_cached("hello.txt"),                                           "Files being sent were kept");
+    sxe_httpd_file_cache_release(&cache, id);
+    sxe_httpd_file_cache_release(&cache, id2);
+
+    sxe_httpd_file_cache_destruct(&cache);
+    unlink(path);
+    snprintf(other, sizeof(other), "%s/a.txt", tempdir);
+    unlink(other);
+    snprintf(other, sizeof(other), "%s/b.txt", tempdir);
+    unlink(other);
+    rmdir(tempdir);
+    return exit_status();
+}
+
+#endif /* SXE_HTTPD_HAS_FILE_CACHE */
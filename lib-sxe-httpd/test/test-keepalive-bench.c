@@ -0,0 +1,103 @@
+/* Copyright 2010 Sophos Limited. All rights reserved. Sophos is a registered
+ * trademark of Sophos Limited.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sxe-httpd.h"
+#include "sxe-log.h"
+#include "sxe-time.h"
+#include "sxe-util.h"
+
+#define REQUESTS 100000
+
+#define REQUEST_TEXT  "GET /small HTTP/1.1\r\nHost: localhost\r\n\r\n"
+#define RESPONSE_TEXT "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nOK"
+
+static unsigned responses = 0;
+static unsigned received  = 0;
+
+static void
+http_respond(SXE_HTTPD_REQUEST * request)
+{
+    sxe_httpd_response_simple(request, NULL, NULL, 200, "OK", "OK", NULL);
+}
+
+static void
+client_connect(SXE * this)
+{
+    SXE_WRITE_LITERAL(this, REQUEST_TEXT);
+}
+
+static void
+client_read(SXE * this, int length)
+{
+    received += length;
+    sxe_buf_clear(this);
+
+    while (received >= SXE_LITERAL_LENGTH(RESPONSE_TEXT)) {
+        received -= SXE_LITERAL_LENGTH(RESPONSE_TEXT);
+
+        if (++responses == REQUESTS) {
+            ev_unloop(ev_default_loop(EVFLAG_AUTO), EVUNLOOP_ALL);
+            return;
+        }
+
+        SXE_WRITE_LITERAL(this, REQUEST_TEXT);
+    }
+}
+
+int
+main(int argc, char * argv[])
+{
+    SXE_HTTPD httpd;
+    SXE     * listener;
+    SXE     * client;
+    SXE_TIME  start_time;
+
+    (void)argv;
+
+    if (argc == 1) {
+        fprintf(stderr, "To benchmark keep-alive requests, run: SXE_LOG_LEVEL=1 build-linux-64-release/test-keepalive-bench -r\n");
+        exit(0);
+    }
+
+    sxe_register(4, 0);
+    sxe_init();
+
+    sxe_httpd_construct(&httpd, 2, 10, 512, 0);
+    SXE_HTTPD_SET_HANDLER(&httpd, respond, http_respond);
+    listener = sxe_httpd_listen(&httpd, "127.0.0.1", 0);
+    client   = sxe_new_tcp(NULL, "127.0.0.1", 0, client_connect, client_read, NULL);
+
+    start_time = sxe_time_get();
+    sxe_connect(client, "127.0.0.1", SXE_LOCAL_PORT(listener));
+    ev_loop(ev_default_loop(EVFLAG_AUTO), 0);
+
+    SXEA1(responses == REQUESTS, "Only got %u of %u responses", responses, REQUESTS);
+    printf("Served %u small GETs per second on one keep-alive connection\n",
+           (unsigned)(((uint64_t)REQUESTS << 32) / (sxe_time_get() - start_time)));
+    sxe_close(client);
+    sxe_close(listener);
+    return 0;
+}
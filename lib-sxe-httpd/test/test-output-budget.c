@@ -0,0 +1,238 @@
+/* Copyright 2010 Sophos Limited. All rights reserved. Sophos is a registered
+ * trademark of Sophos Limited.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "tap.h"
+#include "sxe-httpd.h"
+#include "sxe-test.h"
+#include "sxe-util.h"
+
+#define TEST_WAIT  5.0
+#define TEST_CHUNK 500
+
+static void
+http_respond(SXE_HTTPD_REQUEST * request)
+{
+    SXE * this = request->sxe;
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("%s()", __func__);
+    tap_ev_push(__func__, 1, "request", request);
+    SXER6I("return");
+}
+
+static void
+http_drain(SXE_HTTPD_REQUEST * request)
+{
+    SXE * this = request->sxe;
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("%s()", __func__);
+    tap_ev_push(__func__, 1, "request", request);
+    SXER6I("return");
+}
+
+static void
+http_close(SXE_HTTPD_REQUEST * request)
+{
+    SXE * this = request->sxe;
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("%s()", __func__);
+    tap_ev_push(__func__, 1, "request", request);
+    SXER6I("return");
+}
+
+static void
+client_connect(SXE * this)
+{
+    SXEE6I("%s()", __func__);
+    tap_ev_push(__func__, 1, "this", this);
+    SXER6I("return");
+}
+
+static void
+client_read(SXE * this, int length)
+{
+    SXE_UNUSED_PARAMETER(length);
+    SXEE6I("%s(length=%u)", __func__, length);
+    tap_ev_push(__func__, 3, "this", this, "buf", tap_dup(SXE_BUF(this), SXE_BUF_USED(this)), "used", SXE_BUF_USED(this));
+    sxe_buf_clear(this);
+    SXER6I("return");
+}
+
+static SXE_HTTPD_REQUEST *
+test_get(SXE * client, const char * url)
+{
+    char   request[64];
+    tap_ev ev;
+
+    snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\n\r\n", url);
+    sxe_write(client, request, strlen(request));
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "http_respond", "Respond handler called for %s", url);
+    return (SXE_HTTPD_REQUEST *)(long)tap_ev_arg(ev, "request");
+}
+
+#define STATUS_LINE "HTTP/1.1 200 OK\r\n"
+
+int
+main(void)
+{
+    SXE_HTTPD           httpd;
+    tap_ev              ev;
+    SXE               * listener;
+    SXE               * c1;
+    SXE               * c2;
+    SXE_HTTPD_REQUEST * request;
+    SXE_HTTPD_REQUEST * other;
+    SXE_BUFFER          app_buffer[2];
+    char                chunk[TEST_CHUNK];
+    char                readbuf[12 * TEST_CHUNK];
+    unsigned            count;
+
+    plan_tests(62);
+    memset(chunk, 'x', sizeof(chunk));
+
+    sxe_register(4, 0);        /* http listener and connections */
+    sxe_register(8, 0);        /* http clients */
+    sxe_init();
+
+    sxe_httpd_construct(&httpd, 3, 10, 512, 0);
+    SXE_HTTPD_SET_HANDLER(&httpd, respond, http_respond);
+    SXE_HTTPD_SET_HANDLER(&httpd, close,   http_close);
+    is(SXE_HTTPD_SET_HANDLER(&httpd, drain, http_drain), NULL,                           "No drain handler by default");
+    listener = sxe_httpd_listen(&httpd, "0.0.0.0", 0);
+    c1 = sxe_new_tcp(NULL, "0.0.0.0", 0, client_connect, client_read, NULL);
+    c2 = sxe_new_tcp(NULL, "0.0.0.0", 0, client_connect, client_read, NULL);
+    sxe_connect(c1, "127.0.0.1", SXE_LOCAL_PORT(listener));
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "client_connect",                "Client 1 connected to HTTPD");
+    sxe_connect(c2, "127.0.0.1", SXE_LOCAL_PORT(listener));
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "client_connect",                "Client 2 connected to HTTPD");
+
+    /* A buffer budget refuses output until the queue is drained
+     */
+    sxe_httpd_set_output_budget(&httpd, 3, 0);
+    request = test_get(c1, "/buffers");
+    is(sxe_httpd_response_start(request, 200, "OK"),                  SXE_RETURN_OK,    "Started the response");
+    is(sxe_httpd_response_copy_body_data(request, chunk, TEST_CHUNK), SXE_RETURN_OK,    "Copied the first chunk");
+    ok(sxe_httpd_response_is_writable(request),                                         "Request is still writable");
+    is(sxe_httpd_response_copy_body_data(request, chunk, TEST_CHUNK), SXE_RETURN_OK,    "Copied the second chunk");
+    is(request->out_buffers, 3,                                                         "Request holds 3 buffers");
+    ok(!sxe_httpd_response_is_writable(request),                                        "Request is no longer writable");
+    is(sxe_httpd_response_copy_body_data(request, chunk, TEST_CHUNK), SXE_RETURN_NO_UNUSED_ELEMENTS,
+                                                                                        "Third chunk is refused");
+    is(request->out_buffers, 3,                                                         "Refused chunk's buffers were returned");
+    is(request->out_bytes, SXE_LITERAL_LENGTH(STATUS_LINE "\r\n") + 2 * TEST_CHUNK,     "Request has queued the right bytes");
+    sxe_httpd_response_send(request, NULL, NULL);
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "http_drain",                    "Drain handler called");
+    is(tap_ev_arg(ev, "request"), request,                                              "Drain handler called for the request");
+    ok(sxe_httpd_response_is_writable(request),                                         "Request is writable again");
+    is(sxe_httpd_response_copy_body_data(request, chunk, TEST_CHUNK), SXE_RETURN_OK,    "Copied the third chunk");
+    sxe_httpd_response_end(request, NULL, NULL);
+    test_ev_wait_read(TEST_WAIT, &ev, c1, "client_read", readbuf, SXE_LITERAL_LENGTH(STATUS_LINE "\r\n") + 3 * TEST_CHUNK,
+                      "client 1");
+    is_strncmp(readbuf, STATUS_LINE "\r\n", SXE_LITERAL_LENGTH(STATUS_LINE "\r\n"),     "Got the status line");
+    is(readbuf[SXE_LITERAL_LENGTH(STATUS_LINE "\r\n") + 3 * TEST_CHUNK - 1], 'x',           "Got the body");
+    is(httpd.out_connections, 0,                                                        "No connections hold buffers");
+
+    /* A byte budget refuses application buffers too
+     */
+    sxe_httpd_set_output_budget(&httpd, 0, TEST_CHUNK);
+    sxe_buffer_construct_const(&app_buffer[0], chunk, TEST_CHUNK);
+    sxe_buffer_construct_const(&app_buffer[1], chunk, TEST_CHUNK);
+    request = test_get(c1, "/bytes");
+    is(sxe_httpd_response_start(request, 200, "OK"),                  SXE_RETURN_OK,    "Started the response");
+    is(sxe_httpd_response_add_body_buffer(request, &app_buffer[0]),  SXE_RETURN_OK,     "Added the first buffer");
+    ok(!sxe_httpd_response_is_writable(request),                                        "Request is no longer writable");
+    is(sxe_httpd_response_add_body_buffer(request, &app_buffer[1]),  SXE_RETURN_NO_UNUSED_ELEMENTS,
+                                                                                        "Second buffer is refused");
+    is(sxe_httpd_response_add_body_data(request, chunk, TEST_CHUNK), SXE_RETURN_NO_UNUSED_ELEMENTS,
+                                                                                        "Body data is refused");
+    sxe_httpd_response_end(request, NULL, NULL);
+    test_ev_wait_read(TEST_WAIT, &ev, c1, "client_read", readbuf, SXE_LITERAL_LENGTH(STATUS_LINE "\r\n") + TEST_CHUNK,
+                      "client 1");
+    is(tap_ev_length(), 0,                                                              "No drain when the response is ended");
+
+    /* Without a budget, connections are limited to a fair share of the pool when it runs low
+     */
+    sxe_httpd_set_output_budget(&httpd, 0, 0);
+    request = test_get(c1, "/greedy");
+    other   = test_get(c2, "/modest");
+    is(sxe_httpd_response_start(other, 200, "OK"),                    SXE_RETURN_OK,    "Started the modest response");
+    is(sxe_httpd_response_start(request, 200, "OK"),                  SXE_RETURN_OK,    "Started the greedy response");
+
+    for (count = 0; sxe_httpd_response_copy_body_data(request, chunk, TEST_CHUNK) == SXE_RETURN_OK; count++) {
+    }
+
+    is(count, 4,                                                                        "Greedy response copied 4 chunks");
+    is(request->out_buffers, 5,                                                         "Greedy response holds its fair share");
+    is(httpd.out_connections, 2,                                                        "Two connections hold buffers");
+    ok(sxe_httpd_response_is_writable(other),                                           "Modest response is writable");
+    is(sxe_httpd_response_copy_body_data(other, chunk, TEST_CHUNK),   SXE_RETURN_OK,    "Copied a chunk to the modest response");
+    sxe_httpd_response_end(other, NULL, NULL);
+    test_ev_wait_read(TEST_WAIT, &ev, c2, "client_read", readbuf, SXE_LITERAL_LENGTH(STATUS_LINE "\r\n") + TEST_CHUNK,
+                      "client 2");
+    ok(sxe_httpd_response_is_writable(request),                                         "Greedy response is writable again");
+    sxe_httpd_response_end(request, NULL, NULL);
+    test_ev_wait_read(TEST_WAIT, &ev, c1, "client_read", readbuf, SXE_LITERAL_LENGTH(STATUS_LINE "\r\n") + 4 * TEST_CHUNK,
+                      "client 1");
+
+    /* A request holding no buffers when the pool runs out is drained once another request frees one
+     */
+    request = test_get(c1, "/hog");
+    other   = test_get(c2, "/starved");
+    is(sxe_httpd_response_start(request, 200, "OK"),                  SXE_RETURN_OK,    "Started the hogging response");
+
+    for (count = 0; sxe_httpd_response_copy_body_data(request, chunk, TEST_CHUNK) == SXE_RETURN_OK; count++) {
+    }
+
+    is(request->out_buffers, 10,                                                        "Hogging response holds every buffer");
+    is(sxe_httpd_response_start(other, 200, "OK"),                    SXE_RETURN_NO_UNUSED_ELEMENTS,
+                                                                                        "Starved response can't start");
+    ok(other->out_waiting,                                                              "Starved response waits for a buffer");
+    sxe_httpd_response_end(request, NULL, NULL);
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "http_drain",                    "Drain handler called");
+    is(tap_ev_arg(ev, "request"), other,                                                "Drain handler called for the starved request");
+    ok(!other->out_waiting,                                                             "Starved response no longer waits");
+    test_ev_wait_read(TEST_WAIT, &ev, c1, "client_read", readbuf, SXE_LITERAL_LENGTH(STATUS_LINE "\r\n") + count * TEST_CHUNK,
+                      "client 1");
+    is(sxe_httpd_response_start(other, 200, "OK"),                    SXE_RETURN_OK,    "Started the starved response");
+    is(sxe_httpd_response_copy_body_data(other, chunk, TEST_CHUNK),   SXE_RETURN_OK,    "Copied a chunk to the starved response");
+    sxe_httpd_response_end(other, NULL, NULL);
+    test_ev_wait_read(TEST_WAIT, &ev, c2, "client_read", readbuf, SXE_LITERAL_LENGTH(STATUS_LINE "\r\n") + TEST_CHUNK,
+                      "client 2");
+    is(httpd.out_connections, 0,                                                        "No connections hold buffers");
+
+    /* Buffers queued when a connection closes are returned to the pool
+     */
+    request = test_get(c1, "/closed");
+    is(sxe_httpd_response_start(request, 200, "OK"),                  SXE_RETURN_OK,    "Started the response");
+    is(sxe_httpd_response_copy_body_data(request, chunk, TEST_CHUNK), SXE_RETURN_OK,    "Copied a chunk");
+    is(httpd.out_connections, 1,                                                        "One connection holds buffers");
+    sxe_close(c1);
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "http_close",                    "Close handler called");
+    is(httpd.out_connections, 0,                                                        "Closed connection's buffers returned");
+    is(request->out_buffers, 0,                                                         "Closed request holds no buffers");
+
+    return exit_status();
+}
@@ -0,0 +1,94 @@
+/* Copyright 2010 Sophos Limited. All rights reserved. Sophos is a registered
+ * trademark of Sophos Limited.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sxe-httpd.h"
+#include "sxe-log.h"
+#include "sxe-time.h"
+
+#define RESOURCES 256    /* 4 routes per resource, so 1024 routes in all */
+#define LOOKUPS   1000000
+
+static void
+route_handler(SXE_HTTPD_REQUEST * request, const SXE_HTTPD_ROUTE_MATCH * match, void * user_data)
+{
+    SXE_UNUSED_PARAMETER(request);
+    SXE_UNUSED_PARAMETER(match);
+    SXE_UNUSED_PARAMETER(user_data);
+}
+
+int
+main(int argc, char * argv[])
+{
+    static char           urls[RESOURCES * 4][64];
+    SXE_HTTPD_ROUTER      router;
+    SXE_HTTPD_ROUTE_MATCH match;
+    SXE_TIME              start_time;
+    char                  pattern[64];
+    unsigned              lengths[RESOURCES * 4];
+    unsigned              i;
+    unsigned              matched = 0;
+
+    (void)argv;
+
+    if (argc == 1) {
+        fprintf(stderr, "To benchmark the router, run: build-linux-64-release/test-router-bench -r\n");
+        exit(0);
+    }
+
+    sxe_httpd_router_construct(&router, RESOURCES * 4);
+    start_time = sxe_time_get();
+
+    for (i = 0; i < RESOURCES; i++) {
+        snprintf(pattern, sizeof(pattern), "/api/v1/resource%u", i);
+        sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, pattern, route_handler, NULL);
+        snprintf(pattern, sizeof(pattern), "/api/v1/resource%u/:id", i);
+        sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, pattern, route_handler, NULL);
+        snprintf(pattern, sizeof(pattern), "/api/v1/resource%u/:id/children", i);
+        sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, pattern, route_handler, NULL);
+        snprintf(pattern, sizeof(pattern), "/api/v1/resource%u/:id/children/:child", i);
+        sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, pattern, route_handler, NULL);
+
+        lengths[i * 4 + 0] = snprintf(urls[i * 4 + 0], sizeof(urls[0]), "/api/v1/resource%u", i);
+        lengths[i * 4 + 1] = snprintf(urls[i * 4 + 1], sizeof(urls[0]), "/api/v1/resource%u/%u", i, i * 7);
+        lengths[i * 4 + 2] = snprintf(urls[i * 4 + 2], sizeof(urls[0]), "/api/v1/resource%u/%u/children", i, i * 7);
+        lengths[i * 4 + 3] = snprintf(urls[i * 4 + 3], sizeof(urls[0]), "/api/v1/resource%u/%u/children/%u?q=1", i, i * 7, i);
+    }
+
+    SXEA1(sxe_httpd_router_compile(&router) == SXE_RETURN_OK, "Failed to compile the routes");
+    printf("Compiled %u routes into %u nodes in %.6f seconds\n", router.route_count, router.node_count,
+           sxe_time_to_double_seconds(sxe_time_get() - start_time));
+    start_time = sxe_time_get();
+
+    for (i = 0; i < LOOKUPS; i++) {
+        matched += sxe_httpd_router_match(&router, SXE_HTTP_METHOD_GET, urls[i % (RESOURCES * 4)], lengths[i % (RESOURCES * 4)],
+                                          &match) != NULL;
+    }
+
+    SXEA1(matched == LOOKUPS, "Only %u of %u lookups matched", matched, LOOKUPS);
+    printf("Routed %u URLs per second\n", (unsigned)(((uint64_t)i << 32) / (sxe_time_get() - start_time)));
+    sxe_httpd_router_destruct(&router);
+    return 0;
+}
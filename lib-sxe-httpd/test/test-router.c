@@ -0,0 +1,114 @@
+/* Copyright 2010 Sophos Limited. All rights reserved. Sophos is a registered
+ * trademark of Sophos Limited.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "tap.h"
+#include "sxe-alloc.h"
+#include "sxe-httpd.h"
+#include "sxe-util.h"
+
+static void
+route_handler(SXE_HTTPD_REQUEST * request, const SXE_HTTPD_ROUTE_MATCH * match, void * user_data)
+{
+    SXE_UNUSED_PARAMETER(match);
+    request->user_data = user_data;
+}
+
+/* Match a URL and return the matched pattern or "" if none
+ */
+static const char *
+test_match(SXE_HTTPD_ROUTER * router, SXE_HTTP_METHOD method, const char * url, SXE_HTTPD_ROUTE_MATCH * match)
+{
+    const SXE_HTTPD_ROUTE * route = sxe_httpd_router_match(router, method, url, strlen(url), match);
+
+    return route == NULL ? "" : route->pattern;
+}
+
+int
+main(void)
+{
+    SXE_HTTPD_ROUTER      router;
+    SXE_HTTPD_ROUTE_MATCH match;
+    SXE_HTTPD_REQUEST     request;
+    const char          * value;
+    unsigned              length;
+    uint64_t              start_allocations = sxe_allocations;
+
+    plan_tests(34);
+    sxe_httpd_router_construct(&router, 16);
+
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/", route_handler, NULL), SXE_RETURN_OK,                 "Added /");
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/users", route_handler, NULL), SXE_RETURN_OK,            "Added /users");
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/users/me", route_handler, NULL), SXE_RETURN_OK,         "Added /users/me");
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/users/:id", route_handler, (void *)1), SXE_RETURN_OK,   "Added /users/:id");
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_PUT, "/users/:uid", route_handler, NULL), SXE_RETURN_OK,       "Added PUT");
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/users/:id/posts/:post", route_handler, NULL), SXE_RETURN_OK,
+       "Added /users/:id/posts/:post");
+    is(sxe_httpd_router_add(&router, SXE_HTTPD_ROUTE_ANY_METHOD, "/static/*path", route_handler, NULL), SXE_RETURN_OK,
+       "Added /static/*path");
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/static/index.html", route_handler, NULL), SXE_RETURN_OK,
+       "Added /static/index.html");
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "users", route_handler, NULL), SXE_RETURN_ERROR_INVALID,
+       "Pattern must start with /");
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/a:b", route_handler, NULL), SXE_RETURN_ERROR_INVALID,
+       "Capture must be a whole segment");
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/a/:/b", route_handler, NULL), SXE_RETURN_ERROR_INVALID,
+       "Capture must have a name");
+    is(sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/a/*rest/b", route_handler, NULL), SXE_RETURN_ERROR_INVALID,
+       "*capture must be last");
+    is(sxe_httpd_router_compile(&router), SXE_RETURN_OK,                                                               "Compiled");
+
+    is_eq(test_match(&router, SXE_HTTP_METHOD_GET, "/", &match),                  "/",                 "Matched /");
+    is_eq(test_match(&router, SXE_HTTP_METHOD_GET, "/users?x=1", &match),         "/users",            "Query string is ignored");
+    is_eq(test_match(&router, SXE_HTTP_METHOD_GET, "/users/me", &match),          "/users/me",         "Static beats capture");
+    is_eq(test_match(&router, SXE_HTTP_METHOD_GET, "/users/mel", &match),         "/users/:id",        "Backtracked to capture");
+    ok(match.param_count == 1 && match.param_lengths[0] == 3 && memcmp(match.params[0], "mel", 3) == 0, "Captured mel");
+    is_eq(test_match(&router, SXE_HTTP_METHOD_PUT, "/users/me", &match),          "/users/:uid",       "Method selects route");
+    value = sxe_httpd_route_match_get_param(&match, "uid", &length);
+    ok(value != NULL && length == 2 && memcmp(value, "me", 2) == 0,                                     "Got param uid by name");
+    is(sxe_httpd_route_match_get_param(&match, "id", &length), NULL,                                    "No param id for PUT route");
+    is_eq(test_match(&router, SXE_HTTP_METHOD_GET, "/users/42/posts/7", &match),  "/users/:id/posts/:post", "Matched 2 captures");
+    ok(match.param_count == 2 && match.param_lengths[1] == 1 && match.params[1][0] == '7',             "Captured 7");
+    is_eq(test_match(&router, SXE_HTTP_METHOD_GET, "/users/42/posts", &match),    "",                  "Partial path doesn't match");
+    is_eq(test_match(&router, SXE_HTTP_METHOD_GET, "/users/", &match),            "",                  "Empty capture doesn't match");
+    is_eq(test_match(&router, SXE_HTTP_METHOD_POST, "/static/index.html", &match), "/static/*path",    "Any method wildcard");
+    ok(match.param_count == 1 && match.param_lengths[0] == 10,                                          "Captured index.html");
+    is_eq(test_match(&router, SXE_HTTP_METHOD_GET, "/static/", &match),           "/static/*path",     "Wildcard can be empty");
+    is_eq(test_match(&router, SXE_HTTP_METHOD_DELETE, "/users", &match),          "",                  "No DELETE /users");
+    is(match.allowed, 1U << SXE_HTTP_METHOD_GET,                                                        "Allowed methods is GET");
+
+    request.method    = SXE_HTTP_METHOD_GET;
+    request.sxe       = NULL;
+    request.user_data = NULL;
+    ok(sxe_httpd_router_dispatch(&router, &request, "/users/1", 8),                                     "Dispatched /users/1");
+    is(request.user_data, (void *)1,                                                                    "Handler was called");
+    sxe_httpd_router_destruct(&router);
+
+    sxe_httpd_router_construct(&router, 2);
+    sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/a/:x", route_handler, NULL);
+    sxe_httpd_router_add(&router, SXE_HTTP_METHOD_GET, "/a/:y", route_handler, NULL);
+    is(sxe_httpd_router_compile(&router), SXE_RETURN_ERROR_INVALID,                                     "Duplicate route fails");
+    sxe_httpd_router_destruct(&router);
+    is(sxe_allocations, start_allocations,                                                              "No memory was leaked");
+    return exit_status();
+}
@@ -91,6 +91,60 @@ sxe_list_unshift(SXE_LIST * list, void * object)
     SXER6("return");
 }
 
+/**
+ * Move every object on one list onto the tail of another, keeping their order
+ *
+ * @param to   List to append the objects to
+ * @param from List to take the objects from; it is left empty
+ *
+ * @return The number of objects moved
+ *
+ * @note The lists are relinked in constant time, but since links are relative to the list that holds them and each node records
+ *       its list's id, every moved node is visited once to rebase its links.
+ */
+unsigned
+sxe_list_splice(SXE_LIST * to, SXE_LIST * from)
+{
+    SXE_LIST_NODE * first;
+    SXE_LIST_NODE * last;
+    SXE_LIST_NODE * node;
+    SXE_LIST_NODE * next;
+    unsigned        count = from->length;
+
+    SXEE6("sxe_list_splice(to=%p,from=%p)", to, from);
+    SXEA1(to->offset == from->offset, "Can't splice lists of objects with nodes at different offsets (%zu and %zu)",
+          to->offset, from->offset);
+
+    if (count == 0) {
+        goto SXE_EARLY_OUT;
+    }
+
+    first = SXE_PTR_FIX(from, SXE_LIST_NODE *, from->HEAD);
+    last  = SXE_PTR_FIX(from, SXE_LIST_NODE *, from->TAIL);
+
+    for (node = first; ; node = next) {
+        next       = SXE_PTR_FIX(from, SXE_LIST_NODE *, node->next);
+        node->prev = node == first ? to->TAIL : SXE_PTR_REL(to, SXE_LIST_NODE *, SXE_PTR_FIX(from, SXE_LIST_NODE *, node->prev));
+        node->next = node == last  ? SENTINEL_PTR_REL(to) : SXE_PTR_REL(to, SXE_LIST_NODE *, next);
+        node->id   = to->sentinel.id;
+
+        if (node == last) {
+            break;
+        }
+    }
+
+    SXE_PTR_FIX(to, SXE_LIST_NODE *, to->TAIL)->next = SXE_PTR_REL(to, SXE_LIST_NODE *, first);
+    to->TAIL                                          = SXE_PTR_REL(to, SXE_LIST_NODE *, last);
+    to->length                                       += count;
+    from->HEAD                                        = SENTINEL_PTR_REL(from);
+    from->TAIL                                        = SENTINEL_PTR_REL(from);
+    from->length                                      = 0;
+
+SXE_EARLY_OUT:
+    SXER6("return %u", count);
+    return count;
+}
+
 /**
  * Remove an object from a list (returning a pointer to it)
  */
@@ -44,13 +44,14 @@ main(void)
     struct blob     * blob_ptr;
     SXE_LIST_WALKER   walker;
     struct list_obj * last_obj_ptr = NULL;    /* STFU gcc */
+    SXE_LIST          other_list;
     uint64_t          start_allocations;
 
     for (i = 0; i < 4; i++) {
         blob.list_obj[i].id = i;
     }
 
-    plan_tests(47);
+    plan_tests(54);
     start_allocations     = sxe_allocations;
     sxe_alloc_diagnostics = true;
 
@@ -143,6 +144,32 @@ main(void)
         memset(blob_ptr, 0xBE, sizeof(blob));
     }
 
+    for (i = 0; i < 4; i++) {
+        blob.list_obj[i].id = i;
+    }
+
+    SXE_LIST_CONSTRUCT(&blob.list,  1, struct list_obj, node);
+    SXE_LIST_CONSTRUCT(&other_list, 2, struct list_obj, node);
+    sxe_list_push(&blob.list,  &blob.list_obj[0]);
+    sxe_list_push(&blob.list,  &blob.list_obj[1]);
+    sxe_list_push(&other_list, &blob.list_obj[2]);
+    sxe_list_push(&other_list, &blob.list_obj[3]);
+    is(sxe_list_splice(&blob.list, &other_list), 2,                      "Spliced two objects onto the list");
+    is(SXE_LIST_GET_LENGTH(&blob.list), 4,                               "List has 4 elements");
+    ok(SXE_LIST_IS_EMPTY(&other_list) && sxe_list_peek_head(&other_list) == NULL, "Spliced list is empty");
+    sxe_list_walker_construct(&walker, &blob.list);
+
+    for (i = 0; (obj_ptr = (struct list_obj *)sxe_list_walker_step(&walker)) != NULL && obj_ptr->id == i; i++) {
+    }
+
+    is(i, 4,                                                             "Objects are in order after the splice");
+    obj_ptr = sxe_list_pop(&blob.list);
+    ok(obj_ptr == &blob.list_obj[3] && SXE_LIST_NODE_GET_ID(&obj_ptr->node) == 1, "Spliced objects belong to their new list");
+    is(sxe_list_splice(&blob.list, &other_list), 0,                      "Splicing an empty list moves nothing");
+    sxe_list_push(&other_list, &blob.list_obj[3]);
+    sxe_list_splice(&other_list, &blob.list);
+    is(sxe_list_shift(&other_list), &blob.list_obj[3],                   "Splicing onto a non-empty list appends");
+
     sxe_free(blob_copy);
     is(sxe_allocations, start_allocations, "No memory was leaked");
     return exit_status();
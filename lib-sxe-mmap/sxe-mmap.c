@@ -30,7 +30,7 @@
 #include "sxe-log.h"
 #include "sxe-mmap.h"
 
-unsigned sxe_spinlock_count_max = 1000000; /* number of yields before spinlock fails */
+unsigned sxe_spinlock_count_max = 1000000; /* number of waits before spinlock fails */
 
 #ifndef _WIN32
 
@@ -53,6 +53,25 @@ sxe_mmap_open(SXE_MMAP * memmap, const char * file) {
     SXER6( "return // sxe_mmap_open()" );
 }
 
+/**
+ * Map a file copy on write: the mapping can be changed, but changes are private to the process and never written to the file
+ *
+ * @param memmap Pointer to the memory map object
+ * @param file   Path of the file, which need only be readable
+ */
+void
+sxe_mmap_open_private(SXE_MMAP * memmap, const char * file) {
+    struct stat st;
+
+    SXEE6("sxe_mmap_open_private(memmap=%p, file=%s)", memmap, file);
+    SXEA1(stat(file, &st) >= 0, "Cannot stat size of file %s", file);
+    memmap->size = st.st_size;
+    SXEA1((memmap->fd = open(file, O_RDONLY, 0)) >= 0, "Failed to open file %s: %s", file, strerror(errno));
+    SXEA1((memmap->addr = mmap(NULL, memmap->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, memmap->fd, 0)) != MAP_FAILED,
+       "Failed to mmap file %s: %s", file, strerror(errno));
+    SXER6( "return // sxe_mmap_open_private()" );
+}
+
 void
 sxe_mmap_close(SXE_MMAP* memmap) {
     SXEE6("sxe_mmap_close(memmap=%p)", memmap);
@@ -98,6 +117,32 @@ sxe_mmap_open(SXE_MMAP * memmap, const char * file)
     SXER6("return // sxe_mmap_open()" );
 }
 
+void
+sxe_mmap_open_private(SXE_MMAP * memmap, const char * file)
+{
+    HANDLE      fh;
+    HANDLE      view;
+    struct stat st;
+
+    SXEE6("sxe_mmap_open_private(memmap=%p, file=%s)", memmap, file);
+    SXEA1(0 == stat (file, &st), "failed to stat file: %s", file);
+    memmap->size = st.st_size;
+
+    fh = CreateFile ( file, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL|FILE_FLAG_RANDOM_ACCESS, NULL );
+    SXEA1( fh != INVALID_HANDLE_VALUE, "fail to open file %s", file );
+
+    view = CreateFileMapping ( fh, NULL , PAGE_WRITECOPY, 0, 0, 0 );
+    SXEA1( view != NULL, "fail to create file mapping for file %s", file );
+
+    memmap->addr = MapViewOfFile ( view, FILE_MAP_COPY, 0, 0, memmap->size );
+    SXEA1( 0 != memmap->addr, "fail to map view of file for file %s", file );
+
+    memmap->win32_fh   = fh  ;
+    memmap->win32_view = view;
+    SXEL6("file mapped copy on write to address: %p", memmap->addr );
+    SXER6("return // sxe_mmap_open_private()" );
+}
+
 void
 sxe_mmap_close(SXE_MMAP * memmap)
 {
@@ -0,0 +1,209 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Slow paths of the spinlock (see sxe-spinlock.h). Waiting threads spin with exponential PAUSE backoff, which is enough for the
+ * short critical sections these locks usually protect, then park on the lock's futex until it is given or a short timeout
+ * passes. The calling thread's id is cached in thread local storage rather than fetched with a system call on every take.
+ */
+
+#include <limits.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#endif
+#endif
+
+#include "sxe-log.h"
+#include "sxe-spinlock.h"
+
+bool               sxe_spinlock_stats_enabled = false;
+SXE_SPINLOCK_STATS sxe_spinlock_stats;
+
+#ifndef _WIN32
+__thread long      sxe_spinlock_tid = 0;
+
+static void
+sxe_spinlock_atfork_child(void)
+{
+    sxe_spinlock_tid = 0;    /* The child's only thread has a new id */
+}
+#endif
+
+/**
+ * Get the id of the calling thread and cache it for sxe_spinlock_get_tid()
+ */
+long
+sxe_spinlock_get_tid_slow(void)
+{
+#ifdef _WIN32
+    return SXE_GETTID();
+#else
+    static volatile int atfork_registered = 0;
+
+    if (__sync_bool_compare_and_swap(&atfork_registered, 0, 1)) {
+        pthread_atfork(NULL, NULL, sxe_spinlock_atfork_child);
+    }
+
+    return sxe_spinlock_tid = SXE_GETTID();
+#endif
+}
+
+/**
+ * Wake any threads parked on a spinlock; called after the lock is given while waiters may be parked
+ */
+void
+sxe_spinlock_wake(SXE_SPINLOCK * spinlock)
+{
+    __sync_add_and_fetch(&spinlock->sequence, 1);
+
+#ifdef __linux__
+    syscall(SYS_futex, &spinlock->sequence, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);    /* Not private: locks may be shared */
+#endif
+}
+
+static inline bool
+sxe_spinlock_is_blocked(SXE_SPINLOCK * spinlock, unsigned wait)
+{
+    return wait == SXE_SPINLOCK_WAIT_READERS ? spinlock->readers != 0 : spinlock->lock != 0;
+}
+
+/* Park until the lock is given or SXE_SPINLOCK_PARK_USEC passes
+ */
+static void
+sxe_spinlock_park(SXE_SPINLOCK * spinlock, unsigned wait)
+{
+    int sequence = spinlock->sequence;
+
+    __sync_add_and_fetch(&spinlock->waiters, 1);
+
+    /* Having registered as a waiter, recheck: either the giver sees the waiter and changes the sequence, or the lock is seen free
+     */
+    if (sxe_spinlock_is_blocked(spinlock, wait)) {
+#ifdef __linux__
+        struct timespec timeout = {0, SXE_SPINLOCK_PARK_USEC * 1000};
+
+        syscall(SYS_futex, &spinlock->sequence, FUTEX_WAIT, sequence, &timeout, NULL, 0);
+#else
+        SXE_UNUSED_PARAMETER(sequence);
+        SXE_YIELD();
+#endif
+    }
+
+    __sync_sub_and_fetch(&spinlock->waiters, 1);
+}
+
+/**
+ * Take a spinlock that was found to be held; called by sxe_spinlock_take() and sxe_spinlock_take_read()
+ *
+ * @param spinlock Pointer to the lock
+ * @param our_tid  Id of the calling thread
+ * @param wait     SXE_SPINLOCK_WAIT_WRITER, SXE_SPINLOCK_WAIT_READERS if the calling thread has set itself as the writer and is
+ *                 waiting for readers to give the lock, or SXE_SPINLOCK_WAIT_READ
+ *
+ * @return As for sxe_spinlock_take()
+ *
+ * @note Each backoff round and each park counts toward sxe_spinlock_count_max
+ */
+SXE_SPINLOCK_STATUS
+sxe_spinlock_take_contended(SXE_SPINLOCK * spinlock, long our_tid, unsigned wait)
+{
+    unsigned count = 0;
+    unsigned i;
+    long     old_tid;
+
+    if (sxe_spinlock_stats_enabled) {
+        __sync_add_and_fetch(&sxe_spinlock_stats.contended, 1);
+    }
+
+    for (;;) {
+        if (wait == SXE_SPINLOCK_WAIT_WRITER) {
+            if ((old_tid = InterlockedCompareExchange(&spinlock->lock, our_tid, 0)) == 0) {
+                wait = SXE_SPINLOCK_WAIT_READERS;
+                continue;
+            }
+
+            if (old_tid == our_tid) {
+                SXEL5("sxe_spinlock_take: Spinlock %p already held by our tid %ld", &spinlock->lock, our_tid);
+                return SXE_SPINLOCK_STATUS_ALREADY_TAKEN;
+            }
+        }
+        else if (wait == SXE_SPINLOCK_WAIT_READERS) {
+            if (spinlock->readers == 0) {
+                break;
+            }
+        }
+        else if ((old_tid = spinlock->lock) == our_tid) {
+            SXEL5("sxe_spinlock_take_read: Spinlock %p already held for writing by our tid %ld", &spinlock->lock, our_tid);
+            return SXE_SPINLOCK_STATUS_ALREADY_TAKEN;
+        }
+        else if (old_tid == 0) {
+            __sync_add_and_fetch(&spinlock->readers, 1);
+
+            if (spinlock->lock == 0) {
+                break;
+            }
+
+            sxe_spinlock_give_read(spinlock);
+        }
+
+        if (count >= sxe_spinlock_count_max) {
+            if (wait == SXE_SPINLOCK_WAIT_READERS) {    /* Stop keeping readers out */
+                InterlockedCompareExchange(&spinlock->lock, 0, our_tid);
+                sxe_spinlock_wake(spinlock);
+            }
+
+            if (sxe_spinlock_stats_enabled) {
+                __sync_add_and_fetch(&sxe_spinlock_stats.failures, 1);
+            }
+
+            SXEL3("sxe_spinlock_take failed: reached sxe_spinlock_count_max (%u)", sxe_spinlock_count_max);
+            return SXE_SPINLOCK_STATUS_NOT_TAKEN;
+        }
+
+        if (count++ < SXE_SPINLOCK_SPIN_ROUNDS) {
+            for (i = 1U << count; i > 1; i--) {
+                SXE_SPINLOCK_PAUSE();
+            }
+
+            if (sxe_spinlock_stats_enabled) {
+                __sync_add_and_fetch(&sxe_spinlock_stats.spins, 1);
+            }
+
+            continue;
+        }
+
+        sxe_spinlock_park(spinlock, wait);
+
+        if (sxe_spinlock_stats_enabled) {
+            __sync_add_and_fetch(&sxe_spinlock_stats.parks, 1);
+        }
+    }
+
+    if (sxe_spinlock_stats_enabled) {
+        __sync_add_and_fetch(&sxe_spinlock_stats.takes, 1);
+    }
+
+    return SXE_SPINLOCK_STATUS_TAKEN;
+}
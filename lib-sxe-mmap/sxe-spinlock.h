@@ -22,6 +22,8 @@
 #ifndef __SXE_SPINLOCK__
 #define __SXE_SPINLOCK__
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
 #include "sxe-log.h"
 
@@ -96,7 +98,20 @@ sxe_gettid(void)
 #endif
 #endif
 
-extern unsigned sxe_spinlock_count_max; /* number of yields before spinlock fails */
+extern unsigned sxe_spinlock_count_max; /* number of waits before spinlock fails */
+
+#define SXE_SPINLOCK_SPIN_ROUNDS 8      /* Rounds of 1, 2, 4, ... 128 PAUSEs before parking */
+#define SXE_SPINLOCK_PARK_USEC   100    /* Longest time a thread parks before checking the lock again */
+
+#define SXE_SPINLOCK_WAIT_WRITER  0     /* Waiting to take the lock for writing                                    */
+#define SXE_SPINLOCK_WAIT_READERS 1     /* Took the lock for writing; waiting for the readers holding it to give it */
+#define SXE_SPINLOCK_WAIT_READ    2     /* Waiting to take the lock for reading                                    */
+
+#if defined(__i386__) || defined(__x86_64__)
+#   define SXE_SPINLOCK_PAUSE()  __builtin_ia32_pause()
+#else
+#   define SXE_SPINLOCK_PAUSE()  do { } while (0)
+#endif
 
 typedef enum SXE_SPINLOCK_STATUS {
     SXE_SPINLOCK_STATUS_NOT_TAKEN,       /* Unable to take lock (maximum spin count reached)        */
@@ -104,59 +119,139 @@ typedef enum SXE_SPINLOCK_STATUS {
     SXE_SPINLOCK_STATUS_ALREADY_TAKEN    /* This thread already has the lock - don't double unlock! */
 }  SXE_SPINLOCK_STATUS;
 
+/* A lock that spins with exponential backoff, then parks (on Linux, on a futex; elsewhere, by yielding). It can be held by one
+ * writer (sxe_spinlock_take()) or by any number of readers (sxe_spinlock_take_read()). Locks contain no pointers, so they can be
+ * placed in memory shared between processes.
+ */
 typedef struct SXE_SPINLOCK {
-    volatile long lock;
+    volatile long     lock;        /* Thread id of the writer holding or waiting for readers to release the lock, or 0 */
+    volatile int      sequence;    /* Futex word; changed whenever the lock is released while a thread may be parked   */
+    volatile unsigned waiters;     /* Number of threads parked or about to park                                        */
+    volatile unsigned readers;     /* Number of readers holding the lock                                               */
 } SXE_SPINLOCK;
 
+/* Process wide contention statistics, kept while sxe_spinlock_stats_enabled is true
+ */
+typedef struct SXE_SPINLOCK_STATS {
+    volatile uint64_t takes;        /* Successful takes (read or write)                   */
+    volatile uint64_t contended;    /* Takes that found the lock held                     */
+    volatile uint64_t spins;        /* Backoff rounds spent spinning                      */
+    volatile uint64_t parks;        /* Times a thread parked                              */
+    volatile uint64_t failures;     /* Takes that gave up after sxe_spinlock_count_max    */
+} SXE_SPINLOCK_STATS;
+
+extern bool               sxe_spinlock_stats_enabled;
+extern SXE_SPINLOCK_STATS sxe_spinlock_stats;
+
+#ifndef _WIN32
+extern __thread long      sxe_spinlock_tid;    /* Cached thread id of the calling thread, or 0 if not yet known */
+#endif
+
+#include "sxe-spinlock-proto.h"
+
 static inline void
 sxe_spinlock_construct(SXE_SPINLOCK * spinlock)
 {
-    spinlock->lock = 0;
+    spinlock->lock     = 0;
+    spinlock->sequence = 0;
+    spinlock->waiters  = 0;
+    spinlock->readers  = 0;
+}
+
+static inline long
+sxe_spinlock_get_tid(void)
+{
+#ifdef _WIN32
+    return SXE_GETTID();
+#else
+    return sxe_spinlock_tid != 0 ? sxe_spinlock_tid : sxe_spinlock_get_tid_slow();
+#endif
 }
 
 static inline void
 sxe_spinlock_force(SXE_SPINLOCK * spinlock, long tid)
 {
     InterlockedCompareExchange(&spinlock->lock, tid, InterlockedCompareExchange(&spinlock->lock, tid, tid));
+
+    if (tid == 0) {
+        spinlock->readers = 0;
+        sxe_spinlock_wake(spinlock);
+    }
 }
 
+/**
+ * Take a spinlock for writing (exclusively)
+ *
+ * @return SXE_SPINLOCK_STATUS_TAKEN, SXE_SPINLOCK_STATUS_ALREADY_TAKEN if the calling thread holds it, or
+ *         SXE_SPINLOCK_STATUS_NOT_TAKEN if it could not be taken after sxe_spinlock_count_max waits
+ */
 static inline SXE_SPINLOCK_STATUS
 sxe_spinlock_take(SXE_SPINLOCK * spinlock)
 {
-    unsigned count   = 0;
-    long     our_tid = SXE_GETTID();
-    long     old_tid;
+    long our_tid = sxe_spinlock_get_tid();
 
-    /* SXEL7("SXE_SPINLOCK_TAKE(spinlock.lock=%u, new=%u, old=%u)", spinlock.lock, new, old); */
+    if (InterlockedCompareExchange(&spinlock->lock, our_tid, 0) != 0) {
+        return sxe_spinlock_take_contended(spinlock, our_tid, SXE_SPINLOCK_WAIT_WRITER);
+    }
 
-    while ((count < sxe_spinlock_count_max) && ((old_tid = InterlockedCompareExchange(&spinlock->lock, our_tid, 0)) != 0)) {
-        if (old_tid == our_tid) {
-            SXEL5("sxe_spinlock_take: Spinlock %p already held by our tid %ld", &spinlock->lock, our_tid);
-            return SXE_SPINLOCK_STATUS_ALREADY_TAKEN;
-        }
+    if (spinlock->readers != 0) {    /* Readers still hold the lock; new ones are kept out while we wait for them */
+        return sxe_spinlock_take_contended(spinlock, our_tid, SXE_SPINLOCK_WAIT_READERS);
+    }
 
-        count++;
-        SXE_YIELD();
+    if (sxe_spinlock_stats_enabled) {
+        __sync_add_and_fetch(&sxe_spinlock_stats.takes, 1);
     }
 
-    /* SXEL7("SXE_SPINLOCK_TAKE // done; count=%u", count); */
+    return SXE_SPINLOCK_STATUS_TAKEN;
+}
 
-    if (count >= sxe_spinlock_count_max) {
-        SXEL3("sxe_spinlock_take failed: reached sxe_spinlock_count_max (%u)", sxe_spinlock_count_max);
-        return SXE_SPINLOCK_STATUS_NOT_TAKEN;
+static inline void
+sxe_spinlock_give_read(SXE_SPINLOCK * spinlock)
+{
+    SXEA6(spinlock->readers > 0, "sxe_spinlock_give_read: Lock %p has no readers", &spinlock->lock);
+
+    if (__sync_sub_and_fetch(&spinlock->readers, 1) == 0 && spinlock->waiters != 0) {
+        sxe_spinlock_wake(spinlock);
     }
+}
 
-    return SXE_SPINLOCK_STATUS_TAKEN;
+/**
+ * Take a spinlock for reading; any number of readers can hold the lock at once, but not while a writer holds or is waiting for it
+ *
+ * @return As for sxe_spinlock_take()
+ */
+static inline SXE_SPINLOCK_STATUS
+sxe_spinlock_take_read(SXE_SPINLOCK * spinlock)
+{
+    if (spinlock->lock == 0) {
+        __sync_add_and_fetch(&spinlock->readers, 1);
+
+        if (spinlock->lock == 0) {
+            if (sxe_spinlock_stats_enabled) {
+                __sync_add_and_fetch(&sxe_spinlock_stats.takes, 1);
+            }
+
+            return SXE_SPINLOCK_STATUS_TAKEN;
+        }
+
+        sxe_spinlock_give_read(spinlock);    /* A writer got in first; back out */
+    }
+
+    return sxe_spinlock_take_contended(spinlock, sxe_spinlock_get_tid(), SXE_SPINLOCK_WAIT_READ);
 }
 
 static inline void
 sxe_spinlock_give(SXE_SPINLOCK * spinlock)
 {
-    long our_tid = SXE_GETTID();
+    long our_tid = sxe_spinlock_get_tid();
     long old_tid;
 
     SXEA1((old_tid = InterlockedCompareExchange(&spinlock->lock, 0, our_tid)) == our_tid,
            "sxe_spinlock_give: Lock %p is held by thread %ld, not our tid %ld", &spinlock->lock, old_tid, our_tid);
+
+    if (spinlock->waiters != 0) {
+        sxe_spinlock_wake(spinlock);
+    }
 }
 
 #endif
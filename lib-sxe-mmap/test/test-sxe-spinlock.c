@@ -0,0 +1,146 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sxe-log.h"
+#include "sxe-spinlock.h"
+#include "tap.h"
+
+#define TEST_THREADS    4
+#define TEST_INCREMENTS 100000
+
+static SXE_SPINLOCK      test_lock;
+static volatile unsigned test_counter = 0;
+
+static void *
+test_thread_increment(void * arg)
+{
+    unsigned i;
+
+    SXE_UNUSED_PARAMETER(arg);
+
+    for (i = 0; i < TEST_INCREMENTS; i++) {
+        SXEA1(sxe_spinlock_take(&test_lock) == SXE_SPINLOCK_STATUS_TAKEN, "Failed to take the lock");
+        test_counter++;
+        sxe_spinlock_give(&test_lock);
+    }
+
+    return NULL;
+}
+
+static void *
+test_thread_take(void * arg)
+{
+    SXE_SPINLOCK_STATUS status = sxe_spinlock_take(&test_lock);
+
+    SXE_UNUSED_PARAMETER(arg);
+
+    if (status == SXE_SPINLOCK_STATUS_TAKEN) {
+        test_counter++;
+        sxe_spinlock_give(&test_lock);
+    }
+
+    return (void *)(uintptr_t)status;
+}
+
+int
+main(void)
+{
+    pthread_t thread[TEST_THREADS];
+    void    * result;
+    unsigned  count_max = sxe_spinlock_count_max;
+    unsigned  i;
+    pid_t     pid;
+    int       status;
+
+    plan_tests(22);
+    sxe_spinlock_construct(&test_lock);
+    sxe_spinlock_stats_enabled = true;
+
+    is(sxe_spinlock_take(&test_lock),      SXE_SPINLOCK_STATUS_TAKEN,         "Took the lock");
+    is(test_lock.lock,                     SXE_GETTID(),                      "Lock is held by our thread id");
+    is(sxe_spinlock_take(&test_lock),      SXE_SPINLOCK_STATUS_ALREADY_TAKEN, "Taking it again reports it already taken");
+    is(sxe_spinlock_take_read(&test_lock), SXE_SPINLOCK_STATUS_ALREADY_TAKEN, "Taking it for reading reports it already taken");
+    sxe_spinlock_give(&test_lock);
+    is(test_lock.lock,                     0,                                 "Gave the lock");
+
+    is(sxe_spinlock_take_read(&test_lock), SXE_SPINLOCK_STATUS_TAKEN,         "Took the lock for reading");
+    is(sxe_spinlock_take_read(&test_lock), SXE_SPINLOCK_STATUS_TAKEN,         "Took the lock for reading again");
+    is(test_lock.readers,                  2,                                 "Lock has 2 readers");
+
+    sxe_spinlock_count_max = 20;    /* A writer gives up after 8 backoff rounds and 12 parks */
+    pthread_create(&thread[0], NULL, test_thread_take, NULL);
+    pthread_join(thread[0], &result);
+    is((uintptr_t)result,                  SXE_SPINLOCK_STATUS_NOT_TAKEN,     "Writer can't take the lock while readers hold it");
+    is(test_lock.lock,                     0,                                 "Writer that gave up is no longer keeping readers out");
+    is(sxe_spinlock_stats.failures,        1,                                 "Failure was counted");
+    ok(sxe_spinlock_stats.parks >= 12,                                        "Writer parked (%llu parks)",
+       (unsigned long long)sxe_spinlock_stats.parks);
+    sxe_spinlock_count_max = count_max;
+
+    pthread_create(&thread[0], NULL, test_thread_take, NULL);
+
+    while (test_lock.lock == 0) {    /* Wait for the writer to claim the lock */
+        SXE_YIELD();
+    }
+
+    ok(test_lock.readers == 2,                                                "Writer waits for the readers to give the lock");
+    sxe_spinlock_give_read(&test_lock);
+    sxe_spinlock_give_read(&test_lock);
+    pthread_join(thread[0], &result);
+    is((uintptr_t)result,                  SXE_SPINLOCK_STATUS_TAKEN,         "Writer took the lock once the readers gave it");
+    is(test_counter,                       1,                                 "Writer ran its critical section");
+    is(test_lock.lock,                     0,                                 "Writer gave the lock");
+
+    test_counter = 0;
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        pthread_create(&thread[i], NULL, test_thread_increment, NULL);
+    }
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        pthread_join(thread[i], NULL);
+    }
+
+    is(test_counter,                       TEST_THREADS * TEST_INCREMENTS,    "No increments were lost by %u contending threads",
+       TEST_THREADS);
+    ok(sxe_spinlock_stats.takes >= TEST_THREADS * TEST_INCREMENTS,            "Takes were counted (%llu, %llu contended)",
+       (unsigned long long)sxe_spinlock_stats.takes, (unsigned long long)sxe_spinlock_stats.contended);
+
+    if ((pid = fork()) == 0) {
+        exit(sxe_spinlock_get_tid() == getpid() ? 0 : 1);    /* The child must not use its parent's cached thread id */
+    }
+
+    is(waitpid(pid, &status, 0),           pid,                               "Child exited");
+    ok(WIFEXITED(status) && WEXITSTATUS(status) == 0,                         "Child's thread id is its own");
+
+    sxe_spinlock_force(&test_lock, 1);
+    is(test_lock.lock,                     1,                                 "Forced the lock to thread id 1");
+    sxe_spinlock_force(&test_lock, 0);
+    is(test_lock.lock,                     0,                                 "Forced the lock free");
+
+    return exit_status();
+}
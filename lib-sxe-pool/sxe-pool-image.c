@@ -0,0 +1,196 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Pool images: pools constructed in a file backed (or, under /dev/shm, shared memory backed) mapping, so that they can be
+ * attached to by other processes, or by the same program after a restart, without being rebuilt. Everything inside a pool is
+ * addressed relative to its base (see SXE_PTR_FIX), and a pool in an image keeps nothing that refers to memory in the process that
+ * created it, so attaching only has to validate the image. The mapping is shared: attaching must never write to the pool, since
+ * other processes may be using it.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "sxe-log.h"
+#include "sxe-pool-private.h"
+
+#define SXE_POOL_IMAGE_MAGIC    0x4C4F4F50455853ULL    /* "SXEPOOL" */
+#define SXE_POOL_IMAGE_VERSION  1
+#define SXE_POOL_IMAGE_OPTIONS_PROCESS_LOCAL (SXE_POOL_OPTION_CONCURRENT | SXE_POOL_OPTION_MAGAZINES | SXE_POOL_OPTIONS_MEMORY \
+                                              | SXE_POOL_OPTION_STATS)
+
+/* Header at the start of an image file; the pool's base follows it, a cache line in
+ */
+typedef struct SXE_POOL_IMAGE_HEADER {
+    uint64_t magic;
+    unsigned version;
+    unsigned impl_size;    /* sizeof(SXE_POOL_IMPL) in the program that created the image; guards against layout changes */
+    uint64_t pool_size;    /* Bytes from the pool's base to the end of the pool                                            */
+    char     pad[SXE_POOL_CACHE_LINE_SIZE - 3 * sizeof(uint64_t)];
+} SXE_POOL_IMAGE_HEADER;
+
+/**
+ * Create a pool image file and construct a pool in it
+ *
+ * @param memmap  Pointer to a memory map object that will hold the mapping of the image
+ * @param path    Path of the image file; it is created or truncated. A path under /dev/shm gives a shared memory image that
+ *                survives restarts of the processes using it but not of the machine.
+ * @param name    Name of pool; pointer to '\0' terminated string
+ * @param number  Number of elements in the pool
+ * @param size    Size of each element in the pool
+ * @param states  Number of states each element can be in
+ * @param options SXE_POOL_OPTION_LOCKED if the pool will be shared between processes, SXE_POOL_OPTION_TIMED and/or
+ *                SXE_POOL_OPTION_COMPACT_NODES. Options that need memory outside the image (concurrent pools, magazines,
+ *                statistics and the memory mapping options) are not allowed.
+ *
+ * @return A pointer to the array of objects
+ *
+ * @exception Aborts if the image can't be created
+ *
+ * @note Elements must not contain pointers unless they point into memory mapped at the same address by every user of the image
+ */
+void *
+sxe_pool_image_create(SXE_MMAP * memmap, const char * path, const char * name, unsigned number, size_t size, unsigned states,
+                      unsigned options)
+{
+    SXE_POOL_IMAGE_HEADER * header;
+    FILE                  * file;
+    size_t                  pool_size;
+    void                  * array;
+
+    SXEE6("(memmap=%p,path=%s,name=%s,number=%u,size=%zu,states=%u,options=0x%x)", memmap, path, name, number, size, states,
+          options);
+    SXEA1(!(options & SXE_POOL_IMAGE_OPTIONS_PROCESS_LOCAL), "Pool image %s: options 0x%x can't be kept in an image", name,
+          options & SXE_POOL_IMAGE_OPTIONS_PROCESS_LOCAL);
+    pool_size = sxe_pool_size(number, size, states);
+    SXEA1((file = fopen(path, "wb")) != NULL, "Pool image %s: failed to create %s: %s", name, path, strerror(errno));
+    SXEA1(fseek(file, (long)(sizeof(SXE_POOL_IMAGE_HEADER) + pool_size - 1), SEEK_SET) == 0 && fputc('\0', file) != EOF
+       && fclose(file) == 0, "Pool image %s: failed to extend %s to %zu bytes: %s", name, path,
+          sizeof(SXE_POOL_IMAGE_HEADER) + pool_size, strerror(errno));
+    sxe_mmap_open(memmap, path);
+
+    header            = memmap->addr;
+    array             = sxe_pool_construct(header + 1, name, number, size, states, options);
+    SXE_POOL_ARRAY_TO_IMPL(array)->options |= SXE_POOL_OPTION_IMAGE;    /* Keeps process local pointers out of the image */
+    header->version   = SXE_POOL_IMAGE_VERSION;
+    header->impl_size = sizeof(SXE_POOL_IMPL);
+    header->pool_size = pool_size;
+    header->magic     = SXE_POOL_IMAGE_MAGIC;    /* Set last, so an image whose creation was interrupted is never valid */
+
+    SXER6("return array=%p", array);
+    return array;
+}
+
+/**
+ * Relocate a private copy of a pool made by another process, resetting the fields that point into the address space of the
+ * process that last used it
+ *
+ * @param base Pointer to the pool's base (the memory it was copied to)
+ *
+ * @return A pointer to the array of objects
+ *
+ * @note The pool's state to string function is reset to the default. Pools with options that need memory outside the pool (see
+ *       sxe_pool_image_create()) can't be relocated. Never relocate a pool in memory that another process may be using; pools
+ *       in shared images are attached with sxe_pool_image_attach(), which doesn't change them.
+ */
+void *
+sxe_pool_relocate(void * base)
+{
+    SXE_POOL_IMPL * pool = base;
+    void          * array;
+
+    SXEE6("(base=%p)", base);
+    pool->event_timeout   = NULL;
+    pool->caller_info     = NULL;
+    pool->state_timeouts  = NULL;
+    pool->concurrent      = NULL;
+    pool->magazines       = NULL;
+    pool->stats           = NULL;
+    pool->state_to_string = NULL;
+    array                 = SXE_POOL_IMPL_TO_ARRAY(pool);
+    SXER6("return array=%p", array);
+    return array;
+}
+
+/**
+ * Attach to a pool image created by sxe_pool_image_create(), possibly in another process or before a restart
+ *
+ * @param memmap Pointer to a memory map object that will hold the mapping of the image
+ * @param path   Path of the image file
+ *
+ * @return A pointer to the array of objects, or NULL if there is no image at path or it is not a valid pool image
+ *
+ * @note Pools in images always use the default state to string function. If the pool is locked and no other process can be
+ *       using it (e.g. after a crash), call sxe_pool_override_locked() in case the lock was held when the last user died.
+ */
+void *
+sxe_pool_image_attach(SXE_MMAP * memmap, const char * path)
+{
+    SXE_POOL_IMAGE_HEADER * header;
+    SXE_POOL_IMPL         * pool;
+    struct stat             status;
+    void                  * array = NULL;
+
+    SXEE6("(memmap=%p,path=%s)", memmap, path);
+
+    if (stat(path, &status) < 0 || (size_t)status.st_size < sizeof(SXE_POOL_IMAGE_HEADER) + sizeof(SXE_POOL_IMPL)) {
+        SXEL3("Pool image %s does not exist or is too small to be valid", path);
+        goto SXE_EARLY_OUT;
+    }
+
+    sxe_mmap_open(memmap, path);
+    header = memmap->addr;
+    pool   = (SXE_POOL_IMPL *)(header + 1);
+
+    if (header->magic != SXE_POOL_IMAGE_MAGIC || header->version != SXE_POOL_IMAGE_VERSION
+     || header->impl_size != sizeof(SXE_POOL_IMPL) || header->pool_size > memmap->size - sizeof(SXE_POOL_IMAGE_HEADER)
+     || (pool->options & (SXE_POOL_OPTION_IMAGE | SXE_POOL_IMAGE_OPTIONS_PROCESS_LOCAL)) != SXE_POOL_OPTION_IMAGE
+     || pool->state_to_string != NULL || pool->event_timeout != NULL
+     || header->pool_size != sxe_pool_size(pool->number, pool->size, pool->states)) {
+        SXEL3("Pool image %s is not a valid version %u pool image", path, SXE_POOL_IMAGE_VERSION);
+        sxe_mmap_close(memmap);
+        goto SXE_EARLY_OUT;
+    }
+
+    array = SXE_POOL_IMPL_TO_ARRAY(pool);
+
+SXE_EARLY_OUT:
+    SXER6("return array=%p", array);
+    return array;
+}
+
+/**
+ * Detach from a pool image; the pool stays in the image file for the next process to attach to it
+ *
+ * @param memmap Pointer to the memory map object passed to sxe_pool_image_create() or sxe_pool_image_attach()
+ *
+ * @note Never call sxe_pool_delete() on a pool in an image. To get rid of the image, detach and unlink the file.
+ */
+void
+sxe_pool_image_detach(SXE_MMAP * memmap)
+{
+    SXEE6("(memmap=%p)", memmap);
+    sxe_mmap_close(memmap);
+    SXER6("return");
+}
@@ -0,0 +1,310 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Per thread magazines: each thread keeps a small stack of free indices so that taking an element and giving it back doesn't need
+ * the pool lock. The magazine is refilled from, or flushed to, the pool's free state (0) SXE_POOL_MAGAZINE_BATCH indices at a time
+ * under a single acquisition of the pool lock. Each thread that uses magazines owns one of SXE_POOL_MAGAZINE_THREADS slots, the
+ * index of its magazine in every pool. When it exits, its magazines are flushed and its slot is freed for another thread.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "sxe-log.h"
+#include "sxe-pool-private.h"
+
+SXE_POOL_IMPL * sxe_pool_magazine_pools      = NULL;
+SXE_SPINLOCK    sxe_pool_magazine_pools_lock = {0};
+
+static volatile unsigned sxe_pool_magazine_owned[SXE_POOL_MAGAZINE_THREADS];    /* Set while a thread owns the slot */
+static pthread_key_t     sxe_pool_magazine_key;
+static pthread_once_t    sxe_pool_magazine_once = PTHREAD_ONCE_INIT;
+
+/* The calling thread's slot plus one, 0 if it has none yet, or SXE_POOL_MAGAZINE_THREADS + 1 if none was free
+ */
+static __thread unsigned sxe_pool_magazine_slot = 0;
+
+/* Give an element held by a thread back to the pool's free state; the caller must hold the pool lock
+ */
+static void
+sxe_pool_magazine_free_locked(SXE_POOL_IMPL * pool, unsigned id)
+{
+    sxe_pool_element_stamp(pool, id);
+    sxe_pool_queue_push(pool, 0, id);
+
+    if (pool->stats != NULL) {
+        sxe_pool_stats_enter(pool, 0, 1);
+    }
+}
+
+/* Give the elements in an exiting thread's magazines back to the free states of their pools, then give up its slot
+ */
+static void
+sxe_pool_magazine_release(void * slot_plus_one)
+{
+    SXE_POOL_MAGAZINE * magazine;
+    SXE_POOL_IMPL     * pool;
+    unsigned            slot = (unsigned)(uintptr_t)slot_plus_one - 1;
+
+    sxe_spinlock_take(&sxe_pool_magazine_pools_lock);
+
+    for (pool = sxe_pool_magazine_pools; pool != NULL; pool = pool->magazines_next) {
+        magazine = &pool->magazines[slot];
+
+        if (magazine->count == 0) {
+            continue;
+        }
+
+        if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {    /* Coverage exclusion: Add tests before using in multiprocess code */
+            SXEL2("Pool %s: failed to take the lock to flush the magazine of exiting thread %ld; %u elements are lost",
+                  pool->name, SXE_GETTID(), magazine->count);
+            magazine->count = 0;
+            continue;
+        }
+
+        while (magazine->count > 0) {
+            sxe_pool_magazine_free_locked(pool, magazine->ids[--magazine->count]);
+        }
+
+        sxe_pool_unlock(pool);
+    }
+
+    sxe_spinlock_give(&sxe_pool_magazine_pools_lock);
+    sxe_pool_magazine_slot = 0;
+    __atomic_store_n(&sxe_pool_magazine_owned[slot], 0, __ATOMIC_RELEASE);
+}
+
+static void
+sxe_pool_magazine_key_create(void)
+{
+    SXEA1(pthread_key_create(&sxe_pool_magazine_key, sxe_pool_magazine_release) == 0, "Failed to create the pool magazine key");
+}
+
+/* Give the calling thread a free slot, if there is one
+ */
+static unsigned
+sxe_pool_magazine_claim_slot(void)
+{
+    unsigned i;
+
+    pthread_once(&sxe_pool_magazine_once, sxe_pool_magazine_key_create);
+
+    for (i = 0; i < SXE_POOL_MAGAZINE_THREADS; i++) {
+        if (__atomic_load_n(&sxe_pool_magazine_owned[i], __ATOMIC_RELAXED) == 0
+         && __sync_bool_compare_and_swap(&sxe_pool_magazine_owned[i], 0, 1)) {
+            pthread_setspecific(sxe_pool_magazine_key, (void *)(uintptr_t)(i + 1));
+            SXEL6("Thread %ld has pool magazine slot %u", SXE_GETTID(), i);
+            return i + 1;
+        }
+    }
+
+    SXEL5("More than %u threads are using pool magazines; thread %ld will use the pool lock", SXE_POOL_MAGAZINE_THREADS,
+          SXE_GETTID());
+    return SXE_POOL_MAGAZINE_THREADS + 1;
+}
+
+static SXE_POOL_MAGAZINE *
+sxe_pool_magazine_get(SXE_POOL_IMPL * pool)
+{
+    if (sxe_pool_magazine_slot == 0) {
+        sxe_pool_magazine_slot = sxe_pool_magazine_claim_slot();
+    }
+
+    if (sxe_pool_magazine_slot > SXE_POOL_MAGAZINE_THREADS) {
+        return NULL;
+    }
+
+    return &pool->magazines[sxe_pool_magazine_slot - 1];
+}
+
+
+/* Move up to count of the oldest free elements into the magazine, oldest on top; the caller must hold the pool lock
+ */
+static void
+sxe_pool_magazine_refill_locked(SXE_POOL_IMPL * pool, SXE_POOL_MAGAZINE * magazine, unsigned count)
+{
+    unsigned i;
+
+    if (count > sxe_pool_queue_length(pool, 0)) {
+        count = sxe_pool_queue_length(pool, 0);
+    }
+
+    for (i = count; i-- > 0; ) {
+        if (pool->stats != NULL) {
+            sxe_pool_stats_leave(pool, 0, sxe_pool_queue_head(pool, 0));
+        }
+
+        magazine->ids[magazine->count + i] = sxe_pool_queue_shift(pool, 0);
+        sxe_pool_element_set_state(pool, magazine->ids[magazine->count + i], SXE_POOL_MAGAZINE_STATE(pool));
+    }
+
+    magazine->count += count;
+}
+
+/**
+ * Take a free element from the calling thread's magazine
+ *
+ * @param array Pointer to the pool array; the pool must have been created with SXE_POOL_OPTION_MAGAZINES
+ *
+ * @return Index of the element, or SXE_POOL_NO_INDEX if there are no free elements, or SXE_POOL_LOCK_NOT_TAKEN
+ *
+ * @note The element belongs to the calling thread until it is given back with sxe_pool_magazine_give(). It is in no state queue;
+ *       sxe_pool_index_to_state() returns the pool's number of states for it. Elements in magazines are not counted by
+ *       sxe_pool_get_number_in_state(), and the free state is only oldest first among the elements that are not in magazines.
+ */
+unsigned
+sxe_pool_magazine_take(void * array)
+{
+    SXE_POOL_IMPL     * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+    SXE_POOL_MAGAZINE * magazine;
+    unsigned            id   = SXE_POOL_NO_INDEX;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s)", pool->name);
+    SXEA6(pool->magazines != NULL, "Pool %s has no magazines", pool->name);
+
+    if ((magazine = sxe_pool_magazine_get(pool)) != NULL && magazine->count > 0) {
+        id = magazine->ids[--magazine->count];    /* Common case: no lock, and the most recently given back element */
+        goto SXE_EARLY_OUT;
+    }
+
+    if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
+        id = SXE_POOL_LOCK_NOT_TAKEN;    /* Coverage exclusion: Add tests before using in multiprocess code */
+        goto SXE_EARLY_OUT;              /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    if (magazine == NULL) {    /* Too many threads: take straight from the free state */
+        if (pool->stats != NULL && sxe_pool_queue_length(pool, 0) > 0) {
+            sxe_pool_stats_leave(pool, 0, sxe_pool_queue_head(pool, 0));
+        }
+
+        if ((id = sxe_pool_queue_shift(pool, 0)) != SXE_POOL_NO_INDEX) {
+            sxe_pool_element_set_state(pool, id, SXE_POOL_MAGAZINE_STATE(pool));
+        }
+    }
+    else {
+        sxe_pool_magazine_refill_locked(pool, magazine, SXE_POOL_MAGAZINE_BATCH);
+
+        if (magazine->count > 0) {
+            id = magazine->ids[--magazine->count];
+        }
+    }
+
+    sxe_pool_unlock(pool);
+
+SXE_EARLY_OUT:
+    SXER6("return %s", sxe_pool_return_to_string(id));
+    return id;
+}
+
+/**
+ * Give an element taken with sxe_pool_magazine_take() back to the calling thread's magazine
+ *
+ * @param array Pointer to the pool array
+ * @param id    Index of the element
+ *
+ * @return SXE_POOL_LOCK_TAKEN, or SXE_POOL_LOCK_NOT_TAKEN if the magazine was full and the pool lock could not be taken
+ *
+ * @note An element may be given back by a different thread than the one that took it
+ */
+unsigned
+sxe_pool_magazine_give(void * array, unsigned id)
+{
+    SXE_POOL_IMPL     * pool   = SXE_POOL_ARRAY_TO_IMPL(array);
+    SXE_POOL_MAGAZINE * magazine;
+    unsigned            result = SXE_POOL_LOCK_TAKEN;
+    unsigned            i;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s,id=%u)", pool->name, id);
+    SXEA6(pool->magazines != NULL, "Pool %s has no magazines", pool->name);
+    SXEA6(id < pool->number, "Index %u is too big for pool %s (number=%u)", id, pool->name, pool->number);
+    SXEA6(sxe_pool_element_state(pool, id) == SXE_POOL_MAGAZINE_STATE(pool),
+          "Element %u of pool %s was not taken from a magazine", id, pool->name);
+
+    if ((magazine = sxe_pool_magazine_get(pool)) != NULL && magazine->count < SXE_POOL_MAGAZINE_SIZE) {
+        magazine->ids[magazine->count++] = id;
+        goto SXE_EARLY_OUT;
+    }
+
+    if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
+        goto SXE_EARLY_OUT;    /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    if (magazine == NULL) {    /* Too many threads: give straight back to the free state */
+        sxe_pool_magazine_free_locked(pool, id);
+    }
+    else {    /* Flush the bottom (coldest) batch of the full magazine, keeping the recently used top */
+        for (i = 0; i < SXE_POOL_MAGAZINE_BATCH; i++) {
+            sxe_pool_magazine_free_locked(pool, magazine->ids[i]);
+        }
+
+        memmove(&magazine->ids[0], &magazine->ids[SXE_POOL_MAGAZINE_BATCH],
+                (SXE_POOL_MAGAZINE_SIZE - SXE_POOL_MAGAZINE_BATCH) * sizeof(magazine->ids[0]));
+        magazine->count                  = SXE_POOL_MAGAZINE_SIZE - SXE_POOL_MAGAZINE_BATCH;
+        magazine->ids[magazine->count++] = id;
+    }
+
+    sxe_pool_unlock(pool);
+
+SXE_EARLY_OUT:
+    SXER6("return %s", sxe_pool_return_to_string(result));
+    return result;
+}
+
+/**
+ * Give all elements in the calling thread's magazine back to the pool's free state. This is done when the thread exits, but a
+ * thread that is done with a pool can call it to make the elements available to other threads sooner.
+ *
+ * @param array Pointer to the pool array
+ *
+ * @return SXE_POOL_LOCK_TAKEN, or SXE_POOL_LOCK_NOT_TAKEN if the pool lock could not be taken
+ */
+unsigned
+sxe_pool_magazine_flush(void * array)
+{
+    SXE_POOL_IMPL     * pool   = SXE_POOL_ARRAY_TO_IMPL(array);
+    SXE_POOL_MAGAZINE * magazine;
+    unsigned            result = SXE_POOL_LOCK_TAKEN;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s)", pool->name);
+    SXEA6(pool->magazines != NULL, "Pool %s has no magazines", pool->name);
+
+    if ((magazine = sxe_pool_magazine_get(pool)) == NULL || magazine->count == 0) {
+        goto SXE_EARLY_OUT;
+    }
+
+    if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
+        goto SXE_EARLY_OUT;    /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    while (magazine->count > 0) {
+        sxe_pool_magazine_free_locked(pool, magazine->ids[--magazine->count]);
+    }
+
+    sxe_pool_unlock(pool);
+
+SXE_EARLY_OUT:
+    SXER6("return %s", sxe_pool_return_to_string(result));
+    return result;
+}
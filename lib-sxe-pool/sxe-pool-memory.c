@@ -0,0 +1,238 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Pool memory that is mapped rather than allocated from the heap: growable pools, which reserve address space and back it with
+ * memory a segment at a time, and pools constructed with huge page, prefault or NUMA options, which large lookup heavy pools (for
+ * example, those behind sxe_hash) use to cut TLB misses and remote memory accesses.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+
+#define SXE_POOL_PAGE_SIZE          4096
+#define SXE_POOL_HUGE_PAGE_SIZE     (2UL << 20)
+#define SXE_POOL_HUGE_PAGE_SIZE_1G  (1UL << 30)
+#define SXE_POOL_MPOL_BIND          2          /* From linux/mempolicy.h, which would otherwise need libnuma's headers */
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT              26
+#endif
+
+static size_t
+sxe_pool_memory_page_size(unsigned options)
+{
+    return options & SXE_POOL_OPTION_HUGE_PAGES_1G ? SXE_POOL_HUGE_PAGE_SIZE_1G
+         : options & SXE_POOL_OPTION_HUGE_PAGES    ? SXE_POOL_HUGE_PAGE_SIZE
+         :                                           SXE_POOL_PAGE_SIZE;
+}
+
+/**
+ * Get the number of bytes that sxe_pool_memory_map() will map for a given size and options; if huge pages are asked for but
+ * can't be mapped, only whole normal pages are
+ */
+size_t
+sxe_pool_memory_mapped_size(size_t size, unsigned options)
+{
+    size_t page_size = sxe_pool_memory_page_size(options);
+
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+#ifndef _WIN32
+/* Bind [base, base + size) to a NUMA node. This must be done before the pages are first touched.
+ */
+static void
+sxe_pool_memory_bind(void * base, size_t size, unsigned node)
+{
+#ifdef SYS_mbind
+    unsigned long node_mask[4] = {0, 0, 0, 0};    /* Enough for 256 nodes */
+
+    node_mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+
+    if (syscall(SYS_mbind, base, size, SXE_POOL_MPOL_BIND, node_mask, 8 * sizeof(node_mask), 0) != 0) {
+        SXEL3("Failed to bind %zu bytes of pool memory to NUMA node %u: %s; memory will be placed on first touch", size, node,
+              strerror(errno));
+    }
+#else
+    SXEL3("Can't bind %zu bytes of pool memory to NUMA node %u: mbind is not supported on this platform", size, node);
+#endif
+}
+#endif
+
+/**
+ * Map memory for a pool
+ *
+ * @param size         Number of bytes needed; rounded up to whole pages of the size actually mapped
+ * @param options      Pool options; SXE_POOL_OPTION_HUGE_PAGES, SXE_POOL_OPTION_HUGE_PAGES_1G, SXE_POOL_OPTION_PREFAULT and
+ *                     SXE_POOL_OPTION_NUMA_NODE() are honoured
+ * @param reserve_only True to only reserve address space, to be backed by memory later (see sxe_pool_memory_commit())
+ *
+ * @return Pointer to the zero filled memory, or NULL on failure
+ *
+ * @note If huge pages can't be mapped (for example, because none have been reserved in /proc/sys/vm/nr_hugepages), the memory is
+ *       mapped with normal pages and the kernel is asked to use transparent huge pages for it. Reserved address space is never
+ *       mapped with (or prefaulted into) huge pages up front. Only the <size> bytes needed are prefaulted.
+ *
+ * @note On Windows, huge page and NUMA options are ignored
+ */
+void *
+sxe_pool_memory_map(size_t size, unsigned options, bool reserve_only)
+{
+    void * base;
+    size_t mapped;
+    size_t offset;
+
+    SXEE6("(size=%zu,options=0x%x,reserve_only=%s)", size, options, reserve_only ? "true" : "false");
+    mapped = sxe_pool_memory_mapped_size(size, 0);    /* Normal pages, unless huge pages are mapped below */
+
+#ifdef _WIN32
+    base = VirtualAlloc(NULL, mapped, reserve_only ? MEM_RESERVE : MEM_RESERVE | MEM_COMMIT,
+                        reserve_only ? PAGE_NOACCESS : PAGE_READWRITE);
+#else
+    base = MAP_FAILED;
+
+    if (!reserve_only && (options & (SXE_POOL_OPTION_HUGE_PAGES | SXE_POOL_OPTION_HUGE_PAGES_1G))) {
+#   ifdef MAP_HUGETLB
+        base = mmap(NULL, sxe_pool_memory_mapped_size(size, options), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS
+                    | MAP_HUGETLB | (options & SXE_POOL_OPTION_HUGE_PAGES_1G ? 30 << MAP_HUGE_SHIFT : 21 << MAP_HUGE_SHIFT), -1, 0);
+
+        if (base == MAP_FAILED) {
+            SXEL5("Can't map %zu bytes of huge pages (%s); falling back to transparent huge pages", size, strerror(errno));
+        }
+        else {
+            mapped = sxe_pool_memory_mapped_size(size, options);
+        }
+#   endif
+    }
+
+    if (base == MAP_FAILED) {
+        base = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | (reserve_only ? MAP_NORESERVE : 0), -1, 0);
+
+        if (base == MAP_FAILED) {
+            SXEL2("Failed to map %zu bytes of pool memory: %s", mapped, strerror(errno));
+            base = NULL;
+            goto SXE_EARLY_OUT;
+        }
+
+#   ifdef MADV_HUGEPAGE
+        if (options & (SXE_POOL_OPTION_HUGE_PAGES | SXE_POOL_OPTION_HUGE_PAGES_1G)) {
+            madvise(base, mapped, MADV_HUGEPAGE);
+        }
+#   endif
+    }
+
+    if (options & SXE_POOL_OPTION_NUMA) {
+        sxe_pool_memory_bind(base, mapped, SXE_POOL_OPTION_TO_NUMA_NODE(options));
+    }
+#endif
+
+    if (base != NULL && !reserve_only && (options & SXE_POOL_OPTION_PREFAULT)) {
+        for (offset = 0; offset < size; offset += SXE_POOL_PAGE_SIZE) {    /* Only the bytes asked for */
+            ((volatile char *)base)[offset] = 0;
+        }
+    }
+
+#ifndef _WIN32
+SXE_EARLY_OUT:
+#endif
+    SXER6("return %p", base);
+    return base;
+}
+
+/**
+ * Unmap memory mapped by sxe_pool_memory_map()
+ *
+ * @param base    Base of the memory
+ * @param size    Number of bytes that were passed to sxe_pool_memory_map()
+ * @param options Options that were passed to sxe_pool_memory_map()
+ *
+ * @note Whether huge pages were mapped isn't recorded. The normal pages that would have been mapped instead are unmapped; if that
+ *       fails because the memory is huge pages, which can only be unmapped whole, the huge pages are.
+ */
+void
+sxe_pool_memory_unmap(void * base, size_t size, unsigned options)
+{
+#ifdef _WIN32
+    SXE_UNUSED_PARAMETER(size);
+    SXE_UNUSED_PARAMETER(options);
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    if (munmap(base, sxe_pool_memory_mapped_size(size, 0)) == 0) {
+        return;
+    }
+
+    SXEA1(errno == EINVAL && (options & (SXE_POOL_OPTION_HUGE_PAGES | SXE_POOL_OPTION_HUGE_PAGES_1G))
+          && munmap(base, sxe_pool_memory_mapped_size(size, options)) == 0,
+          "Failed to unmap %zu bytes of pool memory: %s", size, strerror(errno));
+#endif
+}
+
+/**
+ * Back the pages overlapping [address, address + size) of reserved memory with memory; on POSIX systems, anonymous pages are
+ * backed when they are first touched, so this is a no-op
+ */
+void
+sxe_pool_memory_commit(void * address, size_t size)
+{
+#ifdef _WIN32
+    uintptr_t first = (uintptr_t)address & ~(uintptr_t)(SXE_POOL_PAGE_SIZE - 1);
+
+    SXEA1(VirtualAlloc((void *)first, (uintptr_t)address + size - first, MEM_COMMIT, PAGE_READWRITE) != NULL,
+          "Failed to commit %zu bytes of pool memory", size);
+#else
+    SXE_UNUSED_PARAMETER(address);
+    SXE_UNUSED_PARAMETER(size);
+#endif
+}
+
+/**
+ * Give back the memory behind the pages entirely within [address, address + size); they read as zeros if touched again
+ */
+void
+sxe_pool_memory_release(void * address, size_t size)
+{
+    uintptr_t first = ((uintptr_t)address + SXE_POOL_PAGE_SIZE - 1) & ~(uintptr_t)(SXE_POOL_PAGE_SIZE - 1);
+    uintptr_t last  = ((uintptr_t)address + size)                    & ~(uintptr_t)(SXE_POOL_PAGE_SIZE - 1);
+
+    if (last <= first) {
+        return;
+    }
+
+#ifdef _WIN32
+    VirtualFree((void *)first, last - first, MEM_DECOMMIT);
+#else
+    madvise((void *)first, last - first, MADV_DONTNEED);
+#endif
+}
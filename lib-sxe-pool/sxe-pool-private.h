@@ -31,6 +31,23 @@
 #define SXE_POOL_IMPL_TO_ARRAY(impl)  ((void *)((SXE_POOL_IMPL *)(impl) + 1))
 #define SXE_POOL_NODES(impl)          SXE_PTR_FIX(impl, SXE_POOL_NODE *, (impl)->nodes)
 #define SXE_POOL_QUEUE(impl)          SXE_PTR_FIX(impl, SXE_LIST *,      (impl)->queue)
+#define SXE_POOL_COMPACT_QUEUE(impl)  SXE_PTR_FIX(impl, SXE_POOL_COMPACT_QUEUE *, (impl)->queue)
+#define SXE_POOL_COMPACT_LINKS(impl)  SXE_PTR_FIX(impl, SXE_POOL_COMPACT_LINK *,  (impl)->nodes)
+#define SXE_POOL_COMPACT_LASTS(impl)  SXE_PTR_FIX(impl, uint64_t *,               (impl)->compact_lasts)
+#define SXE_POOL_IS_COMPACT(impl)     ((impl)->options & SXE_POOL_OPTION_COMPACT_NODES)
+#define SXE_POOL_ASSERT_ARRAY_INITIALIZED(array) SXEA6((array) != NULL, "%s(array=NULL): Uninitialized pool?", __func__)
+#define SXE_POOL_CACHE_LINE_SIZE      64
+#define SXE_POOL_SPINS_BEFORE_YIELD   1000
+#define SXE_POOL_MAGAZINE_SIZE        31      /* Free indices cached by each thread                     */
+#define SXE_POOL_MAGAZINE_BATCH       16      /* Indices moved to or from the free state per lock taken */
+#define SXE_POOL_MAGAZINE_THREADS     64      /* Threads at once beyond this many use the pool lock     */
+#define SXE_POOL_MAGAZINE_STATE(impl) ((impl)->states)    /* Pseudo state of elements held by a magazine or its thread */
+
+#if defined(__i386__) || defined(__x86_64__)
+#   define SXE_POOL_PAUSE()           __builtin_ia32_pause()
+#else
+#   define SXE_POOL_PAUSE()           do { } while (0)
+#endif
 
 typedef struct SXE_POOL_NODE {
     SXE_LIST_NODE list_node;
@@ -40,29 +57,274 @@ typedef struct SXE_POOL_NODE {
     } last;
 } SXE_POOL_NODE;
 
+/* With SXE_POOL_OPTION_COMPACT_NODES, node metadata is kept in two parallel arrays instead: 32 bit next/prev indices and states,
+ * and last use times/counts. State queues are linked by index, so moves and age scans touch 20 bytes per element instead of 32.
+ */
+typedef struct SXE_POOL_COMPACT_LINK {
+    unsigned next;
+    unsigned prev;
+    unsigned state;    /* Kept with the links, since a walk checks the state of each element it steps from */
+} SXE_POOL_COMPACT_LINK;
+
+typedef struct SXE_POOL_COMPACT_QUEUE {
+    unsigned head;
+    unsigned tail;
+    unsigned length;
+} SXE_POOL_COMPACT_QUEUE;
+
+/* Each state queue of a concurrent pool other than state 0 has its own lock, padded to a cache line to avoid false sharing
+ */
+typedef struct SXE_POOL_STATE_LOCK {
+    volatile int lock;
+    char         pad[SXE_POOL_CACHE_LINE_SIZE - sizeof(int)];
+} SXE_POOL_STATE_LOCK;
+
+/* Extra state kept by SXE_POOL_OPTION_CONCURRENT pools. State 0 (the free state) is a lock-free stack of indices rather than a
+ * queue, so it is LIFO instead of oldest first; the top is tagged with a counter that changes on every push and pop to avoid ABA.
+ */
+typedef struct SXE_POOL_CONCURRENT {
+    volatile uint64_t   free_top;                 /* Tag in the high 32 bits, index of the top element in the low 32 bits */
+    char                pad1[SXE_POOL_CACHE_LINE_SIZE - sizeof(uint64_t)];
+    volatile unsigned   free_count;               /* Number of elements in state 0 */
+    char                pad2[SXE_POOL_CACHE_LINE_SIZE - sizeof(unsigned)];
+    volatile unsigned * free_next;                /* Per element index of the element below it on the free stack */
+    SXE_POOL_STATE_LOCK state_locks[];            /* Per state lock; the lock for state 0 is unused */
+} SXE_POOL_CONCURRENT;
+
+/* A per thread stack of free indices for SXE_POOL_OPTION_MAGAZINES pools. Only its owning thread touches it, so it needs no lock.
+ */
+typedef struct SXE_POOL_MAGAZINE {
+    unsigned count;
+    unsigned ids[SXE_POOL_MAGAZINE_SIZE];
+    char     pad[2 * SXE_POOL_CACHE_LINE_SIZE - (SXE_POOL_MAGAZINE_SIZE + 1) * sizeof(unsigned)];
+} SXE_POOL_MAGAZINE;
+
 typedef struct SXE_POOL_IMPL {
     SXE_SPINLOCK           spinlock;
     char                   name[SXE_POOL_NAME_MAXIMUM_LENGTH + 1];
     unsigned               options;
     unsigned               number;
+    unsigned               maximum;               /* Maximum number of objects; equal to number unless the pool is growable */
+    unsigned               segment;               /* Number of objects added at a time, or 0 if the pool is not growable     */
+    size_t                 reserved;              /* Bytes mapping was asked for by a growable or memory mapped pool, or 0   */
     size_t                 size;
     unsigned               states;
-    SXE_POOL_NODE        * nodes;
-    SXE_LIST             * queue;
+    SXE_POOL_NODE        * nodes;                 /* Compact pools: SXE_POOL_COMPACT_LINK array                              */
+    SXE_LIST             * queue;                 /* Compact pools: SXE_POOL_COMPACT_QUEUE array                             */
+    uint64_t             * compact_lasts;         /* Compact pools only: last use time or count of each object               */
     SXE_POOL_EVENT_TIMEOUT event_timeout;
     void                 * caller_info;
     SXE_TIME             * state_timeouts;
-    SXE_LIST_NODE          timeout_node;
+    unsigned               timeout_index;         /* Index of a pool with timeouts in the timeout heap                     */
+    SXE_TIME               timeout_deadline;      /* Heap key: no element of the pool can time out before this time        */
     uint64_t               next_count;
     const char *        (* state_to_string)(unsigned state);
+    SXE_POOL_CONCURRENT  * concurrent;            /* NULL unless the pool is a concurrent pool */
+    SXE_POOL_MAGAZINE    * magazines;             /* NULL unless the pool has per thread magazines */
+    SXE_POOL_STATE_STATS * stats;                 /* NULL unless the pool keeps statistics; one per state */
+    struct SXE_POOL_IMPL * stats_next;            /* Next pool in the list of pools that keep statistics */
+    struct SXE_POOL_IMPL * magazines_next;        /* Next pool in the list of pools with magazines */
 } SXE_POOL_IMPL;
 
+#define SXE_POOL_OPTION_IMAGE SXE_BIT_OPTION(23)    /* Internal: the pool is in an image that other processes may map */
+
+/* A pool's state_to_string is NULL unless the user sets one, so that a pool in an image never holds the address of a function in
+ * the process that created it
+ */
+#define SXE_POOL_STATE_TO_STRING(pool, state) \
+    ((pool)->state_to_string == NULL ? sxe_pool_state_to_string(state) : (*(pool)->state_to_string)(state))
+
+extern SXE_POOL_IMPL * sxe_pool_stats_pools;       /* List of pools with statistics, for sxe_pool_find_by_name() */
+extern SXE_SPINLOCK    sxe_pool_stats_pools_lock;
+extern SXE_POOL_IMPL * sxe_pool_magazine_pools;    /* List of pools with magazines, flushed by exiting threads */
+extern SXE_SPINLOCK    sxe_pool_magazine_pools_lock;
+
 static inline SXE_POOL_NODE *
 sxe_pool_node_from_list_node(SXE_LIST_NODE * list_node)
 {
     return (SXE_POOL_NODE *)(void *)((char *)list_node - offsetof(SXE_POOL_NODE, list_node));
 }
 
+/* Node metadata and state queue accessors; these hide the difference between the normal and compact layouts. They are not thread
+ * safe; callers must hold the pool lock if the pool has one. Concurrent pools are never compact.
+ */
+
+static inline unsigned
+sxe_pool_element_state(SXE_POOL_IMPL * pool, unsigned id)
+{
+    return SXE_POOL_IS_COMPACT(pool) ? SXE_POOL_COMPACT_LINKS(pool)[id].state : SXE_LIST_NODE_GET_ID(&SXE_POOL_NODES(pool)[id].list_node);
+}
+
+static inline uint64_t
+sxe_pool_element_last(SXE_POOL_IMPL * pool, unsigned id)
+{
+    return SXE_POOL_IS_COMPACT(pool) ? SXE_POOL_COMPACT_LASTS(pool)[id] : SXE_POOL_NODES(pool)[id].last.count;
+}
+
+static inline void
+sxe_pool_element_set_last(SXE_POOL_IMPL * pool, unsigned id, uint64_t last)
+{
+    if (SXE_POOL_IS_COMPACT(pool)) {
+        SXE_POOL_COMPACT_LASTS(pool)[id] = last;
+    }
+    else {
+        SXE_POOL_NODES(pool)[id].last.count = last;
+    }
+}
+
+/* Stamp an element with the current time (timed pools) or the next count
+ */
+static inline void
+sxe_pool_element_stamp(SXE_POOL_IMPL * pool, unsigned id)
+{
+    sxe_pool_element_set_last(pool, id, pool->options & SXE_POOL_OPTION_TIMED ? sxe_time_get() : ++pool->next_count);
+}
+
+/* Set the state of an element that is not on any state queue (for example, one held in a magazine)
+ */
+static inline void
+sxe_pool_element_set_state(SXE_POOL_IMPL * pool, unsigned id, unsigned state)
+{
+    if (SXE_POOL_IS_COMPACT(pool)) {
+        SXE_POOL_COMPACT_LINKS(pool)[id].state = state;
+    }
+    else {
+        SXE_POOL_NODES(pool)[id].list_node.id = state;
+    }
+}
+
+static inline unsigned
+sxe_pool_queue_length(SXE_POOL_IMPL * pool, unsigned state)
+{
+    return SXE_POOL_IS_COMPACT(pool) ? SXE_POOL_COMPACT_QUEUE(pool)[state].length
+                                     : SXE_LIST_GET_LENGTH(&SXE_POOL_QUEUE(pool)[state]);
+}
+
+/* Get the index of the oldest element in a state, or SXE_POOL_NO_INDEX if the state is empty
+ */
+static inline unsigned
+sxe_pool_queue_head(SXE_POOL_IMPL * pool, unsigned state)
+{
+    SXE_POOL_NODE * node;
+
+    if (SXE_POOL_IS_COMPACT(pool)) {
+        return SXE_POOL_COMPACT_QUEUE(pool)[state].head;
+    }
+
+    return (node = sxe_list_peek_head(&SXE_POOL_QUEUE(pool)[state])) == NULL ? SXE_POOL_NO_INDEX
+                                                                              : (unsigned)(node - SXE_POOL_NODES(pool));
+}
+
+/* Add an element to the tail of a state's queue
+ */
+static inline void
+sxe_pool_queue_push(SXE_POOL_IMPL * pool, unsigned state, unsigned id)
+{
+    SXE_POOL_COMPACT_QUEUE * queue;
+    SXE_POOL_COMPACT_LINK  * links;
+
+    if (!SXE_POOL_IS_COMPACT(pool)) {
+        sxe_list_push(&SXE_POOL_QUEUE(pool)[state], &SXE_POOL_NODES(pool)[id].list_node);
+        return;
+    }
+
+    queue                = &SXE_POOL_COMPACT_QUEUE(pool)[state];
+    links                = SXE_POOL_COMPACT_LINKS(pool);
+    links[id].next       = SXE_POOL_NO_INDEX;
+    links[id].prev       = queue->tail;
+
+    if (queue->tail == SXE_POOL_NO_INDEX) {
+        queue->head = id;
+    }
+    else {
+        links[queue->tail].next = id;
+    }
+
+    queue->tail                       = id;
+    SXE_POOL_COMPACT_LINKS(pool)[id].state = state;
+    queue->length++;
+}
+
+/* Remove an element from a state's queue
+ */
+static inline void
+sxe_pool_queue_remove(SXE_POOL_IMPL * pool, unsigned state, unsigned id)
+{
+    SXE_POOL_COMPACT_QUEUE * queue;
+    SXE_POOL_COMPACT_LINK  * links;
+
+    if (!SXE_POOL_IS_COMPACT(pool)) {
+        sxe_list_remove(&SXE_POOL_QUEUE(pool)[state], &SXE_POOL_NODES(pool)[id]);
+        return;
+    }
+
+    queue = &SXE_POOL_COMPACT_QUEUE(pool)[state];
+    links = SXE_POOL_COMPACT_LINKS(pool);
+    SXEA6(SXE_POOL_COMPACT_LINKS(pool)[id].state == state, "Element %u is in state %u, not %u", id, SXE_POOL_COMPACT_LINKS(pool)[id].state,
+          state);
+
+    if (links[id].prev == SXE_POOL_NO_INDEX) {
+        queue->head = links[id].next;
+    }
+    else {
+        links[links[id].prev].next = links[id].next;
+    }
+
+    if (links[id].next == SXE_POOL_NO_INDEX) {
+        queue->tail = links[id].prev;
+    }
+    else {
+        links[links[id].next].prev = links[id].prev;
+    }
+
+    queue->length--;
+}
+
+/* Remove the oldest element from a state's queue, returning its index or SXE_POOL_NO_INDEX if the state is empty
+ */
+static inline unsigned
+sxe_pool_queue_shift(SXE_POOL_IMPL * pool, unsigned state)
+{
+    unsigned id;
+
+    if ((id = sxe_pool_queue_head(pool, state)) != SXE_POOL_NO_INDEX) {
+        sxe_pool_queue_remove(pool, state, id);
+    }
+
+    return id;
+}
+
+/* Statistics are only kept for pools with SXE_POOL_OPTION_STATS. Callers must hold the pool lock if the pool has one.
+ */
+
+static inline void
+sxe_pool_stats_leave(SXE_POOL_IMPL * pool, unsigned state, unsigned id)
+{
+    SXE_TIME dwell;
+    unsigned bucket = 0;
+
+    pool->stats[state].left++;
+
+    if (pool->options & SXE_POOL_OPTION_TIMED) {
+        if ((dwell = sxe_time_get() - sxe_pool_element_last(pool, id)) >= (SXE_TIME_1_SEC >> 10)) {
+            bucket = 63 - __builtin_clzll(dwell) - (SXE_TIME_BITS_IN_FRACTION - 11);
+            bucket = bucket < SXE_POOL_STATS_DWELL_BUCKETS ? bucket : SXE_POOL_STATS_DWELL_BUCKETS - 1;
+        }
+
+        pool->stats[state].dwell[bucket]++;
+    }
+}
+
+static inline void
+sxe_pool_stats_enter(SXE_POOL_IMPL * pool, unsigned state, unsigned count)
+{
+    pool->stats[state].entered += count;
+
+    if (sxe_pool_queue_length(pool, state) > pool->stats[state].high_water) {
+        pool->stats[state].high_water = sxe_pool_queue_length(pool, state);
+    }
+}
+
 /* Locking primitives - danger Will Robinson! */
 
 static inline unsigned
@@ -97,6 +359,33 @@ sxe_pool_unlock(SXE_POOL_IMPL * pool)
     SXER6("return");
 }
 
+/* Per state locking for concurrent pools. Critical sections are a few pointer updates, so spin for a while before yielding; the
+ * yield only matters when the holder has been preempted.
+ */
+static inline void
+sxe_pool_state_lock(SXE_POOL_IMPL * pool, unsigned state)
+{
+    volatile int * lock = &pool->concurrent->state_locks[state].lock;
+    unsigned       spins;
+
+    while (__sync_lock_test_and_set(lock, 1)) {
+        for (spins = 0; *lock; spins++) {
+            if (spins < SXE_POOL_SPINS_BEFORE_YIELD) {
+                SXE_POOL_PAUSE();
+            }
+            else {
+                SXE_YIELD();
+            }
+        }
+    }
+}
+
+static inline void
+sxe_pool_state_unlock(SXE_POOL_IMPL * pool, unsigned state)
+{
+    __sync_lock_release(&pool->concurrent->state_locks[state].lock);
+}
+
 static inline const char *
 sxe_pool_return_to_string(unsigned result)
 {
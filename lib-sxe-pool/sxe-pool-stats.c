@@ -0,0 +1,194 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+/* Per state statistics for pools created with SXE_POOL_OPTION_STATS: high water marks, numbers of moves in and out of each state
+ * and, for timed pools, histograms of how long elements stay in each state. These are for sizing pools and finding leaks or
+ * stuck states, so they are cheap enough to leave on in production.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sxe-log.h"
+#include "sxe-pool-private.h"
+
+/* Append to buffer, keeping track of the length the text would have if it were not truncated
+ */
+#define SXE_POOL_FORMAT(...) (length += snprintf(buffer + (length < size ? length : size), length < size ? size - length : 0, \
+                                                 __VA_ARGS__))
+
+SXE_POOL_IMPL * sxe_pool_stats_pools      = NULL;
+SXE_SPINLOCK    sxe_pool_stats_pools_lock = {0};
+
+/**
+ * Find a pool that keeps statistics by name
+ *
+ * @param name Name of the pool
+ *
+ * @return A pointer to the pool array, or NULL if there is no pool with that name created with SXE_POOL_OPTION_STATS
+ */
+void *
+sxe_pool_find_by_name(const char * name)
+{
+    SXE_POOL_IMPL * pool;
+    void          * array = NULL;
+
+    SXEE6("(name=%s)", name);
+    sxe_spinlock_take(&sxe_pool_stats_pools_lock);
+
+    for (pool = sxe_pool_stats_pools; pool != NULL; pool = pool->stats_next) {
+        if (strcmp(pool->name, name) == 0) {
+            array = SXE_POOL_IMPL_TO_ARRAY(pool);
+            break;
+        }
+    }
+
+    sxe_spinlock_give(&sxe_pool_stats_pools_lock);
+    SXER6("return array=%p", array);
+    return array;
+}
+
+/**
+ * Get a copy of the statistics for a state of a pool
+ *
+ * @param array Pointer to the pool array; the pool must have been created with SXE_POOL_OPTION_STATS
+ * @param state State to get the statistics of
+ * @param stats Pointer to the structure to copy the statistics into
+ *
+ * @return SXE_POOL_LOCK_TAKEN or SXE_POOL_LOCK_NOT_TAKEN
+ */
+unsigned
+sxe_pool_get_state_stats(void * array, unsigned state, SXE_POOL_STATE_STATS * stats)
+{
+    SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+    unsigned        result;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s,state=%s,stats=%p)", pool->name, SXE_POOL_STATE_TO_STRING(pool, state), stats);
+    SXEA1(pool->stats != NULL, "Pool %s doesn't keep statistics", pool->name);
+    SXEA6(state < pool->states, "state %u is not less than the number of states %u for pool %s", state, pool->states, pool->name);
+
+    if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
+        goto SXE_ERROR_OUT;    /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    memcpy(stats, &pool->stats[state], sizeof(*stats));
+    sxe_pool_unlock(pool);
+
+SXE_ERROR_OUT:
+    SXER6("return %s", sxe_pool_return_to_string(result));
+    return result;
+}
+
+/**
+ * Reset the statistics of a pool; high water marks are reset to the number of elements currently in each state
+ *
+ * @return SXE_POOL_LOCK_TAKEN or SXE_POOL_LOCK_NOT_TAKEN
+ */
+unsigned
+sxe_pool_reset_stats(void * array)
+{
+    SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+    unsigned        result;
+    unsigned        state;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s)", pool->name);
+    SXEA1(pool->stats != NULL, "Pool %s doesn't keep statistics", pool->name);
+
+    if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
+        goto SXE_ERROR_OUT;    /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    memset(pool->stats, 0, pool->states * sizeof(*pool->stats));
+
+    for (state = 0; state < pool->states; state++) {
+        pool->stats[state].high_water = sxe_pool_queue_length(pool, state);
+    }
+
+    sxe_pool_unlock(pool);
+
+SXE_ERROR_OUT:
+    SXER6("return %s", sxe_pool_return_to_string(result));
+    return result;
+}
+
+/**
+ * Format the statistics of a pool as text, one line per state
+ *
+ * @param array  Pointer to the pool array; the pool must have been created with SXE_POOL_OPTION_STATS
+ * @param buffer Buffer to format into; always '\0' terminated
+ * @param size   Size of the buffer
+ *
+ * @return The length of the text, which was truncated if it is not less than size (like snprintf), or 0 if the lock was not taken
+ *
+ * @note Each line has the form "<pool> <state>: count=<n> high_water=<n> entered=<n> left=<n>". Timed pools add
+ *       "dwell=<n>/<n>/..." with the counts in each dwell time bucket, up to the last one that isn't empty (see
+ *       SXE_POOL_STATS_DWELL_BUCKETS).
+ */
+size_t
+sxe_pool_format_stats(void * array, char * buffer, size_t size)
+{
+    SXE_POOL_IMPL        * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+    SXE_POOL_STATE_STATS * stats;
+    size_t                 length = 0;
+    unsigned               state;
+    unsigned               buckets;
+    unsigned               i;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s,buffer=%p,size=%zu)", pool->name, buffer, size);
+    SXEA1(pool->stats != NULL, "Pool %s doesn't keep statistics", pool->name);
+
+    if (size > 0) {
+        buffer[0] = '\0';
+    }
+
+    if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
+        goto SXE_ERROR_OUT;    /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    for (state = 0; state < pool->states; state++) {
+        stats = &pool->stats[state];
+        SXE_POOL_FORMAT("%s %s: count=%u high_water=%u entered=%" PRIu64 " left=%" PRIu64, pool->name,
+                        SXE_POOL_STATE_TO_STRING(pool, state), sxe_pool_queue_length(pool, state), stats->high_water,
+                        stats->entered, stats->left);
+
+        if (pool->options & SXE_POOL_OPTION_TIMED) {
+            for (buckets = SXE_POOL_STATS_DWELL_BUCKETS; buckets > 1 && stats->dwell[buckets - 1] == 0; buckets--) {
+            }
+
+            for (i = 0; i < buckets; i++) {
+                SXE_POOL_FORMAT("%s%" PRIu64, i == 0 ? " dwell=" : "/", stats->dwell[i]);
+            }
+        }
+
+        SXE_POOL_FORMAT("\n");
+    }
+
+    sxe_pool_unlock(pool);
+
+SXE_ERROR_OUT:
+    SXER6("return %zu", length);
+    return length;
+}
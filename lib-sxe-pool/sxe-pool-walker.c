@@ -28,19 +28,26 @@
  * @param array  Pointer to the pool array
  * @param state  State to walk
  *
- * @exception If the pool is both locked and timed, it cannot be walked safely
+ * @exception If the pool is both locked (or concurrent) and timed, it cannot be walked safely
+ * @exception The free state (0) of a concurrent pool is a stack and cannot be walked
  */
 void
 sxe_pool_walker_construct(SXE_POOL_WALKER * walker, void * array, unsigned state)
 {
     SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
 
-    SXEE6("sxe_pool_walker_construct(walker=%p,pool=%s,state=%s)", walker, pool->name, (*pool->state_to_string)(state));
-    SXEA1(!((pool->options & SXE_POOL_OPTION_LOCKED) && (pool->options & SXE_POOL_OPTION_TIMED)),
+    SXEE6("sxe_pool_walker_construct(walker=%p,pool=%s,state=%s)", walker, pool->name, SXE_POOL_STATE_TO_STRING(pool, state));
+    SXEA1(!((pool->options & (SXE_POOL_OPTION_LOCKED | SXE_POOL_OPTION_CONCURRENT)) && (pool->options & SXE_POOL_OPTION_TIMED)),
            "sxe_pool_walker_construct: Can't walk thread safe timed pool %s safely", pool->name);
-    sxe_list_walker_construct(&walker->list_walker, &SXE_POOL_QUEUE(pool)[state]);
+    SXEA1(pool->concurrent == NULL || state != 0, "sxe_pool_walker_construct: Can't walk the free state of concurrent pool %s",
+          pool->name);
     walker->pool  = pool;
     walker->state = state;
+    walker->id    = SXE_POOL_NO_INDEX;
+
+    if (!SXE_POOL_IS_COMPACT(pool)) {
+        sxe_list_walker_construct(&walker->list_walker, &SXE_POOL_QUEUE(pool)[state]);
+    }
 
     if (pool->options & SXE_POOL_OPTION_TIMED) {
         walker->last.time  = 0.0;
@@ -52,6 +59,39 @@ sxe_pool_walker_construct(SXE_POOL_WALKER * walker, void * array, unsigned state
     SXER6("return");
 }
 
+/* Step a walker over a compact pool; called with the pool locked. Same semantics as the list walk in sxe_pool_walker_step().
+ */
+static unsigned
+sxe_pool_walker_step_compact(SXE_POOL_WALKER * walker)
+{
+    SXE_POOL_IMPL * pool = walker->pool;
+    unsigned        id   = walker->id;
+
+    if (id == SXE_POOL_NO_INDEX) {
+        id = SXE_POOL_COMPACT_QUEUE(pool)[walker->state].head;
+    }
+    else if (SXE_POOL_COMPACT_LINKS(pool)[id].state == walker->state) {
+        id = SXE_POOL_COMPACT_LINKS(pool)[id].next;
+    }
+    else {
+        SXEL6("sxe_pool_walker_step: node %u moved from state %s to state %s by another thread", id,
+               SXE_POOL_STATE_TO_STRING(pool, walker->state),
+               SXE_POOL_STATE_TO_STRING(pool, SXE_POOL_COMPACT_LINKS(pool)[id].state));
+
+        for (id = SXE_POOL_COMPACT_QUEUE(pool)[walker->state].head;
+             id != SXE_POOL_NO_INDEX && SXE_POOL_COMPACT_LASTS(pool)[id] < walker->last.count;
+             id = SXE_POOL_COMPACT_LINKS(pool)[id].next) {
+        }
+    }
+
+    if (id != SXE_POOL_NO_INDEX) {
+        walker->id         = id;
+        walker->last.count = SXE_POOL_COMPACT_LASTS(pool)[id];
+    }
+
+    return id;
+}
+
 /**
  * Step to the next object in a pool state
  *
@@ -76,6 +116,16 @@ sxe_pool_walker_step(SXE_POOL_WALKER * walker)
         goto SXE_ERROR_OUT;
     }
 
+    if (SXE_POOL_IS_COMPACT(pool)) {
+        result = sxe_pool_walker_step_compact(walker);
+        sxe_pool_unlock(pool);
+        goto SXE_ERROR_OUT;
+    }
+
+    if (pool->concurrent != NULL) {
+        sxe_pool_state_lock(pool, walker->state);
+    }
+
     /* If not at the head of the state queue and the current object has been moved to another state.
      */
     if (((node = sxe_list_walker_find(&walker->list_walker)) != NULL)
@@ -83,7 +133,8 @@ sxe_pool_walker_step(SXE_POOL_WALKER * walker)
      /* TODO: Check for touching */
     {
         SXEL6("sxe_pool_walker_step: node %td moved from state %s to state %s by another thread", node - SXE_POOL_NODES(pool),
-               (*pool->state_to_string)(walker->state), (*pool->state_to_string)(SXE_LIST_NODE_GET_ID(&node->list_node)));
+               SXE_POOL_STATE_TO_STRING(pool, walker->state),
+               SXE_POOL_STATE_TO_STRING(pool, SXE_LIST_NODE_GET_ID(&node->list_node)));
 
         /* If there is a previous object and it has not been moved, get the new next one.
          */
@@ -127,6 +178,10 @@ sxe_pool_walker_step(SXE_POOL_WALKER * walker)
         }
     }
 
+    if (pool->concurrent != NULL) {
+        sxe_pool_state_unlock(pool, walker->state);
+    }
+
     sxe_pool_unlock(pool);
 
 SXE_ERROR_OUT:
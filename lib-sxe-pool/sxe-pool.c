@@ -35,14 +35,19 @@
 
 #define SXE_POOL_ON_INCORRECT_STATE_RETURN_FALSE 0
 #define SXE_POOL_ON_INCORRECT_STATE_ABORT        1
-#define SXE_POOL_ASSERT_ARRAY_INITIALIZED(array) SXEA6((array) != NULL, "%s(array=NULL): Uninitialized pool?", __func__)
 
-static SXE_LIST sxe_pool_timeout_list;
-static unsigned sxe_pool_timeout_count = 0;
+#define SXE_POOL_TIMEOUT_NEVER (~(SXE_TIME)0)
+
+/* Pools with timeouts are kept in a min-heap ordered by deadline. A pool's deadline may be earlier than the time its oldest element
+ * will actually time out (for example, if that element has since changed state), but is never later.
+ */
+static SXE_POOL_IMPL ** sxe_pool_timeout_heap          = NULL;
+static unsigned         sxe_pool_timeout_count         = 0;
+static unsigned         sxe_pool_timeout_heap_capacity = 0;
 
 /* Diagnostic function to convert state to string if none is supplied by the user
  */
-static const char *
+const char *
 sxe_pool_state_to_string(unsigned state)                                /* Coverage Exclusion: Only called in debug mode */
 {                                                                       /* Coverage Exclusion: Only called in debug mode */
 #define MAX_NUMBER_AS_STRING_LENGTH  12
@@ -57,6 +62,16 @@ sxe_pool_state_to_string(unsigned state)                                /* Cover
     return result;                                                      /* Coverage Exclusion: Only called in debug mode */
 }
 
+/**
+ * Get the number of objects in a pool; for a growable pool, this is the number constructed so far
+ */
+unsigned
+sxe_pool_get_number(void * array)
+{
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    return SXE_POOL_ARRAY_TO_IMPL(array)->number;
+}
+
 const char *
 sxe_pool_get_name(void * array)
 {
@@ -72,8 +87,8 @@ sxe_pool_get_number_in_state(void * array, unsigned state)
     unsigned        count;
 
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
-    SXEE6("sxe_pool_get_number_in_state(pool=%s,state=%s)", pool->name, (*pool->state_to_string)(state));
-    count = SXE_LIST_GET_LENGTH(&SXE_POOL_QUEUE(pool)[state]);
+    SXEE6("sxe_pool_get_number_in_state(pool=%s,state=%s)", pool->name, SXE_POOL_STATE_TO_STRING(pool, state));
+    count = (pool->concurrent != NULL && state == 0) ? pool->concurrent->free_count : sxe_pool_queue_length(pool, state);
     SXER6("return %u", count);
     return count;
 }
@@ -87,8 +102,8 @@ sxe_pool_index_to_state(void * array, unsigned id)
     SXEE6("sxe_pool_index_to_state(name=%s,id=%u)", pool->name, id);
     SXEA1(id < pool->number, "sxe_pool_index_to_state(pool=%s,id=%u): Index is too big for pool (max index=%u)",
            pool->name, id, pool->number);
-    state = SXE_LIST_NODE_GET_ID(&SXE_POOL_NODES(pool)[id].list_node);
-    SXER6("return %s", (*pool->state_to_string)(state));
+    state = sxe_pool_element_state(pool, id);
+    SXER6("return %s", SXE_POOL_STATE_TO_STRING(pool, state));
     return state;
 }
 
@@ -112,26 +127,20 @@ sxe_pool_size(unsigned number, size_t size, unsigned states)
     return pool_size;
 }
 
-/**
- * Construct a new pool of <number> objects of size <size> with <states> states
- *
- * @param options = SXE_POOL_OPTION_LOCKED for thread safety
- *                  SXE_POOL_OPTION_TIMED  to keep the time of last insertion for each node
- *
- * @return A pointer to the array of objects
- *
- * @note   The base pointer must point at a region of memory big enough to hold the pool size (see sxe_pool_size())
+/* Construct a pool laid out for <capacity> objects, of which the first <number> are initialized and put in the free state
  */
-void *
-sxe_pool_construct(void * base, const char * name, unsigned number, size_t size, unsigned states, unsigned options)
+static void *
+sxe_pool_construct_impl(void * base, const char * name, unsigned number, unsigned capacity, size_t size, unsigned states,
+                        unsigned options)
 {
     SXE_POOL_IMPL * pool;
     unsigned        i;
     SXE_LOG_LEVEL   log_level_saved;
     SXE_TIME        current_time = 0;    /* Initialize to shut the compiler up */
+    uintptr_t       offset;
 
-    SXEE6("sxe_pool_construct(base=%p,name=%s,number=%u,size=%"PRIuPTR",states=%u,options=%u)",
-          base, name, number, size, states, options);
+    SXEE6("sxe_pool_construct(base=%p,name=%s,number=%u,capacity=%u,size=%"PRIuPTR",states=%u,options=%u)",
+          base, name, number, capacity, size, states, options);
     SXEL6("Constructing pool: %16s: %10zu byte pool structure", name, sizeof(SXE_POOL_IMPL));
     SXEL6("Constructing pool: %16s: %10"PRIuPTR" bytes = %10u * %10"PRIuPTR" byte objects", name, size * number, number, size);
     SXEL6("Constructing pool: %16s: %10zu bytes = %10u * %10zu byte state queue heads",
@@ -140,19 +149,70 @@ sxe_pool_construct(void * base, const char * name, unsigned number, size_t size,
            name, sizeof(SXE_POOL_NODE)* number, number, sizeof(SXE_POOL_NODE));
 
     pool                  = (SXE_POOL_IMPL *)base;
-    pool->queue           = (SXE_LIST      *)(sizeof(SXE_POOL_IMPL) + number * size);
-    pool->nodes           = (SXE_POOL_NODE *)(sizeof(SXE_POOL_IMPL) + number * size + states * sizeof(SXE_LIST));
+    pool->queue           = (SXE_LIST      *)(sizeof(SXE_POOL_IMPL) + capacity * size);
+    pool->nodes           = (SXE_POOL_NODE *)(sizeof(SXE_POOL_IMPL) + capacity * size + states * sizeof(SXE_LIST));
     pool->number          = number;
+    pool->maximum         = number;
+    pool->segment         = 0;
+    pool->reserved        = 0;
     pool->size            = size;
     pool->states          = states;
     pool->options         = options;
-    pool->state_to_string = &sxe_pool_state_to_string;    // Default to just printing the number
+    pool->state_to_string = NULL;                         // Default to just printing the number
     pool->state_timeouts  = NULL;                         // If set, this pointer will be freed by the delete
+    pool->concurrent      = NULL;
+    pool->magazines       = NULL;
+    pool->stats           = NULL;
+
+    if (options & SXE_POOL_OPTION_COMPACT_NODES) {    /* Fits within sxe_pool_size(), which is sized for normal nodes */
+        SXEA1(!(options & SXE_POOL_OPTION_CONCURRENT), "Pool %s can't be both concurrent and compact", name);
+        offset                = sizeof(SXE_POOL_IMPL) + capacity * size;
+        pool->queue           = (SXE_LIST *)offset;
+        offset               += states * sizeof(SXE_POOL_COMPACT_QUEUE);
+        pool->nodes           = (SXE_POOL_NODE *)offset;
+        offset               += capacity * sizeof(SXE_POOL_COMPACT_LINK);
+        pool->compact_lasts   = (uint64_t *)((offset + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1));
+    }
 
     if (options & SXE_POOL_OPTION_LOCKED) {
         sxe_spinlock_construct(&pool->spinlock);
     }
 
+    if (options & SXE_POOL_OPTION_CONCURRENT) {
+        SXEA1(!(options & SXE_POOL_OPTION_LOCKED), "Pool %s can't be both locked and concurrent", name);
+        pool->concurrent = sxe_malloc(sizeof(SXE_POOL_CONCURRENT) + states * sizeof(SXE_POOL_STATE_LOCK));
+        SXEA1(pool->concurrent != NULL, "Error allocating SXE pool %s; concurrent state", name);
+        pool->concurrent->free_next = sxe_malloc(number * sizeof(unsigned));
+        SXEA1(pool->concurrent->free_next != NULL, "Error allocating SXE pool %s; free stack", name);
+        pool->concurrent->free_top   = number == 0 ? SXE_POOL_NO_INDEX : 0;
+        pool->concurrent->free_count = number;
+
+        for (i = 0; i < states; i++) {
+            pool->concurrent->state_locks[i].lock = 0;
+        }
+    }
+
+    if (options & SXE_POOL_OPTION_MAGAZINES) {
+        SXEA1(options & SXE_POOL_OPTION_LOCKED, "Pool %s must be locked to have magazines", name);
+        pool->magazines = sxe_calloc(SXE_POOL_MAGAZINE_THREADS, sizeof(SXE_POOL_MAGAZINE));
+        SXEA1(pool->magazines != NULL, "Error allocating SXE pool %s; magazines", name);
+        sxe_spinlock_take(&sxe_pool_magazine_pools_lock);
+        pool->magazines_next    = sxe_pool_magazine_pools;
+        sxe_pool_magazine_pools = pool;
+        sxe_spinlock_give(&sxe_pool_magazine_pools_lock);
+    }
+
+    if (options & SXE_POOL_OPTION_STATS) {
+        SXEA1(!(options & SXE_POOL_OPTION_CONCURRENT), "Pool %s can't be both concurrent and keep statistics", name);
+        SXEA1((pool->stats = sxe_calloc(states, sizeof(SXE_POOL_STATE_STATS))) != NULL, "Error allocating SXE pool %s; stats",
+              name);
+        pool->stats[0].high_water = number;
+        sxe_spinlock_take(&sxe_pool_stats_pools_lock);
+        pool->stats_next          = sxe_pool_stats_pools;
+        sxe_pool_stats_pools      = pool;
+        sxe_spinlock_give(&sxe_pool_stats_pools_lock);
+    }
+
     strncpy(pool->name, name, sizeof(pool->name));
     pool->name[sizeof(pool->name) - 1] = '\0';
     pool->event_timeout                = NULL;
@@ -162,6 +222,13 @@ sxe_pool_construct(void * base, const char * name, unsigned number, size_t size,
 #endif
 
     for (i = states; i-- > 0; ) {
+        if (options & SXE_POOL_OPTION_COMPACT_NODES) {
+            SXE_POOL_COMPACT_QUEUE(pool)[i].head   = SXE_POOL_NO_INDEX;
+            SXE_POOL_COMPACT_QUEUE(pool)[i].tail   = SXE_POOL_NO_INDEX;
+            SXE_POOL_COMPACT_QUEUE(pool)[i].length = 0;
+            continue;
+        }
+
         SXE_LIST_CONSTRUCT(&SXE_POOL_QUEUE(pool)[i], i, SXE_POOL_NODE, list_node);
     }
 
@@ -177,14 +244,15 @@ sxe_pool_construct(void * base, const char * name, unsigned number, size_t size,
     }
 
     for (i = number; i-- > 0; ) {
-        if (options & SXE_POOL_OPTION_TIMED) {
-            SXE_POOL_NODES(pool)[i].last.time  = current_time;
-        }
-        else {
-            SXE_POOL_NODES(pool)[i].last.count = ++pool->next_count;
+        sxe_pool_element_set_last(pool, i, options & SXE_POOL_OPTION_TIMED ? current_time : ++pool->next_count);
+
+        if (pool->concurrent != NULL) {    /* Stack the free elements so that element 0 is on top */
+            SXE_POOL_NODES(pool)[i].list_node.id = 0;
+            pool->concurrent->free_next[i]       = i + 1 < number ? i + 1 : SXE_POOL_NO_INDEX;
+            continue;
         }
 
-        sxe_list_push(&SXE_POOL_QUEUE(pool)[0], &SXE_POOL_NODES(pool)[i].list_node);
+        sxe_pool_queue_push(pool, 0, i);
     }
 
     sxe_log_set_level(log_level_saved);
@@ -192,6 +260,28 @@ sxe_pool_construct(void * base, const char * name, unsigned number, size_t size,
     return pool + 1;
 }
 
+/**
+ * Construct a new pool of <number> objects of size <size> with <states> states
+ *
+ * @param options = SXE_POOL_OPTION_LOCKED     for thread safety
+ *                  SXE_POOL_OPTION_CONCURRENT for thread safety with less contention (see sxe_pool_new())
+ *                  SXE_POOL_OPTION_TIMED      to keep the time of last insertion for each node
+ *                  SXE_POOL_OPTION_MAGAZINES  with SXE_POOL_OPTION_LOCKED to support sxe_pool_magazine_take()
+ *                  SXE_POOL_OPTION_STATS      to keep per state statistics (see sxe_pool_get_state_stats())
+ *
+ * @return A pointer to the array of objects
+ *
+ * @note   The base pointer must point at a region of memory big enough to hold the pool size (see sxe_pool_size())
+ *
+ * @note   The extra state of a concurrent pool or a pool with magazines is allocated separately, so such pools can't be shared
+ *         between processes
+ */
+void *
+sxe_pool_construct(void * base, const char * name, unsigned number, size_t size, unsigned states, unsigned options)
+{
+    return sxe_pool_construct_impl(base, name, number, number, size, states, options);
+}
+
 /**
  * Get the a pointer to a pool from a base pointer; this can be used to get at the array in a memory mapped pool
  *
@@ -231,12 +321,20 @@ sxe_pool_to_base(void * array)
  * @param number  Number of elements in the pool
  * @param size    Size of each element in the pool
  * @param states  Number of states each element can be in
- * @param options SXE_POOL_OPTION_UNLOCKED for speed or SXE_POOL_OPTION_LOCKED for thread safety, and SXE_POOL_OPTION_TIMED to
- *                support timed operations; bit mask, combined with | operator
+ * @param options SXE_POOL_OPTION_UNLOCKED for speed or SXE_POOL_OPTION_LOCKED or SXE_POOL_OPTION_CONCURRENT for thread safety,
+ *                and SXE_POOL_OPTION_TIMED to support timed operations; bit mask, combined with | operator. Large pools can be
+ *                mapped with SXE_POOL_OPTION_HUGE_PAGES or SXE_POOL_OPTION_HUGE_PAGES_1G, bound to a NUMA node with
+ *                SXE_POOL_OPTION_NUMA_NODE(node) and faulted in up front with SXE_POOL_OPTION_PREFAULT (see sxe_pool_memory_map()).
  *
  * @return A pointer to the array of objects
  *
  * @exception Aborts on failure to allocate memory
+ *
+ * @note A locked pool serializes every operation behind one lock. A concurrent pool keeps state 0 (the free state) in a
+ *       lock-free stack and gives every other state its own lock, so threads taking and giving back elements rarely contend.
+ *       In exchange, state 0 is LIFO rather than oldest first, and elements can only be taken out of it with
+ *       sxe_pool_set_oldest_element_state(). The other states keep their oldest first order. A locked pool can also be given
+ *       per thread magazines of free elements with SXE_POOL_OPTION_MAGAZINES (see sxe_pool_magazine_take()).
  */
 void *
 sxe_pool_new(const char * name, unsigned number, size_t size, unsigned states, unsigned options)
@@ -246,9 +344,16 @@ sxe_pool_new(const char * name, unsigned number, size_t size, unsigned states, u
 
     SXEE6("sxe_pool_new(name=%s,number=%u,size=%"PRIiPTR",states=%u,options=%sSXE_POOL_OPTION_LOCKED|%sSXE_POOL_OPTION_TIMED)",
           name, number, size, states, options & SXE_POOL_OPTION_LOCKED ? "" : "!", options & SXE_POOL_OPTION_TIMED ? "" : "!");
-    SXEA1((base = sxe_malloc(sxe_pool_size(number, size, states))) != NULL, "Error allocating SXE pool %s", name);
-
-    array = sxe_pool_construct(base, name, number, size, states, options);
+    if (options & SXE_POOL_OPTIONS_MEMORY) {
+        SXEA1((base = sxe_pool_memory_map(sxe_pool_size(number, size, states), options, false)) != NULL,
+              "Error mapping SXE pool %s", name);
+        array = sxe_pool_construct(base, name, number, size, states, options);
+        SXE_POOL_ARRAY_TO_IMPL(array)->reserved = sxe_pool_size(number, size, states);
+    }
+    else {
+        SXEA1((base = sxe_malloc(sxe_pool_size(number, size, states))) != NULL, "Error allocating SXE pool %s", name);
+        array = sxe_pool_construct(base, name, number, size, states, options);
+    }
 
 #if SXE_DEBUG
     SXE_POOL_IMPL * pool  = SXE_POOL_ARRAY_TO_IMPL(array);
@@ -258,6 +363,92 @@ sxe_pool_new(const char * name, unsigned number, size_t size, unsigned states, u
     return array;
 }
 
+static inline void
+sxe_pool_timeout_heap_set(unsigned index, SXE_POOL_IMPL * pool)
+{
+    sxe_pool_timeout_heap[index] = pool;
+    pool->timeout_index          = index;
+}
+
+/* Change the deadline of a pool in the timeout heap, moving it up or down to its new place
+ */
+static void
+sxe_pool_timeout_heap_update(SXE_POOL_IMPL * pool, SXE_TIME deadline)
+{
+    unsigned index = pool->timeout_index;
+    unsigned child;
+
+    pool->timeout_deadline = deadline;
+
+    while (index > 0 && sxe_pool_timeout_heap[(index - 1) / 2]->timeout_deadline > deadline) {
+        sxe_pool_timeout_heap_set(index, sxe_pool_timeout_heap[(index - 1) / 2]);
+        index = (index - 1) / 2;
+    }
+
+    while ((child = 2 * index + 1) < sxe_pool_timeout_count) {
+        if (child + 1 < sxe_pool_timeout_count
+         && sxe_pool_timeout_heap[child + 1]->timeout_deadline < sxe_pool_timeout_heap[child]->timeout_deadline) {
+            child++;
+        }
+
+        if (sxe_pool_timeout_heap[child]->timeout_deadline >= deadline) {
+            break;
+        }
+
+        sxe_pool_timeout_heap_set(index, sxe_pool_timeout_heap[child]);
+        index = child;
+    }
+
+    sxe_pool_timeout_heap_set(index, pool);
+}
+
+static void
+sxe_pool_timeout_heap_remove(SXE_POOL_IMPL * pool)
+{
+    SXE_POOL_IMPL * last = sxe_pool_timeout_heap[--sxe_pool_timeout_count];
+
+    if (last != pool) {
+        sxe_pool_timeout_heap_set(pool->timeout_index, last);
+        sxe_pool_timeout_heap_update(last, last->timeout_deadline);
+    }
+
+    if (sxe_pool_timeout_count == 0) {
+        sxe_free(sxe_pool_timeout_heap);
+        sxe_pool_timeout_heap          = NULL;
+        sxe_pool_timeout_heap_capacity = 0;
+    }
+}
+
+/* Compute when the oldest element in any state of a pool with timeouts will time out
+ */
+static SXE_TIME
+sxe_pool_timeout_next_deadline(SXE_POOL_IMPL * pool)
+{
+    SXE_TIME        deadline = SXE_POOL_TIMEOUT_NEVER;
+    unsigned        state;
+    unsigned        id;
+
+    for (state = 0; state < pool->states; state++) {
+        if (pool->state_timeouts[state] != 0 && (id = sxe_pool_queue_head(pool, state)) != SXE_POOL_NO_INDEX
+         && sxe_pool_element_last(pool, id) + pool->state_timeouts[state] < deadline) {
+            deadline = sxe_pool_element_last(pool, id) + pool->state_timeouts[state];
+        }
+    }
+
+    return deadline;
+}
+
+/* Called when an element of a pool with timeouts enters a state at the given time; if it becomes the first element that can time
+ * out, bring the pool's deadline forward
+ */
+static inline void
+sxe_pool_timeout_element_entered(SXE_POOL_IMPL * pool, unsigned state, SXE_TIME time)
+{
+    if (pool->state_timeouts[state] != 0 && time + pool->state_timeouts[state] < pool->timeout_deadline) {
+        sxe_pool_timeout_heap_update(pool, time + pool->state_timeouts[state]);
+    }
+}
+
 /**
  *  @note   Pools with timeouts are not currently relocatable or thread safe.
  */
@@ -279,12 +470,6 @@ sxe_pool_new_with_timeouts(
            name, number, size, states, timeouts, callback, caller_info);
     SXEA1(callback != NULL, "Internal: timeout callback must be a real address of a function");
 
-    /* If it feels like the first time...
-     */
-    if (sxe_pool_timeout_count == 0) {
-        SXE_LIST_CONSTRUCT(&sxe_pool_timeout_list, 0, SXE_POOL_IMPL, timeout_node);
-    }
-
     array                = sxe_pool_new(name, number, size, states, SXE_POOL_OPTION_TIMED);
     pool                 = SXE_POOL_ARRAY_TO_IMPL(array);
     pool->event_timeout  = callback;
@@ -299,8 +484,16 @@ sxe_pool_new_with_timeouts(
         pool->state_timeouts[i] = sxe_time_from_double_seconds(timeouts[i]);
     }
 
-    sxe_list_push(&sxe_pool_timeout_list, pool);
-    sxe_pool_timeout_count++;
+    if (sxe_pool_timeout_count == sxe_pool_timeout_heap_capacity) {
+        sxe_pool_timeout_heap_capacity = sxe_pool_timeout_heap_capacity == 0 ? 16 : 2 * sxe_pool_timeout_heap_capacity;
+        sxe_pool_timeout_heap          = sxe_realloc(sxe_pool_timeout_heap,
+                                                     sxe_pool_timeout_heap_capacity * sizeof(*sxe_pool_timeout_heap));
+        SXEA1(sxe_pool_timeout_heap != NULL, "Error allocating SXE pool %s; timeout heap of %u pools", name,
+              sxe_pool_timeout_heap_capacity);
+    }
+
+    pool->timeout_index = sxe_pool_timeout_count++;
+    sxe_pool_timeout_heap_update(pool, sxe_pool_timeout_next_deadline(pool));
 
     /* TODO: need sxe_pool_construct_with_timeouts() for pools with timeouts using spinlocks */
 
@@ -308,76 +501,504 @@ sxe_pool_new_with_timeouts(
     return array;
 }
 
+/* Construct the next segment of objects of a growable pool and add them to the tail of the free state, lowest index first. The
+ * caller must hold the pool lock.
+ *
+ * @return The number of objects added, which is 0 if the pool is at its maximum
+ */
+static unsigned
+sxe_pool_grow_locked(SXE_POOL_IMPL * pool)
+{
+    unsigned first = pool->number;
+    unsigned last  = pool->maximum - first < pool->segment ? pool->maximum : first + pool->segment;
+    unsigned i;
+
+    SXEL6("Growing pool %s from %u to %u objects", pool->name, first, last);
+    sxe_pool_memory_commit((char *)SXE_POOL_IMPL_TO_ARRAY(pool) + first * pool->size, (last - first) * pool->size);
+    sxe_pool_memory_commit(&SXE_POOL_NODES(pool)[first], (last - first) * sizeof(SXE_POOL_NODE));
+
+    for (i = first; i < last; i++) {
+        sxe_pool_element_stamp(pool, i);
+        sxe_pool_queue_push(pool, 0, i);
+    }
+
+    pool->number = last;
+    return last - first;
+}
+
+/**
+ * Construct a growable pool of up to <maximum> objects in address space reserved by the caller
+ *
+ * @param base    Base of at least sxe_pool_size(maximum, size, states) bytes reserved with sxe_pool_memory_map()
+ * @param name    Name of pool; pointer to '\0' terminated string
+ * @param segment Number of objects constructed initially and each time the pool grows
+ * @param maximum Maximum number of objects the pool can grow to
+ * @param size    Size of each element in the pool
+ * @param states  Number of states each element can be in
+ * @param options As for sxe_pool_new_growable(), less the memory options, which only apply to the reservation
+ *
+ * @return A pointer to the array of objects
+ *
+ * @note The caller owns the reservation and must unmap it rather than calling sxe_pool_delete(); this allows a pool to be
+ *       embedded in a larger growable structure (e.g. a resizable sxe_hash)
+ */
+void *
+sxe_pool_construct_growable(void * base, const char * name, unsigned segment, unsigned maximum, size_t size, unsigned states,
+                            unsigned options)
+{
+    SXE_POOL_IMPL * pool;
+
+    SXEE6("(base=%p,name=%s,segment=%u,maximum=%u,size=%zu,states=%u,options=%u)", base, name, segment, maximum, size, states,
+          options);
+    SXEA1(segment > 0 && segment <= maximum, "Pool %s: segment %u must be between 1 and the maximum %u", name, segment, maximum);
+    SXEA1(!(options & (SXE_POOL_OPTION_CONCURRENT | SXE_POOL_OPTION_MAGAZINES)),
+          "Pool %s: growable pools can't be concurrent or have magazines", name);
+    SXEA1(!(options & SXE_POOL_OPTION_COMPACT_NODES), "Pool %s: growable pools can't have compact nodes", name);
+    sxe_pool_memory_commit(base, sizeof(SXE_POOL_IMPL));
+    sxe_pool_memory_commit((char *)base + sizeof(SXE_POOL_IMPL) + (size_t)maximum * size, states * sizeof(SXE_LIST));
+
+    pool           = SXE_POOL_ARRAY_TO_IMPL(sxe_pool_construct_impl(base, name, 0, maximum, size, states, options));
+    pool->maximum  = maximum;
+    pool->segment  = segment;
+    sxe_pool_grow_locked(pool);
+
+    SXER6("return array=%p", SXE_POOL_IMPL_TO_ARRAY(pool));
+    return SXE_POOL_IMPL_TO_ARRAY(pool);
+}
+
+/**
+ * Allocate and construct a growable pool of up to <maximum> objects of size <size> with <states> states
+ *
+ * @param name    Name of pool; pointer to '\0' terminated string
+ * @param segment Number of objects constructed initially and each time the pool grows
+ * @param maximum Maximum number of objects the pool can grow to
+ * @param size    Size of each element in the pool
+ * @param states  Number of states each element can be in
+ * @param options SXE_POOL_OPTION_UNLOCKED, SXE_POOL_OPTION_LOCKED and/or SXE_POOL_OPTION_TIMED, plus the memory options of
+ *                sxe_pool_new() other than SXE_POOL_OPTION_PREFAULT
+ *
+ * @return A pointer to the array of objects
+ *
+ * @exception Aborts on failure to reserve address space
+ *
+ * @note Address space for <maximum> objects is reserved, so the array and the indices of its objects never move. When
+ *       sxe_pool_set_oldest_element_state() finds the free state (0) empty, another segment is constructed and put in the free
+ *       state. Trailing segments whose objects are all free can be given back with sxe_pool_shrink().
+ */
+void *
+sxe_pool_new_growable(const char * name, unsigned segment, unsigned maximum, size_t size, unsigned states, unsigned options)
+{
+    void   * array;
+    void   * base;
+    size_t   reserved;
+
+    SXEE6("(name=%s,segment=%u,maximum=%u,size=%zu,states=%u,options=%u)", name, segment, maximum, size, states, options);
+    reserved = sxe_pool_memory_mapped_size(sxe_pool_size(maximum, size, states), options);
+    SXEA1((base = sxe_pool_memory_map(reserved, options, true)) != NULL, "Error reserving %zu bytes for SXE pool %s", reserved, name);
+    array = sxe_pool_construct_growable(base, name, segment, maximum, size, states, options);
+    SXE_POOL_ARRAY_TO_IMPL(array)->reserved = reserved;
+
+    SXER6("return array=%p", array);
+    return array;
+}
+
+/**
+ * Add a segment of free objects to a growable pool
+ *
+ * @return The number of objects added (0 if the pool is at its maximum), or SXE_POOL_LOCK_NOT_TAKEN
+ */
+unsigned
+sxe_pool_grow(void * array)
+{
+    SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+    unsigned        result;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s)", pool->name);
+    SXEA1(pool->segment != 0, "Pool %s is not growable", pool->name);
+
+    if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
+        goto SXE_ERROR_OUT;    /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    result = sxe_pool_grow_locked(pool);
+    sxe_pool_unlock(pool);
+
+SXE_ERROR_OUT:
+    SXER6("return %s", sxe_pool_return_to_string(result));
+    return result;
+}
+
+/**
+ * Give back the memory of trailing segments of a growable pool whose objects are all in the free state
+ *
+ * @return The number of objects removed from the pool, or SXE_POOL_LOCK_NOT_TAKEN
+ *
+ * @note The first segment is never given back. Objects in segments that are given back must not be referenced; if the pool
+ *       grows again, they are reconstructed with undefined contents.
+ */
+unsigned
+sxe_pool_shrink(void * array)
+{
+    SXE_POOL_IMPL * pool   = SXE_POOL_ARRAY_TO_IMPL(array);
+    unsigned        result = 0;
+    unsigned        first;
+    unsigned        i;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s)", pool->name);
+    SXEA1(pool->segment != 0, "Pool %s is not growable", pool->name);
+
+    if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
+        result = SXE_POOL_LOCK_NOT_TAKEN;    /* Coverage exclusion: Add tests before using in multiprocess code */
+        goto SXE_ERROR_OUT;                  /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    while (pool->number > pool->segment) {
+        first = (pool->number - 1) / pool->segment * pool->segment;
+
+        for (i = first; i < pool->number; i++) {
+            if (sxe_pool_element_state(pool, i) != 0) {
+                goto SXE_EARLY_OUT;
+            }
+        }
+
+        SXEL6("Shrinking pool %s from %u to %u objects", pool->name, pool->number, first);
+
+        for (i = first; i < pool->number; i++) {
+            sxe_pool_queue_remove(pool, 0, i);
+        }
+
+        sxe_pool_memory_release((char *)array + first * pool->size, (pool->number - first) * pool->size);
+        sxe_pool_memory_release(&SXE_POOL_NODES(pool)[first], (pool->number - first) * sizeof(SXE_POOL_NODE));
+        result      += pool->number - first;
+        pool->number = first;
+    }
+
+SXE_EARLY_OUT:
+    sxe_pool_unlock(pool);
+
+SXE_ERROR_OUT:
+    SXER6("return %s", sxe_pool_return_to_string(result));
+    return result;
+}
+
+/**
+ * Set the function used to convert states to strings in diagnostics; NULL restores the default, which prints the number
+ *
+ * @note A pool in an image (see sxe_pool_image_create()) can only use the default, since the function's address would be
+ *       meaningless to the other processes mapping the image
+ */
 void
 sxe_pool_set_state_to_string(void * array, const char * (*state_to_string)(unsigned state))
 {
     SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
 
-    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
-    SXEE6("sxe_pool_set_state_to_string(pool=%s,state_to_string=%p)", pool->name, state_to_string);
-    pool->state_to_string = state_to_string;
-    SXER6("return");
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("sxe_pool_set_state_to_string(pool=%s,state_to_string=%p)", pool->name, state_to_string);
+    SXEA1(state_to_string == NULL || !(pool->options & SXE_POOL_OPTION_IMAGE),
+          "Pool %s is in an image; it can't keep a pointer to a function in this process", pool->name);
+    pool->state_to_string = state_to_string;
+    SXER6("return");
+}
+
+/* Time out the elements of a pool whose timeouts have been reached at time_now
+ */
+static void
+sxe_pool_timeout_expire(SXE_POOL_IMPL * pool, SXE_TIME time_now)
+{
+    unsigned        state;
+    SXE_TIME        timeout_for_this_state;
+    SXE_TIME        time_oldest_for_this_state;
+    SXE_TIME        time_oldest_for_this_state_last;
+    unsigned        index_oldest_for_this_state;
+    unsigned        index_oldest_for_this_state_last;
+
+    for (state = 0; state < pool->states; state++) {
+        timeout_for_this_state = pool->state_timeouts[state];
+
+        if (timeout_for_this_state == 0) {
+            SXEL6("state %s timeout is infinite; ignoring", SXE_POOL_STATE_TO_STRING(pool, state));
+            continue;
+        }
+
+        index_oldest_for_this_state_last = SXE_POOL_NO_INDEX;
+        time_oldest_for_this_state_last  = 0;
+
+        while ((index_oldest_for_this_state = sxe_pool_queue_head(pool, state)) != SXE_POOL_NO_INDEX) {
+            time_oldest_for_this_state = sxe_pool_element_last(pool, index_oldest_for_this_state);
+
+            SXEA1(   (index_oldest_for_this_state_last != index_oldest_for_this_state)
+                   || (time_oldest_for_this_state       != time_oldest_for_this_state_last),
+                   "Internal: callback failed to update state on pool element with timed out");
+
+            if ((time_now - time_oldest_for_this_state) < timeout_for_this_state) {
+                SXEL6("state %s timeout %" PRIu64 " has not been reached for oldest index %u",
+                       SXE_POOL_STATE_TO_STRING(pool, state), timeout_for_this_state, index_oldest_for_this_state);
+                break;
+            }
+
+            SXEL6("state %s timeout %" PRIu64 " has been reached for oldest index %u", SXE_POOL_STATE_TO_STRING(pool, state),
+                   timeout_for_this_state, index_oldest_for_this_state);
+            (*pool->event_timeout)(SXE_POOL_IMPL_TO_ARRAY(pool), index_oldest_for_this_state, pool->caller_info);
+            index_oldest_for_this_state_last = index_oldest_for_this_state;
+            time_oldest_for_this_state_last  = time_oldest_for_this_state;
+        }
+    }
+}
+
+/**
+ * Call the timeout callbacks of all elements of pools with timeouts whose timeouts have been reached
+ *
+ * @note Only pools whose deadlines have been reached are visited, so calling this when nothing is due is O(1). To avoid polling,
+ *       call it at the time returned by sxe_pool_get_next_timeout().
+ */
+void
+sxe_pool_check_timeouts(void)
+{
+    SXE_TIME        time_now;
+    SXE_POOL_IMPL * pool;
+
+    SXEE6("sxe_pool_check_timeouts()");
+    time_now = sxe_time_get();
+
+    while (sxe_pool_timeout_count > 0 && (pool = sxe_pool_timeout_heap[0])->timeout_deadline <= time_now) {
+        SXEL6("Checking timeouts of pool %s", pool->name);
+
+        /* Park the pool at the bottom while its callbacks run; any element they move into a timed state brings it back up
+         */
+        sxe_pool_timeout_heap_update(pool, SXE_POOL_TIMEOUT_NEVER);
+        sxe_pool_timeout_expire(pool, time_now);
+        sxe_pool_timeout_heap_update(pool, sxe_pool_timeout_next_deadline(pool));
+    }
+
+    SXER6("return");
+}
+
+/**
+ * Get the time at which sxe_pool_check_timeouts() next needs to be called
+ *
+ * @return The earliest time that an element of any pool with timeouts can time out, or 0 if no element can time out
+ *
+ * @note The time returned may be early, if the element that would have timed out then has since changed state; in that case,
+ *       sxe_pool_check_timeouts() will find nothing to time out and this function will then return a later time.
+ */
+SXE_TIME
+sxe_pool_get_next_timeout(void)
+{
+    SXE_TIME next_timeout = 0;
+
+    if (sxe_pool_timeout_count > 0 && sxe_pool_timeout_heap[0]->timeout_deadline != SXE_POOL_TIMEOUT_NEVER) {
+        next_timeout = sxe_pool_timeout_heap[0]->timeout_deadline;
+    }
+
+    SXEL6("sxe_pool_get_next_timeout() // return %" PRIu64, next_timeout);
+    return next_timeout;
+}
+
+/**
+ * Get the time at which the next element of a pool with timeouts will time out
+ *
+ * @param array = Pointer to the pool array
+ *
+ * @return The time that the oldest element in a state with a timeout will time out, or 0 if no element can time out
+ */
+SXE_TIME
+sxe_pool_get_next_timeout_in_pool(void * array)
+{
+    SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+    SXE_TIME        next_timeout;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s)", pool->name);
+    SXEA1(pool->state_timeouts != NULL, "Pool %s has no timeouts", pool->name);
+    next_timeout = sxe_pool_timeout_next_deadline(pool);
+    next_timeout = next_timeout == SXE_POOL_TIMEOUT_NEVER ? 0 : next_timeout;
+    SXER6("return %" PRIu64, next_timeout);
+    return next_timeout;
+}
+
+/* Concurrent pool internals. State 0 is a lock-free stack; every other state is a list protected by its own lock. When an element
+ * moves between two locked states, the locks are taken in state order so that threads moving elements in opposite directions
+ * can't deadlock.
+ */
+
+static void
+sxe_pool_concurrent_push_free(SXE_POOL_IMPL * pool, unsigned id)
+{
+    SXE_POOL_CONCURRENT * concurrent = pool->concurrent;
+    uint64_t              top;
+
+    do {
+        top                        = concurrent->free_top;
+        concurrent->free_next[id]  = (unsigned)top;
+    } while (!__sync_bool_compare_and_swap(&concurrent->free_top, top, (((top >> 32) + 1) << 32) | id));
+
+    __sync_add_and_fetch(&concurrent->free_count, 1);
+}
+
+static unsigned
+sxe_pool_concurrent_pop_free(SXE_POOL_IMPL * pool)
+{
+    SXE_POOL_CONCURRENT * concurrent = pool->concurrent;
+    uint64_t              top;
+    unsigned              id;
+
+    do {
+        top = concurrent->free_top;
+        id  = (unsigned)top;
+
+        if (id == SXE_POOL_NO_INDEX) {
+            return SXE_POOL_NO_INDEX;
+        }
+
+        /* If another thread pops id and pushes it back before our swap, the tag will have changed and the swap will fail */
+    } while (!__sync_bool_compare_and_swap(&concurrent->free_top, top, (((top >> 32) + 1) << 32) | concurrent->free_next[id]));
+
+    __sync_sub_and_fetch(&concurrent->free_count, 1);
+    return id;
+}
+
+static inline void
+sxe_pool_concurrent_lock(SXE_POOL_IMPL * pool, unsigned state_a, unsigned state_b)
+{
+    unsigned low  = state_a < state_b ? state_a : state_b;
+    unsigned high = state_a < state_b ? state_b : state_a;
+
+    if (low != 0) {
+        sxe_pool_state_lock(pool, low);
+    }
+
+    if (high != low) {
+        sxe_pool_state_lock(pool, high);
+    }
+}
+
+static inline void
+sxe_pool_concurrent_unlock(SXE_POOL_IMPL * pool, unsigned state_a, unsigned state_b)
+{
+    if (state_a != 0) {
+        sxe_pool_state_unlock(pool, state_a);
+    }
+
+    if (state_b != state_a && state_b != 0) {
+        sxe_pool_state_unlock(pool, state_b);
+    }
+}
+
+static inline void
+sxe_pool_node_stamp(SXE_POOL_IMPL * pool, SXE_POOL_NODE * node)
+{
+    if (pool->options & SXE_POOL_OPTION_TIMED) {
+        node->last.time  = sxe_time_get();
+    }
+    else if (pool->concurrent != NULL) {
+        node->last.count = __sync_add_and_fetch(&pool->next_count, 1);
+    }
+    else {
+        node->last.count = ++pool->next_count;
+    }
+}
+
+/* Move an element that has been taken off its old state's queue (with that state's lock held, if it has one) to the tail of its
+ * new state. The caller must hold the new state's lock if it has one.
+ */
+static inline void
+sxe_pool_concurrent_enter_state(SXE_POOL_IMPL * pool, SXE_POOL_NODE * node, unsigned new_state)
+{
+    sxe_pool_node_stamp(pool, node);
+
+    if (new_state == 0) {
+        node->list_node.id = 0;
+        return;
+    }
+
+    sxe_list_push(&SXE_POOL_QUEUE(pool)[new_state], &node->list_node);
+}
+
+/* Concurrent version of sxe_pool_set_indexed_element_state_unlocked(); takes the locks it needs
+ */
+static bool
+sxe_pool_concurrent_set_indexed_element_state(SXE_POOL_IMPL * pool, unsigned id, unsigned old_state, unsigned new_state,
+                                              unsigned on_incorrect_state)
+{
+    SXE_POOL_NODE * node    = &SXE_POOL_NODES(pool)[id];
+    bool            success = false;
+
+    SXEE6("(pool=%s,id=%u,old_state=%s,new_state=%s)", pool->name, id, SXE_POOL_STATE_TO_STRING(pool, old_state),
+          SXE_POOL_STATE_TO_STRING(pool, new_state));
+    SXEA1(old_state != 0, "Concurrent pool %s: elements can only be taken from state 0 with sxe_pool_set_oldest_element_state",
+          pool->name);
+    sxe_pool_concurrent_lock(pool, old_state, new_state);
+
+    if (SXE_LIST_NODE_GET_ID(&node->list_node) != old_state) {
+        SXEA1(on_incorrect_state != SXE_POOL_ON_INCORRECT_STATE_ABORT,
+              "sxe_pool_concurrent_set_indexed_element_state(pool=%s,id=%u,old_state=%s,new_state=%s): Object is in state %s",
+              pool->name, id, SXE_POOL_STATE_TO_STRING(pool, old_state), SXE_POOL_STATE_TO_STRING(pool, new_state),
+              SXE_POOL_STATE_TO_STRING(pool, SXE_LIST_NODE_GET_ID(&node->list_node)));
+        sxe_pool_concurrent_unlock(pool, old_state, new_state);
+        goto SXE_EARLY_OUT;
+    }
+
+    sxe_list_remove(&SXE_POOL_QUEUE(pool)[old_state], node);
+    sxe_pool_concurrent_enter_state(pool, node, new_state);
+    sxe_pool_concurrent_unlock(pool, old_state, new_state);
+
+    if (new_state == 0) {
+        sxe_pool_concurrent_push_free(pool, id);
+    }
+
+    success = true;
+
+SXE_EARLY_OUT:
+    SXER6("return %s", success ? "true // success" : "false // failure");
+    return success;
 }
 
-void
-sxe_pool_check_timeouts(void)
+/* Concurrent version of sxe_pool_set_oldest_element_state()
+ */
+static unsigned
+sxe_pool_concurrent_set_oldest_element_state(SXE_POOL_IMPL * pool, unsigned old_state, unsigned new_state)
 {
-    SXE_LIST_WALKER walker;
-    SXE_TIME        time_now;
-    SXE_POOL_IMPL * pool;
-    unsigned        state;
-    SXE_TIME        timeout_for_this_state;
-    SXE_TIME        time_oldest_for_this_state;
-    SXE_TIME        time_oldest_for_this_state_last;
-    unsigned        index_oldest_for_this_state;
-    unsigned        index_oldest_for_this_state_last;
-
-    SXEE6("sxe_pool_check_timeouts()");
-    sxe_list_walker_construct(&walker, &sxe_pool_timeout_list);
-    time_now = sxe_time_get();
-
-    while ((pool = (SXE_POOL_IMPL *)sxe_list_walker_step(&walker)) != NULL) {
-        for (state = 0; state < pool->states; state++) {
-            timeout_for_this_state = pool->state_timeouts[state];
+    SXE_POOL_NODE * node;
+    unsigned        id;
 
-            if (timeout_for_this_state == 0) {
-                SXEL6("state %s timeout is infinite; ignoring", (*pool->state_to_string)(state));
-                continue;
-            }
+    if (old_state == 0) {
+        if ((id = sxe_pool_concurrent_pop_free(pool)) == SXE_POOL_NO_INDEX) {
+            goto SXE_EARLY_OUT;
+        }
 
-            index_oldest_for_this_state_last = SXE_POOL_NO_INDEX;
-            time_oldest_for_this_state_last  = 0;
+        node = &SXE_POOL_NODES(pool)[id];
+        sxe_pool_concurrent_lock(pool, new_state, new_state);
+        sxe_pool_concurrent_enter_state(pool, node, new_state);
+        sxe_pool_concurrent_unlock(pool, new_state, new_state);
 
-            for (;;) {
-                index_oldest_for_this_state = sxe_pool_get_oldest_element_index(SXE_POOL_IMPL_TO_ARRAY(pool), state);
+        if (new_state == 0) {
+            sxe_pool_concurrent_push_free(pool, id);    /* Coverage exclusion: moving from free to free is pointless */
+        }
 
-                if (SXE_POOL_NO_INDEX == index_oldest_for_this_state) {
-                    SXEL6("state %s timeout %" PRIu64 " has no elements", (*pool->state_to_string)(state), timeout_for_this_state);
-                    break;
-                }
+        goto SXE_EARLY_OUT;
+    }
 
-                time_oldest_for_this_state = sxe_pool_get_oldest_element_time(SXE_POOL_IMPL_TO_ARRAY(pool), state);
+    sxe_pool_concurrent_lock(pool, old_state, new_state);
 
-                SXEA1(   (index_oldest_for_this_state_last != index_oldest_for_this_state)
-                       || (time_oldest_for_this_state       != time_oldest_for_this_state_last),
-                       "Internal: callback failed to update state on pool element with timed out");
+    if ((node = sxe_list_peek_head(&SXE_POOL_QUEUE(pool)[old_state])) == NULL) {
+        sxe_pool_concurrent_unlock(pool, old_state, new_state);
+        id = SXE_POOL_NO_INDEX;
+        goto SXE_EARLY_OUT;
+    }
 
-                if ((time_now - time_oldest_for_this_state) < timeout_for_this_state) {
-                    SXEL6("state %s timeout %" PRIu64 " has not been reached for oldest index %u", (*pool->state_to_string)(state),
-                           timeout_for_this_state, index_oldest_for_this_state);
-                    break;
-                }
+    id = node - SXE_POOL_NODES(pool);
+    sxe_list_remove(&SXE_POOL_QUEUE(pool)[old_state], node);
+    sxe_pool_concurrent_enter_state(pool, node, new_state);
+    sxe_pool_concurrent_unlock(pool, old_state, new_state);
 
-                SXEL6("state %s timeout %" PRIu64 " has been reached for oldest index %u", (*pool->state_to_string)(state),
-                       timeout_for_this_state, index_oldest_for_this_state);
-                (*pool->event_timeout)(SXE_POOL_IMPL_TO_ARRAY(pool), index_oldest_for_this_state, pool->caller_info);
-                index_oldest_for_this_state_last = index_oldest_for_this_state;
-                time_oldest_for_this_state_last  = time_oldest_for_this_state;
-            }
-        }
+    if (new_state == 0) {
+        sxe_pool_concurrent_push_free(pool, id);
     }
 
-    SXER6("return");
+SXE_EARLY_OUT:
+    return id;
 }
 
 /**
@@ -389,33 +1010,36 @@ sxe_pool_set_indexed_element_state_unlocked(void * array, unsigned id, unsigned
 {
     bool            success = false;
     SXE_POOL_IMPL * pool    = SXE_POOL_ARRAY_TO_IMPL(array);
-    SXE_POOL_NODE * node;
 
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
     SXEE6("(pool=%s,id=%u,old_state=%s,new_state=%s,on_incorrect_state=%s)",
-           pool->name, id, (*pool->state_to_string)(old_state), (*pool->state_to_string)(new_state),
+           pool->name, id, SXE_POOL_STATE_TO_STRING(pool, old_state), SXE_POOL_STATE_TO_STRING(pool, new_state),
            on_incorrect_state == SXE_POOL_ON_INCORRECT_STATE_ABORT ? "ABORT" : "RETURN_FALSE");
 
-    node = &SXE_POOL_NODES(pool)[id];
-
-    if (SXE_LIST_NODE_GET_ID(&node->list_node) != old_state) {
+    if (sxe_pool_element_state(pool, id) != old_state) {
         SXEA1(on_incorrect_state != SXE_POOL_ON_INCORRECT_STATE_ABORT,
-               "sxe_pool_set_indexed_element_state_unlocked(pool=%s,id=%"PRIdPTR",old_state=%s,new_state=%s): Object is in state %s",
-               pool->name, (intptr_t)(node - SXE_POOL_NODES(pool)), (*pool->state_to_string)(old_state),
-               (*pool->state_to_string)(new_state), (*pool->state_to_string)(SXE_LIST_NODE_GET_ID(&node->list_node)));
+               "sxe_pool_set_indexed_element_state_unlocked(pool=%s,id=%u,old_state=%s,new_state=%s): Object is in state %s",
+               pool->name, id, SXE_POOL_STATE_TO_STRING(pool, old_state),
+               SXE_POOL_STATE_TO_STRING(pool, new_state), SXE_POOL_STATE_TO_STRING(pool, sxe_pool_element_state(pool, id)));
         goto SXE_EARLY_OUT;
     }
 
-    sxe_list_remove(&SXE_POOL_QUEUE(pool)[old_state], node);
+    if (pool->stats != NULL) {
+        sxe_pool_stats_leave(pool, old_state, id);
+    }
 
-    if (pool->options & SXE_POOL_OPTION_TIMED) {
-        node->last.time  = sxe_time_get();
+    sxe_pool_queue_remove(pool, old_state, id);
+    sxe_pool_element_stamp(pool, id);
+    sxe_pool_queue_push(pool, new_state, id);
+
+    if (pool->stats != NULL) {
+        sxe_pool_stats_enter(pool, new_state, 1);
     }
-    else {
-        node->last.count = ++pool->next_count;
+
+    if (pool->state_timeouts != NULL) {
+        sxe_pool_timeout_element_entered(pool, new_state, sxe_pool_element_last(pool, id));
     }
 
-    sxe_list_push(&SXE_POOL_QUEUE(pool)[new_state], &node->list_node);
     success = true;
 
 SXE_EARLY_OUT:
@@ -435,12 +1059,17 @@ sxe_pool_set_indexed_element_state(void * array, unsigned id, unsigned old_state
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
     SXE_UNUSED_PARAMETER(old_state);   /* Used to verify sanity in debug build only */
     SXEE6("(pool=%s,id=%u,old_state=%s,new_state=%s)",
-           pool->name, id, (*pool->state_to_string)(old_state), (*pool->state_to_string)(new_state));
+           pool->name, id, SXE_POOL_STATE_TO_STRING(pool, old_state), SXE_POOL_STATE_TO_STRING(pool, new_state));
     SXEA6(id < pool->number, "sxe_pool_set_indexed_element_state(pool=%s,id=%u): Index is too big (number=%u)",
            pool->name, id, pool->number);
     SXEA6(old_state <= pool->states, "state %u is greater than maximum state %u for pool %s", old_state, pool->states, pool->name);
     SXEA6(new_state <= pool->states, "state %u is greater than maximum state %u for pool %s", new_state, pool->states, pool->name);
 
+    if (pool->concurrent != NULL) {
+        sxe_pool_concurrent_set_indexed_element_state(pool, id, old_state, new_state, SXE_POOL_ON_INCORRECT_STATE_ABORT);
+        goto SXE_ERROR_OUT;
+    }
+
     if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
         goto SXE_ERROR_OUT;
     }
@@ -475,12 +1104,24 @@ sxe_pool_try_to_set_indexed_element_state(void * array, unsigned id, unsigned ol
     SXE_UNUSED_PARAMETER(old_state);   /* Used to verify sanity in debug build only */
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
     SXEE6("sxe_pool_set_indexed_element_state(pool=%s,id=%u,old_state=%s,new_state=%s)",
-           pool->name, id, (*pool->state_to_string)(old_state), (*pool->state_to_string)(*new_state_inout));
+           pool->name, id, SXE_POOL_STATE_TO_STRING(pool, old_state), SXE_POOL_STATE_TO_STRING(pool, *new_state_inout));
     SXEA6(id < pool->number, "sxe_pool_set_indexed_element_state(pool=%s,id=%u): Index is too big (number=%u)",
            pool->name, id, pool->number);
     SXEA6(old_state <= pool->states, "state %u is greater than maximum state %u for pool %s", old_state, pool->states, pool->name);
     SXEA6(*new_state_inout <= pool->states, "state %u is greater than maximum state %u for pool %s", *new_state_inout, pool->states, pool->name);
 
+    if (pool->concurrent != NULL) {
+        if (sxe_pool_concurrent_set_indexed_element_state(pool, id, old_state, *new_state_inout,
+                                                          SXE_POOL_ON_INCORRECT_STATE_RETURN_FALSE)) {
+            result = id;
+        }
+        else {
+            *new_state_inout = sxe_pool_index_to_state(array, id);
+        }
+
+        goto SXE_ERROR_OUT;
+    }
+
     if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
         result = SXE_POOL_LOCK_NOT_TAKEN;    /* Coverage exclusion: Add tests before using in multiprocess code */
         goto SXE_ERROR_OUT;                  /* Coverage exclusion: Add tests before using in multiprocess code */
@@ -512,29 +1153,35 @@ unsigned
 sxe_pool_set_oldest_element_state(void * array, unsigned old_state, unsigned new_state)
 {
     SXE_POOL_IMPL * pool  = SXE_POOL_ARRAY_TO_IMPL(array);
-    SXE_POOL_NODE * node;
     unsigned        result = SXE_POOL_LOCK_TAKEN;
 
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
     SXEE6("sxe_pool_set_oldest_element_state(pool=%s, old_state=%s, new_state=%s)",
-           pool->name, (*pool->state_to_string)(old_state), (*pool->state_to_string)(new_state));
+           pool->name, SXE_POOL_STATE_TO_STRING(pool, old_state), SXE_POOL_STATE_TO_STRING(pool, new_state));
     SXEA6(old_state <= pool->states, "old state %u is greater than maximum state %u for pool %s", old_state, pool->states,
            pool->name);
     SXEA6(new_state <= pool->states, "new state %u is greater than maximum state %u for pool %s", new_state, pool->states,
            pool->name);
 
+    if (pool->concurrent != NULL) {
+        result = sxe_pool_concurrent_set_oldest_element_state(pool, old_state, new_state);
+        goto SXE_ERROR_OUT;
+    }
+
     if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
         goto SXE_ERROR_OUT;
     }
 
-    if ((node = sxe_list_peek_head(&SXE_POOL_QUEUE(pool)[old_state])) == NULL) {
+    if (old_state == 0 && sxe_pool_queue_length(pool, 0) == 0 && pool->number < pool->maximum) {
+        sxe_pool_grow_locked(pool);
+    }
+
+    if ((result = sxe_pool_queue_head(pool, old_state)) == SXE_POOL_NO_INDEX) {
         SXEL6("sxe_pool_set_oldest_element_state(pool=%s): No objects in state %s; returning SXE_POOL_NO_INDEX",
-               pool->name, (*pool->state_to_string)(old_state));
-        result = SXE_POOL_NO_INDEX;
+               pool->name, SXE_POOL_STATE_TO_STRING(pool, old_state));
         goto SXE_EARLY_OUT;
     }
 
-    result = node - SXE_POOL_NODES(pool);
     SXEA1(sxe_pool_set_indexed_element_state_unlocked(array, result, old_state, new_state, SXE_POOL_ON_INCORRECT_STATE_ABORT),
            "sxe_pool_set_indexed_element_state_unlocked failed: internal fatal error");
 
@@ -546,6 +1193,260 @@ SXE_ERROR_OUT:
     return result;
 }
 
+/**
+ * Move up to count of the oldest objects in one state to the tail of another in a single locked operation
+ *
+ * @param array     Pointer to the pool array
+ * @param old_state State to take the objects from
+ * @param new_state State to move them to
+ * @param ids       Array of at least count elements that receives the indices of the objects moved, oldest first
+ * @param count     Maximum number of objects to move
+ *
+ * @return Number of objects moved (fewer than count if old_state ran out) or SXE_POOL_LOCK_NOT_TAKEN
+ *
+ * @note In a concurrent pool, each object is moved separately, since the free state is lock-free
+ */
+unsigned
+sxe_pool_set_oldest_elements_state(void * array, unsigned old_state, unsigned new_state, unsigned * ids, unsigned count)
+{
+    SXE_POOL_IMPL * pool   = SXE_POOL_ARRAY_TO_IMPL(array);
+    unsigned        result = 0;
+    unsigned        id;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s,old_state=%s,new_state=%s,ids=%p,count=%u)", pool->name, SXE_POOL_STATE_TO_STRING(pool, old_state),
+          SXE_POOL_STATE_TO_STRING(pool, new_state), ids, count);
+    SXEA6(old_state < pool->states, "old state %u is not less than the number of states %u for pool %s", old_state, pool->states,
+          pool->name);
+    SXEA6(new_state < pool->states, "new state %u is not less than the number of states %u for pool %s", new_state, pool->states,
+          pool->name);
+
+    if (pool->concurrent != NULL) {
+        while (result < count && (id = sxe_pool_concurrent_set_oldest_element_state(pool, old_state, new_state)) != SXE_POOL_NO_INDEX) {
+            ids[result++] = id;
+        }
+
+        goto SXE_ERROR_OUT;
+    }
+
+    if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
+        result = SXE_POOL_LOCK_NOT_TAKEN;    /* Coverage exclusion: Add tests before using in multiprocess code */
+        goto SXE_ERROR_OUT;                  /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    for (; result < count; result++) {
+        if (old_state == 0 && sxe_pool_queue_length(pool, 0) == 0 && pool->number < pool->maximum) {
+            sxe_pool_grow_locked(pool);
+        }
+
+        if ((id = sxe_pool_queue_head(pool, old_state)) == SXE_POOL_NO_INDEX) {
+            break;
+        }
+
+        SXEA1(sxe_pool_set_indexed_element_state_unlocked(array, id, old_state, new_state, SXE_POOL_ON_INCORRECT_STATE_ABORT),
+              "sxe_pool_set_indexed_element_state_unlocked failed: internal fatal error");
+        ids[result] = id;
+    }
+
+    sxe_pool_unlock(pool);
+
+SXE_ERROR_OUT:
+    SXER6("return %s", sxe_pool_return_to_string(result));
+    return result;
+}
+
+/* Move every object in old_state to the tail of new_state, keeping their order and stamping them as having just entered it. The
+ * caller must hold the locks for both states.
+ */
+static unsigned
+sxe_pool_queue_splice(SXE_POOL_IMPL * pool, unsigned old_state, unsigned new_state)
+{
+    SXE_POOL_COMPACT_QUEUE * from;
+    SXE_POOL_COMPACT_QUEUE * to;
+    SXE_POOL_COMPACT_LINK  * links;
+    SXE_LIST_WALKER          walker;
+    SXE_POOL_NODE          * node;
+    SXE_TIME                 now   = pool->options & SXE_POOL_OPTION_TIMED ? sxe_time_get() : 0;
+    unsigned                 count = sxe_pool_queue_length(pool, old_state);
+    unsigned                 id;
+
+    if (count == 0 || old_state == new_state) {
+        return 0;
+    }
+
+    if (!SXE_POOL_IS_COMPACT(pool)) {
+        sxe_list_walker_construct(&walker, &SXE_POOL_QUEUE(pool)[old_state]);
+
+        while ((node = sxe_list_walker_step(&walker)) != NULL) {
+            if (pool->stats != NULL) {
+                sxe_pool_stats_leave(pool, old_state, node - SXE_POOL_NODES(pool));
+            }
+
+            node->last.count = pool->options & SXE_POOL_OPTION_TIMED ? now
+                             : pool->concurrent != NULL              ? __sync_add_and_fetch(&pool->next_count, 1)
+                             :                                         ++pool->next_count;
+        }
+
+        sxe_list_splice(&SXE_POOL_QUEUE(pool)[new_state], &SXE_POOL_QUEUE(pool)[old_state]);
+        goto SXE_EARLY_OUT;
+    }
+
+    from  = &SXE_POOL_COMPACT_QUEUE(pool)[old_state];
+    to    = &SXE_POOL_COMPACT_QUEUE(pool)[new_state];
+    links = SXE_POOL_COMPACT_LINKS(pool);
+
+    for (id = from->head; id != SXE_POOL_NO_INDEX; id = links[id].next) {
+        if (pool->stats != NULL) {
+            sxe_pool_stats_leave(pool, old_state, id);
+        }
+
+        links[id].state                  = new_state;
+        SXE_POOL_COMPACT_LASTS(pool)[id] = pool->options & SXE_POOL_OPTION_TIMED ? now : ++pool->next_count;
+    }
+
+    if (to->tail == SXE_POOL_NO_INDEX) {
+        to->head = from->head;
+    }
+    else {
+        links[to->tail].next = from->head;
+    }
+
+    links[from->head].prev = to->tail;
+    to->tail               = from->tail;
+    to->length            += count;
+    from->head             = SXE_POOL_NO_INDEX;
+    from->tail             = SXE_POOL_NO_INDEX;
+    from->length           = 0;
+
+SXE_EARLY_OUT:
+    if (pool->stats != NULL) {
+        sxe_pool_stats_enter(pool, new_state, count);
+    }
+
+    return count;
+}
+
+/**
+ * Move every object in one state to the tail of another in a single locked operation
+ *
+ * @param array     Pointer to the pool array
+ * @param old_state State to empty
+ * @param new_state State to move its objects to
+ *
+ * @return Number of objects moved or SXE_POOL_LOCK_NOT_TAKEN
+ *
+ * @note The objects keep their order and are treated as having just entered new_state. The state queues themselves are joined
+ *       in constant time, but each object's state and time of use are updated in one pass over the moved objects.
+ * @exception Concurrent pools can't move objects into or out of the free state (0) this way
+ */
+unsigned
+sxe_pool_set_all_elements_state(void * array, unsigned old_state, unsigned new_state)
+{
+    SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+    unsigned        result;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s,old_state=%s,new_state=%s)", pool->name, SXE_POOL_STATE_TO_STRING(pool, old_state),
+          SXE_POOL_STATE_TO_STRING(pool, new_state));
+    SXEA6(old_state < pool->states, "old state %u is not less than the number of states %u for pool %s", old_state, pool->states,
+          pool->name);
+    SXEA6(new_state < pool->states, "new state %u is not less than the number of states %u for pool %s", new_state, pool->states,
+          pool->name);
+
+    if (pool->concurrent != NULL) {
+        SXEA1(old_state != 0 && new_state != 0, "Concurrent pool %s: the free state is a stack and can't be moved in bulk",
+              pool->name);
+        sxe_pool_concurrent_lock(pool, old_state, new_state);
+        result = sxe_pool_queue_splice(pool, old_state, new_state);
+        sxe_pool_concurrent_unlock(pool, old_state, new_state);
+        goto SXE_ERROR_OUT;
+    }
+
+    if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
+        goto SXE_ERROR_OUT;    /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    if ((result = sxe_pool_queue_splice(pool, old_state, new_state)) != 0 && pool->state_timeouts != NULL) {
+        sxe_pool_timeout_element_entered(pool, new_state, sxe_pool_element_last(pool, sxe_pool_queue_head(pool, new_state)));
+    }
+
+    sxe_pool_unlock(pool);
+
+SXE_ERROR_OUT:
+    SXER6("return %s", sxe_pool_return_to_string(result));
+    return result;
+}
+
+/**
+ * Call a visitor on every object in a state, oldest first, with the pool (or, in a concurrent pool, the state) locked
+ *
+ * @param array     Pointer to the pool array
+ * @param state     State to visit
+ * @param visitor   Function called with the array, each object's index and user_data; returns false to stop the visit
+ * @param user_data Passed to the visitor
+ *
+ * @return Number of objects visited or SXE_POOL_LOCK_NOT_TAKEN
+ *
+ * @note The visitor may read and modify objects, but must not call pool functions that take the lock or change states
+ * @exception The free state (0) of a concurrent pool is a stack and can't be visited
+ */
+unsigned
+sxe_pool_visit_state(void * array, unsigned state, SXE_POOL_VISITOR visitor, void * user_data)
+{
+    SXE_POOL_IMPL * pool   = SXE_POOL_ARRAY_TO_IMPL(array);
+    unsigned        result = 0;
+    SXE_LIST_WALKER walker;
+    SXE_POOL_NODE * node;
+    unsigned        id;
+    unsigned        next;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s,state=%s,visitor=%p,user_data=%p)", pool->name, SXE_POOL_STATE_TO_STRING(pool, state), visitor, user_data);
+    SXEA6(state < pool->states, "state %u is not less than the number of states %u for pool %s", state, pool->states, pool->name);
+
+    if (pool->concurrent != NULL) {
+        SXEA1(state != 0, "Concurrent pool %s: the free state is a stack and can't be visited", pool->name);
+        sxe_pool_state_lock(pool, state);
+    }
+    else if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
+        result = SXE_POOL_LOCK_NOT_TAKEN;    /* Coverage exclusion: Add tests before using in multiprocess code */
+        goto SXE_ERROR_OUT;                  /* Coverage exclusion: Add tests before using in multiprocess code */
+    }
+
+    if (SXE_POOL_IS_COMPACT(pool)) {
+        for (id = SXE_POOL_COMPACT_QUEUE(pool)[state].head; id != SXE_POOL_NO_INDEX; id = next) {
+            next = SXE_POOL_COMPACT_LINKS(pool)[id].next;
+            result++;
+
+            if (!(*visitor)(array, id, user_data)) {
+                break;
+            }
+        }
+    }
+    else {
+        sxe_list_walker_construct(&walker, &SXE_POOL_QUEUE(pool)[state]);
+
+        while ((node = sxe_list_walker_step(&walker)) != NULL) {
+            result++;
+
+            if (!(*visitor)(array, node - SXE_POOL_NODES(pool), user_data)) {
+                break;
+            }
+        }
+    }
+
+    if (pool->concurrent != NULL) {
+        sxe_pool_state_unlock(pool, state);
+    }
+    else {
+        sxe_pool_unlock(pool);
+    }
+
+SXE_ERROR_OUT:
+    SXER6("return %s", sxe_pool_return_to_string(result));
+    return result;
+}
+
 /**
  * Update an object's time of use and move it to the back its current state queue
  */
@@ -560,12 +1461,27 @@ sxe_pool_touch_indexed_element(void * array, unsigned id)
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
     SXEE6("sxe_pool_touch_indexed_element(pool=%s,id=%u)", pool->name, id);
 
+    /* The state is read without a lock, so another thread may move the element before its state's lock is taken; if it does,
+     * touch the element in the state it was moved to
+     */
+    if (pool->concurrent != NULL) {
+        node = &SXE_POOL_NODES(pool)[id];
+
+        do {
+            if ((state = SXE_LIST_NODE_GET_ID(&node->list_node)) == 0) {    /* The free stack isn't ordered */
+                sxe_pool_node_stamp(pool, node);
+                goto SXE_ERROR_OUT;
+            }
+        } while (!sxe_pool_concurrent_set_indexed_element_state(pool, id, state, state, SXE_POOL_ON_INCORRECT_STATE_RETURN_FALSE));
+
+        goto SXE_ERROR_OUT;
+    }
+
     if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
         goto SXE_ERROR_OUT;
     }
 
-    node  = &SXE_POOL_NODES(pool)[id];
-    state = SXE_LIST_NODE_GET_ID(&node->list_node);
+    state = sxe_pool_element_state(pool, id);
     SXEA1(sxe_pool_set_indexed_element_state_unlocked(array, id, state, state, SXE_POOL_ON_INCORRECT_STATE_ABORT),
            "sxe_pool_set_indexed_element_state_unlocked failed: internal fatal error");
     sxe_pool_unlock(pool);
@@ -586,21 +1502,33 @@ sxe_pool_get_oldest_element_index(void * array, unsigned state)
     unsigned        id = SXE_POOL_NO_INDEX;
 
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
-    SXEE6("sxe_pool_get_oldest_element_index(pool=%s, state=%s)", pool->name, (*pool->state_to_string)(state));
+    SXEE6("sxe_pool_get_oldest_element_index(pool=%s, state=%s)", pool->name, SXE_POOL_STATE_TO_STRING(pool, state));
     SXEA6(state <= pool->states, "state %u is greater than maximum state %u for pool %s", state, pool->states, pool->name);
 
+    if (pool->concurrent != NULL) {
+        if (state == 0) {    /* The free stack isn't ordered; return the element that would be taken next */
+            id = (unsigned)pool->concurrent->free_top;
+            goto SXE_ERROR_OUT;
+        }
+
+        sxe_pool_state_lock(pool, state);
+
+        if ((node = sxe_list_peek_head(&SXE_POOL_QUEUE(pool)[state])) != NULL) {
+            id = node - SXE_POOL_NODES(pool);
+        }
+
+        sxe_pool_state_unlock(pool, state);
+        goto SXE_ERROR_OUT;
+    }
+
     if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
         goto SXE_ERROR_OUT;  /* Coverage exclusion: Add tests before using in multiprocess code */
     }
 
-    if ((node = sxe_list_peek_head(&SXE_POOL_QUEUE(pool)[state])) == NULL) {
-        SXEL6("No objects in state %s, returning SXE_POOL_NO_INDEX", (*pool->state_to_string)(state));
-        goto SXE_EARLY_OUT;
+    if ((id = sxe_pool_queue_head(pool, state)) == SXE_POOL_NO_INDEX) {
+        SXEL6("No objects in state %s, returning SXE_POOL_NO_INDEX", SXE_POOL_STATE_TO_STRING(pool, state));
     }
 
-    id = node - SXE_POOL_NODES(pool);
-
-SXE_EARLY_OUT:
     sxe_pool_unlock(pool);
 
 SXE_ERROR_OUT:
@@ -608,6 +1536,23 @@ SXE_ERROR_OUT:
     return id;
 }
 
+/**
+ * Prefetch the head of the queue of a given state, which is the first thing read when walking the state or getting its oldest
+ * element. Used to overlap the cache misses of many lookups (see sxe_hash_look_batch()).
+ */
+void
+sxe_pool_prefetch_state(void * array, unsigned state)
+{
+    SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+
+    if (SXE_POOL_IS_COMPACT(pool)) {
+        __builtin_prefetch(&SXE_POOL_COMPACT_QUEUE(pool)[state]);
+    }
+    else {
+        __builtin_prefetch(&SXE_POOL_QUEUE(pool)[state]);
+    }
+}
+
 /*
  * Get the time or count of the oldest object in a given state (or 0 if none)
  *
@@ -619,20 +1564,38 @@ sxe_pool_impl_get_oldest_element_time_or_count(SXE_POOL_IMPL * pool, unsigned st
 {
     SXE_POOL_NODE * node;
     SXE_TIME        last_time = 0;
+    unsigned        id;
 
     SXEE6("sxe_pool_get_oldest_element_%s(pool=%s, state=%s)", pool->options & SXE_POOL_OPTION_TIMED ? "time" : "count",
-           pool->name, (*pool->state_to_string)(state));
+           pool->name, SXE_POOL_STATE_TO_STRING(pool, state));
+
+    if (pool->concurrent != NULL) {
+        if (state == 0) {    /* The free stack isn't ordered; return the time of the element that would be taken next */
+            id = (unsigned)pool->concurrent->free_top;
+            last_time = id == SXE_POOL_NO_INDEX ? 0 : SXE_POOL_NODES(pool)[id].last.time;
+            goto SXE_ERROR_OUT;
+        }
+
+        sxe_pool_state_lock(pool, state);
+
+        if ((node = sxe_list_peek_head(&SXE_POOL_QUEUE(pool)[state])) != NULL) {
+            last_time = node->last.time;
+        }
+
+        sxe_pool_state_unlock(pool, state);
+        goto SXE_ERROR_OUT;
+    }
 
     if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
         goto SXE_ERROR_OUT;  /* Coverage exclusion: Add tests before using in multiprocess code */
     }
 
-    if ((node = sxe_list_peek_head(&SXE_POOL_QUEUE(pool)[state])) == NULL) {
-        SXEL6("No objects in state %s", (*pool->state_to_string)(state));
+    if ((id = sxe_pool_queue_head(pool, state)) == SXE_POOL_NO_INDEX) {
+        SXEL6("No objects in state %s", SXE_POOL_STATE_TO_STRING(pool, state));
         goto SXE_EARLY_OUT;
     }
 
-    last_time = node->last.time;
+    last_time = sxe_pool_element_last(pool, id);
 
 SXE_EARLY_OUT:
     sxe_pool_unlock(pool);
@@ -690,36 +1653,69 @@ SXE_TIME
 sxe_pool_get_element_time_by_index(void * array, unsigned element)
 {
     SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
-    SXE_POOL_NODE * node;
+    SXE_TIME        last_time;
 
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
     SXEE6("sxe_pool_get_element_time_by_index(pool=%s, index=%u)", pool->name, element);
     SXEA1(pool->options & SXE_POOL_OPTION_TIMED, "sxe_pool_get_element_time_by_index: pool %s is not a timed pool", pool->name);
     SXEA6(element < pool->number, "index %u is greater than maximum index %u for pool %s", element, pool->number, pool->name);
 
-    node = &SXE_POOL_NODES(pool)[element];
+    last_time = sxe_pool_element_last(pool, element);
 
 SXE_EARLY_OR_ERROR_OUT:
-    SXER6("return %llu", (unsigned long long) node->last.time);
-    return node->last.time;
+    SXER6("return %llu", (unsigned long long)last_time);
+    return last_time;
 }
 
 void
 sxe_pool_delete(void * array)
 {
-    SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+    SXE_POOL_IMPL  * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+    SXE_POOL_IMPL ** link;
 
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
     SXEE6("sxe_pool_delete(pool=%s)", pool->name);
 
     if (pool->event_timeout != NULL) {
-        SXEA1(sxe_list_remove(&sxe_pool_timeout_list, pool) == pool, "Remove always returns the object removed");
+        sxe_pool_timeout_heap_remove(pool);
     }
 
     if (pool->state_timeouts)
         sxe_free(pool->state_timeouts);
 
-    sxe_free(pool);
+    if (pool->concurrent != NULL) {
+        sxe_free(SXE_CAST_NOCONST(unsigned *, pool->concurrent->free_next));
+        sxe_free(pool->concurrent);
+    }
+
+    if (pool->magazines != NULL) {
+        sxe_spinlock_take(&sxe_pool_magazine_pools_lock);
+
+        for (link = &sxe_pool_magazine_pools; *link != pool; link = &(*link)->magazines_next) {
+        }
+
+        *link = pool->magazines_next;
+        sxe_spinlock_give(&sxe_pool_magazine_pools_lock);
+        sxe_free(pool->magazines);
+    }
+
+    if (pool->stats != NULL) {
+        sxe_spinlock_take(&sxe_pool_stats_pools_lock);
+
+        for (link = &sxe_pool_stats_pools; *link != pool; link = &(*link)->stats_next) {
+        }
+
+        *link = pool->stats_next;
+        sxe_spinlock_give(&sxe_pool_stats_pools_lock);
+        sxe_free(pool->stats);
+    }
+
+    if (pool->reserved != 0) {
+        sxe_pool_memory_unmap(pool, pool->reserved, pool->options);
+    }
+    else {
+        sxe_free(pool);
+    }
     SXER6("return");
 }
 
@@ -740,5 +1736,13 @@ sxe_pool_override_locked(void * array)
         sxe_spinlock_force(&pool->spinlock, 0);
     }
 
+    if (pool->concurrent != NULL) {
+        unsigned state;
+
+        for (state = 0; state < pool->states; state++) {
+            sxe_pool_state_unlock(pool, state);
+        }
+    }
+
     SXER6("return");
 }
@@ -22,7 +22,10 @@
 #ifndef __SXE_POOL_H__
 #define __SXE_POOL_H__
 
+#include <stdbool.h>
+
 #include "sxe-list.h"
+#include "sxe-mmap.h"
 #include "sxe-time.h"
 #include "sxe-util.h"
 
@@ -35,13 +38,36 @@
 #define SXE_POOL_OPTION_UNLOCKED       0
 #define SXE_POOL_OPTION_LOCKED         SXE_BIT_OPTION(0)
 #define SXE_POOL_OPTION_TIMED          SXE_BIT_OPTION(1)
+#define SXE_POOL_OPTION_CONCURRENT     SXE_BIT_OPTION(2)    /* Thread safe: lock-free free state (0), a lock per other state */
+#define SXE_POOL_OPTION_MAGAZINES      SXE_BIT_OPTION(3)    /* Locked pools: per thread caches of free elements              */
+#define SXE_POOL_OPTION_HUGE_PAGES     SXE_BIT_OPTION(4)    /* Map the pool with 2MB pages, or ask for transparent ones      */
+#define SXE_POOL_OPTION_HUGE_PAGES_1G  SXE_BIT_OPTION(5)    /* Map the pool with 1GB pages, falling back as above            */
+#define SXE_POOL_OPTION_PREFAULT       SXE_BIT_OPTION(6)    /* Touch every page of the pool when it's created                */
+#define SXE_POOL_OPTION_NUMA           SXE_BIT_OPTION(7)    /* Set by SXE_POOL_OPTION_NUMA_NODE(); don't use directly        */
+#define SXE_POOL_OPTION_COMPACT_NODES  SXE_BIT_OPTION(8)    /* Keep node metadata in parallel arrays linked by 32 bit index  */
+#define SXE_POOL_OPTION_STATS          SXE_BIT_OPTION(9)    /* Keep per state statistics (see sxe_pool_get_state_stats())    */
+#define SXE_POOL_OPTION_NUMA_NODE(node) (SXE_POOL_OPTION_NUMA | ((unsigned)(node) << 24))    /* Bind the pool to a NUMA node */
+#define SXE_POOL_OPTION_TO_NUMA_NODE(options) ((unsigned)(options) >> 24)
+#define SXE_POOL_OPTIONS_MEMORY        (SXE_POOL_OPTION_HUGE_PAGES | SXE_POOL_OPTION_HUGE_PAGES_1G | SXE_POOL_OPTION_PREFAULT \
+                                        | SXE_POOL_OPTION_NUMA_NODE(0xFF))
 
 typedef void (*SXE_POOL_EVENT_TIMEOUT)(    void * array, unsigned array_index, void * caller_info);
+typedef bool (*SXE_POOL_VISITOR)(          void * array, unsigned array_index, void * user_data);    /* Return false to stop */
+
+#define SXE_POOL_STATS_DWELL_BUCKETS   24    /* Bucket 0: under 2^-10s; bucket i: [2^(i-11)s, 2^(i-10)s); the last has all longer */
+
+typedef struct SXE_POOL_STATE_STATS {
+    unsigned high_water;                             /* Most elements in the state at once                              */
+    uint64_t entered;                                /* Moves into the state; touching an element counts as a move      */
+    uint64_t left;                                   /* Moves out of the state                                          */
+    uint64_t dwell[SXE_POOL_STATS_DWELL_BUCKETS];    /* Timed pools: how long elements that left had been in the state  */
+} SXE_POOL_STATE_STATS;
 
 typedef struct SXE_POOL_WALKER {
     SXE_LIST_WALKER list_walker;
     void       * pool;
     unsigned     state;
+    unsigned     id;                 /* Compact pools: index of the last object stepped to or SXE_POOL_NO_INDEX */
     union {
         SXE_TIME time;
         uint64_t count;
@@ -0,0 +1,91 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "tap.h"
+
+#define TEST_ELEMENTS 10
+
+enum TEST_STATE {
+    TEST_STATE_FREE = 0,
+    TEST_STATE_USED,
+    TEST_STATE_DONE,
+    TEST_STATE_NUMBER_OF_STATES   /* This is not a state; it MUST come last */
+};
+
+static bool
+test_visitor(void * array, unsigned id, void * user_data)
+{
+    unsigned * sum = user_data;
+
+    *sum += ((unsigned *)array)[id];
+    return ((unsigned *)array)[id] != 3;    /* Stop after the element with value 3 */
+}
+
+static void
+test_bulk(const char * name, unsigned options)
+{
+    SXE_POOL_WALKER walker;
+    unsigned      * array;
+    unsigned        ids[TEST_ELEMENTS];
+    unsigned        i;
+    unsigned        sum = 0;
+
+    array = sxe_pool_new(name, TEST_ELEMENTS, sizeof(*array), TEST_STATE_NUMBER_OF_STATES, options);
+    is(sxe_pool_set_oldest_elements_state(array, TEST_STATE_FREE, TEST_STATE_USED, ids, 4), 4, "%s: Took 4 elements", name);
+
+    for (i = 0; i < 4; i++) {
+        array[ids[i]] = i + 1;
+    }
+
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_USED), 4,                   "%s: 4 elements in use", name);
+    is(sxe_pool_get_oldest_element_index(array, TEST_STATE_USED), ids[0],         "%s: First taken is the oldest", name);
+    is(sxe_pool_visit_state(array, TEST_STATE_USED, test_visitor, &sum), 3,       "%s: Visitor stopped at the third", name);
+    is(sum, 6,                                                                    "%s: Visited 1, 2 and 3", name);
+    is(sxe_pool_set_all_elements_state(array, TEST_STATE_USED, TEST_STATE_DONE), 4, "%s: Moved all 4 used elements", name);
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_USED), 0,                   "%s: No elements in use", name);
+    is(sxe_pool_index_to_state(array, ids[3]), TEST_STATE_DONE,                   "%s: Moved elements are done", name);
+    sxe_pool_set_oldest_elements_state(array, TEST_STATE_FREE, TEST_STATE_USED, ids, 1);
+    array[ids[0]] = 5;
+    is(sxe_pool_set_all_elements_state(array, TEST_STATE_USED, TEST_STATE_DONE), 1, "%s: Moved the new used element", name);
+    sxe_pool_walker_construct(&walker, array, TEST_STATE_DONE);
+
+    for (i = 1; (ids[0] = sxe_pool_walker_step(&walker)) != SXE_POOL_NO_INDEX && array[ids[0]] == i; i++) {
+    }
+
+    is(i, 6,                                                                      "%s: Done elements are in order", name);
+    is(sxe_pool_set_all_elements_state(array, TEST_STATE_USED, TEST_STATE_DONE), 0, "%s: Nothing left to move", name);
+    is(sxe_pool_set_oldest_elements_state(array, TEST_STATE_DONE, TEST_STATE_USED, ids, TEST_ELEMENTS), 5,
+       "%s: Only 5 done elements could be taken", name);
+    sxe_pool_delete(array);
+}
+
+int
+main(void)
+{
+    plan_tests(3 * 12);
+    test_bulk("unlocked",   SXE_POOL_OPTION_UNLOCKED);
+    test_bulk("compact",    SXE_POOL_OPTION_LOCKED | SXE_POOL_OPTION_COMPACT_NODES);
+    test_bulk("concurrent", SXE_POOL_OPTION_CONCURRENT);
+    return exit_status();
+}
@@ -0,0 +1,89 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "sxe-time.h"
+#include "tap.h"
+
+#define TEST_ELEMENTS 8
+
+enum TEST_STATE {
+    TEST_STATE_FREE = 0,
+    TEST_STATE_USED,
+    TEST_STATE_DONE,
+    TEST_STATE_NUMBER_OF_STATES   /* This is not a state; it MUST come last */
+};
+
+int
+main(void)
+{
+    SXE_POOL_WALKER walker;
+    unsigned      * array;
+    SXE_TIME        before;
+    unsigned        i;
+    unsigned        state;
+
+    plan_tests(18);
+    array = sxe_pool_new("compact", TEST_ELEMENTS, sizeof(*array), TEST_STATE_NUMBER_OF_STATES,
+                         SXE_POOL_OPTION_UNLOCKED | SXE_POOL_OPTION_COMPACT_NODES);
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_FREE), TEST_ELEMENTS,        "All elements of a compact pool start free");
+    is(sxe_pool_get_oldest_element_index(array, TEST_STATE_FREE), TEST_ELEMENTS - 1, "Oldest free element is the last one");
+
+    for (i = 0; i < TEST_ELEMENTS; i++) {
+        array[i] = i;
+        sxe_pool_set_indexed_element_state(array, i, TEST_STATE_FREE, TEST_STATE_USED);
+    }
+
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_USED), TEST_ELEMENTS,        "All elements are in use");
+    is(sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED), SXE_POOL_NO_INDEX, "No free elements left");
+    is(sxe_pool_index_to_state(array, 3), TEST_STATE_USED,                         "Element 3 is in use");
+    is(sxe_pool_set_oldest_element_state(array, TEST_STATE_USED, TEST_STATE_DONE), 0, "Element 0 is the oldest in use");
+    sxe_pool_touch_indexed_element(array, 1);
+    is(sxe_pool_get_oldest_element_index(array, TEST_STATE_USED), 2,               "Touching element 1 made element 2 the oldest");
+    sxe_pool_set_indexed_element_state(array, 5, TEST_STATE_USED, TEST_STATE_DONE);
+    state = TEST_STATE_DONE;
+    is(sxe_pool_try_to_set_indexed_element_state(array, 5, TEST_STATE_USED, &state), SXE_POOL_INCORRECT_STATE,
+       "Element 5 was moved out of the middle of the used state");
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_USED), TEST_ELEMENTS - 2,    "Two fewer elements in use");
+
+    sxe_pool_walker_construct(&walker, array, TEST_STATE_USED);
+    is(sxe_pool_walker_step(&walker), 2,                                           "Walk starts at the oldest element");
+    is(sxe_pool_walker_step(&walker), 3,                                           "Then steps to the next oldest");
+    sxe_pool_set_indexed_element_state(array, 3, TEST_STATE_USED, TEST_STATE_DONE);
+    is(sxe_pool_walker_step(&walker), 4,                                           "Stepping past a moved element rewalks");
+    is(sxe_pool_walker_step(&walker), 6,                                           "Element 5 was skipped");
+    is(sxe_pool_walker_step(&walker), 7,                                           "Element 7 is next");
+    is(sxe_pool_walker_step(&walker), 1,                                           "Touched element 1 is the newest");
+    is(sxe_pool_walker_step(&walker), SXE_POOL_NO_INDEX,                           "Walk ends after the newest");
+    sxe_pool_delete(array);
+
+    before = sxe_time_get();
+    array  = sxe_pool_new("compact-timed", TEST_ELEMENTS, sizeof(*array), TEST_STATE_NUMBER_OF_STATES,
+                          SXE_POOL_OPTION_UNLOCKED | SXE_POOL_OPTION_TIMED | SXE_POOL_OPTION_COMPACT_NODES);
+    sxe_pool_set_indexed_element_state(array, 4, TEST_STATE_FREE, TEST_STATE_USED);
+    ok(sxe_pool_get_oldest_element_time(array, TEST_STATE_USED) >= before,         "Oldest time in a compact timed pool is stamped");
+    is(sxe_pool_get_element_time_by_index(array, 4), sxe_pool_get_oldest_element_time(array, TEST_STATE_USED),
+       "Element time matches the oldest time");
+    sxe_pool_delete(array);
+    return exit_status();
+}
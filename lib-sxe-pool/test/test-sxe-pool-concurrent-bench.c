@@ -0,0 +1,131 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "sxe-thread.h"
+#include "sxe-time.h"
+
+#define BENCH_ELEMENTS       1024
+#define BENCH_CYCLES         1000000
+#define BENCH_THREADS_MAX    64
+
+enum BENCH_STATE {
+    BENCH_STATE_FREE = 0,
+    BENCH_STATE_USED,
+    BENCH_STATE_NUMBER_OF_STATES   /* This is not a state; it MUST come last */
+};
+
+static unsigned * bench_array;
+static bool       bench_magazines;
+
+static SXE_THREAD_RETURN SXE_STDCALL
+bench_thread(void * user_data)
+{
+    unsigned i;
+    unsigned id;
+
+    SXE_UNUSED_PARAMETER(user_data);
+
+    if (bench_magazines) {
+        for (i = 0; i < BENCH_CYCLES; i++) {
+            while ((id = sxe_pool_magazine_take(bench_array)) >= SXE_POOL_LOCK_NOT_TAKEN) {
+            }
+
+            bench_array[id]++;
+            sxe_pool_magazine_give(bench_array, id);
+        }
+
+        sxe_pool_magazine_flush(bench_array);
+        return (SXE_THREAD_RETURN)0;
+    }
+
+    for (i = 0; i < BENCH_CYCLES; i++) {
+        while ((id = sxe_pool_set_oldest_element_state(bench_array, BENCH_STATE_FREE, BENCH_STATE_USED)) >= SXE_POOL_LOCK_NOT_TAKEN) {
+        }
+
+        bench_array[id]++;
+
+        while (sxe_pool_set_indexed_element_state(bench_array, id, BENCH_STATE_USED, BENCH_STATE_FREE) != SXE_POOL_LOCK_TAKEN) {
+        }
+    }
+
+    return (SXE_THREAD_RETURN)0;
+}
+
+static void
+bench_run(const char * mode, unsigned options, unsigned threads)
+{
+    SXE_THREAD thread[BENCH_THREADS_MAX];
+    SXE_TIME   start_time;
+    SXE_TIME   elapsed;
+    unsigned   i;
+
+    bench_magazines = (options & SXE_POOL_OPTION_MAGAZINES) != 0;
+    bench_array     = sxe_pool_new("bench", BENCH_ELEMENTS, sizeof(*bench_array), BENCH_STATE_NUMBER_OF_STATES, options);
+    start_time      = sxe_time_get();
+
+    for (i = 0; i < threads; i++) {
+        SXEA1(sxe_thread_create(&thread[i], bench_thread, NULL, SXE_THREAD_OPTION_DEFAULTS) == SXE_RETURN_OK,
+              "Failed to create thread %u", i);
+    }
+
+    for (i = 0; i < threads; i++) {
+        SXEA1(sxe_thread_wait(thread[i], NULL) == SXE_RETURN_OK, "Failed to wait for thread %u", i);
+    }
+
+    elapsed = sxe_time_get() - start_time;
+    printf("%-10s %2u threads: %10.0f take/give pairs per second\n", mode, threads,
+           (double)BENCH_CYCLES * threads / sxe_time_to_double_seconds(elapsed));
+    sxe_pool_delete(bench_array);
+}
+
+int
+main(int argc, char ** argv)
+{
+    unsigned threads_maximum = 16;
+    unsigned threads;
+
+    if (argc == 1) {
+        fprintf(stderr, "To benchmark thread safe pools, run: build-linux-64-release/test-sxe-pool-concurrent-bench -r [threads]\n");
+        exit(0);
+    }
+
+    if (argc > 2) {
+        threads_maximum = atoi(argv[2]);
+        SXEA1(threads_maximum > 0 && threads_maximum <= BENCH_THREADS_MAX, "Threads must be between 1 and %u", BENCH_THREADS_MAX);
+    }
+
+    sxe_log_set_level(SXE_LOG_LEVEL_WARNING);
+
+    for (threads = 1; threads <= threads_maximum; threads *= 2) {
+        bench_run("locked",     SXE_POOL_OPTION_LOCKED,     threads);
+        bench_run("concurrent", SXE_POOL_OPTION_CONCURRENT, threads);
+        bench_run("magazines",  SXE_POOL_OPTION_LOCKED | SXE_POOL_OPTION_MAGAZINES, threads);
+    }
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "sxe-thread.h"
+#include "tap.h"
+
+#define TEST_THREADS    8
+#define TEST_CYCLES     100000
+#define TEST_ELEMENTS   64
+
+enum TEST_STATE {
+    TEST_STATE_FREE = 0,
+    TEST_STATE_USED,
+    TEST_STATE_DONE,
+    TEST_STATE_NUMBER_OF_STATES   /* This is not a state; it MUST come last */
+};
+
+static volatile unsigned * test_array;
+static volatile unsigned   test_double_takes = 0;
+
+/* Take elements and give them back, checking that no element is ever held by two threads at once, and touch elements that other
+ * threads are moving between states
+ */
+static SXE_THREAD_RETURN SXE_STDCALL
+test_thread(void * user_data)
+{
+    unsigned i;
+    unsigned id;
+
+    SXE_UNUSED_PARAMETER(user_data);
+
+    for (i = 0; i < TEST_CYCLES; i++) {
+        if ((id = sxe_pool_set_oldest_element_state(SXE_CAST_NOCONST(void *, test_array), TEST_STATE_FREE, TEST_STATE_USED))
+         == SXE_POOL_NO_INDEX) {
+            continue;
+        }
+
+        if (__sync_add_and_fetch(&test_array[id], 1) != 1) {
+            __sync_add_and_fetch(&test_double_takes, 1);
+        }
+
+        __sync_sub_and_fetch(&test_array[id], 1);
+        sxe_pool_touch_indexed_element(SXE_CAST_NOCONST(void *, test_array), (id + 1 + i) % TEST_ELEMENTS);
+
+        if (i % 2) {
+            sxe_pool_set_indexed_element_state(SXE_CAST_NOCONST(void *, test_array), id, TEST_STATE_USED, TEST_STATE_FREE);
+        }
+        else {    /* Round trip through DONE so that both locked states are exercised */
+            sxe_pool_set_indexed_element_state(SXE_CAST_NOCONST(void *, test_array), id, TEST_STATE_USED, TEST_STATE_DONE);
+            sxe_pool_set_oldest_element_state(SXE_CAST_NOCONST(void *, test_array), TEST_STATE_DONE, TEST_STATE_FREE);
+        }
+    }
+
+    return (SXE_THREAD_RETURN)0;
+}
+
+int
+main(void)
+{
+    SXE_THREAD      threads[TEST_THREADS];
+    SXE_POOL_WALKER walker;
+    unsigned      * pool;
+    unsigned        state;
+    unsigned        i;
+
+    plan_tests(26);
+    pool = sxe_pool_new("concurrent", 4, sizeof(unsigned), TEST_STATE_NUMBER_OF_STATES, SXE_POOL_OPTION_CONCURRENT);
+    is(sxe_pool_get_number_in_state(pool, TEST_STATE_FREE), 4,                               "4 elements are free");
+    is(sxe_pool_get_oldest_element_index(pool, TEST_STATE_FREE), 0,                          "Element 0 will be taken first");
+    is(sxe_pool_set_oldest_element_state(pool, TEST_STATE_FREE, TEST_STATE_USED), 0,         "Took element 0");
+    is(sxe_pool_set_oldest_element_state(pool, TEST_STATE_FREE, TEST_STATE_USED), 1,         "Took element 1");
+    is(sxe_pool_set_oldest_element_state(pool, TEST_STATE_FREE, TEST_STATE_USED), 2,         "Took element 2");
+    is(sxe_pool_get_number_in_state(pool, TEST_STATE_FREE), 1,                               "1 element is free");
+    is(sxe_pool_get_number_in_state(pool, TEST_STATE_USED), 3,                               "3 elements are used");
+    is(sxe_pool_index_to_state(pool, 1), TEST_STATE_USED,                                    "Element 1 is used");
+
+    is(sxe_pool_set_indexed_element_state(pool, 1, TEST_STATE_USED, TEST_STATE_FREE), SXE_POOL_LOCK_TAKEN,
+                                                                                             "Gave back element 1");
+    is(sxe_pool_index_to_state(pool, 1), TEST_STATE_FREE,                                    "Element 1 is free");
+    is(sxe_pool_set_oldest_element_state(pool, TEST_STATE_FREE, TEST_STATE_USED), 1,         "Free state is LIFO");
+    is(sxe_pool_set_oldest_element_state(pool, TEST_STATE_FREE, TEST_STATE_USED), 3,         "Took element 3");
+    is(sxe_pool_set_oldest_element_state(pool, TEST_STATE_FREE, TEST_STATE_USED), SXE_POOL_NO_INDEX,
+                                                                                             "No more free elements");
+    is(sxe_pool_get_oldest_element_index(pool, TEST_STATE_FREE), SXE_POOL_NO_INDEX,          "Free state is empty");
+
+    /* Other states are still oldest first: USED is now 0, 2, 1, 3 */
+    is(sxe_pool_get_oldest_element_index(pool, TEST_STATE_USED), 0,                          "Element 0 is the oldest used");
+    sxe_pool_touch_indexed_element(pool, 0);
+    is(sxe_pool_get_oldest_element_index(pool, TEST_STATE_USED), 2,                          "Touched element 0 is the newest");
+    is(sxe_pool_set_oldest_element_state(pool, TEST_STATE_USED, TEST_STATE_DONE), 2,         "Moved oldest used to done");
+    state = TEST_STATE_DONE;
+    is(sxe_pool_try_to_set_indexed_element_state(pool, 2, TEST_STATE_USED, &state), SXE_POOL_INCORRECT_STATE,
+                                                                                             "Element 2 is not used");
+    is(state, TEST_STATE_DONE,                                                               "Element 2 is done");
+    state = TEST_STATE_USED;
+    is(sxe_pool_try_to_set_indexed_element_state(pool, 2, TEST_STATE_DONE, &state), 2,      "Moved element 2 back to used");
+
+    sxe_pool_walker_construct(&walker, pool, TEST_STATE_USED);
+    is(sxe_pool_walker_step(&walker), 1,                                                     "Walked to element 1");
+    is(sxe_pool_walker_step(&walker), 3,                                                     "Walked to element 3");
+    is(sxe_pool_walker_step(&walker), 0,                                                     "Walked to element 0");
+    is(sxe_pool_walker_step(&walker), 2,                                                     "Walked to element 2");
+    is(sxe_pool_walker_step(&walker), SXE_POOL_NO_INDEX,                                     "Walked all used elements");
+    sxe_pool_delete(pool);
+
+    /* Hammer a concurrent pool from several threads */
+    test_array = sxe_pool_new("hammered", TEST_ELEMENTS, sizeof(unsigned), TEST_STATE_NUMBER_OF_STATES,
+                              SXE_POOL_OPTION_CONCURRENT);
+    memset(SXE_CAST_NOCONST(unsigned *, test_array), 0, TEST_ELEMENTS * sizeof(unsigned));
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        SXEA1(sxe_thread_create(&threads[i], test_thread, NULL, SXE_THREAD_OPTION_DEFAULTS) == SXE_RETURN_OK,
+              "Unable to create thread");
+    }
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        sxe_thread_wait(threads[i], NULL);
+    }
+
+    ok(test_double_takes == 0 && sxe_pool_get_number_in_state(SXE_CAST_NOCONST(void *, test_array), TEST_STATE_FREE)
+                                 == TEST_ELEMENTS,                                           "No element was taken twice and all were returned");
+    sxe_pool_delete(SXE_CAST_NOCONST(void *, test_array));
+    return exit_status();
+}
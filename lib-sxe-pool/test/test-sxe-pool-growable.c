@@ -0,0 +1,94 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "tap.h"
+
+#define TEST_SEGMENT    100
+#define TEST_MAXIMUM    250
+
+enum TEST_STATE {
+    TEST_STATE_FREE = 0,
+    TEST_STATE_USED,
+    TEST_STATE_NUMBER_OF_STATES   /* This is not a state; it MUST come last */
+};
+
+typedef struct TEST_ELEMENT {
+    unsigned id;
+    char     payload[60];
+} TEST_ELEMENT;
+
+int
+main(void)
+{
+    TEST_ELEMENT * array;
+    TEST_ELEMENT * first;
+    unsigned       i;
+    unsigned       id;
+
+    plan_tests(17);
+    array = sxe_pool_new_growable("growable", TEST_SEGMENT, TEST_MAXIMUM, sizeof(*array), TEST_STATE_NUMBER_OF_STATES,
+                                  SXE_POOL_OPTION_UNLOCKED);
+    is(sxe_pool_get_number(array), TEST_SEGMENT,                                 "Growable pool starts with one segment");
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_FREE), TEST_SEGMENT,       "All of which are free");
+    is(sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED), 0, "Elements are taken lowest index first");
+    array[0].id = 0;
+    first       = &array[0];
+
+    for (i = 1; i < TEST_SEGMENT; i++) {
+        id           = sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED);
+        array[id].id = id;
+    }
+
+    is(sxe_pool_get_number(array), TEST_SEGMENT,                                 "Taking every element doesn't grow the pool");
+    is(sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED), TEST_SEGMENT,
+       "Taking one more grows the pool by a segment");
+    is(sxe_pool_get_number(array), 2 * TEST_SEGMENT,                             "Pool has two segments");
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_FREE), TEST_SEGMENT - 1,   "The rest of the new segment is free");
+    ok(&array[0] == first && array[TEST_SEGMENT - 1].id == TEST_SEGMENT - 1,     "Growing didn't move existing elements");
+
+    for (i = TEST_SEGMENT + 1; i < TEST_MAXIMUM; i++) {
+        id           = sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED);
+        array[id].id = id;
+    }
+
+    is(sxe_pool_get_number(array), TEST_MAXIMUM,                                 "Pool grew to its maximum with a partial segment");
+    is(sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED), SXE_POOL_NO_INDEX,
+       "A pool at its maximum can't grow");
+    is(sxe_pool_grow(array), 0,                                                  "Explicit growth at the maximum adds nothing");
+    is(sxe_pool_shrink(array), 0,                                                "Can't shrink a pool with no free segments");
+
+    for (i = TEST_SEGMENT; i < TEST_MAXIMUM; i++) {
+        sxe_pool_set_indexed_element_state(array, i, TEST_STATE_USED, TEST_STATE_FREE);
+    }
+
+    sxe_pool_set_indexed_element_state(array, TEST_SEGMENT, TEST_STATE_FREE, TEST_STATE_USED);
+    is(sxe_pool_shrink(array), TEST_MAXIMUM - 2 * TEST_SEGMENT,                  "Only the trailing free segment was given back");
+    is(sxe_pool_get_number(array), 2 * TEST_SEGMENT,                             "Pool is back to two segments");
+    sxe_pool_set_indexed_element_state(array, TEST_SEGMENT, TEST_STATE_USED, TEST_STATE_FREE);
+    is(sxe_pool_shrink(array), TEST_SEGMENT,                                     "The second segment was given back once free");
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_FREE), 0,                  "Given back elements are no longer free");
+    is(sxe_pool_grow(array), TEST_SEGMENT,                                       "The pool can grow again");
+    sxe_pool_delete(array);
+    return exit_status();
+}
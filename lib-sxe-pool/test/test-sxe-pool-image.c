@@ -0,0 +1,174 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "sxe-test-get-temp-file-name.h"
+#include "tap.h"
+
+#define TEST_ELEMENTS 16
+#define TEST_MOVES    4    /* Elements used by each of the parent and the child in the cross process test */
+
+enum TEST_STATE {
+    TEST_STATE_FREE = 0,
+    TEST_STATE_USED,
+    TEST_STATE_NUMBER_OF_STATES   /* This is not a state; it MUST come last */
+};
+
+/* Attach to the image in a child process, tell the parent, and once it says go, use elements while the parent does the same
+ */
+static int
+test_child(const char * path, int to_parent, int from_parent)
+{
+    SXE_MMAP   memmap;
+    unsigned * array;
+    unsigned   i;
+    char       go;
+
+    if ((array = sxe_pool_image_attach(&memmap, path)) == NULL || write(to_parent, "a", 1) != 1
+     || read(from_parent, &go, 1) != 1) {
+        return 1;
+    }
+
+    for (i = 0; i < TEST_MOVES; i++) {
+        array[sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED)] = 200 + i;
+        usleep(1000);
+    }
+
+    sxe_pool_image_detach(&memmap);
+    return 0;
+}
+
+int
+main(void)
+{
+    char            path[PATH_MAX];
+    unsigned        path_used;
+    SXE_MMAP        memmap;
+    SXE_MMAP        other_memmap;
+    SXE_POOL_WALKER walker;
+    unsigned      * array;
+    unsigned      * other;
+    unsigned        i;
+    unsigned        parent_sum;
+    unsigned        child_sum;
+    uint64_t        pool_size;
+    FILE          * file;
+    void          * before;
+    int             to_parent[2];
+    int             to_child[2];
+    int             status;
+    pid_t           pid;
+    char            attached;
+
+    plan_tests(21);
+    sxe_test_get_temp_file_name("test-sxe-pool-image", path, sizeof(path), &path_used);
+    unlink(path);
+    ok(sxe_pool_image_attach(&memmap, path) == NULL,                              "Can't attach to an image that doesn't exist");
+
+    array = sxe_pool_image_create(&memmap, path, "image", TEST_ELEMENTS, sizeof(*array), TEST_STATE_NUMBER_OF_STATES,
+                                  SXE_POOL_OPTION_LOCKED | SXE_POOL_OPTION_COMPACT_NODES);
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_FREE), TEST_ELEMENTS,      "New image pool is all free");
+
+    for (i = 0; i < 3; i++) {
+        array[sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED)] = 100 + i;
+    }
+
+    sxe_pool_image_detach(&memmap);    /* Simulate a restart */
+
+    ok((array = sxe_pool_image_attach(&memmap, path)) != NULL,                    "Reattached to the image");
+    is_eq(sxe_pool_get_name(array), "image",                                      "Pool name was kept");
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_USED), 3,                   "Used elements were kept");
+    sxe_pool_walker_construct(&walker, array, TEST_STATE_USED);
+    is(array[sxe_pool_walker_step(&walker)], 100,                                 "Oldest used element's contents were kept");
+    is(array[sxe_pool_walker_step(&walker)], 101,                                 "Next used element's contents were kept");
+    is(array[sxe_pool_walker_step(&walker)], 102,                                 "Newest used element's contents were kept");
+    is(sxe_pool_walker_step(&walker), SXE_POOL_NO_INDEX,                          "And there are no others");
+
+    ok((other = sxe_pool_image_attach(&other_memmap, path)) != NULL && other != array, "Attached again at another address");
+    i = sxe_pool_set_oldest_element_state(other, TEST_STATE_FREE, TEST_STATE_USED);
+    other[i] = 103;
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_USED), 4,                   "Change through one mapping is seen in the other");
+    is(sxe_pool_get_oldest_element_index(array, TEST_STATE_FREE), sxe_pool_get_oldest_element_index(other, TEST_STATE_FREE),
+       "Both mappings agree on the oldest free element");
+    is(array[i], 103,                                                             "Element written through one mapping is seen in the other");
+    sxe_pool_image_detach(&other_memmap);
+
+    /* Attach in another process while this one keeps using the pool
+     */
+    SXEA1((before = malloc(memmap.size)) != NULL, "Failed to allocate a copy of the image");
+    memcpy(before, memmap.addr, memmap.size);
+    SXEA1(pipe(to_parent) == 0 && pipe(to_child) == 0, "Failed to create pipes");
+
+    if ((pid = fork()) == 0) {
+        exit(test_child(path, to_parent[1], to_child[0]));
+    }
+
+    is(read(to_parent[0], &attached, 1), 1,                                      "Child attached to the image");
+    ok(memcmp(before, memmap.addr, memmap.size) == 0,                             "Attaching in the child didn't change the image");
+    SXEA1(write(to_child[1], "g", 1) == 1, "Failed to tell the child to go");
+
+    for (i = 0; i < TEST_MOVES; i++) {
+        array[sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED)] = 300 + i;
+        usleep(1000);
+    }
+
+    is(waitpid(pid, &status, 0), pid,                                             "Child exited");
+    ok(WIFEXITED(status) && WEXITSTATUS(status) == 0,                             "Child used the pool");
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_USED), 4 + 2 * TEST_MOVES,  "Elements used by both processes are used");
+    sxe_pool_walker_construct(&walker, array, TEST_STATE_USED);
+    parent_sum = child_sum = 0;
+
+    while ((i = sxe_pool_walker_step(&walker)) != SXE_POOL_NO_INDEX) {
+        parent_sum += array[i] >= 300 ? array[i] - 300 + 1 : 0;
+        child_sum  += array[i] >= 200 && array[i] < 300 ? array[i] - 200 + 1 : 0;
+    }
+
+    ok(parent_sum == TEST_MOVES * (TEST_MOVES + 1) / 2 && child_sum == TEST_MOVES * (TEST_MOVES + 1) / 2,
+       "Every element written by either process is intact");
+    free(before);
+    sxe_pool_image_detach(&memmap);
+
+    SXEA1((file = fopen(path, "r+b")) != NULL, "Failed to open %s", path);
+    SXEA1(fseek(file, 2 * sizeof(uint64_t), SEEK_SET) == 0 && fread(&pool_size, sizeof(pool_size), 1, file) == 1,
+          "Failed to read the pool size");
+    pool_size--;    /* Still fits in the file, but doesn't match the pool */
+    SXEA1(fseek(file, 2 * sizeof(uint64_t), SEEK_SET) == 0 && fwrite(&pool_size, sizeof(pool_size), 1, file) == 1,
+          "Failed to write the pool size");
+    fclose(file);
+    ok(sxe_pool_image_attach(&memmap, path) == NULL,                              "Can't attach to an image whose size is wrong");
+
+    SXEA1((file = fopen(path, "r+b")) != NULL, "Failed to open %s", path);
+    fputc('X', file);    /* Corrupt the magic number */
+    fclose(file);
+    ok(sxe_pool_image_attach(&memmap, path) == NULL,                              "Can't attach to a corrupt image");
+    unlink(path);
+    return exit_status();
+}
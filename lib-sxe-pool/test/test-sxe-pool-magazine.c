@@ -0,0 +1,154 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "sxe-spinlock.h"
+#include "sxe-thread.h"
+#include "tap.h"
+
+#define TEST_ELEMENTS   64
+#define TEST_THREADS    4
+#define TEST_CYCLES     100000
+#define TEST_EXITING    200       /* More threads than there are magazine slots, run one after another */
+
+enum TEST_STATE {
+    TEST_STATE_FREE = 0,
+    TEST_STATE_USED,
+    TEST_STATE_NUMBER_OF_STATES   /* This is not a state; it MUST come last */
+};
+
+static unsigned          * test_array;
+static volatile unsigned   test_double_takes = 0;
+static unsigned            test_magazine_threads = 0;
+
+static SXE_THREAD_RETURN SXE_STDCALL
+test_thread(void * user_data)
+{
+    unsigned ids[4];
+    unsigned i;
+    unsigned j;
+
+    SXE_UNUSED_PARAMETER(user_data);
+
+    for (i = 0; i < TEST_CYCLES; i++) {
+        for (j = 0; j < 4; j++) {    /* Hold a few elements at a time so that magazines run dry and overflow */
+            while ((ids[j] = sxe_pool_magazine_take(test_array)) == SXE_POOL_NO_INDEX) {
+                SXE_YIELD();
+            }
+
+            if (__sync_add_and_fetch(&test_array[ids[j]], 1) != 1) {
+                __sync_add_and_fetch(&test_double_takes, 1);
+            }
+        }
+
+        for (j = 0; j < 4; j++) {
+            __sync_sub_and_fetch(&test_array[ids[j]], 1);
+            sxe_pool_magazine_give(test_array, ids[j]);
+        }
+    }
+
+    sxe_pool_magazine_flush(test_array);
+    return (SXE_THREAD_RETURN)0;
+}
+
+/* Take and give back an element, leaving it in the thread's magazine for its exit to flush
+ */
+static SXE_THREAD_RETURN SXE_STDCALL
+test_exiting_thread(void * user_data)
+{
+    unsigned id;
+
+    SXE_UNUSED_PARAMETER(user_data);
+    id = sxe_pool_magazine_take(test_array);
+    test_magazine_threads += sxe_pool_get_number_in_state(test_array, TEST_STATE_FREE) < TEST_ELEMENTS - 1;  /* Took a batch */
+    sxe_pool_magazine_give(test_array, id);
+    return (SXE_THREAD_RETURN)0;
+}
+
+int
+main(void)
+{
+    SXE_THREAD thread[TEST_THREADS];
+    unsigned   ids[TEST_ELEMENTS];
+    unsigned   id;
+    unsigned   i;
+
+    plan_tests(18);
+    test_array = sxe_pool_new("magazine", TEST_ELEMENTS, sizeof(*test_array), TEST_STATE_NUMBER_OF_STATES,
+                              SXE_POOL_OPTION_LOCKED | SXE_POOL_OPTION_MAGAZINES);
+
+    id = sxe_pool_magazine_take(test_array);
+    is(id, TEST_ELEMENTS - 1,                                                "First take gets the oldest free element");
+    is(sxe_pool_index_to_state(test_array, id), TEST_STATE_NUMBER_OF_STATES, "Taken element is in the magazine pseudo state");
+    is(sxe_pool_get_number_in_state(test_array, TEST_STATE_FREE), TEST_ELEMENTS - 16,
+       "A batch of 16 elements was moved from the free state to the magazine");
+    is(sxe_pool_magazine_give(test_array, id), SXE_POOL_LOCK_TAKEN,         "Give back to the magazine");
+    is(sxe_pool_magazine_take(test_array), id,                               "Take again gets the same (cache warm) element");
+    is(sxe_pool_set_oldest_element_state(test_array, TEST_STATE_FREE, TEST_STATE_USED), TEST_ELEMENTS - 17,
+       "Elements can still be taken from the shared free state");
+    is(sxe_pool_set_indexed_element_state(test_array, TEST_ELEMENTS - 17, TEST_STATE_USED, TEST_STATE_FREE), SXE_POOL_LOCK_TAKEN,
+       "And given back to it");
+    sxe_pool_magazine_give(test_array, id);
+
+    for (i = 0; i < TEST_ELEMENTS; i++) {
+        ids[i] = sxe_pool_magazine_take(test_array);
+    }
+
+    is(sxe_pool_get_number_in_state(test_array, TEST_STATE_FREE), 0,        "All elements have been taken");
+    is(sxe_pool_magazine_take(test_array), SXE_POOL_NO_INDEX,                "No more elements to take");
+
+    for (i = 0; i < TEST_ELEMENTS; i++) {
+        sxe_pool_magazine_give(test_array, ids[i]);
+    }
+
+    is(sxe_pool_get_number_in_state(test_array, TEST_STATE_FREE), TEST_ELEMENTS - 16,
+       "Overflowing the magazine flushed batches back to the free state");
+    is(sxe_pool_index_to_state(test_array, ids[0]), TEST_STATE_FREE,        "The first elements given back were flushed");
+    is(sxe_pool_magazine_take(test_array), ids[TEST_ELEMENTS - 1],          "The last element given back is taken first");
+    sxe_pool_magazine_give(test_array, ids[TEST_ELEMENTS - 1]);
+    is(sxe_pool_magazine_flush(test_array), SXE_POOL_LOCK_TAKEN,            "Flush the magazine");
+    is(sxe_pool_get_number_in_state(test_array, TEST_STATE_FREE), TEST_ELEMENTS, "All elements are back in the free state");
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        SXEA1(sxe_thread_create(&thread[i], test_thread, NULL, SXE_THREAD_OPTION_DEFAULTS) == SXE_RETURN_OK,
+              "Failed to create thread %u", i);
+    }
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        SXEA1(sxe_thread_wait(thread[i], NULL) == SXE_RETURN_OK, "Failed to wait for thread %u", i);
+    }
+
+    is(test_double_takes, 0,                                                 "No element was held by two threads at once");
+    is(sxe_pool_get_number_in_state(test_array, TEST_STATE_FREE), TEST_ELEMENTS, "All elements were flushed back by their threads");
+
+    for (i = 0; i < TEST_EXITING; i++) {
+        SXEA1(sxe_thread_create(&thread[0], test_exiting_thread, NULL, SXE_THREAD_OPTION_DEFAULTS) == SXE_RETURN_OK,
+              "Failed to create exiting thread %u", i);
+        SXEA1(sxe_thread_wait(thread[0], NULL) == SXE_RETURN_OK, "Failed to wait for exiting thread %u", i);
+    }
+
+    is(test_magazine_threads, TEST_EXITING,                                  "Slots of exited threads were reused");
+    is(sxe_pool_get_number_in_state(test_array, TEST_STATE_FREE), TEST_ELEMENTS, "Exiting threads flushed their magazines");
+    sxe_pool_delete(test_array);
+    return exit_status();
+}
@@ -0,0 +1,95 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "tap.h"
+
+#define TEST_ELEMENTS   10000
+
+enum TEST_STATE {
+    TEST_STATE_FREE = 0,
+    TEST_STATE_USED,
+    TEST_STATE_NUMBER_OF_STATES   /* This is not a state; it MUST come last */
+};
+
+typedef struct TEST_ELEMENT {
+    char payload[100];
+} TEST_ELEMENT;
+
+static void
+test_pool(const char * name, unsigned options)
+{
+    TEST_ELEMENT * array;
+    unsigned       i;
+    unsigned       id;
+    unsigned       zeros = 0;
+
+    array = sxe_pool_new(name, TEST_ELEMENTS, sizeof(*array), TEST_STATE_NUMBER_OF_STATES, options);
+
+    for (i = 0; i < TEST_ELEMENTS; i++) {
+        id     = sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED);
+        zeros += array[id].payload[0] == 0 && array[id].payload[sizeof(array[id].payload) - 1] == 0;
+        memset(array[id].payload, 0xA5, sizeof(array[id].payload));
+    }
+
+    is(zeros, TEST_ELEMENTS,                                               "%s: Mapped elements start out zeroed", name);
+    is(sxe_pool_get_number_in_state(array, TEST_STATE_USED), TEST_ELEMENTS, "%s: All elements could be taken and written", name);
+    sxe_pool_delete(array);
+}
+
+int
+main(void)
+{
+    TEST_ELEMENT * array;
+    char         * base;
+
+    plan_tests(17);
+    is(sxe_pool_memory_mapped_size(1, 0),                             4096,       "Normal pages are 4KB");
+    is(sxe_pool_memory_mapped_size(4097, 0),                          8192,       "Sizes are rounded up to whole pages");
+    is(sxe_pool_memory_mapped_size(1, SXE_POOL_OPTION_HUGE_PAGES),    2UL << 20,  "Huge pages are 2MB");
+    is(sxe_pool_memory_mapped_size(1, SXE_POOL_OPTION_HUGE_PAGES_1G), 1UL << 30,  "Gigantic pages are 1GB");
+
+    /* These work whether or not huge pages have been reserved or the machine has NUMA nodes; failures fall back with a message
+     */
+    test_pool("prefault",   SXE_POOL_OPTION_PREFAULT);
+    test_pool("huge",       SXE_POOL_OPTION_HUGE_PAGES | SXE_POOL_OPTION_PREFAULT);
+    test_pool("huge-1g",    SXE_POOL_OPTION_HUGE_PAGES_1G | SXE_POOL_OPTION_LOCKED);
+    test_pool("numa",       SXE_POOL_OPTION_NUMA_NODE(0) | SXE_POOL_OPTION_PREFAULT);
+    test_pool("numa-bogus", SXE_POOL_OPTION_NUMA_NODE(200));
+
+    array = sxe_pool_new_growable("huge-growable", 100, TEST_ELEMENTS, sizeof(*array), TEST_STATE_NUMBER_OF_STATES,
+                                  SXE_POOL_OPTION_HUGE_PAGES | SXE_POOL_OPTION_NUMA_NODE(0));
+    is(sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED), 0, "Growable pools take memory options too");
+    sxe_pool_delete(array);
+
+    /* Without reserved gigantic pages, only the normal page needed is mapped and prefaulted, and it is unmapped again
+     */
+    ok((base = sxe_pool_memory_map(1, SXE_POOL_OPTION_HUGE_PAGES_1G | SXE_POOL_OPTION_PREFAULT, false)) != NULL,
+       "Mapped a byte asking for gigantic pages");
+    base[0] = 1;
+    is(base[0], 1,                                                                    "The mapped byte can be written");
+    sxe_pool_memory_unmap(base, 1, SXE_POOL_OPTION_HUGE_PAGES_1G | SXE_POOL_OPTION_PREFAULT);
+    return exit_status();
+}
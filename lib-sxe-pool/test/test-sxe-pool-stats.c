@@ -0,0 +1,95 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "tap.h"
+
+#define TEST_ELEMENTS 8
+
+enum TEST_STATE {
+    TEST_STATE_FREE = 0,
+    TEST_STATE_USED,
+    TEST_STATE_NUMBER_OF_STATES   /* This is not a state; it MUST come last */
+};
+
+int
+main(void)
+{
+    SXE_POOL_STATE_STATS stats;
+    unsigned           * array;
+    unsigned             ids[TEST_ELEMENTS];
+    char                 buffer[256];
+    unsigned             i;
+    uint64_t             dwells;
+
+    plan_tests(17);
+    array = sxe_pool_new("stats", TEST_ELEMENTS, sizeof(*array), TEST_STATE_NUMBER_OF_STATES,
+                         SXE_POOL_OPTION_UNLOCKED | SXE_POOL_OPTION_STATS);
+    ok(sxe_pool_find_by_name("stats") == array,                            "Found the pool by name");
+    ok(sxe_pool_find_by_name("nonesuch") == NULL,                          "Didn't find a pool that doesn't exist");
+    sxe_pool_set_oldest_elements_state(array, TEST_STATE_FREE, TEST_STATE_USED, ids, 5);
+
+    for (i = 0; i < 3; i++) {
+        sxe_pool_set_indexed_element_state(array, ids[i], TEST_STATE_USED, TEST_STATE_FREE);
+    }
+
+    sxe_pool_get_state_stats(array, TEST_STATE_USED, &stats);
+    is(stats.high_water, 5,                                                "Used high water mark is 5");
+    is(stats.entered,    5,                                                "5 elements entered the used state");
+    is(stats.left,       3,                                                "3 elements left it");
+    sxe_pool_get_state_stats(array, TEST_STATE_FREE, &stats);
+    is(stats.high_water, TEST_ELEMENTS,                                    "Free high water mark is the pool size");
+    is(stats.left,       5,                                                "5 elements left the free state");
+    sxe_pool_touch_indexed_element(array, ids[4]);
+    sxe_pool_get_state_stats(array, TEST_STATE_USED, &stats);
+    is(stats.entered,    6,                                                "Touching counts as entering the state");
+    sxe_pool_set_all_elements_state(array, TEST_STATE_USED, TEST_STATE_FREE);
+    sxe_pool_get_state_stats(array, TEST_STATE_FREE, &stats);
+    is(stats.entered,    5,                                                "Moving all counts every element");
+    ok(sxe_pool_format_stats(array, buffer, sizeof(buffer)) < sizeof(buffer), "Formatted the statistics");
+    is_eq(strchr(buffer, '\n') + 1, "stats 1: count=0 high_water=5 entered=6 left=6\n", "Used state line is as expected");
+    sxe_pool_reset_stats(array);
+    sxe_pool_get_state_stats(array, TEST_STATE_FREE, &stats);
+    ok(stats.entered == 0 && stats.high_water == TEST_ELEMENTS,            "Reset statistics, keeping the current high water mark");
+    sxe_pool_delete(array);
+    ok(sxe_pool_find_by_name("stats") == NULL,                             "Deleted pool is no longer found");
+
+    array = sxe_pool_new("timed", TEST_ELEMENTS, sizeof(*array), TEST_STATE_NUMBER_OF_STATES,
+                         SXE_POOL_OPTION_UNLOCKED | SXE_POOL_OPTION_TIMED | SXE_POOL_OPTION_STATS);
+    i = sxe_pool_set_oldest_element_state(array, TEST_STATE_FREE, TEST_STATE_USED);
+    sxe_pool_set_indexed_element_state(array, i, TEST_STATE_USED, TEST_STATE_FREE);
+    sxe_pool_get_state_stats(array, TEST_STATE_USED, &stats);
+    is(stats.left, 1,                                                      "One element left the used state");
+
+    for (i = 0, dwells = 0; i < SXE_POOL_STATS_DWELL_BUCKETS; i++) {
+        dwells += stats.dwell[i];
+    }
+
+    is(dwells, 1,                                                          "Its dwell time was recorded");
+    ok(sxe_pool_format_stats(array, buffer, 20) > 20,                      "Long statistics are truncated");
+    is(strlen(buffer), 19,                                                 "Truncated statistics are '\\0' terminated");
+    sxe_pool_delete(array);
+    return exit_status();
+}
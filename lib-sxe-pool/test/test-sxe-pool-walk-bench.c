@@ -0,0 +1,118 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "sxe-time.h"
+
+#define BENCH_ELEMENTS_DEFAULT 10000000
+#define BENCH_WALKS            3
+
+enum BENCH_STATE {
+    BENCH_STATE_FREE = 0,
+    BENCH_STATE_USED,
+    BENCH_STATE_NUMBER_OF_STATES   /* This is not a state; it MUST come last */
+};
+
+typedef struct BENCH_ELEMENT {
+    unsigned value;
+    char     payload[60];
+} BENCH_ELEMENT;
+
+/* Move every element to the used state in a scattered order, so that walks don't just stream through memory
+ */
+static void
+bench_scatter(BENCH_ELEMENT * array, unsigned elements)
+{
+    unsigned i;
+    unsigned stride = 7919;    /* Prime, so i * stride visits every index when elements isn't a multiple of it */
+
+    if (elements % stride == 0) {
+        stride = 1;    /* Coverage exclusion: benchmark only */
+    }
+
+    for (i = 0; i < elements; i++) {
+        sxe_pool_set_indexed_element_state(array, (unsigned)(((uint64_t)i * stride) % elements), BENCH_STATE_FREE,
+                                           BENCH_STATE_USED);
+    }
+}
+
+static void
+bench_run(const char * mode, unsigned options, unsigned elements)
+{
+    BENCH_ELEMENT * array;
+    SXE_POOL_WALKER walker;
+    SXE_TIME        start_time;
+    double          seconds;
+    unsigned        walk;
+    unsigned        id;
+    unsigned        count = 0;
+
+    array = sxe_pool_new("bench", elements, sizeof(*array), BENCH_STATE_NUMBER_OF_STATES, options);
+    bench_scatter(array, elements);
+    start_time = sxe_time_get();
+
+    for (walk = 0; walk < BENCH_WALKS; walk++) {
+        sxe_pool_walker_construct(&walker, array, BENCH_STATE_USED);
+
+        while ((id = sxe_pool_walker_step(&walker)) != SXE_POOL_NO_INDEX) {
+            count++;
+        }
+    }
+
+    seconds = sxe_time_to_double_seconds(sxe_time_get() - start_time);
+    SXEA1(count == BENCH_WALKS * elements, "Walked %u elements, expected %u", count, BENCH_WALKS * elements);
+    printf("%-8s %u elements: %12.0f elements walked per second\n", mode, elements, (double)count / seconds);
+
+    start_time = sxe_time_get();
+
+    while ((id = sxe_pool_set_oldest_element_state(array, BENCH_STATE_USED, BENCH_STATE_FREE)) != SXE_POOL_NO_INDEX) {
+    }
+
+    seconds = sxe_time_to_double_seconds(sxe_time_get() - start_time);
+    printf("%-8s %u elements: %12.0f oldest elements freed per second\n", mode, elements, (double)elements / seconds);
+    sxe_pool_delete(array);
+}
+
+int
+main(int argc, char ** argv)
+{
+    unsigned elements = BENCH_ELEMENTS_DEFAULT;
+
+    if (argc == 1) {
+        fprintf(stderr, "To benchmark walking pool node layouts, run: build-linux-64-release/test-sxe-pool-walk-bench -r [elements]\n");
+        exit(0);
+    }
+
+    if (argc > 2) {
+        elements = atoi(argv[2]);
+        SXEA1(elements > 0, "Elements must be greater than 0");
+    }
+
+    sxe_log_set_level(SXE_LOG_LEVEL_WARNING);
+    bench_run("normal",  SXE_POOL_OPTION_UNLOCKED,                                 elements);
+    bench_run("compact", SXE_POOL_OPTION_UNLOCKED | SXE_POOL_OPTION_COMPACT_NODES, elements);
+    return 0;
+}
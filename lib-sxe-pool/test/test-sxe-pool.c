@@ -145,7 +145,7 @@ main(void)
     unsigned        oldest_index;
 
     time(&time_0);
-    plan_tests(122);
+    plan_tests(126);
     uint64_t start_allocations = sxe_allocations;
     sxe_alloc_diagnostics      = true;
 
@@ -316,14 +316,21 @@ main(void)
         sxe_pool_check_timeouts();
         is(test_pool_1_timeout_call_count, 0, TEST_TIMEOUT "test_pool_1_timeout() not called; after 100 seconds: all elements still in TEST_STATE_FREE with infinite timeout");
         is(test_pool_2_timeout_call_count, 0, TEST_TIMEOUT "test_pool_2_timeout() not called; after 100 seconds: all elements still in TEST_STATE_FREE with infinite timeout");
+        ok(sxe_pool_get_next_timeout() == 0,  TEST_TIMEOUT "No element can time out while all are in TEST_STATE_FREE");
         sxe_pool_set_oldest_element_state(pool_1_timeout, TEST_STATE_FREE, TEST_STATE_USED  );
         sxe_pool_set_oldest_element_state(pool_1_timeout, TEST_STATE_FREE, TEST_STATE_ABUSED);
         sxe_pool_set_oldest_element_state(pool_2_timeout, TEST_STATE_FREE, TEST_STATE_USED  );
         sxe_pool_set_oldest_element_state(pool_2_timeout, TEST_STATE_FREE, TEST_STATE_ABUSED);
+        ok(sxe_pool_get_next_timeout() == sxe_time_get() + sxe_time_from_double_seconds(1.0),
+           TEST_TIMEOUT "Next timeout is in 1 second, for the TEST_STATE_USED element of pool_2_timeout");
+        ok(sxe_pool_get_next_timeout_in_pool(pool_1_timeout) == sxe_time_get() + sxe_time_from_double_seconds(3.0),
+           TEST_TIMEOUT "Next timeout of pool_1_timeout is in 3 seconds, for its TEST_STATE_ABUSED element");
         test_mock_gettimeofday_timeval.tv_sec += 1;
         sxe_pool_check_timeouts();
         is(test_pool_1_timeout_call_count, 0, TEST_TIMEOUT "test_pool_1_timeout() not called; after 1 second(s): elements with TEST_STATE_USED/TEST_STATE_ABUSED have rest time 3/2 seconds");
         is(test_pool_2_timeout_call_count, 1, TEST_TIMEOUT "test_pool_2_timeout()     called; after 1 second(s): elements with TEST_STATE_USED/TEST_STATE_ABUSED have rest time 0/1 seconds");
+        ok(sxe_pool_get_next_timeout() == sxe_time_get() + sxe_time_from_double_seconds(1.0),
+           TEST_TIMEOUT "Next timeout is in 1 second, for the TEST_STATE_ABUSED element of pool_2_timeout");
         test_mock_gettimeofday_timeval.tv_sec += 2;
         sxe_pool_check_timeouts();
         is(test_pool_1_timeout_call_count, 1, TEST_TIMEOUT "test_pool_1_timeout()     called; after 2 second(s): elements with TEST_STATE_USED/TEST_STATE_ABUSED have rest time 1/0 seconds");